@@ -0,0 +1,58 @@
+#!/bin/sh
+# Checks that the executables --aot builds print what the interpreter prints
+# after "---*** Running ***---", for every example (or the files given).
+#
+# Run from the Compiler directory, after building ./interpret:
+#   sh bench/check_aot.sh                    # every examples/*.txt
+#   sh bench/check_aot.sh examples/sum.txt   # some programs
+#
+# INTERPRET names the interpreter (default ./interpret) and CC the C compiler
+# --aot uses (default cc). The runs happen in a temporary directory, so
+# outputs/ is left alone. Exits with 1 if an executable could not be built
+# or printed something else. Programs the interpreter rejects (such as
+# examples/swap.txt, with its unknown token) are only checked to be rejected
+# by --aot too.
+
+interpret=$(cd "$(dirname "${INTERPRET:-./interpret}")" && pwd)/$(basename "${INTERPRET:-./interpret}")
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+mkdir "$work/outputs"
+
+[ $# -gt 0 ] || set -- examples/*.txt
+failed=0
+
+for f in "$@"; do
+    name=$(basename "$f" .txt)
+    source=$(cd "$(dirname "$f")" && pwd)/$(basename "$f")
+
+    # A program the interpreter rejects must not build either
+    if ! (cd "$work" && "$interpret" "$source" > /dev/null 2>&1); then
+        if (cd "$work" && "$interpret" --aot "$source" > /dev/null 2>&1); then
+            echo "$name: built, though the interpreter rejects it"
+            failed=1
+        else
+            echo "$name: rejected, as by the interpreter"
+        fi
+
+        continue
+    fi
+
+    # --aot writes its own outputs/<name>_output.txt
+    sed '1,/^---\*\*\* Running \*\*\*---$/d' "$work/outputs/${name}_output.txt" | tail -n +2 \
+        > "$work/expected.txt"
+
+    if ! (cd "$work" && "$interpret" --aot "$source" > /dev/null 2>&1); then
+        echo "$name: not built"
+        failed=1
+        continue
+    fi
+
+    if "$work/outputs/$name" 2>&1 | cmp -s - "$work/expected.txt"; then
+        echo "$name: same output"
+    else
+        echo "$name: different output"
+        failed=1
+    fi
+done
+
+exit $failed
@@ -0,0 +1,52 @@
+#!/bin/sh
+# Checks that a run with limits stops at the same point whatever --threads
+# says, with independent top-level statements that could otherwise run at
+# the same time.
+#
+# Run from the Compiler directory, after building ./interpret:
+#   sh bench/check_limits.sh
+#
+# INTERPRET names the interpreter (default ./interpret). The runs happen in
+# a temporary directory, so outputs/ is left alone. Exits with 1 if a run
+# prints something else than with --threads=1.
+
+interpret=$(cd "$(dirname "${INTERPRET:-./interpret}")" && pwd)/$(basename "${INTERPRET:-./interpret}")
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+mkdir "$work/outputs"
+
+# Two loops of 300000 iterations on different variables, each followed by a
+# print: a limit of 400000 steps stops the run inside the second loop
+cat > "$work/limits.txt" <<'PROGRAM'
+i = 0;
+a = 0;
+while (i < 300000) { a = a + 1; i = i + 1; }
+print "first done " 1;
+j = 0;
+b = 0;
+while (j < 300000) { b = b + 1; j = j + 1; }
+print "second done " 2;
+PROGRAM
+
+failed=0
+
+# Prints what a run with the limits printed, options "$@"
+run() {
+    (cd "$work" && "$interpret" "$@" limits.txt > /dev/null 2>&1)
+    sed '1,/^---\*\*\* Running \*\*\*---$/d' "$work/outputs/limits_output.txt"
+}
+
+for limit in --max-steps=400000 --max-steps=300001 --max-steps=700000; do
+    run --threads=1 $limit > "$work/expected.txt"
+
+    for threads in 2 4 8; do
+        if run --threads=$threads $limit | cmp -s - "$work/expected.txt"; then
+            echo "$limit --threads=$threads: same output"
+        else
+            echo "$limit --threads=$threads: different output"
+            failed=1
+        fi
+    done
+done
+
+exit $failed
@@ -0,0 +1,138 @@
+// Checks that libinterp reuses the programs it specialized on bindings:
+// runs with the same -D bindings, one after the other or at the same time,
+// specialize the program once and print the same output.
+//
+// Build and run from the Compiler directory, after building libinterp.a
+// (see the Library section of the README):
+//   gcc -std=gnu11 -pthread -Icodes -o interp_test bench/interp_test.c libinterp.a
+//   ./interp_test                 # exits with 1 if a check fails
+#include "interp.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define THREADS 4
+
+static const char source[] =
+    "N = 10;\n"
+    "i = 0;\n"
+    "s = 0;\n"
+    "while (i < N) { s = s + i * i; i = i + 1; }\n"
+    "print \"sum \" s;\n";
+
+static int failed;
+
+// Check `what`, printing the outcome
+static void check(const int ok, const char *const what)
+{
+    printf("%s: %s\n", what, ok ? "ok" : "FAILED");
+    failed |= !ok;
+}
+
+// Run the program with N bound to `text`, into a string to free
+static char *run_with(const struct interp_program *const program, const char *const text)
+{
+    struct spec_binding binding;
+    char *output = NULL;
+    size_t size = 0;
+    FILE *const out = open_memstream(&output, &size);
+
+    if (!out || spec_parse_binding(text, &binding) ||
+        interp_run(program, &binding, 1, out, NULL, NULL) != INTERP_OK) {
+        failed = 1;
+    }
+
+    if (out) {
+        fclose(out);
+    }
+
+    return output;
+}
+
+// Whether the counters of the program are `hits` and `misses`
+static int counted(const struct interp_program *const program, const uint64_t hits,
+    const uint64_t misses)
+{
+    uint64_t got_hits, got_misses;
+
+    interp_spec_stats(program, &got_hits, &got_misses);
+    return got_hits == hits && got_misses == misses;
+}
+
+struct thread {
+    pthread_t id;
+    const struct interp_program *program;
+    char *output;
+};
+
+static void *run_thread(void *const arg)
+{
+    struct thread *const thread = arg;
+
+    thread->output = run_with(thread->program, "N=7");
+    return NULL;
+}
+
+int main(void)
+{
+    struct interp_program *program;
+
+    if (interp_compile(source, sizeof(source) - 1, 0, &program, stderr) != INTERP_OK) {
+        return EXIT_FAILURE;
+    }
+
+    // The same bindings twice: one specialization, then one hit
+    char *const first = run_with(program, "N=5");
+    char *const second = run_with(program, "N=5");
+
+    check(first && second && !strcmp(first, second) && strstr(first, "sum 30"),
+        "two runs with N=5 print the same output");
+    check(counted(program, 1, 1), "two runs with N=5 specialize once and hit once");
+
+    // Other bindings specialize again
+    char *const other = run_with(program, "N=6");
+
+    check(other && strstr(other, "sum 55"), "a run with N=6 prints its own output");
+    check(counted(program, 1, 2), "a run with N=6 specializes again");
+
+    // Runs at the same time: the first specializes, the others reuse it
+    struct thread threads[THREADS];
+
+    for (int idx = 0; idx < THREADS; ++idx) {
+        threads[idx] = (struct thread) { .program = program };
+        pthread_create(&threads[idx].id, NULL, run_thread, &threads[idx]);
+    }
+
+    int same = 1;
+
+    for (int idx = 0; idx < THREADS; ++idx) {
+        pthread_join(threads[idx].id, NULL);
+        same &= threads[idx].output && strstr(threads[idx].output, "sum 91") != NULL;
+        free(threads[idx].output);
+    }
+
+    check(same, "runs with N=7 at the same time print the same output");
+    check(counted(program, 1 + THREADS - 1, 3), "runs with N=7 at the same time specialize once");
+
+    // More bindings than the cache keeps: every run still prints its output
+    char text[32];
+    int all = 1;
+
+    for (int value = 20; value < 20 + 2 * SPEC_CACHE_ENTRIES; ++value) {
+        snprintf(text, sizeof(text), "N=%d", value);
+        char *const output = run_with(program, text);
+        all &= output != NULL;
+        free(output);
+    }
+
+    check(all && counted(program, THREADS, 3 + 2 * SPEC_CACHE_ENTRIES),
+        "runs with more bindings than the cache keeps replace its entries");
+
+    free(first);
+    free(second);
+    free(other);
+    interp_free(program);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,406 @@
+// Benchmark suite: generates large programs of several shapes, times the
+// lex, parse and run phases of the interpreter on each (from --stats) over
+// several repetitions, and compares the medians with a stored baseline.
+//
+// Build and run from the Compiler directory, after building ./interpret:
+//   gcc -std=gnu11 -O2 -o bench_suite bench/suite.c
+//   ./bench_suite --save          # store bench/baseline.txt
+//   ./bench_suite                 # compare with it; exits with 1 on a regression
+//
+// Options:
+//   --reps=N          repetitions of each workload (default 5)
+//   --scale=N         multiply the size of every workload (default 1)
+//   --threshold=PCT   slowdown of a median that counts as a regression, beyond
+//                     the noise measured in both runs (default 10)
+//   --baseline=FILE   baseline to compare with or save (default bench/baseline.txt)
+//   --save            store the medians as the baseline instead of comparing
+//   --interpret=PATH  interpreter to time (default ./interpret)
+//   --only=NAME       run one workload
+//   --generate=NAME   print the program of a workload and exit
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define MAX_REPS 64
+
+// Long straight-line lists of assignments over a few dozen variables
+static void gen_straight(FILE *out, const unsigned scale)
+{
+    for (unsigned var = 0; var < 32; ++var) {
+        fprintf(out, "v%u = %u;\n", var, var * 7 + 1);
+    }
+
+    for (unsigned idx = 0; idx < 1000 * scale; ++idx) {
+        fprintf(out, "v%u = v%u + %u * 3 - v%u / 7;\n", idx % 32, (idx * 7 + 3) % 32, idx % 1000,
+            (idx * 13 + 5) % 32);
+    }
+
+    fprintf(out, "print \"v0 = \" v0;\n");
+}
+
+// Deeply nested if/elif chains, taken with many values
+static void gen_branches(FILE *out, const unsigned scale)
+{
+    const unsigned depth = 12, arms = 8;
+
+    fprintf(out, "x = 0;\ns = 0;\nwhile (x < %u) {\n    y = x %% %u;\n", 200000 * scale, depth * arms);
+
+    for (unsigned level = 0; level < depth; ++level) {
+        fprintf(out, "%*sif (y == %u) {\n%*ss = s + %u;\n", 4 * (level + 1), "", level * arms,
+            4 * (level + 2), "", level + 1);
+
+        for (unsigned arm = 1; arm < arms; ++arm) {
+            fprintf(out, "%*s} elif (y == %u) {\n%*ss = s - %u;\n", 4 * (level + 1), "",
+                level * arms + arm, 4 * (level + 2), "", arm);
+        }
+
+        fprintf(out, "%*s} else {\n", 4 * (level + 1), "");
+    }
+
+    fprintf(out, "%*ss = s + 1;\n", 4 * (depth + 1), "");
+
+    for (unsigned level = depth; level-- > 0;) {
+        fprintf(out, "%*s}\n", 4 * (level + 1), "");
+    }
+
+    fprintf(out, "    x = x + 1;\n}\nprint \"s = \" s;\n");
+}
+
+// Tight while loops on scalars
+static void gen_loops(FILE *out, const unsigned scale)
+{
+    fprintf(out,
+        "n = %u;\n"
+        "i = 0;\n"
+        "s = 0;\n"
+        "while (i < n) {\n"
+        "    s = s + i %% 7 - 3;\n"
+        "    i = i + 1;\n"
+        "}\n"
+        "j = 0;\n"
+        "t = 1;\n"
+        "do {\n"
+        "    if (t > 1000000) {\n"
+        "        t = t / 3;\n"
+        "    } else {\n"
+        "        t = t * 2 + j %% 5;\n"
+        "    }\n"
+        "    j = j + 1;\n"
+        "} while (j < n);\n"
+        "print \"s = \" s;\n"
+        "print \"t = \" t;\n", 2000000 * scale);
+}
+
+// Heavy array traffic: filling, passes that read two arrays, a reversal
+static void gen_arrays(FILE *out, const unsigned scale)
+{
+    fprintf(out,
+        "n = %u;\n"
+        "i = 0;\n"
+        "while (i < n) {\n"
+        "    a[i] = i * 3 %% 1000;\n"
+        "    i = i + 1;\n"
+        "}\n"
+        "pass = 0;\n"
+        "while (pass < 10) {\n"
+        "    i = 0;\n"
+        "    while (i < n) {\n"
+        "        b[i] = a[i] + a[n - 1 - i] * pass;\n"
+        "        i = i + 1;\n"
+        "    }\n"
+        "    i = 0;\n"
+        "    while (i < n) {\n"
+        "        a[i] = b[i] %% 1000;\n"
+        "        i = i + 1;\n"
+        "    }\n"
+        "    pass = pass + 1;\n"
+        "}\n"
+        "print \"a[7] = \" a[7];\n", 200000 * scale);
+}
+
+// Long expressions, evaluated in a loop
+static void gen_expressions(FILE *out, const unsigned scale)
+{
+    fprintf(out, "a = 3;\nb = 5;\nc = 7;\nk = 0;\nx = 0;\nwhile (k < 200) {\n    x = x");
+
+    for (unsigned term = 0; term < 2000 * scale; ++term) {
+        static const char *const terms[] = {
+            " + (a * %u - b)", " - (c + %u) / 3", " + a * b %% %u", " - (k + %u) * (b - a)",
+        };
+
+        fprintf(out, terms[term % 4], term % 97 + 1);
+
+        if (term % 8 == 7) {
+            fprintf(out, "\n       ");
+        }
+    }
+
+    fprintf(out, ";\n    x = x %% 100000;\n    k = k + 1;\n}\nprint \"x = \" x;\n");
+}
+
+static const struct workload {
+    const char *name;
+    void (*generate)(FILE *, unsigned scale);
+} workloads[] = {
+    { "straight", gen_straight },
+    { "branches", gen_branches },
+    { "loops", gen_loops },
+    { "arrays", gen_arrays },
+    { "expressions", gen_expressions },
+};
+
+#define NWORKLOADS (sizeof(workloads) / sizeof(*workloads))
+
+// Phases timed, as named in the --stats JSON
+static const char *const phases[] = { "lex", "parse", "run" };
+
+#define NPHASES (sizeof(phases) / sizeof(*phases))
+
+// Median and median absolute deviation of a phase over the repetitions
+struct timing {
+    double median, mad;  // Nanoseconds
+};
+
+static int compare_doubles(const void *const a, const void *const b)
+{
+    const double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+static double median(double *const values, const size_t n)
+{
+    qsort(values, n, sizeof(double), compare_doubles);
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+static struct timing summarize(const double *const samples, const size_t n)
+{
+    double sorted[MAX_REPS], deviations[MAX_REPS];
+
+    memcpy(sorted, samples, n * sizeof(double));
+    const double middle = median(sorted, n);
+
+    for (size_t idx = 0; idx < n; ++idx) {
+        deviations[idx] = samples[idx] > middle ? samples[idx] - middle : middle - samples[idx];
+    }
+
+    return (struct timing) { middle, median(deviations, n) };
+}
+
+// Read the wall time of each phase from a --stats file. Returns 0 on success.
+static int read_phases(const char *const path, double times[NPHASES])
+{
+    char text[8192], key[32];
+    FILE *const file = fopen(path, "r");
+
+    if (!file) {
+        return -1;
+    }
+
+    const size_t len = fread(text, 1, sizeof(text) - 1, file);
+    fclose(file);
+    text[len] = '\0';
+
+    for (size_t phase = 0; phase < NPHASES; ++phase) {
+        snprintf(key, sizeof(key), "\"%s\": {\"wall_ns\": ", phases[phase]);
+        const char *const at = strstr(text, key);
+
+        if (!at) {
+            return -1;
+        }
+
+        times[phase] = strtod(at + strlen(key), NULL);
+    }
+
+    return 0;
+}
+
+// Time one workload: write its program, run it `reps` times
+static int time_workload(const struct workload *const workload, const unsigned scale,
+    const unsigned reps, const char *const interpret, struct timing timings[NPHASES])
+{
+    char program_path[256], stats_path[256], command[1024];
+    double samples[NPHASES][MAX_REPS];
+
+    snprintf(program_path, sizeof(program_path), "outputs/bench_%s.txt", workload->name);
+    snprintf(stats_path, sizeof(stats_path), "outputs/bench_%s_stats.json", workload->name);
+    snprintf(command, sizeof(command), "%s --stats=%s %s > " NULL_DEVICE, interpret, stats_path,
+        program_path);
+
+    FILE *const program = fopen(program_path, "w");
+
+    if (!program) {
+        fprintf(stderr, "Could not write %s (run from the Compiler directory)\n", program_path);
+        return -1;
+    }
+
+    workload->generate(program, scale);
+
+    if (fclose(program)) {
+        fprintf(stderr, "Could not write %s\n", program_path);
+        return -1;
+    }
+
+    for (unsigned rep = 0; rep < reps; ++rep) {
+        double times[NPHASES];
+
+        if (system(command) || read_phases(stats_path, times)) {
+            fprintf(stderr, "Failed: %s\n", command);
+            return -1;
+        }
+
+        for (size_t phase = 0; phase < NPHASES; ++phase) {
+            samples[phase][rep] = times[phase];
+        }
+    }
+
+    for (size_t phase = 0; phase < NPHASES; ++phase) {
+        timings[phase] = summarize(samples[phase], reps);
+    }
+
+    return 0;
+}
+
+// The baseline timing of a workload's phase, or NULL if the file has none
+static const struct timing *find_baseline(FILE *const baseline, const char *const name,
+    const char *const phase, struct timing *const timing)
+{
+    char line[256], line_name[64], line_phase[16];
+
+    rewind(baseline);
+
+    while (fgets(line, sizeof(line), baseline)) {
+        if (sscanf(line, "%63s %15s %lf %lf", line_name, line_phase, &timing->median,
+            &timing->mad) == 4 && !strcmp(line_name, name) && !strcmp(line_phase, phase)) {
+            return timing;
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned reps = 5, scale = 1;
+    double threshold = 10;
+    const char *baseline_path = "bench/baseline.txt", *interpret = "./interpret";
+    const char *only = NULL;
+    int save = 0, regressions = 0;
+
+    for (int arg_idx = 1; arg_idx < argc; ++arg_idx) {
+        const char *const arg = argv[arg_idx];
+
+        if (!strncmp(arg, "--reps=", 7)) {
+            reps = strtoul(arg + 7, NULL, 10);
+        } else if (!strncmp(arg, "--scale=", 8)) {
+            scale = strtoul(arg + 8, NULL, 10);
+        } else if (!strncmp(arg, "--threshold=", 12)) {
+            threshold = strtod(arg + 12, NULL);
+        } else if (!strncmp(arg, "--baseline=", 11)) {
+            baseline_path = arg + 11;
+        } else if (!strcmp(arg, "--save")) {
+            save = 1;
+        } else if (!strncmp(arg, "--interpret=", 12)) {
+            interpret = arg + 12;
+        } else if (!strncmp(arg, "--only=", 7)) {
+            only = arg + 7;
+        } else if (!strncmp(arg, "--generate=", 11)) {
+            for (size_t idx = 0; idx < NWORKLOADS; ++idx) {
+                if (!strcmp(workloads[idx].name, arg + 11)) {
+                    workloads[idx].generate(stdout, scale ?: 1);
+                    return EXIT_SUCCESS;
+                }
+            }
+
+            fprintf(stderr, "No workload named %s\n", arg + 11);
+            return EXIT_FAILURE;
+        } else {
+            fprintf(stderr, "Usage: %s [--reps=N] [--scale=N] [--threshold=PCT] [--baseline=FILE] "
+                "[--save] [--interpret=PATH] [--only=NAME] [--generate=NAME]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!reps || reps > MAX_REPS || !scale) {
+        fprintf(stderr, "--reps must be 1 .. %d and --scale at least 1\n", MAX_REPS);
+        return EXIT_FAILURE;
+    }
+
+    FILE *const baseline = fopen(baseline_path, save ? "w" : "r");
+
+    if (!baseline && save) {
+        perror(baseline_path);
+        return EXIT_FAILURE;
+    } else if (!baseline) {
+        printf("No baseline at %s, only timing (store one with --save)\n", baseline_path);
+    } else if (save) {
+        fprintf(baseline, "# workload phase median_ns mad_ns (--reps=%u --scale=%u)\n", reps, scale);
+    }
+
+    printf("%-12s %-6s %12s %10s %12s %8s\n", "workload", "phase", "median ms", "+- ms",
+        "baseline ms", "change");
+
+    for (size_t idx = 0; idx < NWORKLOADS; ++idx) {
+        struct timing timings[NPHASES];
+
+        if (only && strcmp(only, workloads[idx].name)) {
+            continue;
+        }
+
+        if (time_workload(&workloads[idx], scale, reps, interpret, timings)) {
+            return EXIT_FAILURE;
+        }
+
+        for (size_t phase = 0; phase < NPHASES; ++phase) {
+            const struct timing *const now = &timings[phase];
+            struct timing stored;
+            const struct timing *const base = baseline && !save ?
+                find_baseline(baseline, workloads[idx].name, phases[phase], &stored) : NULL;
+
+            printf("%-12s %-6s %12.3f %10.3f", workloads[idx].name, phases[phase], now->median / 1e6,
+                now->mad / 1e6);
+
+            if (save) {
+                fprintf(baseline, "%s %s %.0f %.0f\n", workloads[idx].name, phases[phase], now->median,
+                    now->mad);
+                printf("\n");
+                continue;
+            } else if (!base) {
+                printf("\n");
+                continue;
+            }
+
+            // A change counts if it passes both the threshold and the noise: four
+            // scaled MADs (about 2.7 standard deviations) of the noisier run
+            const double change = now->median - base->median;
+            const double noise = 4 * 1.4826 * (now->mad > base->mad ? now->mad : base->mad);
+            const double limit = base->median * threshold / 100;
+            const int significant = (change > 0 ? change : -change) > (limit > noise ? limit : noise);
+
+            printf(" %12.3f %+7.1f%%%s\n", base->median / 1e6,
+                base->median ? 100 * change / base->median : 0,
+                !significant ? "" : change > 0 ? "  REGRESSION" : "  faster");
+            regressions += significant && change > 0;
+        }
+    }
+
+    if (baseline && fclose(baseline) && save) {
+        perror(baseline_path);
+        return EXIT_FAILURE;
+    }
+
+    if (save) {
+        printf("Baseline saved to %s\n", baseline_path);
+    } else if (regressions) {
+        printf("%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+    }
+
+    return regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+}
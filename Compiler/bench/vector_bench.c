@@ -0,0 +1,87 @@
+// Throughput of the element-wise kernels used by vectorized loops, in
+// nanoseconds per element, for each instruction set.
+//
+// Build from the Compiler directory:
+//   gcc -O2 -Icodes -o vector_bench bench/vector_bench.c codes/simd.c
+#include "simd.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ELEMENTS 4096   // Fits in L1/L2, like one chunk of a running loop
+#define ROUNDS   20000
+
+static int a[ELEMENTS], b[ELEMENTS], c[ELEMENTS], dst[ELEMENTS];
+
+static double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Time one kernel, returning nanoseconds per element
+#define MEASURE(call) ({ \
+    const double beg = now(); \
+    for (int round = 0; round < ROUNDS; ++round) { \
+        call; \
+        __asm__ volatile("" ::: "memory"); \
+    } \
+    (now() - beg) / ((double) ROUNDS * ELEMENTS); \
+})
+
+int main(void)
+{
+    const struct simd *const sets[] = { &simd_scalar, &simd_sse2, &simd_avx2 };
+    const char *const names[SIMD_BINARY_COUNT] = {
+        "add", "sub", "mul", "eq", "ne", "lt", "gt", "le", "ge", "and", "or",
+    };
+
+    for (size_t idx = 0; idx < ELEMENTS; ++idx) {
+        a[idx] = rand() % 1000 - 500;
+        b[idx] = rand() % 1000 - 500;
+        c[idx] = rand() & 1;
+    }
+
+    printf("best: %s\n%-8s", simd_best()->name, "ns/elem");
+
+    for (size_t set_idx = 0; set_idx < sizeof(sets) / sizeof(*sets); ++set_idx) {
+        printf("%10s", sets[set_idx]->name);
+    }
+
+    printf("\n");
+
+    for (int op = 0; op < SIMD_BINARY_COUNT + 3; ++op) {
+        printf("%-8s", op < SIMD_BINARY_COUNT ? names[op] :
+            (const char *[]) { "neg", "select", "iota" }[op - SIMD_BINARY_COUNT]);
+
+        for (size_t set_idx = 0; set_idx < sizeof(sets) / sizeof(*sets); ++set_idx) {
+            const struct simd *const simd = sets[set_idx];
+            double ns;
+
+            // AVX2 kernels would fault on a CPU without AVX2
+            if (simd == &simd_avx2 && simd_best() != &simd_avx2) {
+                printf("%10s", "-");
+                continue;
+            }
+
+            if (op < SIMD_BINARY_COUNT) {
+                ns = MEASURE(simd->binary[op](dst, a, b, ELEMENTS));
+            } else if (op == SIMD_BINARY_COUNT) {
+                ns = MEASURE(simd->neg(dst, a, ELEMENTS));
+            } else if (op == SIMD_BINARY_COUNT + 1) {
+                ns = MEASURE(simd->select(dst, c, a, b, ELEMENTS));
+            } else {
+                ns = MEASURE(simd->iota(dst, a[0], ELEMENTS));
+            }
+
+            printf("%10.3f", ns);
+        }
+
+        printf("\n");
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,241 @@
+#include "array.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Split an element index into its page table coordinates
+#define TOP_IDX(idx)  ((idx) >> (ARRAY_PAGE_SHIFT + ARRAY_DIR_SHIFT))
+#define DIR_IDX(idx)  (((idx) >> ARRAY_PAGE_SHIFT) & (ARRAY_DIR_SIZE - 1))
+#define PAGE_IDX(idx) ((idx) & (ARRAY_PAGE_SIZE - 1))
+
+// Bytes held by all arrays, and the most they held
+static atomic_size_t held, peak;
+
+// The budget of the arrays this thread allocates, if any
+static _Thread_local struct array_budget *budget;
+
+void array_set_budget(struct array_budget *const arrays)
+{
+    budget = arrays;
+}
+
+size_t array_held(void)
+{
+    return atomic_load_explicit(&held, memory_order_relaxed);
+}
+
+size_t array_peak(void)
+{
+    return atomic_load_explicit(&peak, memory_order_relaxed);
+}
+
+// Count `bytes` more as held, unless that passes the limit of the budget
+static int charge(const size_t bytes)
+{
+    if (budget) {
+        const size_t was = atomic_fetch_add_explicit(&budget->held, bytes, memory_order_relaxed);
+
+        if (budget->limit && was + bytes > budget->limit) {
+            atomic_fetch_sub_explicit(&budget->held, bytes, memory_order_relaxed);
+            return 0;
+        }
+    }
+
+    const size_t was = atomic_fetch_add_explicit(&held, bytes, memory_order_relaxed);
+    size_t top = atomic_load_explicit(&peak, memory_order_relaxed);
+
+    while (was + bytes > top && !atomic_compare_exchange_weak_explicit(&peak, &top, was + bytes,
+        memory_order_relaxed, memory_order_relaxed)) {
+    }
+
+    return 1;
+}
+
+static void uncharge(const size_t bytes)
+{
+    if (budget) {
+        atomic_fetch_sub_explicit(&budget->held, bytes, memory_order_relaxed);
+    }
+
+    atomic_fetch_sub_explicit(&held, bytes, memory_order_relaxed);
+}
+
+// Allocate `count` zeroed items of `size` bytes for an array, within the
+// limit. `*status` tells why it failed.
+static void *array_calloc(struct array *const array, const size_t count, const size_t size,
+    int *const status)
+{
+    if (!charge(count * size)) {
+        *status = ARRAY_LIMIT;
+        return NULL;
+    }
+
+    void *const block = calloc(count, size);
+
+    if (!block) {
+        uncharge(count * size);
+        *status = ARRAY_NOMEM;
+        return NULL;
+    }
+
+    array->bytes += count * size;
+    return block;
+}
+
+// Find the page holding `idx`, optionally allocating it (and its directory).
+// `*status` tells why allocating failed.
+static int *page_of(struct array *const array, const size_t idx, const int allocate,
+    int *const status)
+{
+    if (!array->pages && (!allocate ||
+        !(array->pages = array_calloc(array, ARRAY_TOP_SIZE, sizeof(int **), status)))) {
+        return NULL;
+    }
+
+    int ***const dir = &array->pages[TOP_IDX(idx)];
+
+    if (!*dir && (!allocate || !(*dir = array_calloc(array, ARRAY_DIR_SIZE, sizeof(int *), status)))) {
+        return NULL;
+    }
+
+    int **const page = &(*dir)[DIR_IDX(idx)];
+
+    if (!*page && (!allocate || !(*page = array_calloc(array, ARRAY_PAGE_SIZE, sizeof(int), status)))) {
+        return NULL;
+    }
+
+    return *page;
+}
+
+// Grow the dense prefix to hold at least `cap` elements, zero-filling the new part
+static int grow_dense(struct array *const array, const size_t cap)
+{
+    if (!charge((cap - array->dense_cap) * sizeof(int))) {
+        return ARRAY_LIMIT;
+    }
+
+    int *const tmp = realloc(array->dense, cap * sizeof(int));
+
+    if (!tmp) {
+        uncharge((cap - array->dense_cap) * sizeof(int));
+        return ARRAY_NOMEM;
+    }
+
+    memset(tmp + array->dense_cap, 0, (cap - array->dense_cap) * sizeof(int));
+    array->bytes += (cap - array->dense_cap) * sizeof(int);
+    array->dense = tmp;
+    array->dense_cap = cap;
+    return ARRAY_OK;
+}
+
+// Allocate storage for `idx`: extend the dense prefix while the array fills
+// roughly in order, otherwise put the element on its own page
+static int reserve(struct array *const array, const size_t idx)
+{
+    int status = ARRAY_OK;
+
+    if (idx < array->dense_cap) {
+        return ARRAY_OK;
+    }
+
+    // Once pages exist the dense prefix stays put, so no element ever moves
+    if (!array->pages && idx < 2 * array->dense_cap + ARRAY_PAGE_SIZE) {
+        const size_t doubled = 2 * array->dense_cap;
+
+        if (!(status = grow_dense(array, idx + 1 > doubled ? idx + 1 : doubled))) {
+            return ARRAY_OK;
+        }
+    } else if (page_of(array, idx, 1, &status)) {
+        return ARRAY_OK;
+    }
+
+    array_free(array);
+    return status;
+}
+
+int array_init(struct array *const array, const size_t idx)
+{
+    *array = (struct array) { .size = 0 };
+
+    const int status = idx < ARRAY_PAGE_SIZE ? grow_dense(array, idx + 1) : reserve(array, idx);
+
+    if (status) {
+        array_free(array);
+        return status;
+    }
+
+    array->size = idx + 1;
+    return ARRAY_OK;
+}
+
+int array_grow(struct array *const array, const size_t idx)
+{
+    const int status = reserve(array, idx);
+
+    if (status) {
+        return status;
+    }
+
+    if (idx >= array->size) {
+        array->size = (idx + 1) * 2;  // Double the needed size
+    }
+
+    return ARRAY_OK;
+}
+
+int array_reserve(struct array *const array, const size_t n)
+{
+    if (n <= array->dense_cap) {
+        return ARRAY_OK;
+    }
+
+    return array->pages ? ARRAY_SPARSE : grow_dense(array, n);
+}
+
+void array_set(struct array *const array, const size_t idx, const int value)
+{
+    if (idx < array->dense_cap) {
+        array->dense[idx] = value;
+    } else {
+        int *const page = page_of(array, idx, 0, NULL);
+
+        if (page) {
+            page[PAGE_IDX(idx)] = value;
+        }
+    }
+}
+
+int array_get_paged(const struct array *const array, const size_t idx)
+{
+    int ***const pages = array->pages;
+
+    if (!pages || !pages[TOP_IDX(idx)]) {
+        return 0;
+    }
+
+    const int *const page = pages[TOP_IDX(idx)][DIR_IDX(idx)];
+    return page ? page[PAGE_IDX(idx)] : 0;
+}
+
+void array_free(struct array *const array)
+{
+    if (array->pages) {
+        for (size_t top_idx = 0; top_idx < ARRAY_TOP_SIZE; ++top_idx) {
+            int **const dir = array->pages[top_idx];
+
+            if (dir) {
+                for (size_t dir_idx = 0; dir_idx < ARRAY_DIR_SIZE; ++dir_idx) {
+                    free(dir[dir_idx]);
+                }
+
+                free(dir);
+            }
+        }
+
+        free(array->pages);
+    }
+
+    free(array->dense);
+    uncharge(array->bytes);
+    *array = (struct array) { .size = 0 };
+}
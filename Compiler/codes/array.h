@@ -0,0 +1,85 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include <stdint.h>  // For fixed-width integer types
+#include <stddef.h>  // For size_t type
+#include <stdatomic.h>
+
+// Elements past the dense prefix live in fixed-size pages that are only
+// allocated when one of their elements is written. Pages are found through a
+// two-level table, so memory use follows the elements actually touched and
+// not the largest index (indices are non-negative ints, i.e. 31 bits).
+#define ARRAY_PAGE_SHIFT 10                                   // log2 of ints per page
+#define ARRAY_PAGE_SIZE  ((size_t) 1 << ARRAY_PAGE_SHIFT)
+#define ARRAY_DIR_SHIFT  10                                   // log2 of pages per directory
+#define ARRAY_DIR_SIZE   ((size_t) 1 << ARRAY_DIR_SHIFT)
+#define ARRAY_TOP_SIZE   ((size_t) 1 << (31 - ARRAY_PAGE_SHIFT - ARRAY_DIR_SHIFT))
+
+// A growable integer array
+struct array {
+    size_t size;        // Logical size: indices below it are in bounds (0 after a failed allocation)
+    size_t dense_cap;   // Number of elements stored contiguously in `dense`
+    int *dense;         // Dense prefix, grown while the array fills in order
+    int ***pages;       // Page table for the elements past the dense prefix
+    size_t bytes;       // Bytes currently allocated for this array
+};
+
+// Return codes of the functions below
+enum {
+    ARRAY_OK,     // Storage is available
+    ARRAY_NOMEM,  // Allocation failed, the array has been released and its size is 0
+    ARRAY_SPARSE, // The array has pages, so its dense prefix cannot grow any more
+    ARRAY_LIMIT,  // Allocation would pass the limit of the thread's budget; handled
+                  // like ARRAY_NOMEM
+};
+
+// The bytes the arrays of one run hold, and the most they may hold (0: no
+// limit). Each thread of the run counts what it allocates against it.
+struct array_budget {
+    atomic_size_t held;
+    size_t limit;
+};
+
+// Function declaration: array_set_budget
+// Makes the arrays this thread allocates or frees count against `budget`
+// (NULL: none), as well as in array_held() and array_peak().
+void array_set_budget(struct array_budget *);
+
+// Function declaration: array_held
+// Returns the bytes all arrays of the process hold together.
+size_t array_held(void);
+
+// Function declaration: array_peak
+// Returns the most bytes all arrays held together so far.
+size_t array_peak(void);
+
+// Function declaration: array_init
+// Creates an array whose first write goes to index `idx`; its size becomes idx + 1.
+int array_init(struct array *, size_t idx);
+
+// Function declaration: array_grow
+// Makes index `idx` writable. Writing past the size grows the array to
+// (idx + 1) * 2 elements, the same as the interpreter always did.
+int array_grow(struct array *, size_t idx);
+
+// Function declaration: array_reserve
+// Makes sure the first `n` elements are stored contiguously in `dense`,
+// without changing the size. Unlike array_grow() a failure leaves the array
+// untouched.
+int array_reserve(struct array *, size_t n);
+
+// Function declaration: array_set
+// Stores a value at an index previously made writable with array_grow().
+void array_set(struct array *, size_t idx, int value);
+
+// Function declaration: array_free
+// Releases all storage held by the array.
+void array_free(struct array *);
+
+// Slow path of array_get() for elements past the dense prefix
+int array_get_paged(const struct array *, size_t idx);
+
+// Reads an element; elements that were never written read as 0
+static inline int array_get(const struct array *const array, const size_t idx)
+{
+    return idx < array->dense_cap ? array->dense[idx] : array_get_paged(array, idx);
+}
@@ -0,0 +1,632 @@
+#include "batch.h"
+#include "lex.h"
+#include "parse.h"
+#include "opt.h"
+#include "run.h"
+#include "simd.h"
+#include "warn.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Same limit as the interpreter's variable store (see run.c); programs with
+// fewer variables can never exhaust it
+#define VARSTORE_CAPACITY 128
+
+// Value of a number literal, converted as eval_atom() does
+static int literal_value(const struct node *const atom)
+{
+    const uint8_t *const beg = atom->children[0]->token->beg;
+    const uint8_t *const end = atom->children[0]->token->end;
+    int result = 0, mult = 1;
+
+    for (ptrdiff_t idx = end - beg - 1; idx >= 0; --idx, mult *= 10) {
+        result += mult * (beg[idx] - '0');
+    }
+
+    return result;
+}
+
+// Read the next "name=value" of a line. Returns 1 if there is one, 0 at the
+// end of the line and -1 if the line is malformed.
+static int next_pair(const char **const p, const char *const eol,
+    const char **const name, size_t *const len, int *const value)
+{
+    while (*p < eol && strchr(" \t\r,", **p)) {
+        ++*p;
+    }
+
+    if (*p == eol) {
+        return 0;
+    }
+
+    *name = *p;
+
+    while (*p < eol && (**p == '_' || (**p >= 'a' && **p <= 'z') || (**p >= 'A' && **p <= 'Z') ||
+        (*p > *name && **p >= '0' && **p <= '9'))) {
+        ++*p;
+    }
+
+    *len = *p - *name;
+
+    if (!*len || *p == eol || *(*p)++ != '=' || *p == eol || **p < '0' || **p > '9') {
+        return -1;
+    }
+
+    long long result = 0;
+
+    for (; *p < eol && **p >= '0' && **p <= '9'; ++*p) {
+        if ((result = 10 * result + (**p - '0')) > INT_MAX) {
+            return -1;
+        }
+    }
+
+    *value = (int) result;
+    return 1;
+}
+
+// Index of the parameter named `name`, adding it if `add` is set. Returns
+// -1 if it is unknown (and not added), -2 if memory ran out.
+static ptrdiff_t find_param(const struct program *const program, struct batch *const batch,
+    const char *const name, const size_t len, const int add)
+{
+    for (size_t param = 0; param < batch->nparams; ++param) {
+        const struct symbol *const symbol = &program->symbols[batch->targets[param]->slot];
+
+        if ((size_t) symbol->len == len && !memcmp(symbol->beg, name, len)) {
+            return (ptrdiff_t) param;
+        }
+    }
+
+    struct node *const target = add ? find_parameter(program, name, len) : NULL;
+
+    if (!target) {
+        return -1;
+    }
+
+    struct node **const tmp = realloc(batch->targets, (batch->nparams + 1) * sizeof(struct node *));
+
+    if (!tmp) {
+        return -2;
+    }
+
+    batch->targets = tmp;
+    batch->targets[batch->nparams] = target;
+    return (ptrdiff_t) batch->nparams++;
+}
+
+int batch_load(const struct program *const program, const char *const text, const size_t len,
+    struct batch *const batch, size_t *const error_line)
+{
+    const char *const end = text + len;
+
+    *batch = (struct batch) { 0 };
+    *error_line = 0;
+
+    // The first pass finds the parameters, the second one fills in the values
+    for (int pass = 0; pass < 2; ++pass) {
+        size_t line = 0, lane = 0;
+
+        if (pass && !(batch->values = malloc((batch->nlanes * batch->nparams ?: 1) * sizeof(int)))) {
+            batch_free(batch);
+            return BATCH_NOMEM;
+        }
+
+        for (const char *p = text; p < end; ++line) {
+            const char *const eol = memchr(p, '\n', end - p) ?: end;
+            const char *name;
+            size_t name_len;
+            int value, found, any = 0;
+
+            for (; (found = next_pair(&p, eol, &name, &name_len, &value)) > 0; any = 1) {
+                const ptrdiff_t param = find_param(program, batch, name, name_len, !pass);
+
+                if (param < 0) {
+                    *error_line = line + 1;
+                    batch_free(batch);
+                    return param == -2 ? BATCH_NOMEM : BATCH_UNKNOWN;
+                }
+
+                if (pass && !any) {
+                    // Parameters the line leaves out keep the program's numbers
+                    for (size_t idx = 0; idx < batch->nparams; ++idx) {
+                        batch->values[lane * batch->nparams + idx] =
+                            literal_value(batch->targets[idx]->children[2]->children[0]);
+                    }
+                }
+
+                if (pass) {
+                    batch->values[lane * batch->nparams + param] = value;
+                }
+            }
+
+            if (found < 0) {
+                *error_line = line + 1;
+                batch_free(batch);
+                return BATCH_SYNTAX;
+            }
+
+            lane += any;
+            p = eol < end ? eol + 1 : end;
+        }
+
+        batch->nlanes = lane;
+    }
+
+    return BATCH_OK;
+}
+
+void batch_free(struct batch *const batch)
+{
+    free(batch->targets);
+    free(batch->values);
+    *batch = (struct batch) { 0 };
+}
+
+// Lanes being run together by run_lanes()
+static _Thread_local struct {
+    const struct batch *batch;
+    const struct simd *simd;
+    size_t first, n;       // Lanes first .. first + n - 1 of the batch
+    FILE **outputs;
+    int *values;           // Row of lanes of each variable
+    int *defined;          // Row of each variable: 1 in the lanes where it is defined
+    uint8_t *all_defined;  // Per variable: defined in every lane
+    int *live;             // 1 in the lanes that have not stopped
+    int *stack;            // Scratch rows, BATCH_LANES ints each
+    size_t depth;          // Rows in use
+    struct warn_log warnings[BATCH_LANES];  // Warnings of each lane, as run() counts them
+} lanes;
+
+// Take a scratch row; rows are released in reverse order with pop()
+static int *push(void)
+{
+    return &lanes.stack[lanes.depth++ * BATCH_LANES];
+}
+
+static void pop(size_t nrows)
+{
+    lanes.depth -= nrows;
+}
+
+// Check whether any lane of a mask is set
+static int any(const int *const mask)
+{
+    return lanes.simd->find(mask, 1, lanes.n) < lanes.n;
+}
+
+// dst = a && b, for rows of 0 and 1
+static void and(int *const dst, const int *const a, const int *const b)
+{
+    lanes.simd->binary[SIMD_AND](dst, a, b, lanes.n);
+}
+
+// Stop a lane at an operation that would crash the interpreter
+static void stop_lane(const size_t lane)
+{
+    lanes.live[lane] = 0;
+}
+
+// Same mapping as run.c uses for element-wise loops
+static int simd_op(const token_t op)
+{
+    switch (op) {
+    case token_PLUS: return SIMD_ADD;
+    case token_MINS: return SIMD_SUB;
+    case token_MULT: return SIMD_MUL;
+    case token_EQUL: return SIMD_EQ;
+    case token_NEQL: return SIMD_NE;
+    case token_LTHN: return SIMD_LT;
+    case token_GTHN: return SIMD_GT;
+    case token_LTEQ: return SIMD_LE;
+    case token_GTEQ: return SIMD_GE;
+    case token_CONJ: return SIMD_AND;
+    case token_DISJ: return SIMD_OR;
+    default: return -1;
+    }
+}
+
+// Evaluate an expression into `dst` in the lanes set in `mask`, printing the
+// interpreter's warnings in those lanes. Other lanes get unspecified values.
+static void eval_lanes(const struct node *const expr, const int *const mask, int *const dst)
+{
+    const struct node *const node = expr->children[0];
+    const size_t n = lanes.n;
+
+    switch (node->nt) {
+    case NT_Atom:
+        if (node->children[0]->token->token == token_NMBR) {
+            lanes.simd->fill(dst, literal_value(node), n);
+            return;
+        }
+
+        if (!lanes.all_defined[node->slot]) {
+            const int *const defined = &lanes.defined[node->slot * BATCH_LANES];
+
+            for (size_t lane = 0; lane < n; ++lane) {
+                if (mask[lane] && !defined[lane]) {
+                    warn_at(&lanes.warnings[lane], lanes.outputs[lane], node->children[0]->token,
+                        WARN_UNDEFINED);
+                }
+            }
+        }
+
+        // Undefined variables are 0 in their lanes
+        memcpy(dst, &lanes.values[node->slot * BATCH_LANES], n * sizeof(int));
+        return;
+
+    case NT_Pexp:
+        eval_lanes(node->children[1], mask, dst);
+        return;
+
+    case NT_Bexp: {
+        const token_t op = node->children[1]->token->token;
+        int *const right = push();
+
+        eval_lanes(node->children[0], mask, dst);
+        eval_lanes(node->children[2], mask, right);
+
+        if (op != token_DIVI && op != token_MODU) {
+            lanes.simd->binary[simd_op(op)](dst, dst, right, n);
+            pop(1);
+            return;
+        }
+
+        for (size_t lane = 0; lane < n; ++lane) {
+            if (!mask[lane]) {
+                dst[lane] = 0;
+            } else if (right[lane] == -1 && dst[lane] == INT_MIN) {
+                stop_lane(lane);
+                dst[lane] = 0;
+            } else if (right[lane]) {
+                dst[lane] = op == token_DIVI ? dst[lane] / right[lane] : dst[lane] % right[lane];
+            } else if (op == token_DIVI) {
+                warn_at(&lanes.warnings[lane], lanes.outputs[lane], node->children[1]->token,
+                    WARN_DIVIDE);
+                dst[lane] = 0;
+            } else {
+                stop_lane(lane);
+                dst[lane] = 0;
+            }
+        }
+
+        pop(1);
+        return;
+    }
+
+    case NT_Uexp:
+        eval_lanes(node->children[1], mask, dst);
+
+        if (node->children[0]->token->token == token_MINS) {
+            lanes.simd->neg(dst, dst, n);
+        } else if (node->children[0]->token->token == token_NEGA) {
+            lanes.simd->not(dst, dst, n);
+        }
+        return;
+
+    case NT_Texp: {
+        // Each branch is only evaluated in the lanes that take it
+        int *const cond = push();
+        int *const taken = push();
+        int *const other = push();
+
+        eval_lanes(node->children[0], mask, cond);
+        and(taken, mask, cond);
+
+        if (any(taken)) {
+            eval_lanes(node->children[2], taken, dst);
+        }
+
+        lanes.simd->not(other, cond, n);
+        and(taken, mask, other);
+
+        if (any(taken)) {
+            eval_lanes(node->children[4], taken, other);
+            lanes.simd->select(dst, cond, dst, other, n);
+        }
+
+        pop(3);
+        return;
+    }
+
+    default:
+        abort();  // Rejected by lanes_supported()
+    }
+}
+
+static void exec_block(const struct node *, const int *);
+
+// Print the value of a print statement in the lanes of `mask`, as print_value() does
+static void print_lanes(const struct node *const prnt, const int *const value, const int *const mask)
+{
+    for (size_t lane = 0; lane < lanes.n; ++lane) {
+        if (!mask[lane]) {
+            continue;
+        }
+
+        if (prnt->nchildren == 3) {
+            fprintf(lanes.outputs[lane], "%d\n", value[lane]);
+        } else {
+            const struct token *const strl = prnt->children[1]->token;
+
+            fprintf(lanes.outputs[lane], "%.*s%d\n",
+                (int) (strl->end - strl->beg - 2), strl->beg + 1, value[lane]);
+        }
+    }
+}
+
+// Assign a variable in the lanes of `mask`
+static void assign_lanes(const struct node *const assn, const int *const mask)
+{
+    const uint32_t slot = assn->slot;
+    int *const value = push();
+    int *const row = &lanes.values[slot * BATCH_LANES];
+    int *const defined = &lanes.defined[slot * BATCH_LANES];
+    const struct batch *const batch = lanes.batch;
+    size_t param = 0;
+
+    while (param < batch->nparams && batch->targets[param] != assn) {
+        ++param;
+    }
+
+    if (param < batch->nparams) {
+        for (size_t lane = 0; lane < lanes.n; ++lane) {
+            value[lane] = batch->values[(lanes.first + lane) * batch->nparams + param];
+        }
+    } else {
+        eval_lanes(assn->children[2], mask, value);
+    }
+
+    // Lanes stopped by the expression do not assign
+    int *const assigned = push();
+
+    and(assigned, mask, lanes.live);
+    lanes.simd->select(row, assigned, value, row, lanes.n);
+
+    if (!lanes.all_defined[slot]) {
+        lanes.simd->binary[SIMD_OR](defined, defined, assigned, lanes.n);
+        lanes.all_defined[slot] = lanes.simd->find(defined, 0, lanes.n) == lanes.n;
+    }
+
+    pop(2);
+}
+
+// Run an if/elif/else, a while or a do-while loop in the lanes of `mask`
+static void exec_ctrl(const struct node *const ctrl, const int *const mask)
+{
+    const struct node *const first = ctrl->children[0];
+    int *const active = push();
+    int *const cond = push();
+
+    and(active, mask, lanes.live);
+
+    switch (first->nt) {
+    case NT_Cond: {
+        // `active` holds the lanes that have not taken an arm yet
+        int *const taken = push();
+
+        for (size_t arm_idx = 0; arm_idx < ctrl->nchildren && any(active); ++arm_idx) {
+            const struct node *const arm = ctrl->children[arm_idx];
+
+            if (arm->nt == NT_Else) {
+                exec_block(arm->children[2], active);
+                break;
+            }
+
+            eval_lanes(arm->children[1], active, cond);
+            and(active, active, lanes.live);
+            and(taken, active, cond);
+            lanes.simd->not(cond, cond, lanes.n);
+            and(active, active, cond);
+
+            if (any(taken)) {
+                exec_block(arm->children[3], taken);
+            }
+        }
+
+        pop(1);
+    } break;
+
+    case NT_Whil:
+        for (;;) {
+            eval_lanes(first->children[1], active, cond);
+            and(active, active, cond);
+            and(active, active, lanes.live);
+
+            if (!any(active)) {
+                break;
+            }
+
+            exec_block(first->children[3], active);
+        }
+        break;
+
+    case NT_Dowh:
+        while (any(active)) {
+            exec_block(first->children[2], active);
+            and(active, active, lanes.live);
+            eval_lanes(first->children[first->nchildren - 2], active, cond);
+            and(active, active, cond);
+            and(active, active, lanes.live);
+        }
+        break;
+
+    default:
+        abort();  // Unknown control structure
+    }
+
+    pop(2);
+}
+
+// Run a block in the lanes of `mask`
+static void exec_block(const struct node *stmt, const int *const mask)
+{
+    for (; stmt->nchildren; ++stmt) {
+        const struct node *const node = stmt->children[0];
+
+        switch (node->nt) {
+        case NT_Assn:
+            assign_lanes(node, mask);
+            break;
+
+        case NT_Prnt: {
+            int *const value = push();
+            int *const printed = push();
+
+            eval_lanes(node->children[node->nchildren - 2], mask, value);
+            and(printed, mask, lanes.live);
+            print_lanes(node, value, printed);
+            pop(2);
+        } break;
+
+        case NT_Ctrl:
+            exec_ctrl(node, mask);
+            break;
+
+        default:
+            abort();  // Rejected by lanes_supported()
+        }
+    }
+}
+
+// Check that a subtree only uses what the lanes support: scalar variables and
+// the statements and operators of the language, but no arrays or calls.
+// Returns the depth of the subtree, or 0 if it is not supported.
+static size_t lanes_supported(const struct node *const node)
+{
+    size_t depth = 0;
+
+    if (!node->nchildren) {
+        return 1;
+    }
+
+    if (node->nt == NT_Aexp || node->nt == NT_Call || node->nt == NT_Exst ||
+        (node->nt == NT_Assn && node->children[0]->nchildren)) {
+        return 0;
+    }
+
+    for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+        const size_t child = lanes_supported(node->children[child_idx]);
+
+        if (!child) {
+            return 0;
+        }
+
+        depth = child > depth ? child : depth;
+    }
+
+    return depth + 1;
+}
+
+// Run lanes together. Returns 0, having run nothing, if the program uses
+// something the lanes do not support or memory ran out. Lanes that did not
+// stop end with their summary of warnings, as run() does.
+static int run_lanes(const struct program *const program, const int all_warnings,
+    struct batch_stats *const stats)
+{
+    const size_t depth = program->nsymbols <= VARSTORE_CAPACITY ?
+        lanes_supported(&program->root) : 0;
+    const size_t nsymbols = program->nsymbols ?: 1;
+
+    if (!depth) {
+        return 0;
+    }
+
+    // Each level of the tree takes at most three rows at a time
+    lanes.values = calloc(nsymbols * BATCH_LANES, sizeof(int));
+    lanes.defined = calloc(nsymbols * BATCH_LANES, sizeof(int));
+    lanes.all_defined = calloc(nsymbols, sizeof(uint8_t));
+    lanes.live = malloc(BATCH_LANES * sizeof(int));
+    lanes.stack = malloc((3 * depth + 1) * BATCH_LANES * sizeof(int));
+    lanes.depth = 0;
+
+    const int ok = lanes.values && lanes.defined && lanes.all_defined && lanes.live && lanes.stack;
+
+    if (ok) {
+        for (size_t lane = 0; lane < lanes.n; ++lane) {
+            warn_init(&lanes.warnings[lane], program, all_warnings);
+        }
+
+        lanes.simd->fill(lanes.live, 1, lanes.n);
+        exec_block(program->root.children[1], lanes.live);
+
+        for (size_t lane = 0; lane < lanes.n; ++lane) {
+            stats->stopped_lanes += !lanes.live[lane];
+
+            if (lanes.live[lane]) {
+                warn_summary(&lanes.warnings[lane], program, lanes.outputs[lane]);
+            }
+
+            warn_free(&lanes.warnings[lane]);
+        }
+
+        stats->simd_lanes += lanes.n;
+    }
+
+    free(lanes.values);
+    free(lanes.defined);
+    free(lanes.all_defined);
+    free(lanes.live);
+    free(lanes.stack);
+    return ok;
+}
+
+void run_batch(const struct program *const program, const struct batch *const batch,
+    const size_t first, const size_t n, FILE **const outputs,
+    const struct run_options *const options, struct batch_stats *const stats)
+{
+    struct batch_stats local = { 0 };
+    struct batch_stats *const counters = stats ? stats : &local;
+
+    lanes.batch = batch;
+    lanes.simd = simd_best();
+    lanes.first = first;
+    lanes.n = n;
+    lanes.outputs = outputs;
+
+    // Lanes run together are not governed: with limits, each lane runs alone
+    if (!n || (!run_governed(options) &&
+        run_lanes(program, options && options->all_warnings, counters))) {
+        return;
+    }
+
+    // One lane at a time: each lane's numbers replace the literals in the
+    // tree while the interpreter runs it
+    const size_t nparams = batch->nparams;
+    struct token *const tokens = malloc((nparams ?: 1) * sizeof(struct token));
+    const struct token **const saved = malloc((nparams ?: 1) * sizeof(struct token *));
+    char (*const digits)[12] = malloc((nparams ?: 1) * sizeof(*digits));
+
+    for (size_t lane = 0; lane < n; ++lane) {
+        if (!tokens || !saved || !digits) {
+            fprintf(outputs[lane], "malloc failed\n");
+            continue;
+        }
+
+        for (size_t param = 0; param < nparams; ++param) {
+            struct node *const leaf = batch->targets[param]->children[2]->children[0]->children[0];
+            const int len = snprintf(digits[param], sizeof(digits[param]), "%d",
+                batch->values[(first + lane) * nparams + param]);
+
+            tokens[param] = (struct token) {
+                .beg = (const uint8_t *) digits[param],
+                .end = (const uint8_t *) digits[param] + len,
+                .token = token_NMBR,
+            };
+            saved[param] = leaf->token;
+            leaf->token = &tokens[param];
+        }
+
+        run(program, outputs[lane], options, NULL);
+
+        for (size_t param = 0; param < nparams; ++param) {
+            batch->targets[param]->children[2]->children[0]->children[0]->token = saved[param];
+        }
+
+        counters->serial_lanes++;
+    }
+
+    free(tokens);
+    free(saved);
+    free(digits);
+}
@@ -0,0 +1,72 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include <stdio.h>
+#include <stdint.h>  // For fixed-width counters
+#include <stddef.h>  // For size_t type
+
+// Forward declarations (see opt.h, parse.h and run.h)
+struct program;
+struct node;
+struct run_options;
+
+// Lanes run together by one run_batch() call
+#define BATCH_LANES 256
+
+// Parameter sets for running one program many times. A parameter is a
+// variable whose first top-level assignment is "name = number;": each lane
+// replaces that number with its own value.
+struct batch {
+    size_t nparams;
+    struct node **targets;  // The NT_Assn node of each parameter
+    size_t nlanes;
+    int *values;            // values[lane * nparams + param]
+};
+
+// What run_batch() did
+struct batch_stats {
+    uint64_t simd_lanes;      // Lanes run together, one SIMD element each
+    uint64_t serial_lanes;    // Lanes run one at a time by the interpreter
+    uint64_t stopped_lanes;   // Lanes stopped where the interpreter would crash
+};
+
+// Possible return codes of batch_load()
+enum {
+    BATCH_OK,       // The parameter sets are loaded
+    BATCH_NOMEM,    // Memory allocation failed
+    BATCH_SYNTAX,   // A line is not a list of name=value with 0 <= value <= INT_MAX
+    BATCH_UNKNOWN,  // A name has no top-level "name = number;" assignment
+};
+
+// Function declaration: batch_load
+// Reads parameter sets, one per non-blank line, such as "base=3 exponent=7".
+// Parameters a line leaves out keep the number written in the program.
+// Parameters:
+//   - const struct program *: the program, after optimize()
+//   - const char *, size_t: the text of the parameter file
+//   - struct batch *: filled in; release it with batch_free()
+//   - size_t *: set to the 1-based line of the error, if any
+int batch_load(const struct program *, const char *text, size_t len, struct batch *,
+    size_t *error_line);
+
+// Function declaration: run_batch
+// Runs lanes first .. first + n - 1 of a batch (n <= BATCH_LANES), lane
+// first + k printing to outputs[k] exactly what run() would print with its
+// parameters. Programs with only scalar variables run all lanes at once:
+// every variable is a row of lanes, operators are SIMD kernels over rows, and
+// lanes taking different branches are masked off. Other programs run each
+// lane with run(), as do all programs when the options set limits. A lane
+// that would crash the interpreter (% by zero, or INT_MIN / -1) prints what
+// it printed so far and stops.
+// Parameters:
+//   - const struct program *: the program, after optimize()
+//   - const struct batch *: the parameter sets
+//   - size_t first, n: the lanes to run
+//   - FILE **: one output stream per lane
+//   - const struct run_options *: options for lanes run by run() (may be NULL)
+//   - struct batch_stats *: counters to add to (may be NULL)
+void run_batch(const struct program *, const struct batch *, size_t first, size_t n,
+    FILE **outputs, const struct run_options *, struct batch_stats *);
+
+// Function declaration: batch_free
+// Releases the tables filled by batch_load().
+void batch_free(struct batch *);
@@ -0,0 +1,408 @@
+#include "cache.h"
+#include "lex.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <process.h>  // _getpid
+#define getpid _getpid
+#else
+#include <unistd.h>   // getpid
+#endif
+
+// Header of an entry. The listing follows, padded to 8 bytes, then the
+// tokens of the leaves in source order, then the nodes breadth first (the
+// children of each node are consecutive, as parse() allocates them), then the
+// source the tree was built from.
+struct cache_header {
+    char magic[8];
+    char version[32];      // CACHE_VERSION
+    uint32_t layout[6];    // See layout below
+    uint64_t key;
+    uint64_t source_size;
+    uint64_t ntokens;      // Lexed, for --stats
+    uint64_t listing_size;
+    uint64_t nleaf_tokens;
+    uint64_t nnodes;
+    uint64_t checksum;     // Of the header (with 0 here) and what follows
+};
+
+// A token, by offsets + 1 into the source (0: none, as for token_FBEG)
+struct cached_token {
+    uint64_t beg, end;
+    uint32_t token;
+    uint32_t unused;
+};
+
+// A node: `first` is the index of its first child, or of its token for a leaf
+struct cached_node {
+    uint32_t nchildren;
+    uint32_t nt;
+    uint64_t first;
+};
+
+static const char magic[8] = "ASTCACHE";
+
+// Sizes of a node, a token and a pointer, a byte order mark, and the numbers
+// of token and node kinds
+static const uint32_t layout[6] = {
+    sizeof(struct node), sizeof(struct token), sizeof(void *), 0x01020304,
+    token_FEND + 1, NT_COUNT,
+};
+
+uint64_t cache_hash(const void *const bytes, size_t size, uint64_t hash)
+{
+    const uint8_t *at = bytes;
+
+    hash ^= size;
+
+    for (; size >= 8; at += 8, size -= 8) {
+        uint64_t word;
+
+        memcpy(&word, at, 8);
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15u;
+        hash ^= hash >> 29;
+    }
+
+    uint64_t tail = 0;
+
+    memcpy(&tail, at, size);
+    hash = (hash ^ tail) * 0x9e3779b97f4a7c15u;
+    return hash ^ hash >> 32;
+}
+
+static uint64_t checksum(const struct cache_header *const header, const uint8_t *const body,
+    const size_t size)
+{
+    struct cache_header copy = *header;
+
+    copy.checksum = 0;
+    return cache_hash(body, size, cache_hash(&copy, sizeof(copy), 0));
+}
+
+static size_t pad8(const size_t size)
+{
+    return (size + 7) & ~(size_t) 7;
+}
+
+// Path of the entry with `key` in `directory`, with `suffix`
+static void entry_path(char *const path, const size_t size, const char *const directory,
+    const uint64_t key, const char *const suffix)
+{
+    snprintf(path, size, "%s/%016llx.ast%s", directory, (unsigned long long) key, suffix);
+}
+
+// Rebuild the tree of a mapped entry into entry->tree, checking each index
+// and offset. Returns CACHE_HIT, CACHE_CORRUPT or CACHE_NOMEM.
+static int relocate(struct cache_entry *const entry, const struct cache_header *const header,
+    const uint8_t *const source)
+{
+    const uint8_t *const body = entry->file.text + sizeof(struct cache_header);
+    const struct cached_token *const cached_tokens =
+        (const struct cached_token *) (body + pad8(header->listing_size));
+    const struct cached_node *const cached_nodes =
+        (const struct cached_node *) (cached_tokens + header->nleaf_tokens);
+    const size_t ntokens = header->nleaf_tokens, nnodes = header->nnodes;
+
+    if (!nnodes || !cached_nodes[0].nchildren || cached_nodes[0].nt != NT_Unit) {
+        return CACHE_CORRUPT;
+    }
+
+    struct token *const tokens = malloc(ntokens * sizeof(struct token) +
+        nnodes * sizeof(struct node) + (nnodes - 1) * sizeof(struct node *) + 1);
+    struct node *const nodes = (struct node *) (tokens + ntokens);
+    struct node **const children = (struct node **) (nodes + nnodes);
+
+    if (!tokens) {
+        return CACHE_NOMEM;
+    }
+
+    entry->tree = tokens;
+
+    for (size_t idx = 0; idx < ntokens; ++idx) {
+        const struct cached_token token = cached_tokens[idx];
+
+        if (!token.beg != !token.end || token.beg > token.end ||
+            token.end > header->source_size + 1 || token.token > token_FEND) {
+            return CACHE_CORRUPT;
+        }
+
+        tokens[idx] = (struct token) {
+            .beg = token.beg ? source + token.beg - 1 : NULL,
+            .end = token.end ? source + token.end - 1 : NULL,
+            .token = token.token,
+        };
+    }
+
+    // Breadth first, each node's children must be the next unclaimed ones:
+    // the nodes then form a single tree, with each node reached once
+    size_t next = 1;
+
+    for (size_t idx = 0; idx < nnodes; ++idx) {
+        const struct cached_node node = cached_nodes[idx];
+
+        if (!node.nchildren) {
+            if (node.first >= ntokens) {
+                return CACHE_CORRUPT;
+            }
+
+            nodes[idx] = (struct node) { .token = &tokens[node.first] };
+            continue;
+        }
+
+        if (node.first != next || node.nchildren > nnodes - next || node.nt >= NT_COUNT) {
+            return CACHE_CORRUPT;
+        }
+
+        nodes[idx] = (struct node) {
+            .nchildren = node.nchildren,
+            .nt = node.nt,
+            .children = &children[next - 1],
+        };
+
+        for (uint32_t child_idx = 0; child_idx < node.nchildren; ++child_idx, ++next) {
+            children[next - 1] = &nodes[next];
+        }
+    }
+
+    if (next != nnodes) {
+        return CACHE_CORRUPT;
+    }
+
+    entry->root = nodes[0];
+    return CACHE_HIT;
+}
+
+// Map and check the entry of entry->key, then rebuild its tree
+static int load(struct cache_entry *const entry, const char *const directory,
+    const uint8_t *const source, const size_t size)
+{
+    char path[4096];
+
+    entry_path(path, sizeof(path), directory, entry->key, "");
+
+    const int error = source_open(&entry->file, path);
+
+    if (error == SOURCE_EMPTY) {
+        return CACHE_CORRUPT;
+    } else if (error) {
+        return CACHE_MISS;
+    }
+
+    const struct cache_header *const header = (const struct cache_header *) entry->file.text;
+
+    if (entry->file.size < sizeof(struct cache_header) || memcmp(header->magic, magic, 8)) {
+        return CACHE_CORRUPT;
+    }
+
+    const size_t body_size = entry->file.size - sizeof(struct cache_header);
+
+    if (strncmp(header->version, CACHE_VERSION, sizeof(header->version)) ||
+        memcmp(header->layout, layout, sizeof(layout)) || header->key != entry->key ||
+        header->source_size != size) {
+        return CACHE_STALE;
+    }
+
+    // Every part must fit the file exactly before the checksum is worth taking
+    if (header->listing_size > body_size ||
+        header->nleaf_tokens > body_size / sizeof(struct cached_token) ||
+        header->nnodes > body_size / sizeof(struct cached_node) ||
+        pad8(header->listing_size) + header->nleaf_tokens * sizeof(struct cached_token) +
+        header->nnodes * sizeof(struct cached_node) + size != body_size ||
+        checksum(header, entry->file.text + sizeof(struct cache_header), body_size) !=
+        header->checksum) {
+        return CACHE_CORRUPT;
+    }
+
+    // The hash only narrows the search: the entry is of this source if it
+    // holds the same bytes
+    if (memcmp(entry->file.text + entry->file.size - size, source, size)) {
+        return CACHE_STALE;
+    }
+
+    const int status = relocate(entry, header, source);
+
+    if (status == CACHE_HIT) {
+        entry->ntokens = header->ntokens;
+        entry->listing = (const char *) entry->file.text + sizeof(struct cache_header);
+        entry->listing_size = header->listing_size;
+    }
+
+    return status;
+}
+
+int cache_load(struct cache_entry *const entry, const char *const directory,
+    const uint8_t *const source, const size_t size)
+{
+    const uint64_t key = cache_hash(source, size,
+        cache_hash(CACHE_VERSION, sizeof(CACHE_VERSION), 0));
+
+    *entry = (struct cache_entry) { .key = key };
+
+    const int status = load(entry, directory, source, size);
+
+    if (status != CACHE_HIT) {
+        cache_free(entry);
+        entry->key = key;
+    }
+
+    return status;
+}
+
+int cache_store(const struct cache_entry *const entry, const char *const directory,
+    const uint8_t *const source, const size_t size, const struct node root,
+    const struct token *const tokens, const size_t ntokens, const char *const listing,
+    const size_t listing_size)
+{
+    // The nodes breadth first, from the root; then the tokens their leaves use
+    size_t nnodes = 1, capacity = 1024, nleaf_tokens = 0;
+    const struct node **order = malloc(capacity * sizeof(struct node *));
+    uint32_t *const token_idx = calloc(ntokens ?: 1, sizeof(uint32_t));
+    uint8_t *body = NULL;
+    int status = -1;
+
+    if (!order || !token_idx) {
+        goto done;
+    }
+
+    order[0] = &root;
+
+    for (size_t idx = 0; idx < nnodes; ++idx) {
+        const struct node *const node = order[idx];
+
+        if (!node->nchildren) {
+            const size_t token = (size_t) (node->token - tokens);
+
+            if (token >= ntokens) {
+                errno = EINVAL;
+                goto done;
+            }
+
+            token_idx[token] = 1;
+            continue;
+        }
+
+        if (node->nchildren > capacity - nnodes) {
+            const struct node **const grown = realloc(order,
+                (capacity = 2 * capacity + node->nchildren) * sizeof(struct node *));
+
+            if (!grown) {
+                goto done;
+            }
+
+            order = grown;
+        }
+
+        for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+            order[nnodes++] = node->children[child_idx];
+        }
+    }
+
+    // Numbered in source order, so that tokens still compare by position
+    for (size_t token = 0; token < ntokens; ++token) {
+        if (token_idx[token]) {
+            token_idx[token] = nleaf_tokens++;
+        }
+    }
+
+    const size_t body_size = pad8(listing_size) + nleaf_tokens * sizeof(struct cached_token) +
+        nnodes * sizeof(struct cached_node) + size;
+
+    if (!(body = calloc(body_size, 1))) {
+        goto done;
+    }
+
+    struct cached_token *const cached_tokens = (struct cached_token *) (body + pad8(listing_size));
+    struct cached_node *const cached_nodes = (struct cached_node *) (cached_tokens + nleaf_tokens);
+
+    memcpy(body, listing, listing_size);
+
+    for (size_t idx = 0, next = 1; idx < nnodes; ++idx) {
+        const struct node *const node = order[idx];
+
+        if (node->nchildren) {
+            cached_nodes[idx] = (struct cached_node) {
+                .nchildren = node->nchildren, .nt = node->nt, .first = next,
+            };
+            next += node->nchildren;
+            continue;
+        }
+
+        const struct token *const token = node->token;
+        const uint32_t leaf = token_idx[token - tokens];
+
+        cached_nodes[idx] = (struct cached_node) { .first = leaf };
+        cached_tokens[leaf] = (struct cached_token) {
+            .beg = token->beg ? (uint64_t) (token->beg - source) + 1 : 0,
+            .end = token->end ? (uint64_t) (token->end - source) + 1 : 0,
+            .token = token->token,
+        };
+    }
+
+    memcpy(cached_nodes + nnodes, source, size);
+
+    struct cache_header header = {
+        .key = entry->key,
+        .source_size = size,
+        .ntokens = ntokens,
+        .listing_size = listing_size,
+        .nleaf_tokens = nleaf_tokens,
+        .nnodes = nnodes,
+    };
+
+    memcpy(header.magic, magic, sizeof(magic));
+    strncpy(header.version, CACHE_VERSION, sizeof(header.version));
+    memcpy(header.layout, layout, sizeof(layout));
+    header.checksum = checksum(&header, body, body_size);
+
+    // Written aside and renamed over the entry, so that a run never maps a
+    // half-written one
+    char path[4096], temporary[4096 + 32];
+
+    entry_path(path, sizeof(path), directory, entry->key, "");
+    snprintf(temporary, sizeof(temporary), "%s.%ld", path, (long) getpid());
+
+    FILE *const file = fopen(temporary, "wb");
+
+    if (!file) {
+        goto done;
+    }
+
+    const int written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(body, 1, body_size, file) == body_size;
+
+    if (fclose(file) || !written) {
+        remove(temporary);
+        goto done;
+    }
+
+#ifdef _WIN32
+    remove(path);  // rename() does not replace files on Windows
+#endif
+
+    if (rename(temporary, path)) {
+        remove(temporary);
+        goto done;
+    }
+
+    status = 0;
+
+done:
+    free(order);
+    free(token_idx);
+    free(body);
+    return status;
+}
+
+void cache_free(struct cache_entry *const entry)
+{
+    free(entry->tree);
+
+    if (entry->file.text) {
+        source_close(&entry->file);
+    }
+
+    *entry = (struct cache_entry) { 0 };
+}
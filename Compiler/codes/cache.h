@@ -0,0 +1,64 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include "parse.h"
+#include "source.h"
+#include <stdint.h>  // For fixed-width integer types
+#include <stddef.h>  // For size_t type
+
+// Where --cache keeps its entries by default
+#define CACHE_DIRECTORY "outputs/cache"
+
+// The version of the entries. Bump it with any change to the tokens lex()
+// finds, the trees parse() builds or what either prints, and to the format of
+// the entries: an entry of another version is stale. The numbers of token and
+// node kinds and the layout of the structures are checked as well.
+#define CACHE_VERSION "2"
+
+// Possible return codes of cache_load()
+enum {
+    CACHE_HIT,      // The entry is loaded
+    CACHE_MISS,     // There is no entry for the source
+    CACHE_STALE,    // The entry is of another version, or of another source with the same hash
+    CACHE_CORRUPT,  // The entry fails its checks
+    CACHE_NOMEM,    // Memory allocation failed
+};
+
+// An entry of the front-end cache: the syntax tree of a source and what
+// lex() and parse() printed for it, to skip both when the same source runs
+// again. Entries are files named after the hash of the version and the
+// source, which hold the tree as indices and source offsets, and the source
+// itself to tell apart sources with the same hash; loading one maps it and
+// rebuilds the pointers in a single pass over its nodes.
+struct cache_entry {
+    uint64_t key;          // Hash of the version and the source
+    struct node root;      // The syntax tree, once loaded
+    size_t ntokens;        // Tokens the lexer found
+    const char *listing;   // What lex() and parse() printed, in the mapping
+    size_t listing_size;
+    struct source file;    // The entry, mapped
+    void *tree;            // The tokens, nodes and child pointers of the tree, in one block
+};
+
+// Function declaration: cache_load
+// Looks the source up in the cache `directory` and loads its entry. Returns
+// CACHE_HIT with entry->root, ntokens and listing set, to release with
+// cache_free(), or why there is no tree to use. Either way, entry->key is
+// set for cache_store().
+int cache_load(struct cache_entry *, const char *directory, const uint8_t *source, size_t size);
+
+// Function declaration: cache_store
+// Writes the entry of the source, replacing any other: the tree parse()
+// built from `tokens` and what lex() and parse() printed. Returns 0 on
+// success, -1 if the entry could not be written (errno tells why).
+int cache_store(const struct cache_entry *, const char *directory, const uint8_t *source,
+    size_t size, struct node root, const struct token *tokens, size_t ntokens,
+    const char *listing, size_t listing_size);
+
+// Function declaration: cache_hash
+// Returns a 64-bit hash of `size` bytes, starting from `seed`. Not a
+// cryptographic hash: it tells sources apart and finds damaged entries.
+uint64_t cache_hash(const void *, size_t size, uint64_t seed);
+
+// Function declaration: cache_free
+// Releases the tree of a loaded entry and unmaps the entry.
+void cache_free(struct cache_entry *);
@@ -0,0 +1,254 @@
+// interpret-client: runs a program on a server started with `interpret
+// --serve`, printing its output as the server streams it back
+
+#include "server.h"
+#include "opt.h"
+#include "run.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if __has_include(<sys/un.h>)
+
+#include <errno.h>
+#include <limits.h>  // PATH_MAX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int read_all(const int fd, void *const data, size_t size)
+{
+    for (char *at = data; size;) {
+        const ssize_t got = recv(fd, at, size, 0);
+
+        if (got < 0 && errno == EINTR) {
+            continue;
+        } else if (got <= 0) {
+            return -1;
+        }
+
+        at += got;
+        size -= got;
+    }
+
+    return 0;
+}
+
+static int send_all(const int fd, const void *const data, size_t size)
+{
+    for (const char *at = data; size;) {
+        const ssize_t sent = send(fd, at, size, MSG_NOSIGNAL);
+
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0) {
+            return -1;
+        }
+
+        at += sent;
+        size -= sent;
+    }
+
+    return 0;
+}
+
+// Read all of a file (or of stdin for "-") into *text. Returns 0 on success.
+static int read_source(const char *const path, char **const text, size_t *const len)
+{
+    FILE *const file = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+    size_t allocated = 0, got;
+
+    *text = NULL;
+    *len = 0;
+
+    if (!file) {
+        return -1;
+    }
+
+    do {
+        if (*len == allocated) {
+            char *const tmp = realloc(*text, allocated = allocated ? 2 * allocated : 4096);
+
+            if (!tmp) {
+                free(*text);
+                *text = NULL;
+                break;
+            }
+
+            *text = tmp;
+        }
+
+        got = fread(*text + *len, 1, allocated - *len, file);
+        *len += got;
+    } while (got);
+
+    const int failed = !*text || ferror(file);
+
+    if (file != stdin) {
+        fclose(file);
+    }
+
+    return failed ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct server_request request = {
+        .magic = SERVER_MAGIC, .kind = REQUEST_PATH, .tier_threshold = RUN_TIER_THRESHOLD,
+    };
+    const char *socket_path = SERVER_SOCKET;
+    const char *input_path = NULL;
+    int send_source = 0;      // Send the text of the file rather than its path
+    char bindings[SERVER_MAX_BINDINGS];  // -D name=value, each followed by '\0'
+    int usage = 0;
+
+    // Parse command line options, as interpret does
+    for (int arg_idx = 1; arg_idx < argc && !usage; ++arg_idx) {
+        const char *const arg = argv[arg_idx];
+
+        if (!strncmp(arg, "--socket=", 9)) {
+            socket_path = arg + 9;
+        } else if (!strcmp(arg, "--source")) {
+            send_source = 1;
+        } else if (!strcmp(arg, "--shutdown")) {
+            request.kind = REQUEST_SHUTDOWN;
+        } else if (!strcmp(arg, "--no-vectorize")) {
+            request.options |= OPT_NO_VECTORIZE;
+        } else if (!strncmp(arg, "--threads=", 10)) {
+            request.threads = strtoul(arg + 10, NULL, 10) ?: 1;
+        } else if (!strcmp(arg, "--memoize")) {
+            request.flags |= REQUEST_MEMOIZE;
+        } else if (!strncmp(arg, "--max-steps=", 12)) {
+            request.max_steps = strtoull(arg + 12, NULL, 10);
+        } else if (!strncmp(arg, "--time-limit=", 13)) {
+            request.time_limit_ms = strtoull(arg + 13, NULL, 10);
+        } else if (!strncmp(arg, "--max-memory=", 13)) {
+            request.max_array_bytes = strtoull(arg + 13, NULL, 10);
+        } else if (!strcmp(arg, "--all-warnings")) {
+            request.flags |= REQUEST_ALL_WARNINGS;
+        } else if (!strncmp(arg, "--tier-threshold=", 17)) {
+            request.tier_threshold = strtoull(arg + 17, NULL, 10);
+        } else if (!strncmp(arg, "-D", 2)) {
+            const char *const text = arg[2] ? arg + 2 : arg_idx + 1 < argc ? argv[++arg_idx] : "";
+            const size_t size = strlen(text) + 1;
+
+            if (size > sizeof(bindings) - request.bindings_size) {
+                usage = 1;
+            } else {
+                memcpy(bindings + request.bindings_size, text, size);
+                request.bindings_size += size;
+            }
+        } else if (!input_path && (arg[0] != '-' || !strcmp(arg, "-"))) {
+            input_path = arg;
+        } else {
+            usage = 1;
+        }
+    }
+
+    if (usage || !input_path == (request.kind != REQUEST_SHUTDOWN)) {
+        fprintf(stderr, "Usage: %s [--socket=PATH] [--source] [--no-vectorize] [--tier-threshold=N] [--threads=N] [--memoize] [--max-steps=N] [--time-limit=MS] [--max-memory=BYTES] [--all-warnings] [-D name=value ...] <file | ->\n"
+            "       %s [--socket=PATH] --shutdown\n", argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The server may run elsewhere in the file system: paths go absolute
+    char resolved[PATH_MAX];
+    char *payload = NULL;
+    size_t payload_size = 0;
+
+    if (input_path && (send_source || !strcmp(input_path, "-"))) {
+        request.kind = REQUEST_SOURCE;
+
+        if (read_source(input_path, &payload, &payload_size)) {
+            perror(input_path);
+            return EXIT_FAILURE;
+        }
+    } else if (input_path) {
+        const char *const path = realpath(input_path, resolved) ? resolved : input_path;
+
+        payload_size = strlen(path);
+        payload = strdup(path);
+    }
+
+    request.payload_size = payload_size;
+
+    // Connect and send the request
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "%s: the socket path is too long\n", argv[0]);
+        free(payload);
+        return EXIT_FAILURE;
+    }
+
+    strcpy(address.sun_path, socket_path);
+
+    if (fd < 0 || connect(fd, (const struct sockaddr *) &address, sizeof(address))) {
+        fprintf(stderr, "%s: cannot connect to %s: %s (start a server with interpret --serve)\n",
+            argv[0], socket_path, strerror(errno));
+        free(payload);
+        return EXIT_FAILURE;
+    }
+
+    if (send_all(fd, &request, sizeof(request)) ||
+        send_all(fd, bindings, request.bindings_size) ||
+        send_all(fd, payload ?: "", payload_size)) {
+        fprintf(stderr, "%s: could not send the request: %s\n", argv[0], strerror(errno));
+        free(payload);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    free(payload);
+
+    // Print the output as it comes, until the exit status
+    char buffer[1 << 16];
+    struct server_frame frame;
+    int ended = 0;
+
+    while (!ended && !read_all(fd, &frame, sizeof(frame))) {
+        size_t left = frame.kind == REPLY_OUTPUT ? frame.value : 0;
+
+        if (frame.kind != REPLY_OUTPUT) {
+            ended = frame.kind == REPLY_END ? 1 : -1;
+        }
+
+        for (size_t chunk; left; left -= chunk) {
+            chunk = left < sizeof(buffer) ? left : sizeof(buffer);
+
+            if (read_all(fd, buffer, chunk)) {
+                break;
+            }
+
+            fwrite(buffer, 1, chunk, stdout);
+        }
+
+        if (left) {
+            break;
+        }
+
+        fflush(stdout);
+    }
+
+    close(fd);
+
+    if (ended != 1) {
+        fprintf(stderr, "%s: the server closed the connection before the end of the run\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    return frame.value;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    fprintf(stderr, "%s: this system has no UNIX-domain sockets\n", argv[0]);
+    return EXIT_FAILURE;
+}
+
+#endif
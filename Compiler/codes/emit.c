@@ -0,0 +1,943 @@
+#include "emit.h"
+#include "lex.h"
+#include "parse.h"
+#include "opt.h"
+#include "run.h"
+#include "warn.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Support code of every generated program. It mirrors run.c and array.c:
+// variables are defined by their first assignment, at most VARSTORE_CAPACITY
+// of them; an array's size grows to (idx + 1) * 2 when writing past it; and
+// elements are stored a page at a time, so sparse arrays stay small.
+// Functions keep their locals in C locals, and at most CALL_DEPTH calls can
+// be in progress. Warnings are counted by site (numbered by emit_c()) and
+// kind, as warn.c counts them.
+static const char runtime[] =
+    "#define VARSTORE_CAPACITY 128\n"
+    "#define PAGE_SHIFT 10\n"
+    "#define DIR_SHIFT 10\n"
+    "#define TOP_SIZE ((size_t) 1 << (31 - PAGE_SHIFT - DIR_SHIFT))\n"
+    "\n"
+    "struct var {\n"
+    "    int defined;    // The variable has been assigned\n"
+    "    int scalar;     // Value of a variable never used as an array\n"
+    "    size_t size;    // Logical size of an array (0 after a failed allocation)\n"
+    "    int ***pages;   // Elements of an array, allocated a page at a time\n"
+    "};\n"
+    "\n"
+    "static struct var vars[NSYMBOLS];\n"
+    "static size_t nvars;  // Defined variables\n"
+    "\n"
+    "// Count a warning of kind k at site s, printing it if it is the first\n"
+    "static void warn(unsigned s, int k)\n"
+    "{\n"
+    "    if (ALL_WARNINGS || (!warnings[s][k].count && !warnings[s][k].quiet)) {\n"
+    "        printf(\"%s\\n\", messages[k]);\n"
+    "        warnings[s][k].shown++;\n"
+    "    }\n"
+    "\n"
+    "    warnings[s][k].count++;\n"
+    "}\n"
+    "\n"
+    "// Report how often the warnings that were not all printed happened\n"
+    "static void summarize(void)\n"
+    "{\n"
+    "    for (unsigned s = 0; s < NSITES; ++s) {\n"
+    "        for (int k = 0; k < WARN_KINDS; ++k) {\n"
+    "            if (warnings[s][k].count > warnings[s][k].shown) {\n"
+    "                printf(\"%s (line %u): %llu time%s, %llu not shown\\n\", messages[k], lines[s],\n"
+    "                    warnings[s][k].count, warnings[s][k].count == 1 ? \"\" : \"s\",\n"
+    "                    warnings[s][k].count - warnings[s][k].shown);\n"
+    "            }\n"
+    "        }\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// Element idx of an array, optionally allocating its page\n"
+    "static int *element(struct var *v, size_t idx, int allocate)\n"
+    "{\n"
+    "    if (!v->pages && (!allocate || !(v->pages = calloc(TOP_SIZE, sizeof(int **))))) {\n"
+    "        return NULL;\n"
+    "    }\n"
+    "\n"
+    "    int ***dir = &v->pages[idx >> (PAGE_SHIFT + DIR_SHIFT)];\n"
+    "\n"
+    "    if (!*dir && (!allocate || !(*dir = calloc((size_t) 1 << DIR_SHIFT, sizeof(int *))))) {\n"
+    "        return NULL;\n"
+    "    }\n"
+    "\n"
+    "    int **page = &(*dir)[(idx >> PAGE_SHIFT) & (((size_t) 1 << DIR_SHIFT) - 1)];\n"
+    "\n"
+    "    if (!*page && (!allocate || !(*page = calloc((size_t) 1 << PAGE_SHIFT, sizeof(int))))) {\n"
+    "        return NULL;\n"
+    "    }\n"
+    "\n"
+    "    return &(*page)[idx & (((size_t) 1 << PAGE_SHIFT) - 1)];\n"
+    "}\n"
+    "\n"
+    "// Release an array after a failed allocation\n"
+    "static void release(struct var *v)\n"
+    "{\n"
+    "    for (size_t top = 0; v->pages && top < TOP_SIZE; ++top) {\n"
+    "        for (size_t dir = 0; v->pages[top] && dir < ((size_t) 1 << DIR_SHIFT); ++dir) {\n"
+    "            free(v->pages[top][dir]);\n"
+    "        }\n"
+    "\n"
+    "        free(v->pages[top]);\n"
+    "    }\n"
+    "\n"
+    "    free(v->pages);\n"
+    "    v->pages = NULL;\n"
+    "    v->size = 0;\n"
+    "}\n"
+    "\n"
+    "// Read a variable never used as an array\n"
+    "static inline int read_scalar(const struct var *v, unsigned s)\n"
+    "{\n"
+    "    if (v->defined) {\n"
+    "        return v->scalar;\n"
+    "    }\n"
+    "\n"
+    "    warn(s, WARN_UNDEFINED);\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "// Read an array variable by name, i.e. its element 0\n"
+    "static inline int read_atom(struct var *v, unsigned s)\n"
+    "{\n"
+    "    if (v->defined) {\n"
+    "        const int *e = v->size ? element(v, 0, 0) : NULL;\n"
+    "        return e ? *e : 0;\n"
+    "    }\n"
+    "\n"
+    "    warn(s, WARN_UNDEFINED);\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "// Read a local variable of a function\n"
+    "static inline int read_local(const int *l, const unsigned char *d, unsigned slot, unsigned s)\n"
+    "{\n"
+    "    if (d[slot]) {\n"
+    "        return l[slot];\n"
+    "    }\n"
+    "\n"
+    "    warn(s, WARN_UNDEFINED);\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "static unsigned depth;  // Calls of functions in progress\n"
+    "\n"
+    "// Start a call, unless too many are in progress\n"
+    "static inline int enter(unsigned s)\n"
+    "{\n"
+    "    if (depth < CALL_DEPTH) {\n"
+    "        depth++;\n"
+    "        return 1;\n"
+    "    }\n"
+    "\n"
+    "    warn(s, WARN_DEPTH);\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "// Read element idx of an array\n"
+    "static inline int load(struct var *v, int idx, unsigned s)\n"
+    "{\n"
+    "    if (idx < 0) {\n"
+    "        warn(s, WARN_NEGATIVE);\n"
+    "        return 0;\n"
+    "    }\n"
+    "\n"
+    "    if (!v->defined) {\n"
+    "        warn(s, WARN_NO_ARRAY);\n"
+    "        return 0;\n"
+    "    }\n"
+    "\n"
+    "    if ((size_t) idx >= v->size) {\n"
+    "        warn(s, WARN_BOUNDS);\n"
+    "        return 0;\n"
+    "    }\n"
+    "\n"
+    "    const int *e = element(v, idx, 0);\n"
+    "    return e ? *e : 0;\n"
+    "}\n"
+    "\n"
+    "// Check that a variable never used as an array can be assigned\n"
+    "static inline int scalar_assignable(const struct var *v, unsigned s)\n"
+    "{\n"
+    "    if (v->defined || nvars < VARSTORE_CAPACITY) {\n"
+    "        return 1;\n"
+    "    }\n"
+    "\n"
+    "    warn(s, WARN_VARSTORE);\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "// Assign a variable never used as an array\n"
+    "static inline void set_scalar(struct var *v, int value)\n"
+    "{\n"
+    "    v->scalar = value;\n"
+    "\n"
+    "    if (!v->defined) {\n"
+    "        v->defined = 1;\n"
+    "        nvars++;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// Make element idx of an array writable, growing or creating the array.\n"
+    "// Returns 0, after printing why, if the assignment has no effect.\n"
+    "static inline int prepare(struct var *v, int idx, int *fresh, unsigned s)\n"
+    "{\n"
+    "    *fresh = 0;\n"
+    "\n"
+    "    if (v->defined && !v->size) {\n"
+    "        warn(s, WARN_REALLOC);\n"
+    "        return 0;\n"
+    "    }\n"
+    "\n"
+    "    if (!v->defined && nvars >= VARSTORE_CAPACITY) {\n"
+    "        warn(s, WARN_VARSTORE);\n"
+    "        return 0;\n"
+    "    }\n"
+    "\n"
+    "    if (idx < 0) {\n"
+    "        warn(s, WARN_NEGATIVE);\n"
+    "        return 0;\n"
+    "    }\n"
+    "\n"
+    "    if (!element(v, idx, 1)) {\n"
+    "        release(v);\n"
+    "        printf(v->defined ? \"realloc failed\\n\" : \"malloc failed\\n\");\n"
+    "        return 0;\n"
+    "    }\n"
+    "\n"
+    "    if (!v->defined) {\n"
+    "        v->size = (size_t) idx + 1;\n"
+    "        *fresh = 1;\n"
+    "    } else if ((size_t) idx >= v->size) {\n"
+    "        v->size = ((size_t) idx + 1) * 2;\n"
+    "    }\n"
+    "\n"
+    "    return 1;\n"
+    "}\n"
+    "\n"
+    "// Store into an element made writable by prepare()\n"
+    "static inline void store(struct var *v, int idx, int value, int fresh)\n"
+    "{\n"
+    "    *element(v, idx, 0) = value;\n"
+    "\n"
+    "    if (fresh) {\n"
+    "        v->defined = 1;\n"
+    "        nvars++;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "static inline int divide(int left, int right, unsigned s)\n"
+    "{\n"
+    "    if (right) {\n"
+    "        return left / right;\n"
+    "    }\n"
+    "\n"
+    "    warn(s, WARN_DIVIDE);\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "// fill(a, value, n)\n"
+    "static inline void fill(struct var *a, int value, int n, unsigned s)\n"
+    "{\n"
+    "    for (int idx = 0; idx < n; ++idx) {\n"
+    "        int fresh;\n"
+    "\n"
+    "        if (prepare(a, idx, &fresh, s)) {\n"
+    "            store(a, idx, value, fresh);\n"
+    "        }\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// copy(dst, src, n)\n"
+    "static inline void copy(struct var *dst, struct var *src, int n, unsigned s)\n"
+    "{\n"
+    "    for (int idx = 0; idx < n; ++idx) {\n"
+    "        int fresh;\n"
+    "\n"
+    "        if (prepare(dst, idx, &fresh, s)) {\n"
+    "            store(dst, idx, load(src, idx, s), fresh);\n"
+    "        }\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// sum(a, n), min(a, n) and max(a, n): op is '+', '<' or '>'\n"
+    "static inline int reduce(struct var *a, int n, char op, unsigned s)\n"
+    "{\n"
+    "    if (n <= 0) {\n"
+    "        return 0;\n"
+    "    }\n"
+    "\n"
+    "    int result = load(a, 0, s);\n"
+    "\n"
+    "    for (int idx = 1; idx < n; ++idx) {\n"
+    "        const int e = load(a, idx, s);\n"
+    "\n"
+    "        if (op == '+') {\n"
+    "            result = (int) ((unsigned) result + (unsigned) e);\n"
+    "        } else if (op == '<' ? e < result : e > result) {\n"
+    "            result = e;\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    return result;\n"
+    "}\n"
+    "\n"
+    "// find(a, value, n)\n"
+    "static inline int find(struct var *a, int value, int n, unsigned s)\n"
+    "{\n"
+    "    for (int idx = 0; idx < n; ++idx) {\n"
+    "        if (load(a, idx, s) == value) {\n"
+    "            return idx;\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    return -1;\n"
+    "}\n";
+
+// State of one emit_c() call
+static _Thread_local struct {
+    FILE *out;
+    unsigned depth;   // Indentation level
+    unsigned ntemps;  // Temporaries t0, t1, ... declared so far
+    size_t nsites;
+    const struct token **sites;  // Tokens that may warn, sorted: site s is sites[s]
+} emitter;
+
+// Names of the warning kinds in the generated code
+static const char *const warn_names[WARN_KINDS] = {
+    [WARN_UNDEFINED] = "WARN_UNDEFINED",
+    [WARN_NO_ARRAY]  = "WARN_NO_ARRAY",
+    [WARN_NEGATIVE]  = "WARN_NEGATIVE",
+    [WARN_BOUNDS]    = "WARN_BOUNDS",
+    [WARN_VARSTORE]  = "WARN_VARSTORE",
+    [WARN_REALLOC]   = "WARN_REALLOC",
+    [WARN_DIVIDE]    = "WARN_DIVIDE",
+    [WARN_CALL]      = "WARN_CALL",
+    [WARN_DEPTH]     = "WARN_DEPTH",
+};
+
+static void emit_block(const struct node *);
+
+// Write one indented line of code
+static void line(const char *const fmt, ...)
+{
+    va_list args;
+
+    fprintf(emitter.out, "%*s", (int) (4 * emitter.depth), "");
+    va_start(args, fmt);
+    vfprintf(emitter.out, fmt, args);
+    va_end(args);
+    fputc('\n', emitter.out);
+}
+
+// Declare a new temporary holding `fmt`, returning its number
+static unsigned temp(const char *const fmt, ...)
+{
+    va_list args;
+    const unsigned t = emitter.ntemps++;
+
+    fprintf(emitter.out, "%*sint t%u = ", (int) (4 * emitter.depth), "", t);
+    va_start(args, fmt);
+    vfprintf(emitter.out, fmt, args);
+    va_end(args);
+    fputs(";\n", emitter.out);
+    return t;
+}
+
+// The token the interpreter warns about for a node, if it may warn: the name
+// read, assigned or called, or the division operator
+static const struct token *site_token(const struct node *const node)
+{
+    switch (node->nt) {
+    case NT_Atom:
+        return node->children[0]->token->token == token_NAME ? node->children[0]->token : NULL;
+
+    case NT_Aexp:
+    case NT_Call:
+        return node->children[0]->token;
+
+    case NT_Assn:
+        return node->children[0]->nchildren ? node->children[0]->children[0]->token :
+            node->children[0]->token;
+
+    case NT_Bexp:
+        return node->children[1]->token->token == token_DIVI ? node->children[1]->token : NULL;
+
+    default:
+        return NULL;
+    }
+}
+
+// Add the sites of a subtree to emitter.sites, which has room for them all
+static void collect_sites(const struct node *const node)
+{
+    if (!node->nchildren) {
+        return;
+    }
+
+    const struct token *const site = site_token(node);
+
+    if (site) {
+        emitter.sites[emitter.nsites++] = site;
+    }
+
+    for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+        collect_sites(node->children[child_idx]);
+    }
+}
+
+// Number of nodes of a subtree that are not leaves
+static size_t count_nodes(const struct node *const node)
+{
+    size_t count = node->nchildren ? 1 : 0;
+
+    for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+        count += count_nodes(node->children[child_idx]);
+    }
+
+    return count;
+}
+
+// Order tokens by address, i.e. by position in the source
+static int compare_tokens(const void *const a, const void *const b)
+{
+    const struct token *const x = *(const struct token *const *) a;
+    const struct token *const y = *(const struct token *const *) b;
+
+    return x == y ? 0 : x < y ? -1 : 1;
+}
+
+// Number the sites of the program in source order. Returns 0 if memory ran out.
+static int number_sites(const struct program *const program)
+{
+    emitter.nsites = 0;
+    emitter.sites = malloc((count_nodes(&program->root) ?: 1) * sizeof(struct token *));
+
+    if (!emitter.sites) {
+        return 0;
+    }
+
+    collect_sites(&program->root);
+    qsort(emitter.sites, emitter.nsites, sizeof(struct token *), compare_tokens);
+
+    size_t kept = 0;
+
+    for (size_t idx = 0; idx < emitter.nsites; ++idx) {
+        if (!kept || emitter.sites[kept - 1] != emitter.sites[idx]) {
+            emitter.sites[kept++] = emitter.sites[idx];
+        }
+    }
+
+    emitter.nsites = kept;
+    return 1;
+}
+
+// Number of a site of the program
+static unsigned site(const struct token *const token)
+{
+    const struct token **const found = bsearch(&token, emitter.sites, emitter.nsites,
+        sizeof(struct token *), compare_tokens);
+
+    return (unsigned) (found - emitter.sites);
+}
+
+// Number of the site of a node
+static unsigned site_of(const struct node *const node)
+{
+    return site(site_token(node));
+}
+
+// Value of a number literal, wrapping around like eval_atom()
+static int literal(const struct token *const token)
+{
+    unsigned result = 0;
+
+    for (const uint8_t *digit = token->beg; digit < token->end; ++digit) {
+        result = result * 10 + (*digit - '0');
+    }
+
+    return (int) result;
+}
+
+// C operators of the binary operator tokens; division is checked separately
+static const char *binary_op(const token_t token)
+{
+    switch (token) {
+    case token_PLUS: return "+";
+    case token_MINS: return "-";
+    case token_MULT: return "*";
+    case token_MODU: return "%";
+    case token_EQUL: return "==";
+    case token_NEQL: return "!=";
+    case token_LTHN: return "<";
+    case token_GTHN: return ">";
+    case token_LTEQ: return "<=";
+    case token_GTEQ: return ">=";
+    case token_CONJ: return "&&";
+    case token_DISJ: return "||";
+    default: return NULL;
+    }
+}
+
+// Emit the evaluation of an expression, returning the temporary holding its
+// value. Every operand gets its own statement, so the warnings are printed in
+// the order the interpreter prints them.
+static unsigned emit_expr(const struct node *const expr)
+{
+    const struct node *const node = expr->children[0];
+
+    switch (node->nt) {
+    case NT_Atom:
+        if (node->children[0]->token->token == token_NMBR) {
+            const int value = literal(node->children[0]->token);
+            return value < 0 ? temp("(int) %uu", (unsigned) value) : temp("%d", value);
+        }
+
+        if (node->flags & NF_LOCAL) {
+            return temp("read_local(l, d, %u, %u)", (unsigned) node->slot, site_of(node));
+        }
+
+        return temp(node->flags & NF_SCALAR ? "read_scalar(&vars[%u], %u)" :
+            "read_atom(&vars[%u], %u)", (unsigned) node->slot, site_of(node));
+
+    case NT_Pexp:
+        return emit_expr(node->children[1]);
+
+    case NT_Bexp: {
+        const unsigned left = emit_expr(node->children[0]);
+        const unsigned right = emit_expr(node->children[2]);
+        const token_t op = node->children[1]->token->token;
+
+        if (op == token_DIVI) {
+            return temp("divide(t%u, t%u, %u)", left, right, site_of(node));
+        }
+
+        return temp("t%u %s t%u", left, binary_op(op), right);
+    }
+
+    case NT_Uexp: {
+        const unsigned operand = emit_expr(node->children[1]);
+
+        switch (node->children[0]->token->token) {
+        case token_MINS:
+            return temp("-t%u", operand);
+
+        case token_NEGA:
+            return temp("!t%u", operand);
+
+        default:
+            return operand;
+        }
+    }
+
+    case NT_Texp: {
+        const unsigned result = temp("0");
+
+        line("if (t%u) {", emit_expr(node->children[0]));
+        emitter.depth++;
+        line("t%u = t%u;", result, emit_expr(node->children[2]));
+        emitter.depth--;
+        line("} else {");
+        emitter.depth++;
+        line("t%u = t%u;", result, emit_expr(node->children[4]));
+        emitter.depth--;
+        line("}");
+        return result;
+    }
+
+    case NT_Aexp:
+        return temp("load(&vars[%u], t%u, %u)", (unsigned) node->slot, emit_expr(node->children[2]),
+            site_of(node));
+
+    case NT_Call: {
+        if (node->aux == BUILTIN_USER) {
+            const uint32_t nargs = node->nchildren - 3;
+            unsigned args[nargs + 1];
+
+            for (uint32_t arg_idx = 0; arg_idx < nargs; ++arg_idx) {
+                args[arg_idx] = emit_expr(call_arg(node, arg_idx));
+            }
+
+            const unsigned t = emitter.ntemps++;
+
+            fprintf(emitter.out, "%*sint t%u = fn%u(%u", (int) (4 * emitter.depth), "", t,
+                (unsigned) node->slot, site_of(node));
+
+            for (uint32_t arg_idx = 0; arg_idx < nargs; ++arg_idx) {
+                fprintf(emitter.out, ", t%u", args[arg_idx]);
+            }
+
+            fputs(");\n", emitter.out);
+            return t;
+        }
+
+        const unsigned a = node->aux != BUILTIN_NONE ? call_arg(node, 0)->children[0]->slot : 0;
+        const unsigned s = site_of(node);
+
+        switch (node->aux) {
+        case BUILTIN_SUM:
+            return temp("reduce(&vars[%u], t%u, '+', %u)", a, emit_expr(call_arg(node, 1)), s);
+
+        case BUILTIN_MIN:
+            return temp("reduce(&vars[%u], t%u, '<', %u)", a, emit_expr(call_arg(node, 1)), s);
+
+        case BUILTIN_MAX:
+            return temp("reduce(&vars[%u], t%u, '>', %u)", a, emit_expr(call_arg(node, 1)), s);
+
+        case BUILTIN_FIND: {
+            const unsigned value = emit_expr(call_arg(node, 1));
+            return temp("find(&vars[%u], t%u, t%u, %u)", a, value, emit_expr(call_arg(node, 2)), s);
+        }
+
+        default:
+            line("warn(%u, WARN_CALL);", s);
+            return temp("0");
+        }
+    }
+
+    default:
+        abort();  // Unknown expression type
+    }
+}
+
+// Emit a string literal, escaping everything but plain printable characters
+static void emit_string(const uint8_t *beg, const uint8_t *const end)
+{
+    fputc('"', emitter.out);
+
+    for (; beg < end; ++beg) {
+        if (*beg >= ' ' && *beg <= '~' && *beg != '"' && *beg != '\\' && *beg != '?') {
+            fputc(*beg, emitter.out);
+        } else {
+            fprintf(emitter.out, "\\%03o", *beg);
+        }
+    }
+
+    fputc('"', emitter.out);
+}
+
+// Emit an assignment statement
+static void emit_assign(const struct node *const assn)
+{
+    const struct node *const lhs = assn->children[0];
+    const unsigned slot = assn->slot;
+
+    if (assn->flags & NF_LOCAL) {
+        line("l[%u] = t%u;", slot, emit_expr(assn->children[2]));
+        line("d[%u] = 1;", slot);
+        return;
+    }
+
+    if (assn->flags & NF_SCALAR) {
+        // The value is evaluated while the variable is still undefined
+        line("if (scalar_assignable(&vars[%u], %u)) {", slot, site_of(assn));
+        emitter.depth++;
+        line("set_scalar(&vars[%u], t%u);", slot, emit_expr(assn->children[2]));
+        emitter.depth--;
+        line("}");
+        return;
+    }
+
+    // A variable used as an array is assigned by name through its element 0
+    const unsigned idx = lhs->nchildren ? emit_expr(lhs->children[2]) : temp("0");
+    const unsigned fresh = temp("0");
+
+    line("if (prepare(&vars[%u], t%u, &t%u, %u)) {", slot, idx, fresh, site_of(assn));
+    emitter.depth++;
+    line("store(&vars[%u], t%u, t%u, t%u);", slot, idx, emit_expr(assn->children[2]), fresh);
+    emitter.depth--;
+    line("}");
+}
+
+// Emit an expression statement
+static void emit_exst(const struct node *const exst)
+{
+    const struct node *const call = exst->children[0]->children[0];
+
+    if (call->nt == NT_Call && (call->aux == BUILTIN_FILL || call->aux == BUILTIN_COPY)) {
+        const unsigned a = call_arg(call, 0)->children[0]->slot;
+
+        if (call->aux == BUILTIN_FILL) {
+            const unsigned value = emit_expr(call_arg(call, 1));
+            line("fill(&vars[%u], t%u, t%u, %u);", a, value, emit_expr(call_arg(call, 2)),
+                site_of(call));
+        } else {
+            line("copy(&vars[%u], &vars[%u], t%u, %u);", a,
+                (unsigned) call_arg(call, 1)->children[0]->slot, emit_expr(call_arg(call, 2)),
+                site_of(call));
+        }
+    } else {
+        line("(void) t%u;", emit_expr(exst->children[0]));
+    }
+}
+
+// Emit an if/elif/else chain starting at arm `arm_idx`
+static void emit_cond(const struct node *const ctrl, const size_t arm_idx)
+{
+    const struct node *const arm = ctrl->children[arm_idx];
+
+    line("if (t%u) {", emit_expr(arm->children[1]));
+    emitter.depth++;
+    emit_block(arm->children[3]);
+    emitter.depth--;
+
+    if (arm_idx + 1 < ctrl->nchildren) {
+        const struct node *const next = ctrl->children[arm_idx + 1];
+
+        line("} else {");
+        emitter.depth++;
+        next->nt == NT_Else ? emit_block(next->children[2]) : emit_cond(ctrl, arm_idx + 1);
+        emitter.depth--;
+    }
+
+    line("}");
+}
+
+// Emit a statement, in its own scope
+static void emit_stmt(const struct node *const stmt)
+{
+    const struct node *const node = stmt->children[0];
+
+    line("{");
+    emitter.depth++;
+
+    switch (node->nt) {
+    case NT_Assn:
+        emit_assign(node);
+        break;
+
+    case NT_Prnt: {
+        const unsigned value = emit_expr(node->children[node->nchildren - 2]);
+
+        if (node->nchildren == 3) {
+            line("printf(\"%%d\\n\", t%u);", value);
+        } else {
+            const struct token *const strl = node->children[1]->token;
+
+            fprintf(emitter.out, "%*sprintf(\"%%s%%d\\n\", ", (int) (4 * emitter.depth), "");
+            emit_string(strl->beg + 1, strl->end - 1);
+            fprintf(emitter.out, ", t%u);\n", value);
+        }
+    } break;
+
+    case NT_Ctrl: {
+        const struct node *const first = node->children[0];
+
+        switch (first->nt) {
+        case NT_Cond:
+            emit_cond(node, 0);
+            break;
+
+        case NT_Whil:
+            line("for (;;) {");
+            emitter.depth++;
+            line("if (!t%u) {", emit_expr(first->children[1]));
+            line("    break;");
+            line("}");
+            emit_block(first->children[3]);
+            emitter.depth--;
+            line("}");
+            break;
+
+        case NT_Dowh:
+            line("for (;;) {");
+            emitter.depth++;
+            emit_block(first->children[2]);
+            line("if (!t%u) {", emit_expr(first->children[first->nchildren - 2]));
+            line("    break;");
+            line("}");
+            emitter.depth--;
+            line("}");
+            break;
+
+        default:
+            abort();  // Unknown control structure
+        }
+    } break;
+
+    case NT_Exst:
+        emit_exst(node);
+        break;
+
+    case NT_Rtrn: {
+        const unsigned value = emit_expr(node->children[1]);
+
+        line("depth--;");
+        line("return t%u;", value);
+    } break;
+
+    case NT_Func:  // Emitted before main()
+        break;
+
+    default:
+        abort();  // Unknown statement type
+    }
+
+    emitter.depth--;
+    line("}");
+}
+
+// Emit the statements of a block
+static void emit_block(const struct node *stmt)
+{
+    while (stmt->nchildren) {
+        emit_stmt(stmt++);
+    }
+}
+
+// Emit the header of a function, whose first parameter is the site of the call
+static void emit_head(const struct function *const function, const size_t index)
+{
+    fprintf(emitter.out, "static int fn%zu(unsigned s", index);
+
+    for (uint32_t param = 0; param < function->nparams; ++param) {
+        fprintf(emitter.out, ", int p%u", param);
+    }
+
+    fputs(")", emitter.out);
+}
+
+// Emit a function. Its parameters are its first locals, already defined.
+static void emit_function(const struct function *const function, const size_t index)
+{
+    emit_head(function, index);
+    fprintf(emitter.out, "\n{\n");
+    emitter.depth = 1;
+
+    if (function->nlocals) {
+        fprintf(emitter.out, "    int l[%u] = { ", function->nlocals);
+
+        for (uint32_t param = 0; param < function->nparams; ++param) {
+            fprintf(emitter.out, "%sp%u", param ? ", " : "", param);
+        }
+
+        fprintf(emitter.out, "%s };\n    unsigned char d[%u] = { ",
+            function->nparams ? "" : "0", function->nlocals);
+
+        for (uint32_t param = 0; param < function->nparams; ++param) {
+            fprintf(emitter.out, "%s1", param ? ", " : "");
+        }
+
+        fprintf(emitter.out, "%s };\n\n", function->nparams ? "" : "0");
+    }
+
+    line("if (!enter(s)) {");
+    line("    return 0;");
+    line("}");
+    emit_block(function->node->children[3]);
+    line("depth--;");
+    line("return 0;");
+    fprintf(emitter.out, "}\n\n");
+}
+
+// Emit the tables of warnings: their kinds and messages, the line of each
+// site, and the counts by site and kind, those of program.warnings quiet
+static void emit_warnings(const struct program *const program, const int all_warnings)
+{
+    FILE *const out = emitter.out;
+
+    fprintf(out, "#define NSITES %zu\n#define ALL_WARNINGS %d\n\nenum {\n",
+        emitter.nsites ?: 1, all_warnings);
+
+    for (int kind = 0; kind < WARN_KINDS; ++kind) {
+        fprintf(out, "    %s,\n", warn_names[kind]);
+    }
+
+    fprintf(out, "    WARN_KINDS,\n};\n\nstatic const char *const messages[WARN_KINDS] = {\n");
+
+    for (int kind = 0; kind < WARN_KINDS; ++kind) {
+        fprintf(out, "    \"%s\",\n", warn_messages[kind]);
+    }
+
+    fprintf(out, "};\n\n// Source line of each site\nstatic const unsigned lines[NSITES] = {");
+
+    for (size_t idx = 0; idx < emitter.nsites; ++idx) {
+        fprintf(out, "%s%s%zu", idx ? "," : "", idx % 16 ? " " : "\n    ",
+            program_line(program, emitter.sites[idx]));
+    }
+
+    fprintf(out, "%s};\n\nstatic struct {\n"
+        "    unsigned long long count, shown;\n"
+        "    unsigned char quiet;  // Reported before running: never printed\n"
+        "} warnings[NSITES][WARN_KINDS] = {\n", emitter.nsites ? "\n" : " 0 ");
+
+    for (size_t idx = 0; idx < program->nwarnings; ++idx) {
+        fprintf(out, "    [%u][%s] = { 0, 0, 1 },\n", site(program->warnings[idx].site),
+            warn_names[program->warnings[idx].kind]);
+    }
+
+    fprintf(out, "};\n\n");
+}
+
+int emit_c(const struct program *const program, const char *const source_name,
+    const int all_warnings, FILE *out)
+{
+    const struct node *const unit = &program->root;
+
+    emitter.out = out;
+    emitter.depth = 0;
+    emitter.ntemps = 0;
+
+    if (!number_sites(program)) {
+        return EMIT_NOMEM;
+    }
+
+    fprintf(out, "// Generated from %s by interpret --emit-c\n", source_name);
+    fprintf(out, "//\n// Variables:\n");
+
+    for (size_t slot = 0; slot < program->nsymbols; ++slot) {
+        fprintf(out, "//   vars[%zu]: %.*s\n", slot,
+            (int) program->symbols[slot].len, program->symbols[slot].beg);
+    }
+
+    if (program->nfunctions) {
+        fprintf(out, "//\n// Functions:\n");
+    }
+
+    for (size_t idx = 0; idx < program->nfunctions; ++idx) {
+        const struct token *const name = program->functions[idx].node->children[1]->children[0]->token;
+
+        fprintf(out, "//   fn%zu: %.*s\n", idx, (int) (name->end - name->beg), name->beg);
+    }
+
+    fprintf(out, "\n#include <stdio.h>\n#include <stdlib.h>\n\n#define NSYMBOLS %zu\n"
+        "#define CALL_DEPTH %d\n", program->nsymbols ?: 1, RUN_CALL_DEPTH);
+    emit_warnings(program, all_warnings);
+    fprintf(out, "%s\n", runtime);
+
+    for (size_t idx = 0; idx < program->nfunctions; ++idx) {
+        emit_head(&program->functions[idx], idx);
+        fputs(";\n", out);
+    }
+
+    fputs(program->nfunctions ? "\n" : "", out);
+
+    for (size_t idx = 0; idx < program->nfunctions; ++idx) {
+        emit_function(&program->functions[idx], idx);
+    }
+
+    fprintf(out, "int main(void)\n{\n");
+    emitter.depth = 1;
+
+    // The first and last children of the unit are the file delimiters
+    for (size_t stmt_idx = 1; stmt_idx < unit->nchildren - 1; ++stmt_idx) {
+        emit_stmt(unit->children[stmt_idx]);
+    }
+
+    line("summarize();");
+    line("return 0;");
+    fprintf(out, "}\n");
+    free(emitter.sites);
+    emitter.sites = NULL;
+
+    return fflush(out) || ferror(out) ? EMIT_IO : EMIT_OK;
+}
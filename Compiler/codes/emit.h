@@ -0,0 +1,27 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include <stdio.h>
+
+// Forward declaration of the "program" structure (see opt.h)
+struct program;
+
+// Possible return codes of emit_c()
+enum {
+    EMIT_OK,     // The translation unit has been written
+    EMIT_IO,     // Writing it failed
+    EMIT_NOMEM,  // Memory allocation failed
+};
+
+// Function declaration: emit_c
+// Writes a standalone C translation unit that does what run() does for the
+// program, which must have been through optimize(). Its main() prints to
+// stdout exactly what run() prints to the output file: arrays grow the same
+// way, and undefined reads, out-of-bounds accesses and divisions by zero warn
+// the same way, once per site with a summary at the end unless all_warnings
+// is set. Only running out of memory may be reported differently.
+// Parameters:
+//   - const struct program *: the program to compile
+//   - const char *: name of the source file, for the header comment
+//   - int: print every warning (run_options.all_warnings)
+//   - FILE *: where the C code is written
+int emit_c(const struct program *, const char *source_name, int all_warnings, FILE *);
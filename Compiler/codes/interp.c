@@ -0,0 +1,183 @@
+#include "interp.h"
+#include "lex.h"
+#include "parse.h"
+#include "opt.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if __has_include(<pthread.h>)
+#include <pthread.h>
+#define mutex_init(mutex) pthread_mutex_init(mutex, NULL)
+#define mutex_destroy(mutex) pthread_mutex_destroy(mutex)
+#define mutex_lock(mutex) pthread_mutex_lock(mutex)
+#define mutex_unlock(mutex) pthread_mutex_unlock(mutex)
+typedef pthread_mutex_t mutex_t;
+#else
+// Without threads, runs cannot overlap
+#define mutex_init(mutex) ((void) (mutex))
+#define mutex_destroy(mutex) ((void) (mutex))
+#define mutex_lock(mutex) ((void) (mutex))
+#define mutex_unlock(mutex) ((void) (mutex))
+typedef int mutex_t;
+#endif
+
+struct interp_program {
+    struct program program;  // Its source and AST are the ones below
+    uint8_t *source;
+    struct token *tokens;    // The leaves of the AST point into them
+    int parsed;              // program.root is an AST to collapse
+    int optimized;           // program has the optimizer's tables to free
+    mutex_t lock;            // Taken by runs to use the specializations
+    struct spec_cache specs; // Specializations on the bindings of earlier runs
+};
+
+// Print where an error is and what it is, if there is somewhere to print it
+static void report(FILE *errors, const struct program *const program,
+    const struct token *const token, const char *const message)
+{
+    if (!errors) {
+        return;
+    } else if (token) {
+        fprintf(errors, "line %zu: %.*s: %s\n", program_line(program, token),
+            (int) (token->end - token->beg), token->beg, message);
+    } else {
+        fprintf(errors, "%s\n", message);
+    }
+}
+
+int interp_compile(const char *const source, const size_t size, const unsigned options,
+    struct interp_program **const compiled, FILE *errors)
+{
+    struct interp_program *const self = calloc(1, sizeof(struct interp_program));
+    size_t ntokens;
+    int status = INTERP_NOMEM;
+
+    *compiled = NULL;
+
+    if (!self || !(self->source = malloc(size ?: 1))) {
+        free(self);
+        report(errors, NULL, NULL, "malloc failed");
+        return INTERP_NOMEM;
+    }
+
+    memcpy(self->source, source, size);
+    mutex_init(&self->lock);
+    self->program = (struct program) { .source = self->source, .source_size = size,
+        .options = options };
+
+    const int lex_error = lex(self->source, size, &self->tokens, &ntokens);
+
+    if (lex_error == LEX_NOMEM) {
+        report(errors, NULL, NULL, "The lexer could not allocate memory.");
+        goto fail;
+    } else if (lex_error) {
+        report(errors, &self->program, &self->tokens[ntokens - 1], "unknown token");
+        status = INTERP_LEX;
+        goto fail;
+    }
+
+    const struct node root = parse(self->tokens, ntokens, NULL);
+    const int parse_status = parse_error(root);
+
+    if (parse_status == PARSE_NOMEM) {
+        report(errors, NULL, NULL, "The parser could not allocate memory.");
+        goto fail;
+    } else if (parse_status) {
+        report(errors, NULL, NULL, "syntax error");
+        status = INTERP_PARSE;
+        goto fail;
+    }
+
+    self->program.root = root;
+    self->parsed = 1;
+
+    const int opt_error = optimize(&self->program);
+
+    if (opt_error) {
+        report(errors, &self->program, opt_error == OPT_NOMEM ? NULL : self->program.error,
+            opt_messages[opt_error]);
+        status = opt_error == OPT_NOMEM ? INTERP_NOMEM : INTERP_INVALID;
+        goto fail;
+    }
+
+    self->optimized = 1;
+    *compiled = self;
+    return INTERP_OK;
+
+fail:
+    interp_free(self);
+    return status;
+}
+
+int interp_run(const struct interp_program *const compiled,
+    const struct spec_binding *const bindings, const size_t nbindings, FILE *out,
+    const struct run_options *const options, struct run_stats *stats)
+{
+    // The specializations are the only part of the program runs change
+    struct interp_program *const self = (struct interp_program *) compiled;
+    struct spec *spec = NULL;
+    struct run_stats own;
+    size_t bad;
+
+    // A specialization no run has built yet is built under the lock, so
+    // that runs with the same new bindings build it once
+    if (nbindings) {
+        mutex_lock(&self->lock);
+        const int error = spec_cache_get(&self->specs, &self->program, bindings, nbindings,
+            &spec, &bad);
+        mutex_unlock(&self->lock);
+
+        if (error == SPEC_UNKNOWN) {
+            fprintf(out, "-D %.*s: the name is not assigned a number at the top level of the program\n",
+                (int) bindings[bad].len, bindings[bad].name);
+            return INTERP_UNKNOWN;
+        } else if (error) {
+            fprintf(out, "malloc failed\n");
+            return INTERP_NOMEM;
+        }
+    }
+
+    stats = stats ?: &own;
+    run(spec ? &spec->program : &self->program, out, options, stats);
+
+    if (spec) {
+        mutex_lock(&self->lock);
+        spec_cache_release(&self->specs, spec);
+        mutex_unlock(&self->lock);
+    }
+
+    return stats->stopped ? INTERP_STOPPED : INTERP_OK;
+}
+
+void interp_spec_stats(const struct interp_program *const compiled, uint64_t *const hits,
+    uint64_t *const misses)
+{
+    struct interp_program *const self = (struct interp_program *) compiled;
+
+    mutex_lock(&self->lock);
+    *hits = self->specs.hits;
+    *misses = self->specs.misses;
+    mutex_unlock(&self->lock);
+}
+
+void interp_free(struct interp_program *const compiled)
+{
+    if (!compiled) {
+        return;
+    }
+
+    spec_cache_free(&compiled->specs);
+    mutex_destroy(&compiled->lock);
+
+    if (compiled->optimized) {
+        program_free(&compiled->program);
+    }
+
+    if (compiled->parsed) {
+        collapse_tree(compiled->program.root);
+    }
+
+    free(compiled->tokens);
+    free(compiled->source);
+    free(compiled);
+}
@@ -0,0 +1,58 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include "run.h"
+#include "spec.h"
+#include <stdio.h>
+#include <stdint.h>  // For fixed-width counters
+#include <stddef.h>  // For size_t type
+
+// The interpreter as a library (libinterp): compile a source once, then run
+// it any number of times, from any number of threads at once. Nothing is
+// printed but the program's output, and no file is written.
+
+// A compiled program: a copy of its source, its syntax tree and the
+// optimizer's tables. Running it changes none of them; each run keeps its
+// variables, compiled loops and thread pool to itself. The programs
+// specialized on bindings are kept with it, under a lock, and reused by the
+// runs with the same bindings (see SPEC_CACHE_ENTRIES).
+struct interp_program;
+
+// Possible return codes of interp_compile() and interp_run()
+enum {
+    INTERP_OK,
+    INTERP_NOMEM,    // Memory allocation failed
+    INTERP_LEX,      // The source has a token the lexer does not know
+    INTERP_PARSE,    // The source does not parse
+    INTERP_INVALID,  // The optimizer rejected the program (see opt_messages)
+    INTERP_UNKNOWN,  // A binding names no top-level "name = number;" assignment
+    INTERP_STOPPED,  // The run reached a limit of run_options
+};
+
+// Function declaration: interp_compile
+// Lexes, parses and optimizes `size` bytes of source, with the OPT_ bits of
+// `options`, into *program. Returns INTERP_OK, or why the source could not
+// be compiled after printing the reason, with its line, to `errors` (NULL:
+// nowhere).
+int interp_compile(const char *source, size_t size, unsigned options,
+    struct interp_program **, FILE *errors);
+
+// Function declaration: interp_run
+// Runs the program, printing its output to `out`. Each binding (see
+// spec_parse_binding()) replaces the number of a parameter's first top-level
+// "name = number;" as -D does: the program is specialized on them, or the
+// specialization an earlier run built for the same bindings is reused.
+// `options` and `stats` are as for run(), and may be NULL. Returns
+// INTERP_OK, INTERP_STOPPED, or why it could not run after printing the
+// reason to `out`. Runs that profile need a profile each, and only one run
+// at a time may sample.
+int interp_run(const struct interp_program *, const struct spec_binding *, size_t nbindings,
+    FILE *out, const struct run_options *, struct run_stats *);
+
+// Function declaration: interp_spec_stats
+// Sets *hits to the runs with bindings that reused a specialization of the
+// program, and *misses to those that specialized it.
+void interp_spec_stats(const struct interp_program *, uint64_t *hits, uint64_t *misses);
+
+// Function declaration: interp_free
+// Releases a compiled program, once no run uses it.
+void interp_free(struct interp_program *);
@@ -82,6 +82,21 @@ static sts_t token(const uint8_t c, uint8_t *const s) \
     } \
 }
 
+#define TOKEN_DEFINE_6(token, str) \
+static sts_t token(const uint8_t c, uint8_t *const s) \
+{ \
+    switch (*s) { \
+    case 0: return c == (str)[0] ? TR(1, HUNGRY) : REJECT; \
+    case 1: return c == (str)[1] ? TR(2, HUNGRY) : REJECT; \
+    case 2: return c == (str)[2] ? TR(3, HUNGRY) : REJECT; \
+    case 3: return c == (str)[3] ? TR(4, HUNGRY) : REJECT; \
+    case 4: return c == (str)[4] ? TR(5, HUNGRY) : REJECT; \
+    case 5: return c == (str)[5] ? TR(6, ACCEPT) : REJECT; \
+    case 6: return REJECT; \
+    default: abort(); \
+    } \
+}
+
 // Token recognition functions for specific token types
 static sts_t token_name(const uint8_t c, uint8_t *const s)
 {
@@ -234,6 +249,9 @@ TOKEN_DEFINE_5(token_prnt, "print")
 TOKEN_DEFINE_1(token_scol, ";")
 TOKEN_DEFINE_1(token_ques, "?")
 TOKEN_DEFINE_1(token_coln, ":")
+TOKEN_DEFINE_1(token_coma, ",")
+TOKEN_DEFINE_4(token_func, "func")
+TOKEN_DEFINE_6(token_rtrn, "return")
 
 // Array of token recognition functions
 static sts_t (*const token_funcs[token_COUNT])(const uint8_t, uint8_t *const) = {
@@ -273,6 +291,9 @@ static sts_t (*const token_funcs[token_COUNT])(const uint8_t, uint8_t *const) =
     token_scol,
     token_ques,
     token_coln,
+    token_coma,
+    token_func,
+    token_rtrn,
 };
 
 // Function to push a recognized token into the token list
@@ -306,7 +327,9 @@ static inline int push_token(struct token **const tokens,
 int lex(const uint8_t *const input, const size_t size,
     struct token **const tokens, size_t *const ntokens)
 {
-    static struct {
+    // Per call, so that calls in different threads, or after one that
+    // stopped at an unknown token, start afresh
+    struct {
         sts_t prev, curr;
     } statuses[token_COUNT] = {
         [0 ... token_COUNT - 1] = { STS_HUNGRY, STS_REJECT }
@@ -41,6 +41,9 @@ enum {
     token_SCOL,  // Semicolon ';'
     token_QUES,  // Question mark '?'
     token_COLN,  // Colon ':'
+    token_COMA,  // Comma ',' between call arguments
+    token_FUNC,  // Function definition keyword "func"
+    token_RTRN,  // Return keyword "return"
     token_COUNT, // Total number of token types (used for array sizing)
     token_FBEG,  // Special token: Marks the beginning of the file
     token_FEND,  // Special token: Marks the end of the file
@@ -1,12 +1,42 @@
 #include "lex.h"
 #include "parse.h"
+#include "opt.h"
 #include "run.h"
+#include "writer.h"
+#include "simd.h"
+#include "emit.h"
+#include "batch.h"
+#include "spec.h"
+#include "warn.h"
+#include "source.h"
+#include "stats.h"
+#include "array.h"
+#include "profile.h"
+#include "sample.h"
+#include "cache.h"
+#include "scripts.h"
+#include "server.h"
 
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+
+#ifdef _WIN32
 #include <windows.h>  // Windows-specific headers
+#include <process.h>  // _spawnvp
+#define make_directory(path) CreateDirectory(path, NULL)
+#else
+#include <spawn.h>     // posix_spawnp
+#include <sys/stat.h>  // mkdir
+#include <sys/wait.h>  // waitpid
+extern char **environ;
+#define MAX_PATH 4096
+#define make_directory(path) mkdir(path, 0777)
+#endif
 
 static void print(FILE *output_file, const struct token *const tokens,
     const size_t ntokens, const int error)
@@ -36,71 +66,756 @@ static void print(FILE *output_file, const struct token *const tokens,
     }
 }
 
-int main(int argc, char **argv)
+// Name the outputs of the file or directory at `path` after it: its last
+// component, without a trailing slash or a .txt extension
+static void name_output(const char *const path, char *const base_name, const size_t size)
 {
-    HANDLE hFile, Mapping;
-    LPVOID mapped;
-    DWORD size;
-    int exit_status = EXIT_FAILURE;
+    size_t len = strlen(path);
 
-    if (argc != 2) {
-        return fprintf(stderr, "Usage: %s <file>\n", argv[0]), exit_status;
+    while (len > 1 && (path[len - 1] == '/' || path[len - 1] == '\\')) {
+        len--;  // A directory given as dir/
     }
 
-    // Open the file
-    hFile = CreateFile(argv[1], GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) {
-        perror("CreateFile");
-        return exit_status;
+    size_t start = len;
+
+    while (start && path[start - 1] != '/' && path[start - 1] != '\\') {
+        start--;  // Extract the file name from the path
     }
 
-    // Get file size
-    size = GetFileSize(hFile, NULL);
-    if (size == 0) {
-        fprintf(stderr, "‘%s‘: The file is empty\n", argv[1]);
-        CloseHandle(hFile);
-        return exit_status;
+    snprintf(base_name, size, "%.*s", (int) (len - start), path + start);
+
+    char *const dot = strrchr(base_name, '.');
+    if (dot && strcmp(dot, ".txt") == 0) {
+        *dot = '\0'; // Remove the .txt extension
     }
+}
 
-    // Create file mapping
-    Mapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, size, NULL);
-    if (Mapping == NULL) {
-        perror("CreateFileMapping");
-        CloseHandle(hFile);
-        return exit_status;
+// Parse the value of a numeric option: decimal digits only, up to `max`.
+// Returns 0 on success, -1 with *value set to 0 otherwise.
+static int parse_number(const char *const text, const unsigned long long max,
+    unsigned long long *const value)
+{
+    char *end;
+
+    *value = 0;
+
+    if (*text < '0' || *text > '9') {
+        return -1;  // strtoull() would take blanks and signs
     }
 
-    // Map the file into memory
-    mapped = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, size);
-    if (mapped == NULL) {
-        perror("MapViewOfFile");
-        CloseHandle(Mapping);
-        CloseHandle(hFile);
-        return exit_status;
+    errno = 0;
+    *value = strtoull(text, &end, 10);
+
+    if (*end || errno || *value > max) {
+        *value = 0;
+        return -1;
     }
 
-    // Create the outputs directory if it doesn't exist
-    CreateDirectory("outputs", NULL);
+    return 0;
+}
 
-    // Construct the output file path
+// Report the optimizer's counters, and what they saved at run time, on stderr
+static void print_opt_stats(const struct opt_stats *const opt, const struct run_stats *const run)
+{
+    fprintf(stderr, "optimizer: %zu symbols (%zu unboxed scalars), %zu loops\n",
+        opt->symbols, opt->scalars, opt->loops);
+    fprintf(stderr, "bounds checks: %zu accesses in %zu loops proven in bounds; "
+        "%llu guards passed, %llu failed, %llu checks elided\n",
+        opt->bce_checks, opt->bce_loops,
+        (unsigned long long) run->bce_guards_passed,
+        (unsigned long long) run->bce_guards_failed,
+        (unsigned long long) run->bce_elided);
+    fprintf(stderr, "vectorized: %zu loops (%s kernels); "
+        "%llu entries ran element-wise over %llu iterations, %llu ran normally\n",
+        opt->vector_loops, simd_best()->name,
+        (unsigned long long) run->vector_runs,
+        (unsigned long long) run->vector_elements,
+        (unsigned long long) run->vector_fallbacks);
+    fprintf(stderr, "built-ins: %llu elements by kernels, %llu calls element by element\n",
+        (unsigned long long) run->bulk_elements,
+        (unsigned long long) run->bulk_fallbacks);
+    fprintf(stderr, "parallel: %zu loops; %llu entries ran on several threads over %llu iterations "
+        "(%llu steals), %llu ran serially\n",
+        opt->par_loops,
+        (unsigned long long) run->par_runs,
+        (unsigned long long) run->par_iterations,
+        (unsigned long long) run->par_steals,
+        (unsigned long long) run->par_fallbacks);
+    fprintf(stderr, "statements: %zu top-level statements can run alongside another one over "
+        "%zu levels; %llu ran in %llu groups at the same time\n",
+        opt->stmt_heavy,
+        opt->stmt_levels,
+        (unsigned long long) run->stmt_tasks,
+        (unsigned long long) run->stmt_groups);
+    fprintf(stderr, "tiers: %llu hot loops compiled (%llu failed), %llu entries to compiled loops; "
+        "%.3f ms walking the AST, %.3f ms in compiled loops\n",
+        (unsigned long long) run->tier_promotions,
+        (unsigned long long) run->tier_failures,
+        (unsigned long long) run->tier_entries,
+        run->tier0_ns / 1e6, run->tier1_ns / 1e6);
+    fprintf(stderr, "functions: %zu defined (%zu pure, %zu inlinable); %llu calls, "
+        "%llu answered from memo tables, %llu call sites inlined in compiled loops\n",
+        opt->functions, opt->pure, opt->inlinable,
+        (unsigned long long) run->calls,
+        (unsigned long long) run->memo_hits,
+        (unsigned long long) run->inlined);
+    fprintf(stderr, "governor: %llu steps\n", (unsigned long long) run->steps);
+}
+
+// Explain, on stderr, which loops can run in parallel and why the others cannot
+static void print_par_report(const struct program *const program)
+{
+    for (size_t loop_idx = 1; loop_idx < program->nloops; ++loop_idx) {
+        const struct loop_info *const loop = &program->loops[loop_idx];
+        const struct symbol *const symbol = &program->symbols[loop->par_slot];
+        const size_t line = program_line(program, loop->node->children[0]->token);
+
+        fprintf(stderr, "line %zu: %s loop ", line, loop->node->nt == NT_Whil ? "while" : "do-while");
+
+        switch (loop->par_reason) {
+        case PAR_OK:
+            fprintf(stderr, "can run in parallel\n");
+            break;
+
+        case PAR_DO_WHILE:
+            fprintf(stderr, "stays serial: do-while loops are not analysed\n");
+            break;
+
+        case PAR_NO_INDUCTION:
+            fprintf(stderr, "stays serial: no induction variable i with a loop invariant limit, "
+                "changed only by i = i + c\n");
+            break;
+
+        case PAR_INCREMENT:
+            fprintf(stderr, "stays serial: %.*s is not incremented by the last statement\n",
+                (int) symbol->len, symbol->beg);
+            break;
+
+        case PAR_PRINT:
+            fprintf(stderr, "stays serial: it prints\n");
+            break;
+
+        case PAR_NESTED:
+            fprintf(stderr, "stays serial: it contains a loop\n");
+            break;
+
+        case PAR_CALL:
+            fprintf(stderr, "stays serial: it calls a function\n");
+            break;
+
+        case PAR_SCALAR:
+            fprintf(stderr, "stays serial: it assigns %.*s, which iterations would share\n",
+                (int) symbol->len, symbol->beg);
+            break;
+
+        case PAR_INDEX:
+            fprintf(stderr, "stays serial: %.*s is indexed by something other than i + k\n",
+                (int) symbol->len, symbol->beg);
+            break;
+
+        case PAR_FUNCTION:
+            fprintf(stderr, "stays serial: it is in a function body\n");
+            break;
+
+        case PAR_CARRIED:
+            fprintf(stderr, "stays serial: %.*s is written and accessed at another offset, "
+                "so iterations may depend on each other\n", (int) symbol->len, symbol->beg);
+            break;
+
+        default:
+            fprintf(stderr, "stays serial: it divides by something that may be zero\n");
+        }
+    }
+}
+
+// Report the warnings every run of their site prints, in the output file
+static void print_warnings(const struct program *const program, FILE *output_file)
+{
+    for (size_t idx = 0; idx < program->nwarnings; ++idx) {
+        const struct token *const site = program->warnings[idx].site;
+        const int len = (int) (site->end - site->beg);
+
+        fprintf(output_file, "line %zu: %s", program_line(program, site),
+            warn_messages[program->warnings[idx].kind]);
+
+        switch (program->warnings[idx].kind) {
+        case WARN_UNDEFINED:
+        case WARN_NO_ARRAY:
+            fprintf(output_file, " (%.*s is never assigned)\n", len, site->beg);
+            break;
+
+        case WARN_DIVIDE:
+            fprintf(output_file, " (the divisor is 0)\n");
+            break;
+
+        default:
+            fprintf(output_file, " (%.*s is not a function taking these arguments)\n", len, site->beg);
+        }
+    }
+}
+
+// Report what the partial evaluator did for -D on stderr
+static void print_spec_stats(const struct spec_stats *const spec)
+{
+    fprintf(stderr, "specialized: %zu parameters bound, %zu reads and %zu operators replaced by "
+        "constants, %zu arms dropped, %zu loops unrolled into %zu copies\n",
+        spec->bound, spec->reads, spec->folds, spec->arms, spec->unrolled, spec->iterations);
+}
+
+// Bind the -D parameters of a program, reporting errors in the output file.
+// Returns the specialized program, or NULL. The program runs once, so the
+// cache only holds its specialization, and never reuses it.
+static struct spec *bind_parameters(struct spec_cache *const cache,
+    const struct program *const program, const struct spec_binding *const bindings,
+    const size_t nbindings, FILE *output_file)
+{
+    struct spec *spec;
+    size_t bad;
+    const int error = spec_cache_get(cache, program, bindings, nbindings, &spec, &bad);
+
+    if (error == SPEC_UNKNOWN) {
+        fprintf(output_file, "-D %.*s: the name is not assigned a number at the top level of the program\n",
+            (int) bindings[bad].len, bindings[bad].name);
+    } else if (error) {
+        fprintf(output_file, "malloc failed\n");
+    }
+
+    return spec;
+}
+
+// Write the program as C to outputs/<base_name>.c and, if `compile` is set,
+// build outputs/<base_name> from it with the system C compiler ($CC, or cc).
+// Returns 0 on success; the outcome is reported in the output file.
+// Run a command from its arguments, with no shell in between, and wait for
+// it. Returns its exit status, or -1 if it could not be run or was killed.
+static int run_command(char *const argv[])
+{
+#ifdef _WIN32
+    return (int) _spawnvp(_P_WAIT, argv[0], (const char *const *) argv);
+#else
+    pid_t pid;
+    int status;
+
+    if (posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ)) {
+        return -1;
+    }
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+}
+
+static int emit_program(const struct program *const program, const char *const input_path,
+    const char *const base_name, const int compile, const int all_warnings, FILE *output_file)
+{
+    char c_path[MAX_PATH], exe_path[MAX_PATH];
+    snprintf(c_path, MAX_PATH, "outputs/%s.c", base_name);
+
+    FILE *const c_file = fopen(c_path, "w");
+    if (!c_file) {
+        fprintf(output_file, "Could not open %s\n", c_path);
+        return -1;
+    }
+
+    const int error = emit_c(program, input_path, all_warnings, c_file);
+    if (fclose(c_file) || error) {
+        fprintf(output_file, "Could not write %s\n", c_path);
+        return -1;
+    }
+
+    fprintf(output_file, "C code saved to %s\n", c_path);
+
+    if (!compile) {
+        return 0;
+    }
+
+    // $CC is split into words, as make does, but goes through no shell: the
+    // paths, made from the name of the input file, are passed as they are
+    char cc[MAX_PATH], *argv[32 + 5];
+    size_t argc = 0;
+
+    snprintf(cc, sizeof(cc), "%s", getenv("CC") ? getenv("CC") : "cc");
+    snprintf(exe_path, MAX_PATH, "outputs/%s", base_name);
+
+    for (char *word = strtok(cc, " \t"); word && argc < 32; word = strtok(NULL, " \t")) {
+        argv[argc++] = word;
+    }
+
+    if (!argc) {
+        argv[argc++] = "cc";
+    }
+
+    argv[argc++] = "-O2";
+    argv[argc++] = "-o";
+    argv[argc++] = exe_path;
+    argv[argc++] = c_path;
+    argv[argc] = NULL;
+
+    const int status = run_command(argv);
+    if (status < 0) {
+        fprintf(output_file, "The C compiler %s could not be run\n", argv[0]);
+        return -1;
+    } else if (status) {
+        fprintf(output_file, "The C compiler %s failed (status %d)\n", argv[0], status);
+        return -1;
+    }
+
+    fprintf(output_file, "Executable saved to outputs/%s\n", base_name);
+    return 0;
+}
+
+// Run the program once per parameter set of the file at batch_path, lane k
+// (from 1) printing to outputs/<base_name>_lane<k>.txt. Returns 0 on
+// success; the outcome is reported in the output file.
+static int run_batch_file(const struct program *const program, const char *const batch_path,
+    const char *const base_name, const struct run_options *const run_options, FILE *output_file)
+{
+    FILE *const batch_file = fopen(batch_path, "rb");
+    if (!batch_file) {
+        fprintf(output_file, "Could not open %s\n", batch_path);
+        return -1;
+    }
+
+    // Read the whole parameter file
+    char *text = NULL;
+    size_t len = 0, allocated = 0, got;
+
+    do {
+        if (len == allocated) {
+            char *const tmp = realloc(text, allocated = allocated ? 2 * allocated : 4096);
+            if (!tmp) {
+                free(text);
+                fclose(batch_file);
+                fprintf(output_file, "malloc failed\n");
+                return -1;
+            }
+            text = tmp;
+        }
+
+        got = fread(text + len, 1, allocated - len, batch_file);
+        len += got;
+    } while (got);
+
+    fclose(batch_file);
+
+    struct batch batch;
+    size_t error_line;
+    const int error = batch_load(program, text, len, &batch, &error_line);
+    free(text);
+
+    if (error == BATCH_SYNTAX) {
+        fprintf(output_file, "%s:%zu: expected name=value pairs with values from 0 to 2147483647\n",
+            batch_path, error_line);
+        return -1;
+    } else if (error == BATCH_UNKNOWN) {
+        fprintf(output_file, "%s:%zu: a name is not assigned a number at the top level of the program\n",
+            batch_path, error_line);
+        return -1;
+    } else if (error) {
+        fprintf(output_file, "malloc failed\n");
+        return -1;
+    }
+
+    // Lanes run in groups, each lane writing to its own file
+    struct batch_stats stats = { 0 };
+    FILE *outputs[BATCH_LANES];
+    char lane_path[MAX_PATH];
+    int status = 0;
+
+    for (size_t first = 0; !status && first < batch.nlanes; first += BATCH_LANES) {
+        const size_t n = batch.nlanes - first < BATCH_LANES ? batch.nlanes - first : BATCH_LANES;
+        size_t opened = 0;
+
+        for (; opened < n; ++opened) {
+            snprintf(lane_path, MAX_PATH, "outputs/%s_lane%zu.txt", base_name, first + opened + 1);
+            if (!(outputs[opened] = fopen(lane_path, "w"))) {
+                fprintf(output_file, "Could not open %s\n", lane_path);
+                status = -1;
+                break;
+            }
+        }
+
+        if (!status) {
+            run_batch(program, &batch, first, n, outputs, run_options, &stats);
+        }
+
+        while (opened) {
+            fclose(outputs[--opened]);
+        }
+    }
+
+    if (!status) {
+        fprintf(output_file, "%zu lanes: %llu run together (%s kernels), %llu one at a time, "
+            "%llu stopped where the interpreter would crash\n",
+            batch.nlanes,
+            (unsigned long long) stats.simd_lanes, simd_best()->name,
+            (unsigned long long) stats.serial_lanes,
+            (unsigned long long) stats.stopped_lanes);
+        fprintf(output_file, "Outputs saved to outputs/%s_lane<k>.txt for k = 1 .. %zu\n",
+            base_name, batch.nlanes);
+    }
+
+    batch_free(&batch);
+    return status;
+}
+
+// Run every script of the manifest or directory at scripts_path on `workers`
+// threads, writing what each printed, in order, to outputs/<base_name>_scripts.txt
+// and the throughput to the terminal. Returns 0 if every script ran to the end.
+static int run_scripts_file(const char *const scripts_path, const char *const base_name,
+    const struct scripts_options *const options)
+{
+    struct scripts scripts;
+    struct scripts_stats stats;
     char output_file_path[MAX_PATH];
-    const char *input_file_name = strrchr(argv[1], '\\'); // Extract the file name from the path
-    if (!input_file_name) {
-        input_file_name = strrchr(argv[1], '/');
+    const int error = scripts_list(&scripts, scripts_path);
+
+    if (error == SCRIPTS_OPEN) {
+        perror(scripts_path);
+        return -1;
+    } else if (error == SCRIPTS_NONE) {
+        fprintf(stderr, "%s: there is no script to run\n", scripts_path);
+        return -1;
+    } else if (error) {
+        fprintf(stderr, "malloc failed\n");
+        return -1;
     }
-    if (!input_file_name) {
-        input_file_name = argv[1];
+
+    make_directory("outputs");
+    snprintf(output_file_path, MAX_PATH, "outputs/%s_scripts.txt", base_name);
+
+    FILE *const output_file = fopen(output_file_path, "w");
+    if (!output_file) {
+        perror("Failed to open output file");
+        scripts_free(&scripts);
+        return -1;
+    }
+
+    const int status = scripts_run(&scripts, options, output_file, &stats);
+
+    if (fclose(output_file)) {
+        fprintf(stderr, "Could not write %s\n", output_file_path);
+    }
+
+    const double seconds = stats.wall_ns / 1e9;
+
+    printf("The outputs of %zu scripts are saved to %s\n", scripts.count, output_file_path);
+    printf("%zu scripts in %.3f s on %u worker%s: %.1f scripts/s, %.2f MB/s of source, "
+        "%.2f MB/s of output\n", scripts.count, seconds,
+        stats.workers, stats.workers == 1 ? "" : "s",
+        seconds ? scripts.count / seconds : 0.0,
+        seconds ? stats.source_bytes / 1e6 / seconds : 0.0,
+        seconds ? stats.output_bytes / 1e6 / seconds : 0.0);
+    printf("%zu ran to the end, %zu were stopped by a limit, %zu did not compile, "
+        "%zu could not be read\n", stats.ok, stats.stopped, stats.rejected, stats.unreadable);
+    printf("The workers spent %.3f ms loading and compiling and %.3f ms running; the slowest "
+        "script was %s (%.3f ms)\n\n", stats.compile_ns / 1e6, stats.run_ns / 1e6,
+        scripts.paths[stats.slowest], stats.slowest_ns / 1e6);
+
+    scripts_free(&scripts);
+    return status;
+}
+
+// Serve the requests of interpret-client on the socket at serve_path with
+// `workers` threads, until SIGINT, SIGTERM or a shutdown request, then report
+// what was served. The limits of run_options cap those of every request.
+// Returns 0 once drained.
+static int serve_requests(const char *const serve_path, const unsigned workers,
+    const struct run_options *const limits)
+{
+    const struct server_options options = { .workers = workers, .limits = limits };
+    struct server_stats stats;
+
+    struct server *server;
+
+    make_directory("outputs");
+
+    const int status = server_open(&server, serve_path, &options);
+
+    if (status == SERVER_RUNNING) {
+        fprintf(stderr, "%s: another server is listening on it\n", serve_path);
+    } else if (status == SERVER_UNSUPPORTED) {
+        fprintf(stderr, "--serve: this system has no UNIX-domain sockets\n");
+    } else if (status == SERVER_NOMEM) {
+        fprintf(stderr, "--serve: the server could not start its workers\n");
+    } else if (status) {
+        perror(serve_path);
     } else {
-        input_file_name++; // Skip the slash
+        printf("Serving on %s; interpret-client <file> runs a program, "
+            "interpret-client --shutdown stops\n", serve_path);
+        fflush(stdout);
+        server_run(server, &stats);
+        printf("Served %llu requests on %u worker%s, %llu of which failed; %llu runs reused a "
+            "compiled program and %llu compiled one; connections without a request: %llu\n",
+            (unsigned long long) stats.requests, stats.workers, stats.workers == 1 ? "" : "s",
+            (unsigned long long) stats.failed, (unsigned long long) stats.program_hits,
+            (unsigned long long) stats.program_misses, (unsigned long long) stats.bad);
     }
 
-    // Remove the .txt extension from the input file name
-    char base_name[MAX_PATH];
-    strncpy(base_name, input_file_name, MAX_PATH);
-    char *dot = strrchr(base_name, '.');
-    if (dot && strcmp(dot, ".txt") == 0) {
-        *dot = '\0'; // Remove the .txt extension
+    return status ? -1 : 0;
+}
+
+// Write the statistics of --stats as JSON to stats_path, or to
+// outputs/<base_name>_stats.json if it is NULL
+static void write_stats(struct stats *const stats, const char *const input_path,
+    const char *const base_name, const char *stats_path)
+{
+    char default_path[MAX_PATH];
+
+    if (!stats_path) {
+        snprintf(default_path, MAX_PATH, "outputs/%s_stats.json", base_name);
+        stats_path = default_path;
+    }
+
+    FILE *const stats_file = fopen(stats_path, "w");
+    if (!stats_file) {
+        perror(stats_path);
+        return;
+    }
+
+    if (stats_write(stats, input_path, stats_file) | fclose(stats_file)) {
+        fprintf(stderr, "Could not write %s\n", stats_path);
+    } else {
+        printf("The statistics are saved to %s\n\n", stats_path);
+    }
+}
+
+// Write the profile of --profile to outputs/<base_name>_profile.txt, as an
+// annotated listing, and to outputs/<base_name>_profile.folded, as folded stacks
+static void write_profile(const struct profile *const profile,
+    const struct program *const program, const char *const base_name)
+{
+    char path[MAX_PATH];
+
+    for (int folded = 0; folded <= 1; ++folded) {
+        snprintf(path, MAX_PATH, "outputs/%s_profile.%s", base_name, folded ? "folded" : "txt");
+
+        FILE *const profile_file = fopen(path, "w");
+        if (!profile_file) {
+            perror(path);
+            continue;
+        }
+
+        if (folded) {
+            profile_write_folded(profile, program, profile_file);
+        } else {
+            profile_write_listing(profile, program, profile_file);
+        }
+
+        if (ferror(profile_file) | fclose(profile_file)) {
+            fprintf(stderr, "Could not write %s\n", path);
+        } else {
+            printf("The profile is saved to %s\n", path);
+        }
+    }
+}
+
+// Write the hot lines and loops of --sample to outputs/<base_name>_samples.txt
+static void write_samples(const struct samples *const samples,
+    const struct program *const program, const char *const base_name)
+{
+    char path[MAX_PATH];
+
+    snprintf(path, MAX_PATH, "outputs/%s_samples.txt", base_name);
+
+    FILE *const samples_file = fopen(path, "w");
+    if (!samples_file) {
+        perror(path);
+        return;
+    }
+
+    samples_write(samples, program, samples_file);
+
+    if (ferror(samples_file) | fclose(samples_file)) {
+        fprintf(stderr, "Could not write %s\n", path);
+    } else {
+        printf("The samples are saved to %s\n", path);
     }
+}
+
+int main(int argc, char **argv)
+{
+    struct source source;
+    struct stats stats;
+    struct stats *phases = NULL;  // Points to stats with --stats
+    const char *stats_path = NULL;  // Where to write them (NULL: outputs/<name>_stats.json)
+    int hw_counters = 0;            // Read the hardware counters around each phase too
+    int exit_status = EXIT_FAILURE;
+    const char *input_path = NULL;
+    size_t async_buffer = 0;  // 0 keeps the output synchronous
+    int opt_stats = 0;        // Report what the optimizer did
+    unsigned options = 0;     // OPT_ bits for the optimizer
+    struct run_options run_options = { .tier_threshold = RUN_TIER_THRESHOLD };
+    int emit = 0;             // 1: write C code instead of running, 2: also compile it
+    int par_report = 0;       // Explain which loops can run in parallel
+    int profiling = 0;        // Write what each statement of the run cost
+    unsigned sample_hz = 0;   // Sample the statement running this many times a second (0: never)
+    const char *batch_path = NULL;  // Run once per line of this file instead
+    const char *scripts_path = NULL;  // Run the scripts this manifest or directory lists instead
+    const char *serve_path = NULL;  // Serve requests on this socket instead
+    unsigned jobs = 0;              // Scripts or requests to run at once (0: one per CPU)
+    const char *cache_dir = NULL;   // Reuse the front end's work from this directory (NULL: never)
+    struct spec_binding bindings[argc];  // -D name=value
+    size_t nbindings = 0;
+    unsigned long long number;      // Value of a numeric option
+    int bad_number = 0;             // A numeric option has no valid value
+
+    // Parse command line options
+    for (int arg_idx = 1; arg_idx < argc && !bad_number; ++arg_idx) {
+        const char *const arg = argv[arg_idx];
+
+        if (!strcmp(arg, "--async-output")) {
+            async_buffer = WRITER_DEFAULT_BUFFER;
+        } else if (!strncmp(arg, "--async-output=", 15)) {
+            // 0 would leave the output synchronous, as if the option were not given
+            bad_number = parse_number(arg + 15, SIZE_MAX, &number) || !number;
+            async_buffer = number;
+        } else if (!strcmp(arg, "--opt-stats")) {
+            opt_stats = 1;
+        } else if (!strcmp(arg, "--no-vectorize")) {
+            options |= OPT_NO_VECTORIZE;
+        } else if (!strncmp(arg, "--threads=", 10)) {
+            bad_number = parse_number(arg + 10, UINT_MAX, &number);
+            run_options.threads = number ?: 1;
+        } else if (!strcmp(arg, "--par-report")) {
+            par_report = 1;
+        } else if (!strncmp(arg, "--batch=", 8)) {
+            batch_path = arg + 8;
+        } else if (!strncmp(arg, "--scripts=", 10)) {
+            scripts_path = arg + 10;
+        } else if (!strcmp(arg, "--serve")) {
+            serve_path = SERVER_SOCKET;
+        } else if (!strncmp(arg, "--serve=", 8)) {
+            serve_path = arg + 8;
+        } else if (!strncmp(arg, "--jobs=", 7)) {
+            bad_number = parse_number(arg + 7, UINT_MAX, &number);
+            jobs = number;
+        } else if (!strncmp(arg, "-D", 2)) {
+            const char *const text = arg[2] ? arg + 2 : arg_idx + 1 < argc ? argv[++arg_idx] : "";
+
+            if (spec_parse_binding(text, &bindings[nbindings++])) {
+                fprintf(stderr, "-D %s: expected name=value with a value from 0 to 2147483647\n", text);
+                input_path = scripts_path = serve_path = NULL;
+                break;
+            }
+        } else if (!strcmp(arg, "--emit-c")) {
+            emit = 1;
+        } else if (!strcmp(arg, "--aot")) {
+            emit = 2;
+        } else if (!strcmp(arg, "--memoize")) {
+            run_options.memoize = 1;
+        } else if (!strncmp(arg, "--max-steps=", 12)) {
+            bad_number = parse_number(arg + 12, UINT64_MAX, &number);
+            run_options.max_steps = number;
+        } else if (!strncmp(arg, "--time-limit=", 13)) {
+            bad_number = parse_number(arg + 13, UINT64_MAX, &number);
+            run_options.time_limit_ms = number;
+        } else if (!strncmp(arg, "--max-memory=", 13)) {
+            bad_number = parse_number(arg + 13, SIZE_MAX, &number);
+            run_options.max_array_bytes = number;
+        } else if (!strcmp(arg, "--stats")) {
+            phases = &stats;
+        } else if (!strncmp(arg, "--stats=", 8)) {
+            phases = &stats;
+            stats_path = arg + 8;
+        } else if (!strcmp(arg, "--hw-counters")) {
+            phases = &stats;
+            hw_counters = 1;
+        } else if (!strcmp(arg, "--profile")) {
+            profiling = 1;
+        } else if (!strcmp(arg, "--sample")) {
+            sample_hz = SAMPLE_DEFAULT_HZ;
+        } else if (!strncmp(arg, "--sample=", 9)) {
+            bad_number = parse_number(arg + 9, UINT_MAX, &number);
+            sample_hz = number ?: SAMPLE_DEFAULT_HZ;
+        } else if (!strcmp(arg, "--cache")) {
+            cache_dir = CACHE_DIRECTORY;
+        } else if (!strncmp(arg, "--cache=", 8)) {
+            cache_dir = arg + 8;
+        } else if (!strcmp(arg, "--all-warnings")) {
+            run_options.all_warnings = 1;
+        } else if (!strncmp(arg, "--tier-threshold=", 17)) {
+            bad_number = parse_number(arg + 17, UINT64_MAX, &number);
+            run_options.tier_threshold = number;
+        } else if (!input_path && arg[0] != '-') {
+            input_path = arg;
+        } else {
+            input_path = scripts_path = serve_path = NULL;
+            break;
+        }
+    }
+
+    // --scripts runs each script as the library does: no trace, no file of its own
+    const int scripts_only = !(batch_path || emit || profiling || sample_hz || cache_dir ||
+        phases || par_report || opt_stats || async_buffer);
+
+    // --serve takes the rest from each request, within its limits
+    const int per_request = options || nbindings || run_options.threads || run_options.memoize ||
+        run_options.all_warnings || run_options.tier_threshold != RUN_TIER_THRESHOLD;
+
+    if (bad_number) {
+        input_path = scripts_path = serve_path = NULL;
+    }
+
+    if (!!input_path + !!scripts_path + !!serve_path != 1 || (nbindings && batch_path) ||
+        (profiling && sample_hz) || (scripts_path && !scripts_only) ||
+        (serve_path && (!scripts_only || per_request))) {
+        return fprintf(stderr, "Usage: %s [--async-output[=BYTES]] [--opt-stats] [--no-vectorize] [--tier-threshold=N] [--threads=N] [--par-report] [--memoize] [--max-steps=N] [--time-limit=MS] [--max-memory=BYTES] [--all-warnings] [--cache[=DIR]] [--stats[=FILE]] [--hw-counters] [--profile | --sample[=HZ]] [-D name=value ...] [--emit-c | --aot] <file>\n"
+            "       %s [options] --batch=FILE <file>\n"
+            "       %s [--no-vectorize] [--tier-threshold=N] [--threads=N] [--memoize] [--max-steps=N] [--time-limit=MS] [--max-memory=BYTES] [--all-warnings] [-D name=value ...] [--jobs=N] --scripts=MANIFEST|DIR\n"
+            "       %s [--max-steps=N] [--time-limit=MS] [--max-memory=BYTES] [--jobs=N] --serve[=SOCKET]\n",
+            argv[0], argv[0], argv[0], argv[0]), exit_status;
+    }
+
+    if (serve_path) {
+        return serve_requests(serve_path, jobs, &run_options) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (scripts_path) {
+        char base_name[MAX_PATH / 2];
+        const struct scripts_options scripts_options = {
+            .workers = jobs, .options = options,
+            .bindings = bindings, .nbindings = nbindings, .run = &run_options,
+        };
+
+        // The workers already keep the CPUs busy
+        run_options.threads = run_options.threads ?: 1;
+        name_output(scripts_path, base_name, sizeof(base_name));
+        return run_scripts_file(scripts_path, base_name, &scripts_options) ?
+            EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    // Map the file into memory, or read it if it cannot be mapped
+    stats_start(phases, hw_counters);
+
+    if (phases && hw_counters && !phases->hw_counters) {
+        fprintf(stderr, "Hardware counters are unavailable (%s), reporting timings only\n",
+            stats_counters_error(phases));
+    }
+    stats_begin(phases, PHASE_LOAD);
+    const int source_error = source_open(&source, input_path);
+    stats_end(phases);
+    if (source_error == SOURCE_EMPTY) {
+        fprintf(stderr, "‘%s‘: The file is empty\n", input_path);
+        return exit_status;
+    } else if (source_error) {
+        perror(input_path);
+        return exit_status;
+    }
+
+    // Create the outputs directory if it doesn't exist
+    make_directory("outputs");
+
+    // Construct the output file path
+    // (half of MAX_PATH, which leaves room for the outputs/ prefix and suffixes)
+    char output_file_path[MAX_PATH];
+    char base_name[MAX_PATH / 2];
+    name_output(input_path, base_name, sizeof(base_name));
 
     // Construct the final output file name
     snprintf(output_file_path, MAX_PATH, "outputs/%s_output.txt", base_name);
@@ -109,41 +824,256 @@ int main(int argc, char **argv)
     FILE *output_file = fopen(output_file_path, "w");
     if (!output_file) {
         perror("Failed to open output file");
-        UnmapViewOfFile(mapped);
-        CloseHandle(Mapping);
-        CloseHandle(hFile);
+        source_close(&source);
         return exit_status;
     }
 
-    fprintf(output_file, "\n---*** Lexing ***---\n\n");
-    struct token *tokens;
-    size_t ntokens;
-    const int lex_error = lex((const uint8_t *)mapped, size, &tokens, &ntokens);
+    // Optionally let a writer thread own the output file while we interpret
+    FILE *const output_sink = output_file;
+    struct writer *writer = NULL;
+
+    if (async_buffer) {
+        writer = writer_open(output_sink, async_buffer);
 
-    if (!lex_error || lex_error == LEX_UNKNOWN_TOKEN) {
-        print(output_file, tokens, ntokens, lex_error);
-    } else if (lex_error == LEX_NOMEM) {
-        fprintf(output_file, "The lexer could not allocate memory.\n");
+        if (writer) {
+            output_file = writer_stream(writer);
+        } else {
+            fprintf(stderr, "Could not start the output writer, writing synchronously\n");
+        }
     }
 
-    if (!lex_error) {
-        fprintf(output_file, "\n\n\n---*** Parsing ***---\n\n");
-        const struct node root = parse(tokens, ntokens, output_file);
+    struct token *tokens = NULL;
+    size_t ntokens = 0;
+    int lex_error = 0;
+    struct node root = { 0 };
+    struct cache_entry cached = { 0 };
+    int cache_status = CACHE_MISS;
+    FILE *front = output_file;  // Where lex and parse print; a buffer to keep with --cache
+    char *listing = NULL;
+    size_t listing_size = 0;
+
+    stats_begin(phases, PHASE_LEX);
+
+    if (cache_dir) {
+        static const char *const found[] = {
+            [CACHE_HIT] = "hit", [CACHE_MISS] = "miss", [CACHE_STALE] = "stale",
+            [CACHE_CORRUPT] = "corrupt", [CACHE_NOMEM] = "miss",
+        };
+
+        make_directory(cache_dir);
+        cache_status = cache_load(&cached, cache_dir, source.text, source.size);
+
+        if (cache_status == CACHE_CORRUPT) {
+            fprintf(stderr, "--cache: the entry for %s is corrupt, rebuilding it\n", input_path);
+        }
+
+        if (phases) {
+            phases->cache = found[cache_status];
+        }
+    }
+
+    // A hit prints what lex and parse printed, and has the tree they built
+    if (cache_status == CACHE_HIT) {
+        fwrite(cached.listing, 1, cached.listing_size, output_file);
+        ntokens = cached.ntokens;
+        root = cached.root;
+    } else {
+        if (cache_dir) {
+            front = open_memstream(&listing, &listing_size) ?: output_file;
+        }
+
+        fprintf(front, "\n---*** Lexing ***---\n\n");
+        lex_error = lex(source.text, source.size, &tokens, &ntokens);
 
+        if (!lex_error || lex_error == LEX_UNKNOWN_TOKEN) {
+            print(front, tokens, ntokens, lex_error);
+        } else if (lex_error == LEX_NOMEM) {
+            fprintf(front, "The lexer could not allocate memory.\n");
+        }
+    }
+
+    stats_end(phases);
+
+    if (phases) {
+        phases->input_bytes = source.size;
+        phases->tokens = lex_error ? 0 : ntokens;
+    }
+
+    if (!lex_error && cache_status != CACHE_HIT) {
+        fprintf(front, "\n\n\n---*** Parsing ***---\n\n");
+        stats_begin(phases, PHASE_PARSE);
+        root = parse(tokens, ntokens, front);
+
+        if (front != output_file && !parse_error(root) && (fflush(front) ||
+            cache_store(&cached, cache_dir, source.text, source.size, root, tokens, ntokens,
+            listing, listing_size))) {
+            perror("--cache: could not store the entry");
+        }
+
+        stats_end(phases);
+    }
+
+    if (front != output_file) {
+        fclose(front);
+        fwrite(listing, 1, listing_size, output_file);
+        free(listing);
+    }
+
+    if (!lex_error) {
         if (!parse_error(root)) {
-            fprintf(output_file, "\n\n---*** Running ***---\n\n");
-            run(&root, output_file);
-            collapse_tree(root);
-            exit_status = EXIT_SUCCESS;
+            struct program program = { .root = root, .source = source.text,
+                .source_size = source.size, .options = options };
+            struct spec_cache cache = { 0 };
+            struct spec *spec = NULL;
+
+            if (phases) {
+                phases->nodes = stats_count_nodes(root);
+            }
+
+            stats_begin(phases, PHASE_OPTIMIZE);
+            const int opt_error = optimize(&program);
+
+            if (!opt_error && nbindings) {
+                spec = bind_parameters(&cache, &program, bindings, nbindings, output_file);
+            }
+
+            stats_end(phases);
+
+            if (opt_error == OPT_NOMEM) {
+                fprintf(output_file, "The optimizer could not allocate memory.\n");
+            } else if (opt_error) {
+                const struct token *const token = program.error;
+
+                fprintf(output_file, "line %zu: %.*s: %s\n", program_line(&program, token),
+                    (int) (token->end - token->beg), token->beg, opt_messages[opt_error]);
+            } else if (nbindings && !spec) {
+                program_free(&program);
+            } else {
+                // With -D, the program specialized on the bindings runs instead
+                const struct program *const target = spec ? &spec->program : &program;
+                struct profile profile;
+                struct samples samples;
+
+                // --all-warnings prints them all as they happen instead, as the
+                // interpreter did before it checked the program
+                if (target->nwarnings && !run_options.all_warnings) {
+                    fprintf(output_file, "\n\n---*** Checking ***---\n\n");
+                    print_warnings(target, output_file);
+                }
+
+                stats_begin(phases, PHASE_RUN);
+
+                if (batch_path) {
+                    fprintf(output_file, "\n\n---*** Running batch ***---\n\n");
+
+                    if (!run_batch_file(target, batch_path, base_name, &run_options, output_file)) {
+                        exit_status = EXIT_SUCCESS;
+                    }
+                } else if (emit) {
+                    fprintf(output_file, "\n\n---*** Emitting C ***---\n\n");
+
+                    if (!emit_program(target, input_path, base_name, emit == 2,
+                        run_options.all_warnings, output_file)) {
+                        exit_status = EXIT_SUCCESS;
+                    }
+                } else {
+                    if (par_report) {
+                        print_par_report(target);
+                    }
+
+                    fprintf(output_file, "\n\n---*** Running ***---\n\n");
+                    struct run_stats run_stats;
+
+                    if (profiling && profile_init(&profile, target)) {
+                        fprintf(stderr, "The profile could not allocate memory.\n");
+                    } else if (profiling) {
+                        run_options.profile = &profile;
+                    }
+
+                    if (sample_hz && samples_init(&samples, target, sample_hz)) {
+                        fprintf(stderr, "The samples could not allocate memory.\n");
+                    } else if (sample_hz && samples_start(&samples)) {
+                        fprintf(stderr, "--sample: this system has no SIGPROF timer\n");
+                        samples_free(&samples);
+                    } else if (sample_hz) {
+                        run_options.sample = 1;
+                    }
+
+                    run(target, output_file, &run_options, &run_stats);
+
+                    if (run_options.sample) {
+                        samples_stop(&samples);
+                    }
+
+                    if (opt_stats) {
+                        print_opt_stats(&target->stats, &run_stats);
+                    }
+
+                    if (opt_stats && spec) {
+                        print_spec_stats(&spec->stats);
+                    }
+
+                    exit_status = run_stats.stopped ? EXIT_FAILURE : EXIT_SUCCESS;
+                }
+
+                stats_end(phases);
+
+                if (run_options.profile) {
+                    write_profile(&profile, target, base_name);
+                    profile_free(&profile);
+                    run_options.profile = NULL;
+                }
+
+                if (run_options.sample) {
+                    write_samples(&samples, target, base_name);
+                    samples_free(&samples);
+                    run_options.sample = 0;
+                }
+
+                if (phases) {
+                    phases->variables = target->nsymbols;
+                    phases->array_bytes = array_peak();
+                }
+
+                spec_cache_release(&cache, spec);
+                spec_cache_free(&cache);
+                program_free(&program);
+            }
+
+            stats_begin(phases, PHASE_COLLAPSE);
+
+            if (cache_status == CACHE_HIT) {
+                cache_free(&cached);
+            } else {
+                collapse_tree(root);
+            }
+
+            stats_end(phases);
         }
     }
     
+    // Flush the writer and report how long we waited on it
+    if (writer) {
+        struct writer_stats stats;
+        writer_close(writer, &stats);
+        output_file = output_sink;
+
+        fprintf(stderr, "async output: %llu bytes in %llu handoffs, %llu stalls, "
+            "%.3f ms waiting on backpressure\n",
+            (unsigned long long) stats.bytes, (unsigned long long) stats.handoffs,
+            (unsigned long long) stats.stalls, stats.stall_ns / 1e6);
+    }
+
     // Print the output file location to the terminal
     printf("The output is saved to %s in the outputs folder\n\n", output_file_path);
+
     free(tokens);
-    UnmapViewOfFile(mapped);
-    CloseHandle(Mapping);
-    CloseHandle(hFile);
+    source_close(&source);
     fclose(output_file); // Close the output file
+
+    if (phases) {
+        write_stats(phases, input_path, base_name, stats_path);
+    }
+
     return exit_status;
 }
\ No newline at end of file
@@ -0,0 +1,2299 @@
+#include "opt.h"
+#include "lex.h"
+#include <stdlib.h>
+#include <string.h>
+
+const char *const opt_messages[OPT_ERRORS] = {
+    [OPT_NOMEM] = "the optimizer could not allocate memory",
+    [OPT_NESTED] = "functions can only be defined at the top level",
+    [OPT_PARAMETER] = "parameters must be distinct plain names, not used as arrays",
+    [OPT_REDEFINED] = "a function with this name is already defined",
+    [OPT_RETURN] = "return outside of a function",
+};
+
+// Iterate over the statements of a block: they are contiguous in memory and
+// the block ends at the first leaf (the closing brace or the end of file)
+#define foreach_stmt(stmt, first) \
+    for (struct node *stmt = (first); stmt->nchildren; ++stmt)
+
+// Scratch state shared by the passes of one optimize() call
+static _Thread_local struct {
+    struct program *program;
+
+    // Open-addressing hash table from names to slots
+    uint32_t *table;
+    size_t table_size;
+
+    // Per-symbol stamps, compared against the id of the loop being analysed
+    uint32_t *written;  // The symbol is assigned somewhere in the loop
+    uint32_t *unsafe;   // The array is written at an index that is not proven
+    uint32_t *seen;     // The array already has an entry in the loop's table
+    uint32_t *entry;    // Index of that entry
+
+    // Accesses that may be in bounds, pending the per-array decision
+    size_t ncandidates, allocated;
+    struct candidate {
+        struct node *aexp;
+        int k;
+    } *candidates;
+
+    // Names of the function being resolved (NULL at the top level): its
+    // locals, numbered in order, and the names it uses as arrays
+    struct function *function;
+    size_t nnames, names_allocated;
+    struct name {
+        const struct token *token;
+        uint8_t is_array;
+        uint32_t local;
+    } *names;
+
+    size_t warnings_allocated;  // Capacity of program->warnings
+    size_t statements_allocated;  // Capacity of program->statements
+} scan;
+
+// Functions whose bodies compiled loops inline have at most this many nodes
+// in their returned expression
+#define INLINE_NODES 64
+
+// First statement of the block inside a Unit, Cond, Elif, Else, Dowh or Whil node
+static struct node *block_of(const struct node *const node)
+{
+    switch (node->nt) {
+    case NT_Unit:
+        return node->children[1];
+
+    case NT_Else:
+    case NT_Dowh:
+        return node->children[2];
+
+    default:
+        return node->children[3];
+    }
+}
+
+// Look through parentheses and return the node below an Expr
+static const struct node *unwrap(const struct node *expr)
+{
+    while (expr->children[0]->nt == NT_Pexp) {
+        expr = expr->children[0]->children[1];
+    }
+
+    return expr->children[0];
+}
+
+// Check whether an expression is just the variable in `slot`
+static int is_var(const struct node *const expr, const uint32_t slot)
+{
+    const struct node *const node = unwrap(expr);
+
+    return node->nt == NT_Atom && node->children[0]->token->token == token_NAME &&
+        node->slot == slot;
+}
+
+// Check whether an expression is a number literal and get its value
+static int is_literal(const struct node *const expr, int *const value)
+{
+    const struct node *const node = unwrap(expr);
+
+    if (node->nt != NT_Atom || node->children[0]->token->token != token_NMBR) {
+        return 0;
+    }
+
+    const uint8_t *const beg = node->children[0]->token->beg;
+    const uint8_t *const end = node->children[0]->token->end;
+    int result = 0, mult = 1;
+
+    // Same conversion as eval_atom()
+    for (ptrdiff_t idx = end - beg - 1; idx >= 0; --idx, mult *= 10) {
+        result += mult * (beg[idx] - '0');
+    }
+
+    return *value = result, 1;
+}
+
+static uint32_t hash_name(const uint8_t *const beg, const ptrdiff_t len)
+{
+    uint32_t hash = 2166136261u;  // FNV-1a
+
+    for (ptrdiff_t idx = 0; idx < len; ++idx) {
+        hash = (hash ^ beg[idx]) * 16777619u;
+    }
+
+    return hash;
+}
+
+// Return the slot of a name, adding it to the symbol table if it is new
+static int intern(const struct token *const name, uint32_t *const slot)
+{
+    struct program *const program = scan.program;
+    const ptrdiff_t len = name->end - name->beg;
+
+    // Keep the table at most half full
+    if (2 * (program->nsymbols + 1) > scan.table_size) {
+        const size_t size = scan.table_size ? 2 * scan.table_size : 64;
+        uint32_t *const table = malloc(size * sizeof(uint32_t));
+        struct symbol *const symbols =
+            realloc(program->symbols, size / 2 * sizeof(struct symbol));
+
+        if (symbols) {
+            program->symbols = symbols;
+        }
+
+        if (!table || !symbols) {
+            return free(table), OPT_NOMEM;
+        }
+
+        memset(table, 0xff, size * sizeof(uint32_t));
+
+        for (uint32_t sym = 0; sym < program->nsymbols; ++sym) {
+            size_t at = hash_name(symbols[sym].beg, symbols[sym].len) & (size - 1);
+
+            while (table[at] != UINT32_MAX) {
+                at = (at + 1) & (size - 1);
+            }
+
+            table[at] = sym;
+        }
+
+        free(scan.table);
+        scan.table = table;
+        scan.table_size = size;
+    }
+
+    size_t at = hash_name(name->beg, len) & (scan.table_size - 1);
+
+    while (scan.table[at] != UINT32_MAX) {
+        const struct symbol *const sym = &program->symbols[scan.table[at]];
+
+        if (sym->len == len && !memcmp(sym->beg, name->beg, len)) {
+            return *slot = scan.table[at], OPT_OK;
+        }
+
+        at = (at + 1) & (scan.table_size - 1);
+    }
+
+    program->symbols[program->nsymbols] = (struct symbol) {
+        .beg = name->beg,
+        .len = len,
+        .is_array = 0,
+    };
+
+    scan.table[at] = *slot = program->nsymbols++;
+    return OPT_OK;
+}
+
+// Name, arity and number of leading array arguments of each built-in function
+static const struct {
+    const char *name;
+    uint8_t nargs, narrays;
+} builtins[] = {
+    [BUILTIN_FILL] = { "fill", 3, 1 },
+    [BUILTIN_COPY] = { "copy", 3, 2 },
+    [BUILTIN_SUM]  = { "sum",  2, 1 },
+    [BUILTIN_MIN]  = { "min",  2, 1 },
+    [BUILTIN_MAX]  = { "max",  2, 1 },
+    [BUILTIN_FIND] = { "find", 3, 1 },
+};
+
+// Check whether an expression is a plain variable name
+static int is_name(const struct node *const expr)
+{
+    const struct node *const node = expr->children[0];
+    return node->nt == NT_Atom && node->children[0]->token->token == token_NAME;
+}
+
+// Find the built-in function a call refers to
+static int builtin_of(const struct node *const call)
+{
+    const struct token *const name = call->children[0]->token;
+    const size_t len = name->end - name->beg;
+    const size_t nbuiltins = sizeof(builtins) / sizeof(*builtins);
+
+    for (size_t builtin = BUILTIN_NONE + 1; builtin < nbuiltins; ++builtin) {
+        if (strlen(builtins[builtin].name) != len || memcmp(builtins[builtin].name, name->beg, len)) {
+            continue;
+        }
+
+        if (call->nchildren - 3 != builtins[builtin].nargs) {
+            return BUILTIN_NONE;
+        }
+
+        for (size_t arg_idx = 0; arg_idx < builtins[builtin].narrays; ++arg_idx) {
+            if (!is_name(call_arg(call, arg_idx))) {
+                return BUILTIN_NONE;
+            }
+        }
+
+        return builtin;
+    }
+
+    return BUILTIN_NONE;
+}
+
+// The array written by a fill() or copy() statement, or UINT32_MAX
+static uint32_t bulk_target(const struct node *const exst)
+{
+    const struct node *const call = exst->children[0]->children[0];
+
+    if (call->nt != NT_Call || (call->aux != BUILTIN_FILL && call->aux != BUILTIN_COPY)) {
+        return UINT32_MAX;
+    }
+
+    return call_arg(call, 0)->children[0]->slot;
+}
+
+// Record an error about `token`
+static int opt_error(const int status, const struct token *const token)
+{
+    scan.program->error = token;
+    return status;
+}
+
+// Check that functions are only defined at the top level, and that return
+// statements are inside them
+static int check_placement(const struct node *const node, const int top_level,
+    const int in_function)
+{
+    if (!node->nchildren) {
+        return OPT_OK;
+    }
+
+    if (node->nt == NT_Func && !top_level) {
+        return opt_error(OPT_NESTED, node->children[0]->token);
+    }
+
+    if (node->nt == NT_Rtrn && !in_function) {
+        return opt_error(OPT_RETURN, node->children[0]->token);
+    }
+
+    for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+        const int status = check_placement(node->children[child_idx],
+            node->nt == NT_Unit || (top_level && node->nt == NT_Stmt),
+            in_function || node->nt == NT_Func);
+
+        if (status) {
+            return status;
+        }
+    }
+
+    return OPT_OK;
+}
+
+static int same_name(const struct token *const a, const struct token *const b)
+{
+    return a->end - a->beg == b->end - b->beg && !memcmp(a->beg, b->beg, a->end - a->beg);
+}
+
+// The name of a function
+static const struct token *function_name(const struct function *const function)
+{
+    return function->node->children[1]->children[0]->token;
+}
+
+// The user-defined function called `name`, or NULL
+static struct function *function_named(const struct token *const name)
+{
+    struct program *const program = scan.program;
+
+    for (size_t idx = 0; idx < program->nfunctions; ++idx) {
+        if (same_name(function_name(&program->functions[idx]), name)) {
+            return &program->functions[idx];
+        }
+    }
+
+    return NULL;
+}
+
+// Gather the functions defined at the top level, checking their parameters
+static int collect_functions(struct node *const unit)
+{
+    struct program *const program = scan.program;
+
+    foreach_stmt(stmt, block_of(unit)) {
+        const struct node *const func = stmt->children[0];
+        const struct node *const head = func->nt == NT_Func ? func->children[1] : NULL;
+
+        if (!head) {
+            continue;
+        }
+
+        if (function_named(head->children[0]->token)) {
+            return opt_error(OPT_REDEFINED, head->children[0]->token);
+        }
+
+        const uint32_t nparams = head->nchildren - 3;
+
+        for (uint32_t param = 0; param < nparams; ++param) {
+            const struct node *const arg = call_arg(head, param);
+
+            if (!is_name(arg)) {
+                return opt_error(OPT_PARAMETER, head->children[0]->token);
+            }
+
+            for (uint32_t other = 0; other < param; ++other) {
+                if (same_name(call_arg(head, other)->children[0]->children[0]->token,
+                    arg->children[0]->children[0]->token)) {
+                    return opt_error(OPT_PARAMETER, arg->children[0]->children[0]->token);
+                }
+            }
+        }
+
+        struct function *const tmp = realloc(program->functions,
+            (program->nfunctions + 1) * sizeof(struct function));
+
+        if (!tmp) {
+            return OPT_NOMEM;
+        }
+
+        program->functions = tmp;
+        program->functions[program->nfunctions++] = (struct function) {
+            .node = func,
+            .nparams = nparams,
+        };
+    }
+
+    return OPT_OK;
+}
+
+// Find or add a name of the function being resolved. New names are locals
+// unless `is_array`; a parameter found with `is_array` is marked, to be
+// reported.
+static struct name *add_name(const struct token *const token, const int is_array)
+{
+    for (size_t idx = 0; idx < scan.nnames; ++idx) {
+        if (same_name(scan.names[idx].token, token)) {
+            scan.names[idx].is_array |= is_array;
+            return &scan.names[idx];
+        }
+    }
+
+    if (scan.nnames == scan.names_allocated) {
+        const size_t allocated = scan.names_allocated ? 2 * scan.names_allocated : 16;
+        struct name *const tmp = realloc(scan.names, allocated * sizeof(struct name));
+
+        if (!tmp) {
+            return NULL;
+        }
+
+        scan.names = tmp;
+        scan.names_allocated = allocated;
+    }
+
+    scan.names[scan.nnames] = (struct name) {
+        .token = token,
+        .is_array = is_array,
+        .local = is_array ? 0 : scan.function->nlocals++,
+    };
+
+    return &scan.names[scan.nnames++];
+}
+
+// Add the names a function body uses as arrays: indexed, or passed to a
+// built-in function as an array
+static int find_arrays(const struct node *const node)
+{
+    if (!node->nchildren) {
+        return OPT_OK;
+    }
+
+    if (node->nt == NT_Aexp && !add_name(node->children[0]->token, 1)) {
+        return OPT_NOMEM;
+    }
+
+    if (node->nt == NT_Call && !function_named(node->children[0]->token)) {
+        const int builtin = builtin_of(node);
+
+        for (size_t arg_idx = 0; builtin && arg_idx < builtins[builtin].narrays; ++arg_idx) {
+            if (!add_name(call_arg(node, arg_idx)->children[0]->children[0]->token, 1)) {
+                return OPT_NOMEM;
+            }
+        }
+    }
+
+    for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+        const int status = find_arrays(node->children[child_idx]);
+
+        if (status) {
+            return status;
+        }
+    }
+
+    return OPT_OK;
+}
+
+// Resolve a variable name in an Atom or Assn node: a local of the function
+// being resolved, or else a variable of the program
+static int resolve_name(struct node *const node, const struct token *const name)
+{
+    if (!scan.function) {
+        return intern(name, &node->slot);
+    }
+
+    const struct name *const found = add_name(name, 0);
+
+    if (!found) {
+        return OPT_NOMEM;
+    } else if (found->is_array) {
+        return intern(name, &node->slot);
+    }
+
+    node->flags |= NF_LOCAL;
+    node->slot = found->local;
+    return OPT_OK;
+}
+
+static int resolve(struct node *);
+
+// Resolve the names of a function definition. Its parameters are its first
+// locals, and are never used as arrays.
+static int resolve_function(struct node *const func)
+{
+    struct node *const head = func->children[1];
+    struct function *function = scan.program->functions;
+    int status = OPT_OK;
+
+    while (function->node != func) {
+        ++function;
+    }
+
+    scan.function = function;
+    scan.nnames = 0;
+
+    for (uint32_t param = 0; !status && param < function->nparams; ++param) {
+        struct node *const atom = call_arg(head, param)->children[0];
+
+        status = add_name(atom->children[0]->token, 0) ? OPT_OK : OPT_NOMEM;
+        atom->flags |= NF_LOCAL;
+        atom->slot = param;
+    }
+
+    status = status ?: find_arrays(func);
+
+    for (uint32_t param = 0; !status && param < function->nparams; ++param) {
+        if (scan.names[param].is_array) {
+            status = opt_error(OPT_PARAMETER, scan.names[param].token);
+        }
+    }
+
+    foreach_stmt(stmt, block_of(func)) {
+        if (status) {
+            break;
+        }
+
+        status = resolve(stmt);
+    }
+
+    scan.function = NULL;
+    return status;
+}
+
+// Resolve the names used by Atom, Aexp and Assn nodes to slots (or to
+// locals, in functions), and calls to built-in or user-defined functions
+static int resolve(struct node *const node)
+{
+    if (!node->nchildren) {
+        return OPT_OK;
+    }
+
+    int status = OPT_OK;
+
+    switch (node->nt) {
+    case NT_Atom:
+        if (node->children[0]->token->token == token_NAME) {
+            status = resolve_name(node, node->children[0]->token);
+        }
+        break;
+
+    case NT_Aexp:
+        status = intern(node->children[0]->token, &node->slot);
+        break;
+
+    case NT_Assn: {
+        const struct node *const lhs = node->children[0];
+        status = lhs->nchildren ? intern(lhs->children[0]->token, &node->slot) :
+            resolve_name(node, lhs->token);
+    } break;
+
+    case NT_Func:
+        return resolve_function(node);
+    }
+
+    for (size_t child_idx = 0; !status && child_idx < node->nchildren; ++child_idx) {
+        status = resolve(node->children[child_idx]);
+    }
+
+    if (node->nt == NT_Call) {
+        const struct function *const function = function_named(node->children[0]->token);
+
+        if (function) {
+            node->aux = node->nchildren - 3 == function->nparams ? BUILTIN_USER : BUILTIN_NONE;
+            node->slot = function - scan.program->functions;
+            return status;
+        }
+
+        node->aux = builtin_of(node);
+
+        for (size_t arg_idx = 0; node->aux && arg_idx < builtins[node->aux].narrays; ++arg_idx) {
+            scan.program->symbols[call_arg(node, arg_idx)->children[0]->slot].is_array = 1;
+        }
+    } else if (node->nt == NT_Aexp) {
+        scan.program->symbols[node->slot].is_array = 1;
+    }
+
+    return status;
+}
+
+// Flag the Atom and Assn nodes of variables never used as arrays, which the
+// interpreter keeps unboxed
+static void mark_scalars(struct node *const node)
+{
+    if (!node->nchildren) {
+        return;
+    }
+
+    // Locals are not in the symbol table
+    if (((node->nt == NT_Assn && !node->children[0]->nchildren) ||
+        (node->nt == NT_Atom && node->children[0]->token->token == token_NAME)) &&
+        !(node->flags & NF_LOCAL)) {
+        node->flags |= scan.program->symbols[node->slot].is_array ? 0 : NF_SCALAR;
+    }
+
+    for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+        mark_scalars(node->children[child_idx]);
+    }
+}
+
+// Note how a function's subtree, and the functions it calls as known so
+// far, use arrays
+static void array_effects(const struct node *const node, struct function *const function)
+{
+    if (!node->nchildren) {
+        return;
+    }
+
+    switch (node->nt) {
+    case NT_Atom:
+        function->reads_arrays |= node->children[0]->token->token == token_NAME &&
+            !(node->flags & NF_LOCAL);
+        break;
+
+    case NT_Aexp:
+        function->reads_arrays = 1;
+        break;
+
+    case NT_Assn:
+        function->writes_arrays |= !(node->flags & NF_LOCAL);
+        break;
+
+    case NT_Call:
+        if (node->aux == BUILTIN_USER) {
+            function->reads_arrays |= scan.program->functions[node->slot].reads_arrays;
+            function->writes_arrays |= scan.program->functions[node->slot].writes_arrays;
+        } else if (node->aux != BUILTIN_NONE) {
+            function->reads_arrays = 1;
+            function->writes_arrays |= node->aux == BUILTIN_FILL || node->aux == BUILTIN_COPY;
+        }
+        break;
+    }
+
+    for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+        array_effects(node->children[child_idx], function);
+    }
+}
+
+// Check that evaluating an expression of a function cannot print a warning
+// or touch an array. `assigned` flags the locals certainly defined here.
+static int pure_expr(const struct node *const expr, const uint8_t *const assigned)
+{
+    const struct node *const node = expr->children[0];
+    int value;
+
+    switch (node->nt) {
+    case NT_Atom:
+        return node->children[0]->token->token == token_NMBR ||
+            ((node->flags & NF_LOCAL) && assigned[node->slot]);
+
+    case NT_Pexp:
+        return pure_expr(node->children[1], assigned);
+
+    case NT_Bexp:
+        if (node->children[1]->token->token == token_DIVI &&
+            !(is_literal(node->children[2], &value) && value > 0)) {
+            return 0;
+        }
+
+        return pure_expr(node->children[0], assigned) && pure_expr(node->children[2], assigned);
+
+    case NT_Uexp:
+        return pure_expr(node->children[1], assigned);
+
+    case NT_Texp:
+        return pure_expr(node->children[0], assigned) &&
+            pure_expr(node->children[2], assigned) && pure_expr(node->children[4], assigned);
+
+    case NT_Call:
+        if (node->aux != BUILTIN_USER || !scan.program->functions[node->slot].pure) {
+            return 0;
+        }
+
+        for (size_t arg_idx = 0; arg_idx + 3 < node->nchildren; ++arg_idx) {
+            if (!pure_expr(call_arg(node, arg_idx), assigned)) {
+                return 0;
+            }
+        }
+
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+// Check that the statements of a function block cannot print anything or
+// touch an array. A local is only known to be assigned after an assignment
+// that always runs before the read: assignments in the arms of an if or in
+// the body of a while loop do not count after it.
+static int pure_block(struct node *const first, uint8_t *const assigned, const size_t nlocals)
+{
+    foreach_stmt(stmt, first) {
+        const struct node *const node = stmt->children[0];
+
+        switch (node->nt) {
+        case NT_Assn:
+            if (!(node->flags & NF_LOCAL) || !pure_expr(node->children[2], assigned)) {
+                return 0;
+            }
+
+            assigned[node->slot] = 1;
+            break;
+
+        case NT_Exst:
+            if (!pure_expr(node->children[0], assigned)) {
+                return 0;
+            }
+            break;
+
+        case NT_Rtrn:
+            if (!pure_expr(node->children[1], assigned)) {
+                return 0;
+            }
+            break;
+
+        case NT_Ctrl:
+            for (size_t arm_idx = 0; arm_idx < node->nchildren; ++arm_idx) {
+                const struct node *const arm = node->children[arm_idx];
+                uint8_t inner[nlocals + 1];
+
+                // The body of a do-while loop always runs once, before its condition
+                if (arm->nt == NT_Dowh) {
+                    if (!pure_block(block_of(arm), assigned, nlocals) ||
+                        !pure_expr(arm->children[arm->nchildren - 2], assigned)) {
+                        return 0;
+                    }
+
+                    continue;
+                }
+
+                if (arm->nt != NT_Else && !pure_expr(arm->children[1], assigned)) {
+                    return 0;
+                }
+
+                memcpy(inner, assigned, nlocals);
+
+                if (!pure_block(block_of(arm), inner, nlocals)) {
+                    return 0;
+                }
+            }
+            break;
+
+        default:
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Check that an expression only reads parameters and literals and calls
+// nothing, using at most `*budget` nodes
+static int inlinable(const struct node *const expr, size_t *const budget)
+{
+    const struct node *const node = expr->children[0];
+
+    if (!*budget) {
+        return 0;
+    }
+
+    --*budget;
+
+    switch (node->nt) {
+    case NT_Atom:
+        return node->children[0]->token->token == token_NMBR ||
+            ((node->flags & NF_LOCAL) && node->slot < scan.function->nparams);
+
+    case NT_Pexp:
+    case NT_Uexp:
+        return inlinable(node->children[1], budget);
+
+    case NT_Bexp:
+        return inlinable(node->children[0], budget) && inlinable(node->children[2], budget);
+
+    case NT_Texp:
+        return inlinable(node->children[0], budget) && inlinable(node->children[2], budget) &&
+            inlinable(node->children[4], budget);
+
+    default:
+        return 0;
+    }
+}
+
+// Work out what the functions do (see struct function). Array effects and
+// purity go through calls, so they are iterated until nothing changes.
+// Every function starts pure and loses it once a call to an impure one, or
+// any of its own statements, rules it out.
+static void analyze_functions(void)
+{
+    struct program *const program = scan.program;
+    int changed = 1;
+
+    for (size_t idx = 0; idx < program->nfunctions; ++idx) {
+        program->functions[idx].pure = 1;
+    }
+
+    while (changed) {
+        changed = 0;
+
+        for (size_t idx = 0; idx < program->nfunctions; ++idx) {
+            struct function *const function = &program->functions[idx];
+            const uint8_t reads = function->reads_arrays, writes = function->writes_arrays;
+
+            array_effects(function->node, function);
+            changed |= reads != function->reads_arrays || writes != function->writes_arrays;
+        }
+    }
+
+    for (changed = 1; changed; ) {
+        changed = 0;
+
+        for (size_t idx = 0; idx < program->nfunctions; ++idx) {
+            struct function *const function = &program->functions[idx];
+            uint8_t assigned[function->nlocals + 1];
+
+            // Parameters are always defined
+            memset(assigned, 0, function->nlocals);
+            memset(assigned, 1, function->nparams);
+
+            if (function->pure && (function->reads_arrays || function->writes_arrays ||
+                !pure_block(block_of(function->node), assigned, function->nlocals))) {
+                function->pure = 0;
+                changed = 1;
+            }
+        }
+    }
+
+    for (size_t idx = 0; idx < program->nfunctions; ++idx) {
+        struct function *const function = &program->functions[idx];
+        const struct node *const body = block_of(function->node);
+        size_t budget = INLINE_NODES;
+
+        scan.function = function;
+
+        if (body->nchildren && body[0].children[0]->nt == NT_Rtrn && !body[1].nchildren &&
+            function->nparams <= INLINE_PARAMS && inlinable(body->children[0]->children[1], &budget)) {
+            function->inline_expr = body->children[0]->children[1];
+            program->stats.inlinable++;
+        }
+
+        program->stats.pure += function->pure;
+    }
+
+    scan.function = NULL;
+    program->stats.functions = program->nfunctions;
+}
+
+// Stamp every variable assigned anywhere in a block, nested blocks included
+static void stamp_writes(struct node *const first, const uint32_t stamp)
+{
+    foreach_stmt(stmt, first) {
+        const struct node *const node = stmt->children[0];
+
+        if (node->nt == NT_Assn) {
+            scan.written[node->slot] = stamp;
+        } else if (node->nt == NT_Exst && bulk_target(node) != UINT32_MAX) {
+            scan.written[bulk_target(node)] = stamp;
+        } else if (node->nt == NT_Ctrl) {
+            for (size_t arm_idx = 0; arm_idx < node->nchildren; ++arm_idx) {
+                stamp_writes(block_of(node->children[arm_idx]), stamp);
+            }
+        }
+    }
+}
+
+// Check that an expression has the same value on every iteration and can be
+// evaluated at loop entry without side effects (no warnings)
+static int is_invariant(const struct node *const expr, const uint32_t stamp)
+{
+    const struct node *const node = expr->children[0];
+
+    switch (node->nt) {
+    case NT_Atom:
+        return node->children[0]->token->token == token_NMBR ||
+            scan.written[node->slot] != stamp;
+
+    case NT_Pexp:
+        return is_invariant(node->children[1], stamp);
+
+    case NT_Bexp: {
+        const token_t op = node->children[1]->token->token;
+
+        return op != token_DIVI && op != token_MODU &&
+            is_invariant(node->children[0], stamp) &&
+            is_invariant(node->children[2], stamp);
+    }
+
+    case NT_Uexp:
+        return is_invariant(node->children[1], stamp);
+
+    case NT_Texp:
+        return is_invariant(node->children[0], stamp) &&
+            is_invariant(node->children[2], stamp) &&
+            is_invariant(node->children[4], stamp);
+
+    default:
+        return 0;
+    }
+}
+
+// Check whether an index expression is i, i + k or i - k for the induction variable
+static int index_offset(const struct node *const expr, const uint32_t ivar, int *const k)
+{
+    const struct node *const node = unwrap(expr);
+
+    if (is_var(expr, ivar)) {
+        return *k = 0, 1;
+    }
+
+    if (node->nt != NT_Bexp) {
+        return 0;
+    }
+
+    const token_t op = node->children[1]->token->token;
+    int value;
+
+    if (op == token_PLUS && is_var(node->children[0], ivar) &&
+        is_literal(node->children[2], &value)) {
+        return *k = value, 1;
+    } else if (op == token_PLUS && is_literal(node->children[0], &value) &&
+        is_var(node->children[2], ivar)) {
+        return *k = value, 1;
+    } else if (op == token_MINS && is_var(node->children[0], ivar) &&
+        is_literal(node->children[2], &value)) {
+        return *k = -value, 1;
+    }
+
+    return 0;
+}
+
+static int add_candidate(struct node *const aexp, const int k)
+{
+    if (scan.ncandidates >= scan.allocated) {
+        scan.allocated = (scan.allocated ?: 1) * 8;
+
+        struct candidate *const tmp = realloc(scan.candidates,
+            scan.allocated * sizeof(struct candidate));
+
+        if (!tmp) {
+            return OPT_NOMEM;
+        }
+
+        scan.candidates = tmp;
+    }
+
+    scan.candidates[scan.ncandidates++] = (struct candidate) { aexp, k };
+    return OPT_OK;
+}
+
+// Collect the array reads of an expression indexed by the induction variable
+static int collect_expr(struct node *const expr, const uint32_t ivar)
+{
+    struct node *const node = expr->children[0];
+    int k, status = OPT_OK;
+
+    switch (node->nt) {
+    case NT_Pexp:
+        return collect_expr(node->children[1], ivar);
+
+    case NT_Bexp:
+        return collect_expr(node->children[0], ivar) ?:
+            collect_expr(node->children[2], ivar);
+
+    case NT_Uexp:
+        return collect_expr(node->children[1], ivar);
+
+    case NT_Texp:
+        return collect_expr(node->children[0], ivar) ?:
+            collect_expr(node->children[2], ivar) ?:
+            collect_expr(node->children[4], ivar);
+
+    case NT_Aexp:
+        if (node->slot != ivar && index_offset(node->children[2], ivar, &k)) {
+            status = add_candidate(node, k);
+        }
+
+        return status ?: collect_expr(node->children[2], ivar);
+
+    default:
+        return OPT_OK;
+    }
+}
+
+static int collect_block(struct node *, uint32_t, uint32_t, int);
+
+// Collect candidate accesses in a statement. Only statements that run before
+// the increment (`proven`) may contribute; after it only array writes matter,
+// since they could grow (and, if that fails, release) an array.
+static int collect_stmt(struct node *const stmt, const uint32_t ivar,
+    const uint32_t stamp, const int proven)
+{
+    struct node *const node = stmt->children[0];
+    int status = OPT_OK;
+
+    switch (node->nt) {
+    case NT_Assn: {
+        struct node *const lhs = node->children[0];
+        int k;
+
+        if (lhs->nchildren) {
+            if (proven && lhs->slot != ivar && index_offset(lhs->children[2], ivar, &k)) {
+                status = add_candidate(lhs, k);
+            } else {
+                scan.unsafe[lhs->slot] = stamp;
+            }
+
+            if (!status && proven) {
+                status = collect_expr(lhs->children[2], ivar);
+            }
+        }
+
+        if (!status && proven) {
+            status = collect_expr(node->children[2], ivar);
+        }
+    } break;
+
+    case NT_Prnt:
+        if (proven) {
+            status = collect_expr(node->children[node->nchildren - 2], ivar);
+        }
+        break;
+
+    case NT_Exst:
+        if (bulk_target(node) != UINT32_MAX) {
+            scan.unsafe[bulk_target(node)] = stamp;
+        }
+        break;
+
+    case NT_Ctrl:
+        for (size_t arm_idx = 0; !status && arm_idx < node->nchildren; ++arm_idx) {
+            struct node *const arm = node->children[arm_idx];
+
+            if (proven && arm->nt != NT_Else) {
+                status = collect_expr(arm->nt == NT_Dowh ?
+                    arm->children[arm->nchildren - 2] : arm->children[1], ivar);
+            }
+
+            status = status ?: collect_block(block_of(arm), ivar, stamp, proven);
+        }
+        break;
+    }
+
+    return status;
+}
+
+static int collect_block(struct node *const first, const uint32_t ivar,
+    const uint32_t stamp, const int proven)
+{
+    foreach_stmt(stmt, first) {
+        const int status = collect_stmt(stmt, ivar, stamp, proven);
+
+        if (status) {
+            return status;
+        }
+    }
+
+    return OPT_OK;
+}
+
+// Find the increment "i = i + c" (c > 0) among the top-level statements of a body
+static const struct node *find_increment(struct node *const first, const uint32_t ivar,
+    int *const step)
+{
+    const struct node *increment = NULL;
+
+    foreach_stmt(stmt, first) {
+        const struct node *const assn = stmt->children[0];
+
+        if (assn->nt != NT_Assn || assn->slot != ivar) {
+            continue;
+        }
+
+        const struct node *const rhs = unwrap(assn->children[2]);
+
+        if (increment || assn->children[0]->nchildren || rhs->nt != NT_Bexp ||
+            rhs->children[1]->token->token != token_PLUS) {
+            return NULL;
+        }
+
+        if (!(is_var(rhs->children[0], ivar) && is_literal(rhs->children[2], step)) &&
+            !(is_literal(rhs->children[0], step) && is_var(rhs->children[2], ivar))) {
+            return NULL;
+        }
+
+        if (*step <= 0) {
+            return NULL;
+        }
+
+        increment = assn;
+    }
+
+    return increment;
+}
+
+// Count the assignments to a variable in a block, nested blocks included
+static size_t count_writes(struct node *const first, const uint32_t slot)
+{
+    size_t count = 0;
+
+    foreach_stmt(stmt, first) {
+        const struct node *const node = stmt->children[0];
+
+        if (node->nt == NT_Assn) {
+            count += node->slot == slot;
+        } else if (node->nt == NT_Exst) {
+            count += bulk_target(node) == slot;
+        } else if (node->nt == NT_Ctrl) {
+            for (size_t arm_idx = 0; arm_idx < node->nchildren; ++arm_idx) {
+                count += count_writes(block_of(node->children[arm_idx]), slot);
+            }
+        }
+    }
+
+    return count;
+}
+
+// Try to prove the array accesses of a loop in bounds
+static int prove_in_bounds(struct loop_info *const loop, struct node *const body,
+    const struct node *const increment, const uint32_t stamp)
+{
+    const uint32_t ivar = loop->ivar;
+
+    // Gather candidates before the increment, and unsafe writes everywhere
+    scan.ncandidates = 0;
+    size_t marked = 0;
+    int proven = 1, status = OPT_OK;
+
+    foreach_stmt(stmt, body) {
+        if (stmt->children[0] == increment) {
+            proven = 0;
+        }
+
+        if ((status = collect_stmt(stmt, ivar, stamp, proven))) {
+            return status;
+        }
+    }
+
+    // Keep the candidates on arrays that cannot be released inside the loop
+    for (size_t idx = 0; idx < scan.ncandidates; ++idx) {
+        struct node *const aexp = scan.candidates[idx].aexp;
+        const int k = scan.candidates[idx].k;
+
+        if (scan.unsafe[aexp->slot] == stamp) {
+            continue;
+        }
+
+        if (scan.seen[aexp->slot] != stamp) {
+            struct loop_array *const tmp = realloc(loop->arrays,
+                (loop->narrays + 1) * sizeof(struct loop_array));
+
+            if (!tmp) {
+                return OPT_NOMEM;
+            }
+
+            loop->arrays = tmp;
+            scan.seen[aexp->slot] = stamp;
+            scan.entry[aexp->slot] = loop->narrays;
+            loop->arrays[loop->narrays++] = (struct loop_array) { aexp->slot, k };
+        }
+
+        struct loop_array *const array = &loop->arrays[scan.entry[aexp->slot]];
+        array->kmax = k > array->kmax ? k : array->kmax;
+        loop->kmin = !marked++ || k < loop->kmin ? k : loop->kmin;
+
+        aexp->flags |= NF_INBOUNDS;
+        aexp->loop = loop - scan.program->loops;
+        aexp->aux = k;
+        scan.program->stats.bce_checks++;
+    }
+
+    if (loop->narrays) {
+        scan.program->stats.bce_loops++;
+    }
+
+    return OPT_OK;
+}
+
+// Find or add the entry of an array in a vector loop
+static struct vector_array *vector_array(struct vector_loop *const vector, const uint32_t slot)
+{
+    for (size_t idx = 0; idx < vector->narrays; ++idx) {
+        if (vector->arrays[idx].slot == slot) {
+            return &vector->arrays[idx];
+        }
+    }
+
+    struct vector_array *const tmp = realloc(vector->arrays,
+        (vector->narrays + 1) * sizeof(struct vector_array));
+
+    if (!tmp) {
+        return NULL;
+    }
+
+    vector->arrays = tmp;
+    vector->arrays[vector->narrays] = (struct vector_array) { .slot = slot };
+    return &vector->arrays[vector->narrays++];
+}
+
+// Check that an expression can be evaluated element-wise, recording the arrays
+// and variables it reads and counting its nodes in `ntemps`. Clears `*ok` if it
+// cannot.
+static int vector_expr(struct vector_loop *const vector, struct node *const expr,
+    const uint32_t ivar, const uint32_t stamp, size_t *const ntemps, int *const ok)
+{
+    struct node *const node = expr->children[0];
+    int k;
+
+    ++*ntemps;
+
+    switch (node->nt) {
+    case NT_Atom:
+        if (node->children[0]->token->token == token_NMBR || node->slot == ivar) {
+            return OPT_OK;
+        }
+
+        if (scan.written[node->slot] == stamp) {
+            return *ok = 0, OPT_OK;
+        }
+
+        for (size_t idx = 0; idx < vector->nscalars; ++idx) {
+            if (vector->scalars[idx] == node->slot) {
+                return OPT_OK;
+            }
+        }
+
+        uint32_t *const tmp = realloc(vector->scalars,
+            (vector->nscalars + 1) * sizeof(uint32_t));
+
+        if (!tmp) {
+            return OPT_NOMEM;
+        }
+
+        vector->scalars = tmp;
+        vector->scalars[vector->nscalars++] = node->slot;
+        return OPT_OK;
+
+    case NT_Pexp:
+        return vector_expr(vector, node->children[1], ivar, stamp, ntemps, ok);
+
+    case NT_Bexp: {
+        const token_t op = node->children[1]->token->token;
+
+        if (op == token_DIVI || op == token_MODU) {
+            return *ok = 0, OPT_OK;
+        }
+
+        return vector_expr(vector, node->children[0], ivar, stamp, ntemps, ok) ?:
+            vector_expr(vector, node->children[2], ivar, stamp, ntemps, ok);
+    }
+
+    case NT_Uexp:
+        return vector_expr(vector, node->children[1], ivar, stamp, ntemps, ok);
+
+    case NT_Texp:
+        return vector_expr(vector, node->children[0], ivar, stamp, ntemps, ok) ?:
+            vector_expr(vector, node->children[2], ivar, stamp, ntemps, ok) ?:
+            vector_expr(vector, node->children[4], ivar, stamp, ntemps, ok);
+
+    case NT_Aexp: {
+        if (node->slot == ivar || !index_offset(node->children[2], ivar, &k)) {
+            return *ok = 0, OPT_OK;
+        }
+
+        struct vector_array *const array = vector_array(vector, node->slot);
+
+        if (!array) {
+            return OPT_NOMEM;
+        }
+
+        array->kmin = !array->read || k < array->kmin ? k : array->kmin;
+        array->kmax = !array->read || k > array->kmax ? k : array->kmax;
+        array->read = 1;
+        array->live_in |= !array->written;
+        node->aux = k;
+        return OPT_OK;
+    }
+
+    default:
+        return *ok = 0, OPT_OK;
+    }
+}
+
+// Check whether a loop is element-wise (see struct vector_loop)
+static int vectorize(struct loop_info *const loop, struct node *const body,
+    const struct node *const increment, const int step, const uint32_t stamp)
+{
+    struct vector_loop vector = { 0 };
+    int ok = step == 1, status = OPT_OK;
+
+    foreach_stmt(stmt, body) {
+        struct node *const assn = stmt->children[0];
+        struct node *const lhs = assn->children[0];
+        struct vector_array *array;
+        size_t ntemps = 0;
+        int k;
+
+        if (!ok || status) {
+            break;
+        }
+
+        if (assn == increment) {
+            ok = !stmt[1].nchildren;  // The increment must come last
+            break;
+        }
+
+        if (assn->nt != NT_Assn || !lhs->nchildren || lhs->slot == loop->ivar ||
+            !index_offset(lhs->children[2], loop->ivar, &k) || k) {
+            ok = 0;
+            break;
+        }
+
+        // The value is computed before the element is written
+        if ((status = vector_expr(&vector, assn->children[2], loop->ivar, stamp, &ntemps, &ok))) {
+            break;
+        }
+
+        if (!(array = vector_array(&vector, lhs->slot))) {
+            status = OPT_NOMEM;
+            break;
+        }
+
+        array->written = 1;
+        lhs->aux = 0;
+        vector.ntemps = ntemps > vector.ntemps ? ntemps : vector.ntemps;
+        vector.nstmts++;
+    }
+
+    // A written array read at another offset would carry values between iterations
+    for (size_t idx = 0; ok && idx < vector.narrays; ++idx) {
+        const struct vector_array *const array = &vector.arrays[idx];
+        ok = !array->written || (array->kmin == 0 && array->kmax == 0);
+    }
+
+    if (!status && ok && vector.nstmts) {
+        if ((loop->vector = malloc(sizeof(struct vector_loop)))) {
+            *loop->vector = vector;
+            scan.program->stats.vector_loops++;
+            return OPT_OK;
+        }
+
+        status = OPT_NOMEM;
+    }
+
+    free(vector.arrays);
+    free(vector.scalars);
+    return status;
+}
+
+// Reject a loop for parallel execution, unless an earlier reason was found
+static void par_reject(struct loop_info *const loop, const uint8_t reason, const uint32_t slot)
+{
+    if (loop->par_reason == PAR_OK) {
+        loop->par_reason = reason;
+        loop->par_slot = slot;
+    }
+}
+
+// Record an access to element i + k of an array in a parallel loop. Writes
+// are recorded after the reads of their value.
+static int par_access(struct par_loop *const par, const uint32_t slot, const int k,
+    const int write, const int conditional)
+{
+    struct par_array *array = NULL;
+
+    for (size_t idx = 0; !array && idx < par->narrays; ++idx) {
+        array = par->arrays[idx].slot == slot ? &par->arrays[idx] : NULL;
+    }
+
+    if (!array) {
+        struct par_array *const tmp = realloc(par->arrays,
+            (par->narrays + 1) * sizeof(struct par_array));
+
+        if (!tmp) {
+            return OPT_NOMEM;
+        }
+
+        par->arrays = tmp;
+        array = &par->arrays[par->narrays++];
+        *array = (struct par_array) { .slot = slot, .kmin = k, .kmax = k };
+    }
+
+    array->kmin = k < array->kmin ? k : array->kmin;
+    array->kmax = k > array->kmax ? k : array->kmax;
+
+    // Until the analysis ends, `grow` means an unconditional write was seen
+    if (!array->grow && !(write && !conditional)) {
+        array->live_in = 1;
+    }
+
+    if (write) {
+        array->written = 1;
+        array->grow |= !conditional;
+    }
+
+    return OPT_OK;
+}
+
+// Check an expression of a parallel loop, recording what it reads
+static int par_expr(struct loop_info *const loop, struct par_loop *const par,
+    struct node *const expr, const uint32_t stamp, const int conditional)
+{
+    struct node *const node = expr->children[0];
+    const uint32_t ivar = loop->ivar;
+    int k, value;
+
+    switch (node->nt) {
+    case NT_Atom:
+        if (node->children[0]->token->token == token_NMBR || node->slot == ivar) {
+            return OPT_OK;
+        }
+
+        if (scan.written[node->slot] == stamp) {
+            par_reject(loop, scan.program->symbols[node->slot].is_array ? PAR_CARRIED : PAR_SCALAR,
+                node->slot);
+            return OPT_OK;
+        }
+
+        for (size_t idx = 0; idx < par->nscalars; ++idx) {
+            if (par->scalars[idx] == node->slot) {
+                return OPT_OK;
+            }
+        }
+
+        uint32_t *const tmp = realloc(par->scalars, (par->nscalars + 1) * sizeof(uint32_t));
+
+        if (!tmp) {
+            return OPT_NOMEM;
+        }
+
+        par->scalars = tmp;
+        par->scalars[par->nscalars++] = node->slot;
+        return OPT_OK;
+
+    case NT_Pexp:
+        return par_expr(loop, par, node->children[1], stamp, conditional);
+
+    case NT_Bexp: {
+        const token_t op = node->children[1]->token->token;
+
+        if ((op == token_DIVI || op == token_MODU) &&
+            !(is_literal(node->children[2], &value) && value)) {
+            par_reject(loop, PAR_DIVISION, 0);
+        }
+
+        return par_expr(loop, par, node->children[0], stamp, conditional) ?:
+            par_expr(loop, par, node->children[2], stamp, conditional);
+    }
+
+    case NT_Uexp:
+        return par_expr(loop, par, node->children[1], stamp, conditional);
+
+    case NT_Texp:
+        return par_expr(loop, par, node->children[0], stamp, conditional) ?:
+            par_expr(loop, par, node->children[2], stamp, conditional) ?:
+            par_expr(loop, par, node->children[4], stamp, conditional);
+
+    case NT_Aexp:
+        if (node->slot == ivar || !index_offset(node->children[2], ivar, &k)) {
+            par_reject(loop, PAR_INDEX, node->slot);
+            return OPT_OK;
+        }
+
+        node->aux = k;
+        return par_access(par, node->slot, k, 0, conditional);
+
+    default:
+        par_reject(loop, PAR_CALL, 0);
+        return OPT_OK;
+    }
+}
+
+// Check the statements of a block of a parallel loop
+static int par_block(struct loop_info *const loop, struct par_loop *const par,
+    struct node *const first, const struct node *const increment, const uint32_t stamp,
+    const int conditional)
+{
+    int status = OPT_OK;
+
+    foreach_stmt(stmt, first) {
+        struct node *const node = stmt->children[0];
+        int k;
+
+        if (status || loop->par_reason != PAR_OK) {
+            break;
+        }
+
+        if (node == increment) {
+            if (stmt[1].nchildren) {
+                par_reject(loop, PAR_INCREMENT, loop->ivar);
+            }
+
+            break;
+        }
+
+        switch (node->nt) {
+        case NT_Assn: {
+            struct node *const lhs = node->children[0];
+
+            if (!lhs->nchildren) {
+                par_reject(loop, PAR_SCALAR, node->slot);
+            } else if (!index_offset(lhs->children[2], loop->ivar, &k)) {
+                par_reject(loop, PAR_INDEX, node->slot);
+            } else {
+                // The value is computed before the element is written
+                lhs->aux = k;
+                status = par_expr(loop, par, node->children[2], stamp, conditional) ?:
+                    par_access(par, node->slot, k, 1, conditional);
+            }
+        } break;
+
+        case NT_Prnt:
+            par_reject(loop, PAR_PRINT, 0);
+            break;
+
+        case NT_Ctrl:
+            if (node->children[0]->nt != NT_Cond) {
+                par_reject(loop, PAR_NESTED, 0);
+                break;
+            }
+
+            for (size_t arm_idx = 0; !status && arm_idx < node->nchildren; ++arm_idx) {
+                struct node *const arm = node->children[arm_idx];
+
+                if (arm->nt != NT_Else) {
+                    status = par_expr(loop, par, arm->children[1], stamp, conditional || arm_idx);
+                }
+
+                status = status ?: par_block(loop, par, block_of(arm), NULL, stamp, 1);
+            }
+            break;
+
+        default:
+            par_reject(loop, PAR_CALL, 0);
+        }
+    }
+
+    return status;
+}
+
+// Check whether the iterations of a loop are independent (see struct par_loop)
+static int parallelize(struct loop_info *const loop, struct node *const body,
+    const struct node *const increment, const int step, const uint32_t stamp)
+{
+    struct par_loop par = { .step = step };
+    int status = par_block(loop, &par, body, increment, stamp, 0);
+
+    // Iterations would exchange values through an array written at i + k and
+    // accessed at any other offset
+    for (size_t idx = 0; !status && idx < par.narrays; ++idx) {
+        struct par_array *const array = &par.arrays[idx];
+
+        if (array->written && array->kmin != array->kmax) {
+            par_reject(loop, PAR_CARRIED, array->slot);
+        }
+
+        array->grow = array->written && !array->live_in && step == 1;
+    }
+
+    if (!status && loop->par_reason == PAR_OK) {
+        if ((loop->par = malloc(sizeof(struct par_loop)))) {
+            *loop->par = par;
+            scan.program->stats.par_loops++;
+            return OPT_OK;
+        }
+
+        status = OPT_NOMEM;
+    }
+
+    free(par.arrays);
+    free(par.scalars);
+    return status;
+}
+
+// Check whether a subtree calls a function that writes arrays
+static int calls_writer(const struct node *const node)
+{
+    if (!node->nchildren) {
+        return 0;
+    }
+
+    if (node->nt == NT_Call && node->aux == BUILTIN_USER &&
+        scan.program->functions[node->slot].writes_arrays) {
+        return 1;
+    }
+
+    for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+        if (calls_writer(node->children[child_idx])) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Recognise the induction variable of a while loop, then try to prove its
+// array accesses in bounds, to vectorize it and to run it in parallel
+static int analyze_loop(struct loop_info *const loop, const uint32_t stamp)
+{
+    struct node *const whil = (struct node *) loop->node;
+    struct node *const body = block_of(whil);
+    const struct node *const cond = unwrap(whil->children[1]);
+
+    if (cond->nt != NT_Bexp) {
+        return OPT_OK;
+    }
+
+    // Accept i < n, i <= n, n > i and n >= i
+    const token_t op = cond->children[1]->token->token;
+    const struct node *var, *limit;
+
+    if (op == token_LTHN || op == token_LTEQ) {
+        var = unwrap(cond->children[0]), limit = cond->children[2];
+    } else if (op == token_GTHN || op == token_GTEQ) {
+        var = unwrap(cond->children[2]), limit = cond->children[0];
+    } else {
+        return OPT_OK;
+    }
+
+    if (var->nt != NT_Atom || var->children[0]->token->token != token_NAME) {
+        return OPT_OK;
+    }
+
+    const uint32_t ivar = var->slot;
+    int step;
+    const struct node *const increment = find_increment(body, ivar, &step);
+
+    stamp_writes(body, stamp);
+
+    if (calls_writer(whil)) {
+        // Any array may grow, or be released, during the loop
+        for (uint32_t sym = 0; sym < scan.program->nsymbols; ++sym) {
+            scan.written[sym] = scan.unsafe[sym] = stamp;
+        }
+    }
+
+    if (!increment || count_writes(body, ivar) != 1 || !is_invariant(limit, stamp)) {
+        return OPT_OK;
+    }
+
+    loop->ivar = ivar;
+    loop->limit = limit;
+    loop->inclusive = op == token_LTEQ || op == token_GTEQ;
+    loop->par_reason = PAR_OK;
+
+    int status = prove_in_bounds(loop, body, increment, stamp);
+
+    if (!status && !(scan.program->options & OPT_NO_VECTORIZE)) {
+        status = vectorize(loop, body, increment, step, stamp);
+    }
+
+    return status ?: parallelize(loop, body, increment, step, stamp);
+}
+
+// Number the statements in pre-order, which is source order, storing the id
+// of each one in its slot
+static int number_statements(struct node *const node)
+{
+    struct program *const program = scan.program;
+
+    if (node->nchildren && node->nt == NT_Stmt) {
+        if (program->nstatements == scan.statements_allocated) {
+            const size_t allocated = scan.statements_allocated ? 2 * scan.statements_allocated : 64;
+            const struct node **const tmp = realloc(program->statements,
+                allocated * sizeof(struct node *));
+
+            if (!tmp) {
+                return OPT_NOMEM;
+            }
+
+            program->statements = tmp;
+            scan.statements_allocated = allocated;
+        }
+
+        node->slot = program->nstatements;
+        program->statements[program->nstatements++] = node;
+    }
+
+    for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+        const int status = number_statements(node->children[child_idx]);
+
+        if (status) {
+            return status;
+        }
+    }
+
+    return OPT_OK;
+}
+
+// Index the start of each line of the source
+static int index_lines(struct program *const program)
+{
+    program->nlines = 1;
+
+    for (size_t at = 0; at < program->source_size; ++at) {
+        program->nlines += program->source[at] == '\n';
+    }
+
+    if (!(program->lines = malloc(program->nlines * sizeof(const uint8_t *)))) {
+        return OPT_NOMEM;
+    }
+
+    program->lines[0] = program->source;
+
+    for (size_t at = 0, line = 1; at < program->source_size; ++at) {
+        if (program->source[at] == '\n') {
+            program->lines[line++] = &program->source[at + 1];
+        }
+    }
+
+    return OPT_OK;
+}
+
+// Number the loops in pre-order and analyse each while loop, except in
+// function bodies
+static int analyze_block(struct node *const first, const int in_function)
+{
+    struct program *const program = scan.program;
+    int status = OPT_OK;
+
+    foreach_stmt(stmt, first) {
+        struct node *const ctrl = stmt->children[0];
+
+        if (ctrl->nt != NT_Ctrl) {
+            continue;
+        }
+
+        for (size_t arm_idx = 0; !status && arm_idx < ctrl->nchildren; ++arm_idx) {
+            struct node *const arm = ctrl->children[arm_idx];
+
+            if ((arm->nt == NT_Whil || arm->nt == NT_Dowh) && program->nloops <= UINT16_MAX) {
+                struct loop_info *const tmp = realloc(program->loops,
+                    (program->nloops + 1) * sizeof(struct loop_info));
+
+                if (!tmp) {
+                    return OPT_NOMEM;
+                }
+
+                program->loops = tmp;
+                program->loops[program->nloops] = (struct loop_info) {
+                    .node = arm,
+                    .par_reason = in_function ? PAR_FUNCTION :
+                        arm->nt == NT_Whil ? PAR_NO_INDUCTION : PAR_DO_WHILE,
+                    .in_function = in_function,
+                    .stmt = stmt->slot,
+                };
+                arm->loop = program->nloops++;
+                program->stats.loops++;
+
+                if (arm->nt == NT_Whil && !in_function) {
+                    status = analyze_loop(&program->loops[arm->loop], arm->loop);
+                }
+            }
+
+            status = status ?: analyze_block(block_of(arm), in_function);
+        }
+
+        if (status) {
+            break;
+        }
+    }
+
+    return status;
+}
+
+// Variables touched by one top-level statement, collected by collect_deps()
+static _Thread_local struct {
+    uint32_t *read_stamp, *write_stamp;  // Per symbol: index + 1 of the last statement
+                                         // that read or wrote it
+    uint32_t *reads, *writes;            // The statement's variables, each listed once
+    size_t nreads, nwrites;
+} deps;
+
+// Record a variable read or written by the statement stamped `stamp`
+static void add_dep(uint32_t *const stamps, uint32_t *const list, size_t *const n,
+    const uint32_t slot, const uint32_t stamp)
+{
+    if (stamps[slot] != stamp) {
+        stamps[slot] = stamp;
+        list[(*n)++] = slot;
+    }
+}
+
+// Collect the variables a statement reads and writes, its loops and whether
+// it is heavy. Array elements count as the whole array, and a call to a
+// function that uses arrays counts as using all of them. Definitions do
+// nothing when they run.
+static void collect_deps(const struct node *const node, const uint32_t stamp,
+    struct stmt_info *const info)
+{
+    if (!node->nchildren || node->nt == NT_Func) {
+        return;
+    }
+
+    switch (node->nt) {
+    case NT_Atom:
+        if (node->children[0]->token->token == token_NAME) {
+            add_dep(deps.read_stamp, deps.reads, &deps.nreads, node->slot, stamp);
+        }
+        break;
+
+    case NT_Aexp:
+        add_dep(deps.read_stamp, deps.reads, &deps.nreads, node->slot, stamp);
+        break;
+
+    case NT_Assn:
+        add_dep(deps.write_stamp, deps.writes, &deps.nwrites, node->slot, stamp);
+        break;
+
+    case NT_Whil:
+    case NT_Dowh:
+        info->heavy = 1;
+        info->loops_end = node->loop >= info->loops_end ? (uint32_t) node->loop + 1 :
+            info->loops_end;
+        break;
+
+    case NT_Call:
+        info->heavy |= node->aux != BUILTIN_NONE;
+
+        if (node->aux == BUILTIN_FILL || node->aux == BUILTIN_COPY) {
+            add_dep(deps.write_stamp, deps.writes, &deps.nwrites,
+                call_arg(node, 0)->children[0]->slot, stamp);
+        } else if (node->aux == BUILTIN_USER) {
+            const struct function *const function = &scan.program->functions[node->slot];
+
+            for (uint32_t sym = 0; sym < scan.program->nsymbols; ++sym) {
+                if (!scan.program->symbols[sym].is_array) {
+                    continue;
+                }
+
+                if (function->writes_arrays) {
+                    add_dep(deps.write_stamp, deps.writes, &deps.nwrites, sym, stamp);
+                } else if (function->reads_arrays) {
+                    add_dep(deps.read_stamp, deps.reads, &deps.nreads, sym, stamp);
+                }
+            }
+        }
+        break;
+    }
+
+    for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+        collect_deps(node->children[child_idx], stamp, info);
+    }
+}
+
+// Level the top-level statements (see struct stmt_info). The table is only
+// kept when some level has two heavy statements that could run at the same time.
+static int schedule(struct program *const program)
+{
+    const struct node *const unit = &program->root;
+    const size_t nstmts = unit->nchildren > 2 ? unit->nchildren - 2 : 0;
+    const size_t nsymbols = program->nsymbols ?: 1;
+
+    // Loops past UINT16_MAX share id 0, and with it their tier state
+    if (nstmts < 2 || program->nloops > UINT16_MAX) {
+        return OPT_OK;
+    }
+
+    struct stmt_info *const stmts = calloc(nstmts, sizeof(struct stmt_info));
+    uint32_t *const write_level = calloc(nsymbols, sizeof(uint32_t));
+    uint32_t *const read_level = calloc(nsymbols, sizeof(uint32_t));
+    uint32_t *const nheavy = calloc(nstmts + 1, sizeof(uint32_t));  // Per level
+    int status = OPT_NOMEM;
+
+    deps.read_stamp = calloc(nsymbols, sizeof(uint32_t));
+    deps.write_stamp = calloc(nsymbols, sizeof(uint32_t));
+    deps.reads = malloc(nsymbols * sizeof(uint32_t));
+    deps.writes = malloc(nsymbols * sizeof(uint32_t));
+
+    if (stmts && write_level && read_level && nheavy &&
+        deps.read_stamp && deps.write_stamp && deps.reads && deps.writes) {
+        uint32_t nlevels = 0;
+
+        for (size_t stmt_idx = 0; stmt_idx < nstmts; ++stmt_idx) {
+            struct stmt_info *const info = &stmts[stmt_idx];
+            uint32_t level = 0;
+
+            info->loops_end = stmt_idx ? stmts[stmt_idx - 1].loops_end : 1;
+            deps.nreads = deps.nwrites = 0;
+            collect_deps(unit->children[stmt_idx + 1], (uint32_t) stmt_idx + 1, info);
+
+            // After the last writer of what it reads, and after every
+            // earlier access to what it writes
+            for (size_t idx = 0; idx < deps.nreads; ++idx) {
+                level = write_level[deps.reads[idx]] > level ? write_level[deps.reads[idx]] : level;
+            }
+
+            for (size_t idx = 0; idx < deps.nwrites; ++idx) {
+                const uint32_t slot = deps.writes[idx];
+
+                level = write_level[slot] > level ? write_level[slot] : level;
+                level = read_level[slot] > level ? read_level[slot] : level;
+            }
+
+            info->level = ++level;
+            nlevels = level > nlevels ? level : nlevels;
+            nheavy[level] += info->heavy;
+
+            for (size_t idx = 0; idx < deps.nreads; ++idx) {
+                const uint32_t slot = deps.reads[idx];
+                read_level[slot] = level > read_level[slot] ? level : read_level[slot];
+            }
+
+            for (size_t idx = 0; idx < deps.nwrites; ++idx) {
+                write_level[deps.writes[idx]] = level;
+            }
+        }
+
+        for (size_t stmt_idx = 0; stmt_idx < nstmts; ++stmt_idx) {
+            program->stats.stmt_heavy += stmts[stmt_idx].heavy && nheavy[stmts[stmt_idx].level] >= 2;
+        }
+
+        program->stats.stmt_levels = nlevels;
+
+        if (program->stats.stmt_heavy) {
+            program->nstmts = nstmts;
+            program->stmts = stmts;
+            program->nlevels = nlevels;
+        }
+
+        status = OPT_OK;
+    }
+
+    if (!program->stmts) {
+        free(stmts);
+    }
+
+    free(write_level);
+    free(read_level);
+    free(nheavy);
+    free(deps.read_stamp);
+    free(deps.write_stamp);
+    free(deps.reads);
+    free(deps.writes);
+    deps.read_stamp = deps.write_stamp = deps.reads = deps.writes = NULL;
+    return status;
+}
+
+// Mark the variables a subtree assigns, or fills or copies into: the locals
+// of its function if `local` is set, else the variables of the program
+static void mark_assigned(const struct node *const node, uint8_t *const assigned, const int local)
+{
+    if (!node->nchildren) {
+        return;
+    }
+
+    if (node->nt == NT_Assn && !(node->flags & NF_LOCAL) == !local) {
+        assigned[node->slot] = 1;
+    } else if (node->nt == NT_Exst && !local && bulk_target(node) != UINT32_MAX) {
+        assigned[bulk_target(node)] = 1;
+    }
+
+    for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+        mark_assigned(node->children[child_idx], assigned, local);
+    }
+}
+
+// Record that every run of `site` prints warning `kind`
+static int add_warning(const struct token *const site, const int kind)
+{
+    struct program *const program = scan.program;
+
+    if (program->nwarnings == scan.warnings_allocated) {
+        const size_t allocated = scan.warnings_allocated ? 2 * scan.warnings_allocated : 16;
+        struct warning *const tmp = realloc(program->warnings, allocated * sizeof(struct warning));
+
+        if (!tmp) {
+            return OPT_NOMEM;
+        }
+
+        program->warnings = tmp;
+        scan.warnings_allocated = allocated;
+    }
+
+    program->warnings[program->nwarnings++] = (struct warning) { site, kind };
+    return OPT_OK;
+}
+
+static int find_warnings(const struct node *, const uint8_t *, const uint8_t *);
+
+// Find the warnings of a call that is not invalid: those of the arguments it
+// evaluates, leaving out the names of arrays passed to a built-in function
+static int call_warnings(const struct node *const call, const uint8_t *const globals,
+    const uint8_t *const locals)
+{
+    const size_t skip = call->aux == BUILTIN_USER ? 0 : builtins[call->aux].narrays;
+    int status = OPT_OK;
+
+    for (size_t arg_idx = skip; !status && arg_idx < call->nchildren - 3u; ++arg_idx) {
+        status = find_warnings(call_arg(call, arg_idx), globals, locals);
+    }
+
+    return status;
+}
+
+// Find the warnings every run of a site in a subtree prints, given which
+// variables of the program and locals of the enclosing function are assigned
+// somewhere. A variable nothing assigns is undefined whenever it is read, a
+// division by the literal 0 always warns, and so does an invalid call, which
+// evaluates nothing.
+static int find_warnings(const struct node *const node, const uint8_t *const globals,
+    const uint8_t *const locals)
+{
+    if (!node->nchildren) {
+        return OPT_OK;
+    }
+
+    int status = OPT_OK, value;
+
+    switch (node->nt) {
+    case NT_Atom:
+        if (node->children[0]->token->token == token_NAME &&
+            !(node->flags & NF_LOCAL ? locals : globals)[node->slot]) {
+            status = add_warning(node->children[0]->token, WARN_UNDEFINED);
+        }
+        break;
+
+    case NT_Aexp:
+        if (!globals[node->slot]) {
+            status = add_warning(node->children[0]->token, WARN_NO_ARRAY);
+        }
+        break;
+
+    case NT_Bexp:
+        if (node->children[1]->token->token == token_DIVI &&
+            is_literal(node->children[2], &value) && !value) {
+            status = add_warning(node->children[1]->token, WARN_DIVIDE);
+        }
+        break;
+
+    case NT_Call:
+        if (node->aux == BUILTIN_NONE || node->aux == BUILTIN_FILL || node->aux == BUILTIN_COPY) {
+            return add_warning(node->children[0]->token, WARN_CALL);
+        }
+
+        return call_warnings(node, globals, locals);
+
+    case NT_Exst:
+        if (bulk_target(node) != UINT32_MAX) {
+            return call_warnings(node->children[0]->children[0], globals, locals);
+        }
+        break;
+
+    case NT_Assn: {
+        // The assigned element is not read
+        const struct node *const lhs = node->children[0];
+
+        return (lhs->nchildren ? find_warnings(lhs->children[2], globals, locals) : OPT_OK) ?:
+            find_warnings(node->children[2], globals, locals);
+    }
+
+    case NT_Func: {
+        // The parameters are the first locals, defined by the call
+        const struct function *function = scan.program->functions;
+
+        while (function->node != node) {
+            ++function;
+        }
+
+        uint8_t *const assigned = calloc(function->nlocals ?: 1, sizeof(uint8_t));
+
+        if (!assigned) {
+            return OPT_NOMEM;
+        }
+
+        memset(assigned, 1, function->nparams);
+        mark_assigned(node->children[3], assigned, 1);
+
+        foreach_stmt(stmt, block_of(node)) {
+            if ((status = find_warnings(stmt, globals, assigned))) {
+                break;
+            }
+        }
+
+        free(assigned);
+        return status;
+    }
+
+    default:
+        break;
+    }
+
+    for (size_t child_idx = 0; !status && child_idx < node->nchildren; ++child_idx) {
+        status = find_warnings(node->children[child_idx], globals, locals);
+    }
+
+    return status;
+}
+
+// Order warnings by site, then kind
+static int compare_warnings(const void *const a, const void *const b)
+{
+    const struct warning *const x = a, *const y = b;
+
+    if (x->site != y->site) {
+        return x->site < y->site ? -1 : 1;
+    }
+
+    return (x->kind > y->kind) - (x->kind < y->kind);
+}
+
+// Gather the warnings of the program, in the order of their sites in the
+// source (the tokens are in one array), each site and kind once
+static int collect_warnings(struct program *const program)
+{
+    uint8_t *const globals = calloc(program->nsymbols ?: 1, sizeof(uint8_t));
+
+    if (!globals) {
+        return OPT_NOMEM;
+    }
+
+    mark_assigned(&program->root, globals, 0);
+
+    const int status = find_warnings(&program->root, globals, NULL);
+    size_t kept = 0;
+
+    free(globals);
+
+    if (program->nwarnings > 1) {
+        qsort(program->warnings, program->nwarnings, sizeof(struct warning), compare_warnings);
+    }
+
+    for (size_t idx = 0; idx < program->nwarnings; ++idx) {
+        if (!kept || compare_warnings(&program->warnings[kept - 1], &program->warnings[idx])) {
+            program->warnings[kept++] = program->warnings[idx];
+        }
+    }
+
+    program->nwarnings = kept;
+    return status;
+}
+
+int optimize(struct program *const program)
+{
+    scan.program = program;
+    program->nsymbols = 0;
+    program->symbols = NULL;
+    program->nstmts = 0;
+    program->stmts = NULL;
+    program->nlevels = 0;
+    program->nstatements = 0;
+    program->statements = NULL;
+    program->nlines = 0;
+    program->lines = NULL;
+    program->nfunctions = 0;
+    program->functions = NULL;
+    program->nwarnings = 0;
+    program->warnings = NULL;
+    program->error = NULL;
+    program->stats = (struct opt_stats) { 0 };
+
+    // Loop id 0 means "no loop"
+    program->nloops = 1;
+    program->loops = calloc(1, sizeof(struct loop_info));
+
+    int status = !program->loops ? OPT_NOMEM : check_placement(&program->root, 0, 0) ?:
+        collect_functions(&program->root) ?: resolve(&program->root) ?:
+        number_statements(&program->root) ?: index_lines(program);
+    const size_t nsymbols = program->nsymbols ?: 1;
+
+    free(scan.table);
+    free(scan.names);
+    scan.table = NULL;
+    scan.table_size = 0;
+    scan.names = NULL;
+    scan.nnames = scan.names_allocated = 0;
+
+    if (!status) {
+        mark_scalars(&program->root);
+        analyze_functions();
+
+        for (size_t sym = 0; sym < program->nsymbols; ++sym) {
+            program->stats.scalars += !program->symbols[sym].is_array;
+        }
+
+        scan.written = calloc(nsymbols, sizeof(uint32_t));
+        scan.unsafe = calloc(nsymbols, sizeof(uint32_t));
+        scan.seen = calloc(nsymbols, sizeof(uint32_t));
+        scan.entry = calloc(nsymbols, sizeof(uint32_t));
+
+        status = scan.written && scan.unsafe && scan.seen && scan.entry ?
+            analyze_block(block_of(&program->root), 0) : OPT_NOMEM;
+
+        // Loops in functions are numbered after all the others, so that the
+        // loops of each top-level statement keep consecutive ids
+        for (size_t idx = 0; !status && idx < program->nfunctions; ++idx) {
+            status = analyze_block(block_of(program->functions[idx].node), 1);
+        }
+
+        status = status ?: schedule(program) ?: collect_warnings(program);
+    }
+
+    program->stats.symbols = program->nsymbols;
+
+    free(scan.written);
+    free(scan.unsafe);
+    free(scan.seen);
+    free(scan.entry);
+    free(scan.candidates);
+    scan.candidates = NULL;
+    scan.ncandidates = scan.allocated = 0;
+    scan.warnings_allocated = 0;
+    scan.statements_allocated = 0;
+
+    if (status) {
+        program_free(program);
+    }
+
+    return status;
+}
+
+void program_free(struct program *const program)
+{
+    for (size_t loop_idx = 0; program->loops && loop_idx < program->nloops; ++loop_idx) {
+        struct vector_loop *const vector = program->loops[loop_idx].vector;
+
+        if (vector) {
+            free(vector->arrays);
+            free(vector->scalars);
+            free(vector);
+        }
+
+        struct par_loop *const par = program->loops[loop_idx].par;
+
+        if (par) {
+            free(par->arrays);
+            free(par->scalars);
+            free(par);
+        }
+
+        free(program->loops[loop_idx].arrays);
+    }
+
+    free(program->loops);
+    free(program->symbols);
+    free(program->stmts);
+    free(program->functions);
+    free(program->warnings);
+    free(program->statements);
+    free(program->lines);
+    program->loops = NULL;
+    program->symbols = NULL;
+    program->stmts = NULL;
+    program->functions = NULL;
+    program->warnings = NULL;
+    program->statements = NULL;
+    program->lines = NULL;
+    program->nfunctions = 0;
+    program->nwarnings = 0;
+    program->nstatements = 0;
+    program->nlines = 0;
+    program->nstmts = 0;
+    program->nloops = 0;
+    program->nsymbols = 0;
+}
+
+size_t program_line(const struct program *const program, const struct token *const token)
+{
+    if (program->lines) {
+        return program_line_at(program, token->beg);
+    }
+
+    size_t line = 1;
+
+    for (const uint8_t *c = program->source; c < token->beg; ++c) {
+        line += *c == '\n';
+    }
+
+    return line;
+}
+
+// Where the subtree of `node` begins in the source, or NULL
+static const uint8_t *subtree_start(const struct program *const program,
+    const struct node *const node)
+{
+    if (!node->nchildren) {
+        const uint8_t *const beg = node->token ? node->token->beg : NULL;
+
+        return beg >= program->source && beg < program->source + program->source_size ? beg : NULL;
+    }
+
+    for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+        const uint8_t *const beg = subtree_start(program, node->children[child_idx]);
+
+        if (beg) {
+            return beg;
+        }
+    }
+
+    return NULL;
+}
+
+const uint8_t *program_statement_start(const struct program *const program, const uint32_t stmt)
+{
+    return subtree_start(program, program->statements[stmt]);
+}
+
+size_t program_line_at(const struct program *const program, const uint8_t *const at)
+{
+    size_t lo = 0, hi = program->nlines;
+
+    // The last line that starts at or before `at`
+    while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+
+        *(program->lines[mid] <= at ? &lo : &hi) = mid;
+    }
+
+    return lo + 1;
+}
+
+struct node *find_parameter(const struct program *const program, const char *const name,
+    const size_t len)
+{
+    const struct node *const unit = &program->root;
+    uint32_t slot = 0;
+
+    while (slot < program->nsymbols && ((size_t) program->symbols[slot].len != len ||
+        memcmp(program->symbols[slot].beg, name, len))) {
+        ++slot;
+    }
+
+    for (size_t stmt_idx = 1; slot < program->nsymbols && stmt_idx + 1 < unit->nchildren; ++stmt_idx) {
+        struct node *const assn = unit->children[stmt_idx]->children[0];
+
+        if (assn->nt == NT_Assn && assn->slot == slot && !assn->children[0]->nchildren &&
+            assn->children[2]->children[0]->nt == NT_Atom &&
+            assn->children[2]->children[0]->children[0]->token->token == token_NMBR) {
+            return assn;
+        }
+    }
+
+    return NULL;
+}
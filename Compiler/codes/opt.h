@@ -0,0 +1,277 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include "parse.h"
+#include <stdint.h>  // For fixed-width integer types
+#include <stddef.h>  // For size_t and ptrdiff_t
+
+// A distinct variable name; its index is the slot stored in the AST
+struct symbol {
+    const uint8_t *beg;  // Pointer to the name in the source
+    ptrdiff_t len;       // Length of the name
+    uint8_t is_array;    // Indexed somewhere, or passed to a built-in as an array;
+                         // otherwise the variable is stored unboxed
+};
+
+// An array whose accesses inside a loop were proven in bounds
+struct loop_array {
+    uint32_t slot;  // Variable slot of the array
+    int kmax;       // Largest constant offset added to the induction variable
+};
+
+// An array used by a vectorized loop
+struct vector_array {
+    uint32_t slot;    // Variable slot of the array
+    int kmin, kmax;   // Range of the constant offsets it is read at (0, 0 if never read)
+    uint8_t read;     // Some expression of the loop reads it
+    uint8_t live_in;  // Some read happens before the loop writes the element (so it
+                      // sees a value from before the loop)
+    uint8_t written;  // The loop assigns its elements (always at offset 0)
+};
+
+// An element-wise loop: every top-level statement before a final "i = i + 1"
+// assigns x[i] from an expression of literals, loop invariant variables, i
+// itself and elements a[i + k], with no division. Arrays the loop writes are
+// only ever read at offset 0, so iterations are independent and each
+// statement can run over a whole range of i at once.
+struct vector_loop {
+    size_t nstmts;                // Statements before the increment
+    size_t ntemps;                // Scratch rows needed by the largest expression
+    size_t narrays;
+    struct vector_array *arrays;
+    size_t nscalars;
+    uint32_t *scalars;            // Slots of the loop invariant variables read
+};
+
+// An array used by a parallel loop
+struct par_array {
+    uint32_t slot;    // Variable slot of the array
+    int kmin, kmax;   // Range of the constant offsets it is accessed at (equal if written)
+    uint8_t written;  // The loop assigns its elements
+    uint8_t grow;     // Every iteration assigns it before reading it, so it may grow on
+                      // entry as the serial loop would grow it (step 1 only)
+    uint8_t live_in;  // Some access may happen before the first unconditional write
+};
+
+// A loop whose iterations are independent: the body only assigns elements
+// x[i + k] (each array always at the same k), possibly under if/elif/else,
+// before a final "i = i + step". Arrays it writes are only accessed at that
+// offset, and other arrays only at offsets from i. Nothing can warn once the
+// entry checks hold, since there is no print, call or nested loop, and only
+// nonzero literals are divided by.
+struct par_loop {
+    int step;                     // Increment of the induction variable
+    size_t narrays;
+    struct par_array *arrays;
+    size_t nscalars;
+    uint32_t *scalars;            // Slots of the loop invariant variables read
+};
+
+// Why a loop cannot run in parallel
+enum {
+    PAR_OK,            // It can (loop_info.par is set)
+    PAR_DO_WHILE,      // Do-while loops are not analysed
+    PAR_NO_INDUCTION,  // No induction variable with a loop invariant limit was recognised
+    PAR_INCREMENT,     // The increment of i is not the last statement of the body
+    PAR_PRINT,         // The body prints
+    PAR_NESTED,        // The body contains a loop
+    PAR_CALL,          // The body calls a function
+    PAR_SCALAR,        // The body assigns the variable par_slot, not an element
+    PAR_INDEX,         // Array par_slot is indexed by something other than i + k
+    PAR_CARRIED,       // Array par_slot is written and also accessed at another offset,
+                       // so an iteration may depend on another one
+    PAR_DIVISION,      // Something is divided by a value that may be zero
+    PAR_FUNCTION,      // Loops in function bodies are not analysed
+};
+
+// What the optimizer knows about one loop (only while loops are analysed,
+// do-while loops just get an id). The in-bounds proof holds
+// for "while (i < limit)" or "while (i <= limit)" where i is only changed by
+// one "i = i + c" (c > 0) at the top level of the body, limit is loop
+// invariant, and the marked accesses a[i + k] all come before that increment.
+// The remaining facts (i + kmin >= 0 and every array being large enough for
+// the last iteration) are checked once each time the loop is entered.
+struct loop_info {
+    const struct node *node;    // The NT_Whil or NT_Dowh node (NULL for the unused id 0)
+    uint32_t ivar;              // Slot of the induction variable
+    const struct node *limit;   // Loop invariant upper bound of i (NULL if i was not recognised)
+    uint8_t inclusive;          // The condition is i <= limit rather than i < limit
+    int kmin;                   // Smallest constant offset added to the induction variable
+    size_t narrays;             // Number of arrays with elided checks (0 if nothing proven)
+    struct loop_array *arrays;  // Those arrays
+    struct vector_loop *vector; // Set if the loop can run element-wise over whole ranges
+    struct par_loop *par;       // Set if the iterations can run on several threads
+    uint8_t par_reason;         // Otherwise, why not (PAR_)
+    uint32_t par_slot;          // Variable the reason refers to
+    uint8_t in_function;        // The loop is in a function body (and is never compiled)
+    uint32_t stmt;              // Id of the statement of the loop (see program.statements)
+};
+
+// Counters describing what the optimizer did
+struct opt_stats {
+    size_t symbols;      // Distinct variable names
+    size_t scalars;      // Of those, the ones never used as arrays
+    size_t loops;        // Loops (while and do-while)
+    size_t bce_loops;    // Loops with at least one access proven in bounds
+    size_t bce_checks;   // Array accesses whose bounds check is elided under a guard
+    size_t vector_loops; // Loops that can run element-wise
+    size_t par_loops;    // Loops that can run in parallel
+    size_t stmt_levels;  // Levels of the top-level statements (see struct stmt_info)
+    size_t stmt_heavy;   // Heavy top-level statements sharing their level with another one
+    size_t functions;    // User-defined functions
+    size_t pure;         // Of those, the ones whose results may be memoized
+    size_t inlinable;    // Of those, the ones compiled loops inline
+};
+
+// A top-level statement of the unit. Its level is one more than the highest
+// level of the earlier statements it depends on: those that write a variable
+// it reads or writes, or read a variable it writes. Statements of the same
+// level touch disjoint variables, so they can run at the same time.
+struct stmt_info {
+    uint32_t level;      // 1 .. nlevels
+    uint32_t loops_end;  // Its loops have the ids from the previous statement's loops_end
+                         // (1 for the first one) up to loops_end - 1
+    uint8_t heavy;       // It contains a loop or calls a function
+};
+
+// Built-in functions, stored in the aux field of NT_Call nodes. Array
+// arguments must be plain names; elements are read and written exactly as
+// the equivalent loop over i = 0 .. n - 1 would, warnings and growth included.
+enum {
+    BUILTIN_NONE,  // Unknown name or wrong arguments: the call warns and yields 0
+    BUILTIN_FILL,  // fill(a, value, n): a[i] = value (statement only)
+    BUILTIN_COPY,  // copy(dst, src, n): dst[i] = src[i] (statement only)
+    BUILTIN_SUM,   // sum(a, n): a[0] + ... + a[n - 1]
+    BUILTIN_MIN,   // min(a, n): smallest element (0 if n <= 0)
+    BUILTIN_MAX,   // max(a, n): largest element (0 if n <= 0)
+    BUILTIN_FIND,  // find(a, value, n): first i with a[i] == value, or -1
+    BUILTIN_USER,  // A user-defined function, whose index is the call's slot
+};
+
+// Parameters of the functions compiled loops may inline
+#define INLINE_PARAMS 8
+
+// A user-defined function "func name(a, b) { ... }", defined at the top level
+// and callable from anywhere in the program. Its variables are locals: the
+// parameters and every name it assigns or reads, except the names it uses as
+// arrays, which are the program's arrays. Locals live in the call's frame and
+// start undefined, apart from the parameters. A call with another number of
+// arguments warns like an unknown function. A function's name hides the
+// built-in function of the same name.
+struct function {
+    const struct node *node;         // The NT_Func node
+    uint32_t nparams;                // Its parameters are locals 0 .. nparams - 1
+    uint32_t nlocals;
+    uint8_t reads_arrays;            // It, or a function it calls, reads an array
+    uint8_t writes_arrays;           // It, or a function it calls, writes an array
+    uint8_t pure;                    // No call can print anything or touch an array, so the
+                                     // result only depends on the arguments
+    const struct node *inline_expr;  // Set if the body is "return expr;", expr reading only
+                                     // parameters and calling nothing (at most INLINE_PARAMS)
+};
+
+// Argument `idx` (an NT_Expr) of an NT_Call node
+static inline const struct node *call_arg(const struct node *const call, const size_t idx)
+{
+    const size_t nargs = call->nchildren - 3;
+
+    return idx + 1 < nargs ? call->children[2 + idx]->children[0] :
+        call->children[call->nchildren - 2];
+}
+
+// Bits of program.options
+enum {
+    OPT_NO_VECTORIZE = 1 << 0,  // Never run loops element-wise
+};
+
+// Warnings the interpreter prints at run time, by kind (see warn.h)
+enum {
+    WARN_UNDEFINED,  // A variable is read before it is assigned
+    WARN_NO_ARRAY,   // An element of an array is read before the array is assigned
+    WARN_NEGATIVE,   // An array is accessed at a negative offset
+    WARN_BOUNDS,     // An array is read past its end
+    WARN_VARSTORE,   // A new variable is assigned with the variable store full
+    WARN_REALLOC,    // An element is assigned in an array whose growth failed
+    WARN_DIVIDE,     // Something is divided by zero
+    WARN_CALL,       // A function is unknown or called with the wrong arguments
+    WARN_DEPTH,      // A call is made with RUN_CALL_DEPTH calls in progress
+    WARN_KINDS,
+};
+
+// A warning that every run of its site prints, found before running: a read
+// of a variable or array that nothing assigns, a division by the literal 0,
+// or an invalid call
+struct warning {
+    const struct token *site;  // The name read or called, or the division operator
+    uint8_t kind;              // WARN_
+};
+
+// A parsed program together with the tables built by optimize()
+struct program {
+    struct node root;          // Root of the AST returned by parse()
+    const uint8_t *source;     // The text the tokens point into, set by the caller
+    size_t source_size;        // Its length in bytes, set by the caller
+    size_t nlines;
+    const uint8_t **lines;     // Start of each line of the source
+    size_t nsymbols;
+    struct symbol *symbols;    // Indexed by the slot stored in NT_Atom, NT_Aexp and NT_Assn nodes
+    size_t nloops;
+    struct loop_info *loops;   // Indexed by the id stored in NT_Whil and NT_Dowh nodes and
+                               // marked accesses
+    size_t nstmts;
+    struct stmt_info *stmts;   // By position in the unit, NULL unless some level has
+                               // two heavy statements
+    uint32_t nlevels;
+    size_t nstatements;
+    const struct node **statements;  // Every NT_Stmt node, in source order, by the id
+                                     // stored in its slot
+    size_t nfunctions;
+    struct function *functions;  // Indexed by the slot of NT_Call nodes calling them
+    size_t nwarnings;
+    struct warning *warnings;    // By position of their site in the source
+    const struct token *error;   // The token an OPT_ error other than OPT_NOMEM is about
+    struct opt_stats stats;
+    unsigned options;          // OPT_ bits, set by the caller before optimize()
+};
+
+// Possible return codes of optimize()
+enum {
+    OPT_OK,         // The program is ready to run
+    OPT_NOMEM,      // Memory allocation failed
+    OPT_NESTED,     // A function is defined inside a block
+    OPT_PARAMETER,  // A parameter is not a plain name, is repeated or is used as an array
+    OPT_REDEFINED,  // Two functions have the same name
+    OPT_RETURN,     // A return statement is outside any function
+    OPT_ERRORS      // Number of return codes (not an actual one)
+};
+
+// What each OPT_ error means, to follow the token it is about
+extern const char *const opt_messages[OPT_ERRORS];
+
+// Function declaration: optimize
+// Resolves every variable name to a slot and runs the analysis passes,
+// annotating the AST in place. Must succeed before the program is run.
+int optimize(struct program *);
+
+// Function declaration: program_free
+// Releases the tables built by optimize() (but not the AST itself).
+void program_free(struct program *);
+
+// Function declaration: program_line
+// Returns the 1-based line of the source a token of the program is on.
+size_t program_line(const struct program *, const struct token *);
+
+// Function declaration: program_line_at
+// Returns the 1-based line of a byte of the source, with a binary search of
+// program.lines.
+size_t program_line_at(const struct program *, const uint8_t *);
+
+// Function declaration: program_statement_start
+// Returns where the statement with id `stmt` begins in the source, or NULL
+// if it has no token there (statements -D builds may begin with their own).
+const uint8_t *program_statement_start(const struct program *, uint32_t stmt);
+
+// Function declaration: find_parameter
+// Returns the first top-level "name = number;" assigning the variable called
+// `name` (len bytes), or NULL if there is none. Batch runs and -D bindings
+// replace the number of this assignment.
+struct node *find_parameter(const struct program *, const char *name, size_t len);
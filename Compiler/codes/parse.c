@@ -51,6 +51,9 @@ static const struct rule {
     r1(Stmt, n(Assn)                                                           )
     r1(Stmt, n(Prnt)                                                           )
     r1(Stmt, n(Ctrl)                                                           )
+    r1(Stmt, n(Exst)                                                           )
+    r1(Stmt, n(Func)                                                           )
+    r1(Stmt, n(Rtrn)                                                           )
 
     r4(Assn, t(NAME), t(ASSN), n(Expr), t(SCOL)                                )
     r4(Assn, n(Aexp), t(ASSN), n(Expr), t(SCOL)                                )
@@ -58,6 +61,10 @@ static const struct rule {
     r3(Prnt, t(PRNT), n(Expr), t(SCOL)                                         )
     r4(Prnt, t(PRNT), t(STRL), n(Expr), t(SCOL)                                )
 
+    /* the head of a definition has the shape of a call, parameters as arguments */
+    r5(Func, t(FUNC), n(Call), t(LBRC), m(Stmt), t(RBRC)                       )
+    r3(Rtrn, t(RTRN), n(Expr), t(SCOL)                                         )
+
     r2(Ctrl, n(Cond), m(Elif)                                                  )
     r3(Ctrl, n(Cond), m(Elif), n(Else)                                         )
     r1(Ctrl, n(Dowh)                                                           )
@@ -79,6 +86,12 @@ static const struct rule {
     r1(Expr, n(Uexp)                                                           )
     r1(Expr, n(Texp)                                                           )
     r1(Expr, n(Aexp)                                                           )
+    r1(Expr, n(Call)                                                           )
+
+    /* before Pexp, so that "f(x)" is a call and not f followed by (x) */
+    r5(Call, t(NAME), t(LPAR), m(Args), n(Expr), t(RPAR)                       )
+    r3(Call, t(NAME), t(LPAR), t(RPAR)                                         )
+    r2(Args, n(Expr), t(COMA)                                                  )
 
     r3(Pexp, t(LPAR), n(Expr), t(RPAR)                                         )
 
@@ -103,6 +116,9 @@ static const struct rule {
     r5(Texp, n(Expr), t(QUES), n(Expr), t(COLN), n(Expr)                       )
 
     r4(Aexp, t(NAME), t(LBRA), n(Expr), t(RBRA)                                )
+
+    /* last, so that every other statement ending in "Expr ;" wins */
+    r2(Exst, n(Expr), t(SCOL)                                                  )
 };
 
 #undef r1
@@ -122,7 +138,7 @@ static const uint8_t preced[token_MODU - token_EQUL + 1] = {
     4, 4, 3, 3, 3, 3, 5, 6, 2, 2, 1, 1, 1,
 };
 
-static struct {
+static _Thread_local struct {
     size_t size, allocated;
     struct node *nodes;
 } stack;
@@ -147,6 +163,11 @@ static void print(FILE *output_file)
         "Uexp",
         "Texp",
         "Aexp",
+        "Args",
+        "Call",
+        "Exst",
+        "Func",
+        "Rtrn",
     };
 
     for (size_t i = 0; i < stack.size; ++i) {
@@ -167,6 +188,14 @@ static void print(FILE *output_file)
     fprintf(output_file, "\n");
 }
 
+// Print a step of the trace and the stack after it, unless there is no trace
+static void trace(FILE *output_file, const char *const step)
+{
+    if (output_file) {
+        fprintf(output_file, "%s", step), print(output_file);
+    }
+}
+
 static void collapse_node(const struct node *const node)
 {
     if (node->nchildren) {
@@ -288,10 +317,11 @@ static inline bool shift_pre(
         }
     } else if (rule->lhs == NT_Atom && rule->rhs[RULE_RHS_LAST].token == token_NAME) {
         /*
-            Do not allow the left side of an assignment or an array name to
-            escalate to Expr.
+            Do not allow the left side of an assignment, an array name or a
+            function name to escalate to Expr.
         */
-        if (ahead->token == token_ASSN || ahead->token == token_LBRA) {
+        if (ahead->token == token_ASSN || ahead->token == token_LBRA ||
+            ahead->token == token_LPAR) {
             return true;
         }
     } else if (rule->lhs == NT_Expr && rule->rhs[RULE_RHS_LAST].nt == NT_Aexp) {
@@ -302,6 +332,16 @@ static inline bool shift_pre(
         if (ahead->token == token_ASSN) {
             return true;
         }
+    } else if (rule->lhs == NT_Expr && rule->rhs[RULE_RHS_LAST].nt == NT_Call) {
+        /*
+            Do not allow the head of a function definition to escalate to
+            Expr.
+        */
+        const struct node *const before = &stack.nodes[stack.size - 2]; /* ^ is always below */
+
+        if (!before->nchildren && before->token->token == token_FUNC) {
+            return true;
+        }
     }
 
     return false;
@@ -360,6 +400,10 @@ static int reduce(const struct rule *const rule,
     child_nodes[0].children = old_children;
     reduce_at->nchildren = size;
     reduce_at->nt = rule->lhs;
+    reduce_at->flags = 0;
+    reduce_at->loop = 0;
+    reduce_at->slot = 0;
+    reduce_at->aux = 0;
     stack.size = at + 1;
     return PARSE_OK;
 }
@@ -376,13 +420,17 @@ struct node parse(const struct token *const tokens, const size_t ntokens, FILE *
 
     #define SHIFT_OR_NOMEM(t) \
         if (shift(t)) { \
-            fprintf(output_file, "Out of memory on shift!\n"); \
+            if (output_file) { \
+                fprintf(output_file, "Out of memory on shift!\n"); \
+            } \
             return collapse_stack(), err_nomem; \
         }
 
     #define REDUCE_OR_NOMEM(r, a, s) \
         if (reduce(r, a, s)) { \
-            fprintf(output_file, "Out of memory on reduce!\n"); \
+            if (output_file) { \
+                fprintf(output_file, "Out of memory on reduce!\n"); \
+            } \
             return collapse_stack(), err_nomem; \
         }
 
@@ -393,7 +441,7 @@ struct node parse(const struct token *const tokens, const size_t ntokens, FILE *
         }
 
         SHIFT_OR_NOMEM(&tokens[token_idx++]);
-        fprintf(output_file, "Shift: "), print(output_file);
+        trace(output_file, "Shift: ");
 
         try_reduce_again:;
         const struct rule *rule = grammar;
@@ -406,12 +454,12 @@ struct node parse(const struct token *const tokens, const size_t ntokens, FILE *
 
                 if (!do_shift) {
                     REDUCE_OR_NOMEM(rule, reduction_at, reduction_size);
-                    fprintf(output_file, "Reduce: "), print(output_file);
+                    trace(output_file, "Reduce: ");
                 }
 
                 if (do_shift || shift_post(rule, tokens, &token_idx)) {
                     SHIFT_OR_NOMEM(&tokens[token_idx++]);
-                    fprintf(output_file, "Shift: "), print(output_file);
+                    trace(output_file, "Shift: ");
                 }
 
                 goto try_reduce_again;
@@ -425,7 +473,7 @@ struct node parse(const struct token *const tokens, const size_t ntokens, FILE *
     const int accepted = stack.size == 1 &&
         stack.nodes[0].nchildren && stack.nodes[0].nt == NT_Unit;
 
-    fprintf(output_file, accepted ? "ACCEPT " : "REJECT "), print(output_file);
+    trace(output_file, accepted ? "ACCEPT " : "REJECT ");
 
     if (accepted) {
         const struct node ret = stack.nodes[0];
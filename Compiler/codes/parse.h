@@ -24,12 +24,25 @@ enum {
     NT_Uexp,   // Unary expression
     NT_Texp,   // Ternary expression
     NT_Aexp,   // Array expression (or potentially arithmetic expression)
+    NT_Args,   // Call argument followed by a comma
+    NT_Call,   // Call of a built-in or user-defined function, e.g. sum(a, n)
+    NT_Exst,   // Expression statement, e.g. fill(a, 0, n);
+    NT_Func,   // Function definition, e.g. func add(a, b) { return a + b; }
+    NT_Rtrn,   // Return statement of a function
     NT_COUNT   // Total number of node types (not an actual node type)
 };
 
 // Define nt_t as an 8-bit unsigned integer to represent node types
 typedef uint8_t nt_t;
 
+// Annotations the optimizer attaches to non-leaf nodes (see opt.h)
+enum {
+    NF_INBOUNDS = 1 << 0,  // Aexp proven in bounds while its loop's guard holds
+    NF_SCALAR   = 1 << 1,  // Atom or Assn of a variable never used as an array
+    NF_LOCAL    = 1 << 2,  // Atom or Assn of a function's local variable; slot is its
+                           // index in the call's frame
+};
+
 // Forward declaration of the "token" structure
 struct token;
 
@@ -39,6 +52,10 @@ struct node {
     // If nchildren == 0, it's a leaf node holding a token
     uint32_t nchildren;
 
+    // Integer annotation added by the optimizer; for an Aexp indexed by its
+    // loop's induction variable i as a[i + k], this is k
+    int32_t aux;
+
     union {
         // If this is a leaf node (nchildren == 0), it holds a pointer to a token
         const struct token *token;
@@ -46,6 +63,9 @@ struct node {
         // If this is a non-leaf node (nchildren > 0), it holds:
         struct {
             nt_t nt;                // Node type (one of the NT_ enum values)
+            uint8_t flags;          // NF_ annotations added by the optimizer
+            uint16_t loop;          // Id of the loop an annotation refers to (0 for none)
+            uint32_t slot;          // Variable slot resolved by the optimizer
             struct node **children; // Array of pointers to child nodes
         };
     };
@@ -55,6 +75,7 @@ struct node {
 // Parameters:
 //   - const struct token *: pointer to the array of tokens
 //   - size_t: number of tokens in the array
+//   - FILE *: where the trace of shifts and reductions is printed (NULL: nowhere)
 // Returns:
 //   - struct node: the root node of the parsed abstract syntax tree
 struct node parse(const struct token *, size_t,FILE*);
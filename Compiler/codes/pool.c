@@ -0,0 +1,268 @@
+#include "pool.h"
+#include <stdlib.h>
+
+#if __has_include(<pthread.h>)
+
+#include <pthread.h>
+#include <unistd.h>
+
+// The tasks a worker still has to run, next .. end - 1. Thieves take the
+// upper half, the owner takes from the bottom.
+struct worker {
+    pthread_mutex_t lock;
+    size_t next, end;
+    struct pool *pool;
+};
+
+struct pool {
+    unsigned nworkers;           // Including the thread calling pool_for()
+    struct worker *workers;      // workers[0] is the calling thread
+    pthread_t *threads;          // Threads of workers 1 .. nworkers - 1
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;        // A new pool_for() began, or the pool is stopping
+    pthread_cond_t done;         // The last busy thread has finished
+    uint64_t generation;         // Number of pool_for() calls so far
+    unsigned busy;               // Threads still running the current tasks
+    int stopping;
+
+    void (*fn)(void *, size_t);  // Current tasks
+    void *ctx;
+    uint64_t steals;             // Guarded by `lock`
+};
+
+unsigned pool_cpus(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return ncpus > 1 ? (unsigned) ncpus : 1;
+#else
+    return 1;
+#endif
+}
+
+// Take the next task of worker `self`, stealing one if it has none left.
+// Returns 0 when no worker has any task left.
+static int next_task(struct pool *const pool, const unsigned self, size_t *const task,
+    uint64_t *const steals)
+{
+    struct worker *const own = &pool->workers[self];
+
+    for (;;) {
+        pthread_mutex_lock(&own->lock);
+
+        if (own->next < own->end) {
+            *task = own->next++;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+
+        pthread_mutex_unlock(&own->lock);
+
+        // Steal the upper half of the first victim that has tasks left
+        size_t from = 0, to = 0;
+
+        for (unsigned offset = 1; from == to && offset < pool->nworkers; ++offset) {
+            struct worker *const victim = &pool->workers[(self + offset) % pool->nworkers];
+
+            pthread_mutex_lock(&victim->lock);
+
+            if (victim->next < victim->end) {
+                from = victim->next + (victim->end - victim->next) / 2;
+                to = victim->end;
+                victim->end = from;
+            }
+
+            pthread_mutex_unlock(&victim->lock);
+        }
+
+        if (from == to) {
+            return 0;
+        }
+
+        ++*steals;
+        pthread_mutex_lock(&own->lock);
+        own->next = from;
+        own->end = to;
+        pthread_mutex_unlock(&own->lock);
+    }
+}
+
+// Run tasks as worker `self` until none are left anywhere
+static void work(struct pool *const pool, const unsigned self)
+{
+    uint64_t steals = 0;
+    size_t task;
+
+    while (next_task(pool, self, &task, &steals)) {
+        pool->fn(pool->ctx, task);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->steals += steals;
+
+    if (!--pool->busy) {
+        pthread_cond_signal(&pool->done);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void *worker_main(void *const arg)
+{
+    struct worker *const worker = arg;
+    struct pool *const pool = worker->pool;
+    const unsigned self = worker - pool->workers;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    for (;;) {
+        while (!pool->stopping && pool->generation == seen) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+
+        if (pool->stopping) {
+            break;
+        }
+
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+        work(pool, self);
+        pthread_mutex_lock(&pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct pool *pool_create(const unsigned nthreads)
+{
+    struct pool *const pool = calloc(1, sizeof(struct pool));
+
+    if (!pool || nthreads < 1) {
+        free(pool);
+        return NULL;
+    }
+
+    pool->workers = calloc(nthreads, sizeof(struct worker));
+    pool->threads = calloc(nthreads, sizeof(pthread_t));
+
+    if (!pool->workers || !pool->threads) {
+        free(pool->workers);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (unsigned idx = 0; idx < nthreads; ++idx) {
+        pthread_mutex_init(&pool->workers[idx].lock, NULL);
+        pool->workers[idx].pool = pool;
+    }
+
+    // Worker 0 is whoever calls pool_for()
+    for (pool->nworkers = 1; pool->nworkers < nthreads; ++pool->nworkers) {
+        if (pthread_create(&pool->threads[pool->nworkers], NULL, worker_main,
+            &pool->workers[pool->nworkers])) {
+            pool_destroy(pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+void pool_for(struct pool *const pool, const size_t ntasks,
+    void (*const fn)(void *, size_t), void *const ctx)
+{
+    // Equal shares to begin with
+    for (unsigned idx = 0; idx < pool->nworkers; ++idx) {
+        pool->workers[idx].next = ntasks * idx / pool->nworkers;
+        pool->workers[idx].end = ntasks * (idx + 1) / pool->nworkers;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->busy = pool->nworkers;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    work(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (pool->busy) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+uint64_t pool_steals(const struct pool *const pool)
+{
+    return pool->steals;
+}
+
+void pool_destroy(struct pool *const pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned idx = 1; idx < pool->nworkers; ++idx) {
+        pthread_join(pool->threads[idx], NULL);
+    }
+
+    for (unsigned idx = 0; idx < pool->nworkers; ++idx) {
+        pthread_mutex_destroy(&pool->workers[idx].lock);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool->threads);
+    free(pool);
+}
+
+#else
+
+// Without POSIX threads every loop runs serially
+unsigned pool_cpus(void)
+{
+    return 1;
+}
+
+struct pool *pool_create(const unsigned nthreads)
+{
+    (void) nthreads;
+    return NULL;
+}
+
+void pool_for(struct pool *const pool, const size_t ntasks,
+    void (*const fn)(void *, size_t), void *const ctx)
+{
+    (void) pool, (void) ntasks, (void) fn, (void) ctx;
+    abort();
+}
+
+uint64_t pool_steals(const struct pool *const pool)
+{
+    (void) pool;
+    return 0;
+}
+
+void pool_destroy(struct pool *const pool)
+{
+    (void) pool;
+    abort();
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include <stddef.h>  // For size_t type
+#include <stdint.h>  // For fixed-width counters
+
+// Opaque thread pool state (defined in pool.c)
+struct pool;
+
+// Function declaration: pool_cpus
+// Returns the number of CPUs available to the process (at least 1).
+unsigned pool_cpus(void);
+
+// Function declaration: pool_create
+// Starts a pool of `nthreads` workers, counting the thread that calls
+// pool_for(), so nthreads - 1 threads are created. Returns NULL if they
+// could not be started.
+struct pool *pool_create(unsigned nthreads);
+
+// Function declaration: pool_for
+// Calls fn(ctx, task) for every task in 0 .. ntasks - 1 and returns when all
+// calls have returned. Each worker starts with an equal share of the tasks,
+// runs its own in order and, once it has none left, steals the upper half of
+// another worker's remaining tasks. Tasks may run in any order and at the
+// same time, so they must not depend on each other.
+void pool_for(struct pool *, size_t ntasks, void (*fn)(void *ctx, size_t task), void *ctx);
+
+// Function declaration: pool_steals
+// Returns how many times a worker has taken tasks from another one so far.
+uint64_t pool_steals(const struct pool *);
+
+// Function declaration: pool_destroy
+// Stops and joins the workers and frees the pool.
+void pool_destroy(struct pool *);
@@ -0,0 +1,297 @@
+#include "profile.h"
+#include "lex.h"
+#include <stdlib.h>
+
+int profile_init(struct profile *const profile, const struct program *const program)
+{
+    *profile = (struct profile) {
+        .nstatements = program->nstatements,
+        .statements = calloc(program->nstatements ?: 1, sizeof(struct stmt_profile)),
+        .npaths = 1,
+        .capacity = 256,
+        .paths = calloc(256, sizeof(struct profile_path)),
+        .index = calloc(2 * 256, sizeof(uint32_t)),
+    };
+
+    if (!profile->statements || !profile->paths || !profile->index) {
+        profile_free(profile);
+        return -1;
+    }
+
+    return 0;
+}
+
+// First slot to probe for a path, in an index of `size` slots (a power of two)
+static size_t home(const uint32_t parent, const uint32_t stmt, const size_t size)
+{
+    const uint64_t hash = (((uint64_t) parent << 32) | stmt) * 0x9e3779b97f4a7c15u;
+    return (size_t) (hash >> 32) & (size - 1);
+}
+
+// Double the paths and their index. Returns 0 if memory ran out.
+static int grow(struct profile *const profile)
+{
+    const size_t capacity = 2 * profile->capacity;
+    struct profile_path *const paths = realloc(profile->paths, capacity * sizeof(struct profile_path));
+    uint32_t *const index = calloc(2 * capacity, sizeof(uint32_t));
+
+    if (paths) {
+        profile->paths = paths;
+    }
+
+    if (!paths || !index) {
+        free(index);
+        return 0;
+    }
+
+    for (uint32_t path = 1; path < profile->npaths; ++path) {
+        size_t at = home(paths[path].parent, paths[path].stmt, 2 * capacity);
+
+        while (index[at]) {
+            at = (at + 1) & (2 * capacity - 1);
+        }
+
+        index[at] = path;
+    }
+
+    free(profile->index);
+    profile->index = index;
+    profile->capacity = capacity;
+    return 1;
+}
+
+uint32_t profile_path(struct profile *const profile, const uint32_t parent, const uint32_t stmt)
+{
+    if (profile->paths[parent].depth >= PROFILE_DEPTH) {
+        return parent;
+    }
+
+    const size_t size = 2 * profile->capacity;
+    size_t at = home(parent, stmt, size);
+
+    for (; profile->index[at]; at = (at + 1) & (size - 1)) {
+        const struct profile_path *const path = &profile->paths[profile->index[at]];
+
+        if (path->parent == parent && path->stmt == stmt) {
+            return profile->index[at];
+        }
+    }
+
+    if (profile->npaths == profile->capacity) {
+        if (profile->npaths > UINT32_MAX / 4 || !grow(profile)) {
+            profile->incomplete = 1;
+            return 0;
+        }
+
+        return profile_path(profile, parent, stmt);
+    }
+
+    const uint32_t path = profile->npaths++;
+
+    profile->paths[path] = (struct profile_path) {
+        .parent = parent,
+        .stmt = stmt,
+        .depth = profile->paths[parent].depth + 1,
+    };
+    profile->index[at] = path;
+    return path;
+}
+
+void profile_scale(struct profile *const profile, const double ns_per_tick)
+{
+    for (size_t stmt = 0; stmt < profile->nstatements; ++stmt) {
+        profile->statements[stmt].inclusive_ns *= ns_per_tick;
+        profile->statements[stmt].exclusive_ns *= ns_per_tick;
+    }
+
+    for (size_t path = 1; path < profile->npaths; ++path) {
+        profile->paths[path].ns *= ns_per_tick;
+    }
+}
+
+// The line each statement begins on, by id (0: none). Returns NULL if memory
+// ran out.
+static size_t *statement_lines(const struct program *const program)
+{
+    size_t *const lines = malloc((program->nstatements ?: 1) * sizeof(size_t));
+
+    for (size_t stmt = 0; lines && stmt < program->nstatements; ++stmt) {
+        const uint8_t *const beg = program_statement_start(program, stmt);
+
+        lines[stmt] = beg ? program_line_at(program, beg) : 0;
+    }
+
+    return lines;
+}
+
+// Characters of its text a frame of the folded stacks shows, at most
+#define FRAME_TEXT 40
+
+static void print_ms(const uint64_t ns, FILE *out)
+{
+    fprintf(out, " %11.3f", ns / 1e6);
+}
+
+void profile_write_listing(const struct profile *const profile,
+    const struct program *const program, FILE *out)
+{
+    const uint8_t *const end = program->source + program->source_size;
+    const size_t nlines = program->nlines;
+
+    // What the statements that begin on each line cost
+    struct {
+        uint32_t first;         // Id of the one that begins first, + 1 (0: none)
+        uint8_t how;
+        uint64_t exclusive_ns;
+    } *const per_line = calloc(nlines + 1, sizeof(*per_line));
+    size_t *const lines = statement_lines(program);
+    uint64_t total_ns = 0;
+
+    if (!per_line || !lines) {
+        fprintf(stderr, "The profile could not allocate memory.\n");
+        free(per_line);
+        free(lines);
+        return;
+    }
+
+    for (size_t stmt = 0; stmt < program->nstatements; ++stmt) {
+        const struct stmt_profile *const entry = &profile->statements[stmt];
+        const uint32_t first = per_line[lines[stmt]].first;
+
+        if (!first || program_statement_start(program, stmt) <
+            program_statement_start(program, first - 1)) {
+            per_line[lines[stmt]].first = stmt + 1;
+        }
+
+        per_line[lines[stmt]].how |= entry->how;
+        per_line[lines[stmt]].exclusive_ns += entry->exclusive_ns;
+        total_ns += entry->exclusive_ns;
+    }
+
+    fprintf(out, "%.3f ms in statements. Per line, for the first statement that begins there:\n"
+        "runs, loop iterations and time with the statements it runs; then the time of all\n"
+        "the statements of the line themselves. Iterations run [compiled], [element-wise]\n"
+        "or [parallel] are only timed as a whole, in the time of their loop.\n\n", total_ns / 1e6);
+    fprintf(out, "%12s %12s %11s %11s  %5s\n", "runs", "iterations", "incl ms", "excl ms", "line");
+
+    const uint8_t *line_beg = program->source;
+
+    for (size_t line = 1; line <= nlines && line_beg < end; ++line) {
+        const uint8_t *line_end = line_beg;
+        const uint32_t first = per_line[line].first;
+
+        while (line_end < end && *line_end != '\n') {
+            line_end++;
+        }
+
+        if (!first) {
+            fprintf(out, "%12s %12s %11s %11s", "", "", "", "");
+        } else if (!profile->statements[first - 1].count) {
+            fprintf(out, "%12s %12s %11s %11s", "0", "", "", "");
+        } else {
+            const struct stmt_profile *const entry = &profile->statements[first - 1];
+
+            fprintf(out, "%12llu", (unsigned long long) entry->count);
+
+            if (entry->trips) {
+                fprintf(out, " %12llu", (unsigned long long) entry->trips);
+            } else {
+                fprintf(out, " %12s", "");
+            }
+
+            print_ms(entry->inclusive_ns, out);
+            print_ms(per_line[line].exclusive_ns, out);
+        }
+
+        const int length = (int) (line_end - line_beg) - (line_end > line_beg && line_end[-1] == '\r');
+        const uint8_t how = per_line[line].how;
+
+        fprintf(out, "  %5zu  %.*s%s%s%s\n", line, length, line_beg,
+            how & PROFILE_COMPILED ? "  [compiled]" : "",
+            how & PROFILE_VECTOR ? "  [element-wise]" : "",
+            how & PROFILE_PARALLEL ? "  [parallel]" : "");
+        line_beg = line_end + 1;
+    }
+
+    if (per_line[0].exclusive_ns) {
+        fprintf(out, "\n%.3f ms in statements -D built.\n", per_line[0].exclusive_ns / 1e6);
+    }
+
+    if (profile->incomplete) {
+        fprintf(out, "\nMemory ran out: some paths are missing from the folded stacks.\n");
+    }
+
+    free(per_line);
+    free(lines);
+}
+
+// Print the frame of a statement: its line and the start of its text, with
+// spaces collapsed and without the semicolons folded stacks use as separators
+static void print_frame(const struct program *const program, const size_t *const lines,
+    const uint32_t stmt, FILE *out)
+{
+    const uint8_t *at = program_statement_start(program, stmt);
+    const uint8_t *const end = program->source + program->source_size;
+    char text[FRAME_TEXT];
+    int length = 0, space = 1;
+
+    if (!at) {
+        fprintf(out, "statement %u", stmt);
+        return;
+    }
+
+    for (; at < end && *at != '\n' && *at != '\r' && length < FRAME_TEXT - 1; ++at) {
+        if (*at == ' ' || *at == '\t') {
+            space = 1;
+        } else if (*at != ';') {
+            if (space) {
+                text[length++] = ' ';
+            }
+
+            text[length++] = (char) *at;
+            space = 0;
+        }
+    }
+
+    fprintf(out, "line %zu:%.*s", lines[stmt], length, text);
+}
+
+// Print a path, from the top level
+static void print_path(const struct profile *const profile, const struct program *const program,
+    const size_t *const lines, const uint32_t path, FILE *out)
+{
+    if (profile->paths[path].parent) {
+        print_path(profile, program, lines, profile->paths[path].parent, out);
+        fputc(';', out);
+    }
+
+    print_frame(program, lines, profile->paths[path].stmt, out);
+}
+
+void profile_write_folded(const struct profile *const profile,
+    const struct program *const program, FILE *out)
+{
+    size_t *const lines = statement_lines(program);
+
+    if (!lines) {
+        fprintf(stderr, "The profile could not allocate memory.\n");
+        return;
+    }
+
+    for (uint32_t path = 1; path < profile->npaths; ++path) {
+        if (profile->paths[path].ns) {
+            print_path(profile, program, lines, path, out);
+            fprintf(out, " %llu\n", (unsigned long long) profile->paths[path].ns);
+        }
+    }
+
+    free(lines);
+}
+
+void profile_free(struct profile *const profile)
+{
+    free(profile->statements);
+    free(profile->paths);
+    free(profile->index);
+    *profile = (struct profile) { 0 };
+}
@@ -0,0 +1,95 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include "opt.h"
+#include <stdio.h>
+#include <stdint.h>  // For fixed-width counters
+#include <stddef.h>  // For size_t type
+
+// How a loop statement ran besides the tree-walking interpreter. The time of
+// statements run that way is counted in the loop's own time.
+enum {
+    PROFILE_COMPILED = 1,  // Some iterations ran in compiled code
+    PROFILE_VECTOR = 2,    // Some entries ran element-wise
+    PROFILE_PARALLEL = 4,  // Some entries ran on several threads
+};
+
+// What a statement cost
+struct stmt_profile {
+    uint64_t count;         // Times it ran
+    uint64_t trips;         // For a loop, iterations over all its entries
+    uint64_t inclusive_ns;  // Time from its start to its end, the statements it ran included
+                            // (a recursive call is counted in the outermost one only)
+    uint64_t exclusive_ns;  // Of that, the time not spent in the statements it ran
+    uint32_t depth;         // Runs in progress, while running
+    uint32_t parent, path;  // The path it was last reached through, and from where
+    uint8_t how;            // PROFILE_ bits
+};
+
+// Paths are cut at this many statements: deeper ones, in recursive calls,
+// count in the last statement kept
+#define PROFILE_DEPTH 64
+
+// A statement reached through the statements that ran it (blocks and calls),
+// for folded stacks
+struct profile_path {
+    uint32_t parent;  // Path of the statement that ran it (0: the top level)
+    uint32_t stmt;    // Its id
+    uint32_t depth;   // Statements on the path
+    uint64_t ns;      // Exclusive time spent in it along this path
+};
+
+// What each statement of a program cost in a run (see run_options)
+struct profile {
+    size_t nstatements;
+    struct stmt_profile *statements;  // By statement id
+    size_t npaths, capacity;          // paths[0] is the empty path
+    struct profile_path *paths;
+    uint32_t *index;                  // Open-addressing table of path ids, 2 * capacity long
+    int incomplete;                   // Some paths were dropped for lack of memory
+};
+
+// Function declaration: profile_init
+// Prepares an empty profile of the statements of a program. Returns 0 on
+// success, -1 if memory ran out.
+int profile_init(struct profile *, const struct program *);
+
+// Function declaration: profile_path
+// Returns the id of the path to `stmt` from the path `parent`, added if it
+// is new, or `parent` itself if that is PROFILE_DEPTH long; on failure, 0
+// (time along it is then only counted per statement).
+uint32_t profile_path(struct profile *, uint32_t parent, uint32_t stmt);
+
+// Function declaration: profile_enter
+// profile_path() for a statement about to run, looking at the path it was
+// last reached through first: outside recursive calls, it is the same.
+static inline uint32_t profile_enter(struct profile *const profile, const uint32_t parent,
+    const uint32_t stmt)
+{
+    struct stmt_profile *const entry = &profile->statements[stmt];
+
+    if (entry->path && entry->parent == parent) {
+        return entry->path;
+    }
+
+    entry->parent = parent;
+    return entry->path = profile_path(profile, parent, stmt);
+}
+
+// Function declaration: profile_scale
+// Multiplies the times of a profile, taken in ticks of some clock, by the
+// nanoseconds per tick.
+void profile_scale(struct profile *, double ns_per_tick);
+
+// Function declaration: profile_write_listing
+// Writes the source of the program, each line annotated with the count, loop
+// trips and inclusive and exclusive times of the statements that begin there.
+void profile_write_listing(const struct profile *, const struct program *, FILE *);
+
+// Function declaration: profile_write_folded
+// Writes the exclusive time of each path as folded stacks, one
+// "frame;frame;... nanoseconds" line per path, as flame graph tools read them.
+void profile_write_folded(const struct profile *, const struct program *, FILE *);
+
+// Function declaration: profile_free
+// Releases the tables of a profile.
+void profile_free(struct profile *);
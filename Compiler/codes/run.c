@@ -1,12 +1,28 @@
 #include "lex.h"
 #include "parse.h"
+#include "array.h"
+#include "opt.h"
+#include "run.h"
+#include "simd.h"
+#include "pool.h"
+#include "warn.h"
+#include "profile.h"
+#include "sample.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>  // __rdtsc
+#endif
 
 // Forward declarations of helper functions
 static void run_statement(const struct node *const, FILE *);
+static void execute_statement(const struct node *const, FILE *);
+static void profile_statement(const struct node *const, FILE *);
 static void run_assign(const struct node *const, FILE *);
 static void run_print(const struct node *const, FILE *);
 static void run_ctrl(const struct node *const, FILE *);
@@ -14,43 +30,488 @@ static int eval_atom(const struct node *const, FILE *);
 static int eval_expr(const struct node *const, FILE *);
 static int eval_pexp(const struct node *const, FILE *);
 static int eval_bexp(const struct node *const, FILE *);
+static int apply_binary(const struct node *const, int, int, FILE *);
 static int eval_uexp(const struct node *const, FILE *);
 static int eval_texp(const struct node *const, FILE *);
 static int eval_aexp(const struct node *const, FILE *);
+static int bce_guard(const struct loop_info *const, FILE *);
+static int run_vector(const struct loop_info *const, FILE *);
+static int run_parallel(const struct loop_info *const, FILE *);
+static void run_exst(const struct node *const, FILE *);
+static int eval_call(const struct node *const, FILE *);
+static int load_element(uint32_t, int, const struct token *, FILE *);
+static struct array *element_for_write(uint32_t, int, int *, const struct token *, FILE *);
+static void store_element(uint32_t, struct array *, int, int, int);
+static int readable_range(uint32_t, int64_t, int64_t);
+static int writable_range(uint32_t, int64_t, int64_t);
+static int grow_for_range(uint32_t, int64_t, int64_t);
+static int scalar_value(uint32_t);
+static void print_value(const struct node *const, int, FILE *);
+static int enter_while(const struct node *const, uint8_t *, FILE *);
+static int tier_count(const struct node *const);
+static void run_tier(const struct node *const, FILE *);
+static struct insn *compile_loop(const struct node *const);
+static void tier_free(void);
+static uint64_t now_ns(void);
+static uint64_t profile_clock(void);
+static void run_scheduled(const struct node *const, FILE *);
+static void run_block(const struct node *, FILE *);
+static void frames_free(void);
+static void memo_free(void);
+static int refuel(uint64_t);
+static int halt(int);
 
 // Maximum number of variables that can be stored
 #define VARSTORE_CAPACITY 128
 
-// Global variable storage structure
-static struct {
-    size_t size;  // Current number of variables stored
+// Variable storage of a run
+struct varstore {
+    atomic_size_t size;  // Current number of variables stored (top-level statements
+                         // running at the same time may define variables)
 
     struct {
-        const uint8_t *beg;        // Pointer to variable name start
-        ptrdiff_t len;             // Length of variable name
-        size_t array_size;        // Size of array (0 for scalar)
-        int *values;              // Pointer to array values
-    } vars[VARSTORE_CAPACITY];    // Array of variable entries
-} varstore;
+        uint8_t defined;           // The variable has been assigned
+        struct array array;        // Values of a variable used as an array (a scalar
+                                   // read or assigned is its element 0)
+    } *vars;                       // Indexed by the slots resolved by the optimizer
+
+    int *scalars;                  // Values of the variables never used as arrays
+                                   // (NF_SCALAR), by slot, followed by the registers
+                                   // of compiled loops
+};
+
+// Warnings of the run; top-level statements that run on the pool keep
+// their own (see run_stmt_task())
+static _Thread_local struct warn_log *warnings;
+
+// Counters reported back to the caller. Top-level statements that run on
+// the pool count apart (see run_stmt_task()).
+static _Thread_local struct run_stats stats;
+
+// Element-wise loops run this many iterations of each statement at a time
+#define VECTOR_CHUNK 256
+
+// Scratch rows of VECTOR_CHUNK ints for evaluating element-wise expressions
+static _Thread_local struct {
+    int *rows;
+    size_t nrows;
+} scratch;
+
+// Iterations each task of a parallel loop runs
+#define PAR_CHUNK 1024
+
+// Parallel loops with fewer iterations run serially
+#define PAR_MIN_ITERATIONS (4 * PAR_CHUNK)
+
+// Threads for parallel loops
+struct par_threads {
+    unsigned threads;    // Threads to use (1: run every loop serially)
+    struct pool *pool;   // Started by the first loop or statements that run in parallel
+    int statements;      // Top-level statements are running on the pool: loops stay serial
+                         // and none is compiled
+};
+
+// One instruction of a compiled loop (see the tier 1 section below)
+struct insn {
+    uint8_t op;               // OP_ code
+    int32_t a, b, c;          // Registers, a scalar slot or a jump target
+    const struct node *node;  // Node the instruction stands for, if any
+};
+
+// Tier state of the loops, by loop id
+struct tiers {
+    uint64_t threshold;          // Iterations before a loop is compiled (0: never)
+    struct {
+        uint64_t iterations;     // Iterations counted in the AST walker
+        struct insn *code;       // The compiled loop, once promoted
+    } *loops;
+    size_t nregs;                // Registers in use in varstore.scalars
+    size_t capacity;             // Registers allocated
+};
+
+// Nesting of run_tier() in this thread, so time is only counted once
+static _Thread_local unsigned tier_depth;
+
+// The profile of the run (see run_options.profile). Only the thread that
+// called run() profiles: statements run on the pool are in the time of the
+// statement that started them. Times are in ticks of profile_clock() until
+// the run ends.
+static _Thread_local struct {
+    struct profile *data;  // NULL: not profiling
+    uint32_t path;         // Path of the statement running
+    uint64_t children;     // Time of the statements it ran so far
+    uint64_t start_ns, start_ticks;  // When the run began
+} prof;
+
+// Locals of the calls of user-defined functions in progress, in one
+// contiguous stack: each call's frame starts where its caller's frame ends.
+// When memoizing, a frame also keeps a copy of the arguments after the
+// locals, since the body may assign its parameters.
+static _Thread_local struct {
+    int *values;
+    uint8_t *defined;
+    size_t base;        // First local of the running call
+    size_t top;         // End of the last frame
+    size_t capacity;
+    unsigned depth;     // Calls in progress
+    unsigned peak;      // Deepest depth the memoized calls in progress reached
+    uint8_t returning;  // A return statement ran: blocks are left up to its call
+    int result;         // The value it returned
+    uint64_t refused;   // Calls refused because RUN_CALL_DEPTH was reached
+} frames;
+
+// Memo tables stop growing at this many results per function
+#define MEMO_ENTRIES (1 << 20)
+
+// Results of a pure function by arguments: each entry is the arguments
+// followed by the result and the height of the call, the deepest depth it
+// reached below its caller's
+struct memo {
+    int *entries;
+    uint8_t *used;
+    size_t nentries, capacity;
+};
+
+// Memo tables of this thread, by function, allocated by the first call
+static _Thread_local struct memo *memos;
+
+// Steps a thread takes between two checks of the governor's limits
+#define GOVERNOR_SLICE 4096
+
+// The governor: limits of the run (see run_options), shared by its threads.
+// Each thread takes steps from the budget a slice at a time, so the hot
+// path only decrements a thread-local counter.
+struct governor {
+    int active;                  // Some limit is set
+    uint64_t max_steps;
+    uint64_t time_limit_ms;
+    size_t max_array_bytes;
+    uint64_t deadline_ns;        // now_ns() at which time runs out
+    atomic_uint_fast64_t left;   // Steps not handed out to a thread yet
+    atomic_int stop;             // RUN_STOP_ reason, once a limit is reached
+};
+
+// The state of a run, which all the threads running it share. run() keeps it
+// on its stack, so that runs in different threads do not meet; the tasks it
+// gives its pool point their threads to it (see adopt()).
+struct run_state {
+    struct varstore varstore;
+    const struct program *program;  // The program being run
+    uint8_t *bce_live;              // Per loop id: the loop's entry guard held, so its
+                                    // marked accesses are in bounds
+    const struct simd *simd;        // Kernels used by element-wise loops
+    struct par_threads par;
+    struct tiers tier;
+    int sampling;                   // Keep sample_site up to date (see run_options.sample)
+    int memoize;                    // Reuse the results of pure functions (run_options.memoize)
+    struct governor gov;
+    struct array_budget arrays;     // Bytes its arrays hold, within max_array_bytes
+};
+
+// The run this thread works for
+static _Thread_local struct run_state *state;
+
+// Point this thread to a run, for a task of its pool
+static void adopt(struct run_state *const run)
+{
+    state = run;
+    array_set_budget(&run->arrays);
+}
+
+// Count an iteration of a loop in the profile
+static inline void profile_trip(const struct node *const loop)
+{
+    if (prof.data) {
+        prof.data->statements[state->program->loops[loop->loop].stmt].trips++;
+    }
+}
+
+// Steps this thread may take before checking in with the governor. It is
+// negative once the run is stopping, which loops and blocks check.
+static _Thread_local int64_t fuel;
+
+// Steps handed to this thread, of which `fuel` are still unused
+static _Thread_local uint64_t granted;
+
+// Charge one step. Returns 0 if the run is stopping.
+static inline int step(void)
+{
+    if (fuel > 0) {
+        fuel--;
+        return 1;
+    }
+
+    return refuel(1);
+}
+
+// Charge `n` steps at once. Returns 0, charging none, if they are not all
+// left; if n > 1 the run goes on, so that the caller can take them one by one.
+static inline int take_steps(const uint64_t n)
+{
+    if (fuel >= 0 && (uint64_t) fuel >= n) {
+        fuel -= n;
+        return 1;
+    }
+
+    return refuel(n);
+}
+
+// Charge the elements of a built-in call, stopping the run if they are not left
+static int spend(const uint64_t n)
+{
+    return take_steps(n) || halt(RUN_STOP_STEPS);
+}
+
+// Statements may run: no return statement is leaving the blocks of a call,
+// and the run is not stopping
+static inline int running(void)
+{
+    return !frames.returning && fuel >= 0;
+}
+
+// Start this thread's account of steps
+static void fuel_init(void)
+{
+    fuel = state->gov.active ? 0 : INT64_MAX;
+    granted = fuel;
+}
+
+// Steps this thread took since fuel_init()
+static uint64_t fuel_used(void)
+{
+    return granted - (fuel > 0 ? fuel : 0);
+}
+
+// Stop the run for `reason`, unless it is already stopping. Returns 0.
+static int halt(const int reason)
+{
+    int none = RUN_STOP_NONE;
+
+    atomic_compare_exchange_strong(&state->gov.stop, &none, reason);
+    granted = fuel_used();
+    fuel = -1;
+    return 0;
+}
+
+// Whether the run is stopping, possibly because of another thread
+static int stopping(void)
+{
+    if (fuel >= 0 && atomic_load_explicit(&state->gov.stop, memory_order_relaxed)) {
+        halt(RUN_STOP_NONE);
+    }
+
+    return fuel < 0;
+}
+
+// Slow path of step() and take_steps(), when this thread needs `n` steps and
+// has fewer: check the limits, and take another slice from the budget
+static int refuel(const uint64_t n)
+{
+    if (stopping()) {
+        return 0;
+    }
+
+    if (state->gov.deadline_ns && now_ns() >= state->gov.deadline_ns) {
+        return halt(RUN_STOP_TIME);
+    }
+
+    uint_fast64_t grant = n - fuel + GOVERNOR_SLICE;
+
+    if (state->gov.max_steps) {
+        uint_fast64_t left = atomic_load(&state->gov.left), take;
+
+        do {
+            take = left < grant ? left : grant;
+        } while (!atomic_compare_exchange_weak(&state->gov.left, &left, left - take));
+
+        grant = take;
+    }
+
+    fuel += grant;
+    granted += grant;
+
+    if ((uint64_t) fuel < n) {
+        return n == 1 ? halt(RUN_STOP_STEPS) : 0;
+    }
+
+    fuel -= n;
+    return 1;
+}
 
 // Main execution function that runs the program unit
-void run(const struct node *const unit, FILE *output_file)
+void run(const struct program *const prog, FILE *output_file,
+    const struct run_options *const options, struct run_stats *const run_stats)
 {
-    // Execute each statement in the unit (skipping first and last children which are likely delimiters)
-    for (size_t stmt_idx = 1; stmt_idx < unit->nchildren - 1; ++stmt_idx) {
-        run_statement(unit->children[stmt_idx], output_file);
+    const struct node *const unit = &prog->root;
+    const uint64_t start_ns = now_ns();
+    const int governed = run_governed(options);
+    struct run_state run_state = {
+        .varstore.vars = calloc(prog->nsymbols ?: 1, sizeof(*run_state.varstore.vars)),
+        .varstore.scalars = calloc(prog->nsymbols ?: 1, sizeof(int)),
+        .program = prog,
+        .bce_live = calloc(prog->nloops ?: 1, sizeof(uint8_t)),
+        .simd = simd_best(),
+        .par.threads = options && options->threads ? options->threads : pool_cpus(),
+        .tier.threshold = options ? options->tier_threshold : RUN_TIER_THRESHOLD,
+        .tier.loops = calloc(prog->nloops ?: 1, sizeof(*run_state.tier.loops)),
+        .tier.nregs = prog->nsymbols,
+        .tier.capacity = prog->nsymbols ?: 1,
+        .sampling = options && options->sample,
+        .memoize = options && options->memoize,
+        .gov.active = governed,
+        .gov.max_steps = governed ? options->max_steps : 0,
+        .gov.time_limit_ms = governed ? options->time_limit_ms : 0,
+        .gov.max_array_bytes = governed ? options->max_array_bytes : 0,
+        .gov.deadline_ns = governed && options->time_limit_ms ?
+            start_ns + options->time_limit_ms * 1000000u : 0,
+        .gov.left = governed ? options->max_steps : 0,
+        .gov.stop = RUN_STOP_NONE,
+        .arrays.limit = governed ? options->max_array_bytes : 0,
+    };
+
+    adopt(&run_state);
+    stats = (struct run_stats) { 0 };
+    prof.data = options ? options->profile : NULL;
+    prof.path = 0;
+    prof.children = 0;
+    prof.start_ns = start_ns;
+    prof.start_ticks = profile_clock();
+    fuel_init();
+
+    struct warn_log log;
+    warn_init(&log, prog, options && options->all_warnings);
+    warnings = &log;
+
+    if (state->varstore.vars && state->varstore.scalars && state->bce_live && state->tier.loops) {
+        if (prog->stmts && state->par.threads > 1 && prog->nsymbols <= VARSTORE_CAPACITY &&
+            !prof.data && !state->sampling && !governed) {
+            // Independent statements may run at the same time. With no more
+            // variables than the store holds, none can find it exhausted.
+            // Profiled runs run them one after the other, so each has a time,
+            // and so do runs with limits, so that they stop at the same
+            // statement whatever the threads.
+            run_scheduled(unit, output_file);
+        } else {
+            // Execute each statement in the unit (skipping first and last children which are likely delimiters)
+            for (size_t stmt_idx = 1; stmt_idx < unit->nchildren - 1 && fuel >= 0; ++stmt_idx) {
+                run_statement(unit->children[stmt_idx], output_file);
+            }
+        }
+    } else {
+        fprintf(output_file, "malloc failed\n");
+    }
+
+    switch (atomic_load(&state->gov.stop)) {
+    case RUN_STOP_STEPS:
+        fprintf(output_file, "error: step limit of %llu reached, execution stopped\n",
+            (unsigned long long) state->gov.max_steps);
+        break;
+
+    case RUN_STOP_TIME:
+        fprintf(output_file, "error: time limit of %llu ms reached, execution stopped\n",
+            (unsigned long long) state->gov.time_limit_ms);
+        break;
+
+    case RUN_STOP_MEMORY:
+        fprintf(output_file, "error: array memory limit of %zu bytes reached, execution stopped\n",
+            state->gov.max_array_bytes);
+        break;
+    }
+
+    warn_summary(&log, prog, output_file);
+    warn_free(&log);
+    warnings = NULL;
+
+    if (prof.data) {
+        const uint64_t ticks = profile_clock() - prof.start_ticks;
+
+        profile_scale(prof.data, ticks ? (double) (now_ns() - prof.start_ns) / ticks : 1);
+        prof.data = NULL;
     }
+    stats.steps += fuel_used();
+    stats.stopped = atomic_load(&state->gov.stop);
 
     // Clean up allocated memory for variables
-    for (size_t var_idx = 0; var_idx < varstore.size; ++var_idx) {
-        free(varstore.vars[var_idx].values);
+    for (size_t var_idx = 0; state->varstore.vars && var_idx < prog->nsymbols; ++var_idx) {
+        array_free(&state->varstore.vars[var_idx].array);
+    }
+
+    free(state->varstore.vars);
+    free(state->varstore.scalars);
+    free(state->bce_live);
+    free(scratch.rows);
+    tier_free();
+    frames_free();
+    memo_free();
+
+    if (state->par.pool) {
+        stats.par_steals = pool_steals(state->par.pool);
+        pool_destroy(state->par.pool);
     }
+    scratch.rows = NULL;
+    scratch.nrows = 0;
+    state = NULL;
+    array_set_budget(NULL);
 
-    varstore.size = 0;  // Reset variable store
+    // Compiled loops of statements that ran at the same time may add up to more
+    const uint64_t elapsed_ns = now_ns() - start_ns;
+    stats.tier0_ns = elapsed_ns > stats.tier1_ns ? elapsed_ns - stats.tier1_ns : 0;
+
+    if (run_stats) {
+        *run_stats = stats;
+    }
 }
 
 // Execute a single statement
 static void run_statement(const struct node *const stmt, FILE *output_file)
+{
+    if (prof.data) {
+        profile_statement(stmt, output_file);
+    } else if (state->sampling) {
+        const uint_fast32_t outer = atomic_load_explicit(&sample_site, memory_order_relaxed);
+
+        atomic_store_explicit(&sample_site, stmt->slot + 1, memory_order_relaxed);
+        execute_statement(stmt, output_file);
+        atomic_store_explicit(&sample_site, outer, memory_order_relaxed);
+    } else {
+        execute_statement(stmt, output_file);
+    }
+}
+
+// Execute a statement, adding its count and time to the profile
+static void profile_statement(const struct node *const stmt, FILE *output_file)
+{
+    struct stmt_profile *const entry = &prof.data->statements[stmt->slot];
+    const uint32_t parent = prof.path;
+    const uint64_t parent_children = prof.children;
+    const uint64_t start = profile_clock();
+
+    prof.path = profile_enter(prof.data, parent, stmt->slot);
+    prof.children = 0;
+    entry->count++;
+    entry->depth++;
+
+    execute_statement(stmt, output_file);
+
+    const uint64_t elapsed = profile_clock() - start;
+    const uint64_t self = elapsed > prof.children ? elapsed - prof.children : 0;
+
+    entry->exclusive_ns += self;
+
+    if (!--entry->depth) {
+        entry->inclusive_ns += elapsed;
+    }
+
+    if (prof.path) {
+        prof.data->paths[prof.path].ns += self;
+    }
+
+    prof.path = parent;
+    prof.children = parent_children + elapsed;
+}
+
+// Execute a statement in the AST walker
+static void execute_statement(const struct node *const stmt, FILE *output_file)
 {
     // Determine statement type and delegate to appropriate handler
     switch (stmt->children[0]->nt) {
@@ -66,108 +527,173 @@ static void run_statement(const struct node *const stmt, FILE *output_file)
         run_ctrl(stmt->children[0], output_file);
         break;
 
+    case NT_Exst:  // Expression statement
+        run_exst(stmt->children[0], output_file);
+        break;
+
+    case NT_Rtrn:  // Return statement: the blocks of the call are left
+        frames.result = eval_expr(stmt->children[0]->children[1], output_file);
+        frames.returning = 1;
+        break;
+
+    case NT_Func:  // Function definition, which does nothing when reached
+        break;
+
     default:
         abort();  // Unknown statement type
     }
 }
 
+// Assign a variable never used as an array; it needs no allocation
+static void assign_scalar(const struct node *const assn, FILE *output_file)
+{
+    const uint32_t slot = assn->slot;
+
+    if (state->varstore.vars[slot].defined) {
+        state->varstore.scalars[slot] = eval_expr(assn->children[2], output_file);
+    } else if (state->varstore.size < VARSTORE_CAPACITY) {
+        // The value is evaluated while the variable is still undefined
+        state->varstore.scalars[slot] = eval_expr(assn->children[2], output_file);
+        state->varstore.vars[slot].defined = 1;
+        state->varstore.size++;
+    } else {
+        warn_at(warnings, output_file, assn->children[0]->token, WARN_VARSTORE);
+    }
+}
+
 // Execute an assignment statement
 static void run_assign(const struct node *const assn, FILE *output_file)
 {
+    if (assn->flags & NF_LOCAL) {
+        // Evaluated first: a call in the value may move the stack
+        const int value = eval_expr(assn->children[2], output_file);
+
+        frames.values[frames.base + assn->slot] = value;
+        frames.defined[frames.base + assn->slot] = 1;
+        return;
+    }
+
+    if (assn->flags & NF_SCALAR) {
+        assign_scalar(assn, output_file);
+        return;
+    }
+
     // Check if left-hand side is an array access (aexp) or scalar
-    const int lhs_is_aexp = assn->children[0]->nchildren;
-    
+    const struct node *const lhs = assn->children[0];
+    const int lhs_is_aexp = lhs->nchildren;
+
     // Get array index if this is an array assignment, otherwise use 0
-    const int array_idx = lhs_is_aexp ?
-        eval_expr(assn->children[0]->children[2], output_file) : 0;
-
-    // Get variable name start and length
-    const uint8_t *const beg = lhs_is_aexp ?
-        assn->children[0]->children[0]->token->beg :
-        assn->children[0]->token->beg;
-
-    const ptrdiff_t len = lhs_is_aexp ?
-        assn->children[0]->children[0]->token->end - beg :
-        assn->children[0]->token->end - beg;
-
-    // Look for existing variable
-    size_t var_idx;
-    for (var_idx = 0; var_idx < varstore.size; ++var_idx) {
-        if (varstore.vars[var_idx].len == len &&
-            !memcmp(varstore.vars[var_idx].beg, beg, len)) {
-
-            const size_t array_size = varstore.vars[var_idx].array_size;
-
-            if (!array_size) {
-                // Previous allocation failed
-                fprintf(output_file, "WARN: a previous reallocation has failed, "
-                    "assignment has no effect\n");
-                return;
-            }
+    const int array_idx = lhs_is_aexp ? eval_expr(lhs->children[2], output_file) : 0;
+
+    // Accesses proven in bounds need neither the checks nor growth below
+    if (lhs_is_aexp && (lhs->flags & NF_INBOUNDS) && state->bce_live[lhs->loop]) {
+        const int value = eval_expr(assn->children[2], output_file);
+        state->varstore.vars[assn->slot].array.dense[array_idx] = value;
+        stats.bce_elided++;
+        return;
+    }
 
-            if (array_idx >= 0 && array_idx < array_size) {
-                // Existing array/slot - just assign
-                varstore.vars[var_idx].values[array_idx] =
-                    eval_expr(assn->children[2], output_file);
-                return;
-            } else if (array_idx >= 0) {
-                // Need to resize array
-                const size_t new_size = (array_idx + 1) * 2;  // Double the needed size
-
-                int *const tmp = realloc(
-                    varstore.vars[var_idx].values, new_size * sizeof(int));
-
-                if (!tmp) {
-                    free(varstore.vars[var_idx].values);
-                    varstore.vars[var_idx].array_size = 0;
-                    varstore.vars[var_idx].values = NULL;
-                    fprintf(output_file, "realloc failed\n");
-                    return;
-                }
+    int fresh;
+    struct array *const array = element_for_write(assn->slot, array_idx, &fresh,
+        lhs_is_aexp ? lhs->children[0]->token : lhs->token, output_file);
 
-                varstore.vars[var_idx].values = tmp;
-                varstore.vars[var_idx].array_size = new_size;
-                varstore.vars[var_idx].values[array_idx] =
-                    eval_expr(assn->children[2], output_file);
-                return;
-            } else {
-                fprintf(output_file, "warn: negative array offset\n");
-                return;
-            }
-        }
+    // The value is only evaluated if the assignment can take effect
+    if (array) {
+        store_element(assn->slot, array, array_idx,
+            eval_expr(assn->children[2], output_file), fresh);
     }
+}
 
-    // Variable not found - create new entry
-    if (var_idx < VARSTORE_CAPACITY) {
-        if (array_idx < 0) {
-            fprintf(output_file, "warn: negative array offset\n");
-            return;
+// Make element `idx` of a variable writable as an assignment does, growing or
+// creating it, and return its array. Returns NULL, after warning at `site`,
+// if the assignment has no effect. A variable created here (`*fresh`) only
+// becomes defined in store_element(), after the assigned value has been
+// evaluated.
+static struct array *element_for_write(const uint32_t slot, const int idx,
+    int *const fresh, const struct token *const site, FILE *output_file)
+{
+    *fresh = 0;
+
+    // Existing variable
+    if (state->varstore.vars[slot].defined) {
+        struct array *const array = &state->varstore.vars[slot].array;
+
+        if (!array->size) {
+            // Previous allocation failed
+            warn_at(warnings, output_file, site, WARN_REALLOC);
+            return NULL;
+        }
+
+        if (idx < 0) {
+            warn_at(warnings, output_file, site, WARN_NEGATIVE);
+            return NULL;
         }
 
-        varstore.vars[var_idx].beg = beg;
-        varstore.vars[var_idx].len = len;
-        varstore.vars[var_idx].values = malloc((array_idx + 1) * sizeof(int));
-        varstore.vars[var_idx].array_size = 0;
+        // Existing slot, or grow the array to make room for it
+        const int status = array_grow(array, idx);
 
-        if (!varstore.vars[var_idx].values) {
-            fprintf(output_file, "malloc failed\n");
-            return;
+        if (status == ARRAY_LIMIT) {
+            halt(RUN_STOP_MEMORY);
+            return NULL;
+        } else if (status) {
+            fprintf(output_file, "realloc failed\n");
+            return NULL;
         }
 
-        varstore.vars[var_idx].array_size = array_idx + 1;
-        varstore.vars[var_idx].values[array_idx] = eval_expr(assn->children[2], output_file);
-        varstore.size++;
-    } else {
-        fprintf(output_file, "warn: varstore exhausted, assignment has no effect\n");
+        return array;
+    }
+
+    // Variable not found - create new entry
+    if (state->varstore.size >= VARSTORE_CAPACITY) {
+        warn_at(warnings, output_file, site, WARN_VARSTORE);
+        return NULL;
+    }
+
+    if (idx < 0) {
+        warn_at(warnings, output_file, site, WARN_NEGATIVE);
+        return NULL;
+    }
+
+    const int status = array_init(&state->varstore.vars[slot].array, idx);
+
+    if (status == ARRAY_LIMIT) {
+        halt(RUN_STOP_MEMORY);
+        return NULL;
+    } else if (status) {
+        fprintf(output_file, "malloc failed\n");
+        return NULL;
+    }
+
+    *fresh = 1;
+    return &state->varstore.vars[slot].array;
+}
+
+// Store a value into an element made writable by element_for_write()
+static void store_element(const uint32_t slot, struct array *const array, const int idx,
+    const int value, const int fresh)
+{
+    array_set(array, idx, value);
+
+    if (fresh) {
+        state->varstore.vars[slot].defined = 1;
+        state->varstore.size++;
     }
 }
 
 // Execute a print statement
 static void run_print(const struct node *const prnt, FILE *output_file)
 {
-    if (prnt->nchildren == 3) {
+    print_value(prnt, eval_expr(prnt->children[prnt->nchildren - 2], output_file), output_file);
+}
+
+// Print the value of a print statement's expression
+static void print_value(const struct node *const prnt, const int value, FILE *output_file)
+{
+    if (fuel < 0) {
+        return;  // The value was cut short by a limit
+    } else if (prnt->nchildren == 3) {
         // Simple print of expression
-        fprintf(output_file, "%d\n", eval_expr(prnt->children[1], output_file));
+        fprintf(output_file, "%d\n", value);
     } else if (prnt->nchildren == 4) {
         // Print with string literal prefix
         const struct node *const strl = prnt->children[1];
@@ -176,7 +702,7 @@ static void run_print(const struct node *const prnt, FILE *output_file)
         const uint8_t *const end = strl->token->end - 1; // Skip closing quote
         const ptrdiff_t len = end - beg;
 
-        fprintf(output_file, "%.*s%d\n", (int) len, beg, eval_expr(prnt->children[2], output_file));
+        fprintf(output_file, "%.*s%d\n", (int) len, beg, value);
     }
 }
 
@@ -189,10 +715,7 @@ static void run_ctrl(const struct node *const ctrl, FILE *output_file)
 
         if (eval_expr(cond->children[1], output_file)) {
             // Execute 'if' block
-            const struct node *stmt = cond->children[3];
-            while (stmt->nchildren) {
-                run_statement(stmt++, output_file);
-            }
+            run_block(cond->children[3], output_file);
         } else if (ctrl->nchildren >= 2) {
             // Check 'elif' and 'else' blocks
             size_t child_idx = 1;
@@ -202,19 +725,13 @@ static void run_ctrl(const struct node *const ctrl, FILE *output_file)
 
                     if (eval_expr(elif->children[1], output_file)) {
                         // Execute 'elif' block
-                        const struct node *stmt = elif->children[3];
-                        while (stmt->nchildren) {
-                            run_statement(stmt++, output_file);
-                        }
+                        run_block(elif->children[3], output_file);
                         break;
                     }
                 } else {
                     // Execute 'else' block
                     const struct node *const els = ctrl->children[child_idx];
-                    const struct node *stmt = els->children[2];
-                    while (stmt->nchildren) {
-                        run_statement(stmt++, output_file);
-                    }
+                    run_block(els->children[2], output_file);
                 }
             } while (++child_idx < ctrl->nchildren);
         }
@@ -224,25 +741,59 @@ static void run_ctrl(const struct node *const ctrl, FILE *output_file)
         const struct node *const dowh = ctrl->children[0];
         const struct node *const expr = dowh->children[dowh->nchildren - 2];
 
-        do {
+        // A loop compiled on an earlier entry runs in tier 1 from the start
+        if (state->tier.loops[dowh->loop].code) {
+            stats.tier_entries++;
+            run_tier(dowh, output_file);
+            break;
+        }
+
+        for (;;) {
+            if (!step()) {
+                break;
+            }
+
             // Execute loop body
-            const struct node *stmt = dowh->children[2];
-            while (stmt->nchildren) {
-                run_statement(stmt++, output_file);
+            profile_trip(dowh);
+            run_block(dowh->children[2], output_file);
+
+            if (!running() || !eval_expr(expr, output_file)) {
+                break;
+            }
+
+            // Once the loop is hot, the remaining iterations continue in its compiled code
+            if (tier_count(dowh)) {
+                run_tier(dowh, output_file);
+                break;
             }
-        } while (eval_expr(expr, output_file));
+        }
     } break;
 
     case NT_Whil: {  // While loop
         const struct node *const whil = ctrl->children[0];
+        uint8_t was_live;
 
-        while (eval_expr(whil->children[1], output_file)) {
-            // Execute loop body
-            const struct node *stmt = whil->children[3];
-            while (stmt->nchildren) {
-                run_statement(stmt++, output_file);
+        if (enter_while(whil, &was_live, output_file)) {
+            break;
+        }
+
+        if (state->tier.loops[whil->loop].code) {
+            stats.tier_entries++;
+            run_tier(whil, output_file);
+        } else {
+            while (running() && eval_expr(whil->children[1], output_file) && step()) {
+                // Execute loop body
+                profile_trip(whil);
+                run_block(whil->children[3], output_file);
+
+                if (tier_count(whil)) {
+                    run_tier(whil, output_file);
+                    break;
+                }
             }
         }
+
+        state->bce_live[whil->loop] = was_live;
     } break;
 
     default:
@@ -250,28 +801,91 @@ static void run_ctrl(const struct node *const ctrl, FILE *output_file)
     }
 }
 
+// Execute the statements of a block, up to a return statement
+static void run_block(const struct node *stmt, FILE *output_file)
+{
+    while (stmt->nchildren && running()) {
+        run_statement(stmt++, output_file);
+    }
+}
+
+// Count `trips` iterations of a while loop that ran all at once `how` in the
+// profile, and a run of each statement of its body per iteration
+static void profile_batch(const struct node *const whil, const uint64_t trips, const uint8_t how)
+{
+    if (!prof.data) {
+        return;
+    }
+
+    struct stmt_profile *const statements = prof.data->statements;
+
+    statements[state->program->loops[whil->loop].stmt].trips += trips;
+    statements[state->program->loops[whil->loop].stmt].how |= how;
+
+    for (const struct node *stmt = whil->children[3]; stmt->nchildren; ++stmt) {
+        statements[stmt->slot].count += trips;
+        statements[stmt->slot].how |= how;
+    }
+}
+
+// Entry actions of a while loop, saving the loop's previous bounds check state
+// in `*was_live`. Returns 1 if the loop has already run element-wise.
+static int enter_while(const struct node *const whil, uint8_t *const was_live, FILE *output_file)
+{
+    const struct loop_info *const loop = &state->program->loops[whil->loop];
+    const uint64_t elements = stats.vector_elements, iterations = stats.par_iterations;
+
+    // Element-wise loops run whole ranges of i at once when no iteration can warn
+    if (loop->vector && run_vector(loop, output_file)) {
+        profile_batch(whil, stats.vector_elements - elements, PROFILE_VECTOR);
+        return 1;
+    }
+
+    // So do loops with independent iterations, on several threads
+    if (loop->par && run_parallel(loop, output_file)) {
+        profile_batch(whil, stats.par_iterations - iterations, PROFILE_PARALLEL);
+        return 1;
+    }
+
+    *was_live = state->bce_live[whil->loop];
+
+    // Skip the bounds checks the optimizer proved redundant, if its guard holds
+    if (loop->narrays) {
+        state->bce_live[whil->loop] = bce_guard(loop, output_file);
+        state->bce_live[whil->loop] ? stats.bce_guards_passed++ : stats.bce_guards_failed++;
+    }
+
+    return 0;
+}
+
 // Evaluate an atomic expression (variable or number)
 static int eval_atom(const struct node *const atom, FILE *output_file)
 {
     switch (atom->children[0]->token->token) {
     case token_NAME: {  // Variable reference
-        const uint8_t *const beg = atom->children[0]->token->beg;
-        const ptrdiff_t len = atom->children[0]->token->end - beg;
+        if (atom->flags & NF_LOCAL) {
+            if (frames.defined[frames.base + atom->slot]) {
+                return frames.values[frames.base + atom->slot];
+            }
+
+            warn_at(warnings, output_file, atom->children[0]->token, WARN_UNDEFINED);
+            return 0;
+        }
 
         // Look up variable in store
-        for (size_t idx = 0; idx < varstore.size; ++idx) {
-            if (varstore.vars[idx].len == len &&
-                !memcmp(varstore.vars[idx].beg, beg, len)) {
+        if (state->varstore.vars[atom->slot].defined) {
+            if (atom->flags & NF_SCALAR) {
+                return state->varstore.scalars[atom->slot];
+            }
 
-                if (varstore.vars[idx].array_size) {
-                    return varstore.vars[idx].values[0];  // Return scalar value
-                } else {
-                    return 0;  // Uninitialized array
-                }
+            if (state->varstore.vars[atom->slot].array.size) {
+                return array_get(&state->varstore.vars[atom->slot].array, 0);  // Return scalar value
+            } else {
+                return 0;  // Uninitialized array
             }
         }
 
-        fprintf(output_file, "warn: access to undefined variable\n");
+        warn_at(warnings, output_file, atom->children[0]->token, WARN_UNDEFINED);
         return 0;
     }
 
@@ -315,6 +929,9 @@ static int eval_expr(const struct node *const expr, FILE *output_file)
     case NT_Aexp:  // Array access
         return eval_aexp(expr->children[0], output_file);
 
+    case NT_Call:  // Built-in function
+        return eval_call(expr->children[0], output_file);
+
     default:
         abort();  // Unknown expression type
     }
@@ -334,8 +951,15 @@ static int eval_bexp(const struct node *const bexp, FILE *output_file)
     const int left = eval_expr(bexp->children[0], output_file);
     const int right = eval_expr(bexp->children[2], output_file);
 
+    return apply_binary(bexp->children[1], left, right, output_file);
+}
+
+// Apply a binary operator (the operator's leaf) to its operands
+static int apply_binary(const struct node *const op, const int left, const int right,
+    FILE *output_file)
+{
     // Perform operation based on operator
-    switch (bexp->children[1]->token->token) {
+    switch (op->token->token) {
     case token_PLUS:  // Addition
         return left + right;
 
@@ -349,7 +973,7 @@ static int eval_bexp(const struct node *const bexp, FILE *output_file)
         if (right) {
             return left / right;
         } else {
-            fprintf(output_file, "warn: prevented attempt to divide by zero\n");
+            warn_at(warnings, output_file, op->token, WARN_DIVIDE);
             return 0;
         }
     }
@@ -416,29 +1040,1959 @@ static int eval_texp(const struct node *const texp, FILE *output_file)
 // Evaluate an array access expression
 static int eval_aexp(const struct node *const aexp, FILE *output_file)
 {
-    const uint8_t *const beg = aexp->children[0]->token->beg;
-    const ptrdiff_t len = aexp->children[0]->token->end - beg;
     const int array_idx = eval_expr(aexp->children[2], output_file);
 
-    if (array_idx < 0) {
-        fprintf(output_file, "warn: negative array offset\n");
+    // Accesses proven in bounds skip the lookup and the checks below
+    if ((aexp->flags & NF_INBOUNDS) && state->bce_live[aexp->loop]) {
+        stats.bce_elided++;
+        return state->varstore.vars[aexp->slot].array.dense[array_idx];
+    }
+
+    return load_element(aexp->slot, array_idx, aexp->children[0]->token, output_file);
+}
+
+// Read element `idx` of an array, warning at `site` if it does not exist
+static int load_element(const uint32_t slot, const int idx, const struct token *const site,
+    FILE *output_file)
+{
+    if (idx < 0) {
+        warn_at(warnings, output_file, site, WARN_NEGATIVE);
         return 0;
     }
 
     // Look up array in variable store
-    for (size_t idx = 0; idx < varstore.size; ++idx) {
-        if (varstore.vars[idx].len == len &&
-            !memcmp(varstore.vars[idx].beg, beg, len)) {
-
-            if (array_idx < varstore.vars[idx].array_size) {
-                return varstore.vars[idx].values[array_idx];
-            } else {
-                fprintf(output_file, "warn: out of bounds array access\n");
-                return 0;
-            }
+    if (state->varstore.vars[slot].defined) {
+        if ((size_t) idx < state->varstore.vars[slot].array.size) {
+            return array_get(&state->varstore.vars[slot].array, idx);
+        } else {
+            warn_at(warnings, output_file, site, WARN_BOUNDS);
+            return 0;
         }
     }
 
-    fprintf(output_file, "warn: access to undefined array\n");
+    warn_at(warnings, output_file, site, WARN_NO_ARRAY);
     return 0;
-}
\ No newline at end of file
+}
+
+// Check that an expression only reads defined variables and no arrays, so
+// evaluating it cannot print a warning
+static int reads_defined(const struct node *const expr)
+{
+    const struct node *const node = expr->children[0];
+
+    switch (node->nt) {
+    case NT_Atom:
+        return node->children[0]->token->token == token_NMBR ||
+            state->varstore.vars[node->slot].defined;
+
+    case NT_Pexp:
+        return reads_defined(node->children[1]);
+
+    case NT_Bexp:
+        return node->children[1]->token->token != token_DIVI &&
+            reads_defined(node->children[0]) && reads_defined(node->children[2]);
+
+    case NT_Uexp:
+        return reads_defined(node->children[1]);
+
+    case NT_Texp:
+        return reads_defined(node->children[0]) &&
+            reads_defined(node->children[2]) && reads_defined(node->children[4]);
+
+    default:
+        return 0;
+    }
+}
+
+// Check, on entry to a loop, the facts the optimizer could not prove
+// statically: the induction variable starts at a usable index and every
+// marked array already holds the elements touched by the last iteration
+static int bce_guard(const struct loop_info *const loop, FILE *output_file)
+{
+    if (!state->varstore.vars[loop->ivar].defined || !reads_defined(loop->limit)) {
+        return 0;
+    }
+
+    const int64_t start = scalar_value(loop->ivar);
+    const int64_t last = (int64_t) eval_expr(loop->limit, output_file) - !loop->inclusive;
+
+    if (last < start) {
+        return 1;  // The body does not run at all
+    }
+
+    if (start + loop->kmin < 0) {
+        return 0;
+    }
+
+    for (size_t array_idx = 0; array_idx < loop->narrays; ++array_idx) {
+        const uint32_t slot = loop->arrays[array_idx].slot;
+        const struct array *const array = &state->varstore.vars[slot].array;
+        const int64_t max_idx = last + loop->arrays[array_idx].kmax;
+
+        if (!state->varstore.vars[slot].defined ||
+            max_idx >= (int64_t) array->size || max_idx >= (int64_t) array->dense_cap) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Check that elements first .. last of an array can be read without a
+// warning, straight from its dense prefix
+static int readable_range(const uint32_t slot, const int64_t first, const int64_t last)
+{
+    const struct array *const array = &state->varstore.vars[slot].array;
+
+    return state->varstore.vars[slot].defined && first >= 0 &&
+        last < (int64_t) array->size && last < (int64_t) array->dense_cap;
+}
+
+// Check that assigning elements first .. last of a variable in order would
+// not print anything, so grow_for_range() can stand in for it
+static int writable_range(const uint32_t slot, const int64_t first, const int64_t last)
+{
+    const struct array *const array = &state->varstore.vars[slot].array;
+
+    if (first < 0) {
+        return 0;
+    }
+
+    if (!state->varstore.vars[slot].defined) {
+        return first < (int64_t) ARRAY_PAGE_SIZE && state->varstore.size < VARSTORE_CAPACITY;
+    }
+
+    return array->size && !(array->pages && last >= (int64_t) array->dense_cap);
+}
+
+// Give a variable the size that assigning elements first .. last in order
+// would, with all of them in the dense prefix. Returns 0 if memory ran out;
+// sizes only ever change as those assignments would have changed them, so
+// the caller can still fall back to assigning element by element. The range
+// must pass writable_range(), so first is at least 0.
+static int grow_for_range(const uint32_t slot, const int64_t first, const int64_t last)
+{
+    struct array *const array = &state->varstore.vars[slot].array;
+
+    if (!state->varstore.vars[slot].defined) {
+        if (array_init(array, first)) {
+            return 0;
+        }
+
+        state->varstore.vars[slot].defined = 1;
+        state->varstore.size++;
+    }
+
+    // The first index at or past the size is where an assignment grows it
+    while ((int64_t) array->size <= last) {
+        array->size = ((array->size > (size_t) first ? array->size : (size_t) first) + 1) * 2;
+    }
+
+    return array_reserve(array, last + 1) == ARRAY_OK;
+}
+
+// Value of a defined variable read as a scalar
+static int scalar_value(const uint32_t slot)
+{
+    const struct array *const array = &state->varstore.vars[slot].array;
+
+    if (!state->program->symbols[slot].is_array) {
+        return state->varstore.scalars[slot];
+    }
+
+    return array->size ? array_get(array, 0) : 0;
+}
+
+// Check that a variable is defined and can be assigned as a scalar without a warning
+static int scalar_assignable(const uint32_t slot)
+{
+    return state->varstore.vars[slot].defined &&
+        (!state->program->symbols[slot].is_array || state->varstore.vars[slot].array.size);
+}
+
+// Assign a variable checked with scalar_assignable()
+static void set_scalar(const uint32_t slot, const int value)
+{
+    if (state->program->symbols[slot].is_array) {
+        array_set(&state->varstore.vars[slot].array, 0, value);
+    } else {
+        state->varstore.scalars[slot] = value;
+    }
+}
+
+// Kernel for each binary operator, or -1 if it has none
+static int simd_op(const token_t op)
+{
+    switch (op) {
+    case token_PLUS: return SIMD_ADD;
+    case token_MINS: return SIMD_SUB;
+    case token_MULT: return SIMD_MUL;
+    case token_EQUL: return SIMD_EQ;
+    case token_NEQL: return SIMD_NE;
+    case token_LTHN: return SIMD_LT;
+    case token_GTHN: return SIMD_GT;
+    case token_LTEQ: return SIMD_LE;
+    case token_GTEQ: return SIMD_GE;
+    case token_CONJ: return SIMD_AND;
+    case token_DISJ: return SIMD_OR;
+    default: return -1;
+    }
+}
+
+// Evaluate an expression of an element-wise loop for i = from .. from + n - 1.
+// The result is either a scratch row taken from `*row` or the array itself.
+static const int *eval_vector(const struct node *const expr, const uint32_t ivar,
+    const int from, const size_t n, int **const row)
+{
+    const struct node *const node = expr->children[0];
+    int *const dst = *row;
+
+    switch (node->nt) {
+    case NT_Atom:
+        *row += VECTOR_CHUNK;
+
+        if (node->children[0]->token->token == token_NMBR) {
+            state->simd->fill(dst, eval_atom(node, NULL), n);
+        } else if (node->slot == ivar) {
+            state->simd->iota(dst, from, n);
+        } else {
+            state->simd->fill(dst, scalar_value(node->slot), n);
+        }
+
+        return dst;
+
+    case NT_Pexp:
+        return eval_vector(node->children[1], ivar, from, n, row);
+
+    case NT_Aexp:
+        return state->varstore.vars[node->slot].array.dense + from + node->aux;
+
+    case NT_Bexp: {
+        const int *const left = eval_vector(node->children[0], ivar, from, n, row);
+        const int *const right = eval_vector(node->children[2], ivar, from, n, row);
+        int *const result = *row;
+
+        *row += VECTOR_CHUNK;
+        state->simd->binary[simd_op(node->children[1]->token->token)](result, left, right, n);
+        return result;
+    }
+
+    case NT_Uexp: {
+        const int *const operand = eval_vector(node->children[1], ivar, from, n, row);
+        int *const result = *row;
+
+        switch (node->children[0]->token->token) {
+        case token_MINS:
+            *row += VECTOR_CHUNK;
+            state->simd->neg(result, operand, n);
+            return result;
+
+        case token_NEGA:
+            *row += VECTOR_CHUNK;
+            state->simd->not(result, operand, n);
+            return result;
+
+        default:
+            return operand;  // Unary plus
+        }
+    }
+
+    case NT_Texp: {
+        const int *const cond = eval_vector(node->children[0], ivar, from, n, row);
+        const int *const then = eval_vector(node->children[2], ivar, from, n, row);
+        const int *const other = eval_vector(node->children[4], ivar, from, n, row);
+        int *const result = *row;
+
+        *row += VECTOR_CHUNK;
+        state->simd->select(result, cond, then, other, n);
+        return result;
+    }
+
+    default:
+        abort();  // Rejected by the optimizer
+    }
+}
+
+// Run an element-wise loop (see struct vector_loop) over its whole range,
+// statement by statement, a chunk of iterations at a time. This only happens
+// when the loop could not print anything: every variable it reads is defined
+// and every array element it reads is in bounds. Arrays it only writes grow
+// exactly as the element-by-element loop would have grown them. Returns 0,
+// having changed nothing visible, when the loop has to run normally.
+static int run_vector(const struct loop_info *const loop, FILE *output_file)
+{
+    const struct vector_loop *const vector = loop->vector;
+
+    if (!scalar_assignable(loop->ivar) || !reads_defined(loop->limit)) {
+        return stats.vector_fallbacks++, 0;
+    }
+
+    for (size_t idx = 0; idx < vector->nscalars; ++idx) {
+        if (!state->varstore.vars[vector->scalars[idx]].defined) {
+            return stats.vector_fallbacks++, 0;
+        }
+    }
+
+    const int64_t start = scalar_value(loop->ivar);
+    const int64_t last = (int64_t) eval_expr(loop->limit, output_file) - !loop->inclusive;
+
+    if (last < start) {
+        stats.vector_runs++;
+        return 1;  // The body does not run at all
+    }
+
+    if (start < 0 || last >= INT32_MAX) {
+        return stats.vector_fallbacks++, 0;
+    }
+
+    size_t created = 0;
+
+    for (size_t idx = 0; idx < vector->narrays; ++idx) {
+        const struct vector_array *const entry = &vector->arrays[idx];
+
+        if (entry->live_in ?
+            !readable_range(entry->slot, start + entry->kmin, last + entry->kmax) :
+            !writable_range(entry->slot, start, last)) {
+            return stats.vector_fallbacks++, 0;
+        }
+
+        created += !state->varstore.vars[entry->slot].defined;
+    }
+
+    if (state->varstore.size + created > VARSTORE_CAPACITY) {
+        return stats.vector_fallbacks++, 0;
+    }
+
+    if (scratch.nrows < vector->ntemps) {
+        int *const rows = realloc(scratch.rows, vector->ntemps * VECTOR_CHUNK * sizeof(int));
+
+        if (!rows) {
+            return stats.vector_fallbacks++, 0;
+        }
+
+        scratch.rows = rows;
+        scratch.nrows = vector->ntemps;
+    }
+
+    // Grow the arrays whose elements the loop writes before reading them
+    for (size_t idx = 0; idx < vector->narrays; ++idx) {
+        const struct vector_array *const entry = &vector->arrays[idx];
+
+        if (!entry->live_in && !grow_for_range(entry->slot, start, last)) {
+            return stats.vector_fallbacks++, 0;
+        }
+    }
+
+    // Without the steps for every iteration, the loop stops at the right one
+    if (!take_steps(last - start + 1)) {
+        return stats.vector_fallbacks++, 0;
+    }
+
+    // Statement by statement over each chunk, so a later statement sees the
+    // elements an earlier one just wrote
+    for (int64_t from = start; from <= last; from += VECTOR_CHUNK) {
+        const size_t n = last - from + 1 < VECTOR_CHUNK ? last - from + 1 : VECTOR_CHUNK;
+        const struct node *stmt = loop->node->children[3];
+
+        for (size_t stmt_idx = 0; stmt_idx < vector->nstmts; ++stmt_idx, ++stmt) {
+            const struct node *const assn = stmt->children[0];
+            int *row = scratch.rows;
+            const int *const value = eval_vector(assn->children[2], loop->ivar, from, n, &row);
+
+            memmove(state->varstore.vars[assn->slot].array.dense + from, value, n * sizeof(int));
+        }
+    }
+
+    set_scalar(loop->ivar, (int) (last + 1));
+    stats.vector_runs++;
+    stats.vector_elements += last - start + 1;
+    return 1;
+}
+
+// Evaluate an expression of a parallel loop for one value of i. The entry
+// checks of run_parallel() ensure that nothing here can warn, so the only
+// shared state it touches is array elements.
+static int eval_par(const struct node *const expr, const uint32_t ivar, const int i)
+{
+    const struct node *const node = expr->children[0];
+
+    switch (node->nt) {
+    case NT_Atom:
+        if (node->children[0]->token->token == token_NMBR) {
+            return eval_atom(node, NULL);
+        }
+
+        return node->slot == ivar ? i : scalar_value(node->slot);
+
+    case NT_Pexp:
+        return eval_par(node->children[1], ivar, i);
+
+    case NT_Bexp: {
+        const int left = eval_par(node->children[0], ivar, i);
+        const int right = eval_par(node->children[2], ivar, i);
+
+        // Only nonzero literals are divided by
+        return apply_binary(node->children[1], left, right, NULL);
+    }
+
+    case NT_Uexp: {
+        const int operand = eval_par(node->children[1], ivar, i);
+
+        switch (node->children[0]->token->token) {
+        case token_MINS:
+            return -operand;
+
+        case token_NEGA:
+            return !operand;
+
+        default:
+            return operand;  // Unary plus
+        }
+    }
+
+    case NT_Texp:
+        return eval_par(node->children[0], ivar, i) ?
+            eval_par(node->children[2], ivar, i) : eval_par(node->children[4], ivar, i);
+
+    case NT_Aexp:
+        return state->varstore.vars[node->slot].array.dense[i + node->aux];
+
+    default:
+        abort();  // Rejected by the optimizer
+    }
+}
+
+// Run one iteration of a block of a parallel loop
+static void run_par_block(const struct node *stmt, const uint32_t ivar, const int i)
+{
+    for (; stmt->nchildren; ++stmt) {
+        const struct node *const node = stmt->children[0];
+
+        if (node->nt == NT_Assn) {
+            const struct node *const lhs = node->children[0];
+
+            if (!lhs->nchildren) {
+                return;  // The increment of i, last in the body
+            }
+
+            const int value = eval_par(node->children[2], ivar, i);
+            state->varstore.vars[node->slot].array.dense[i + lhs->aux] = value;
+            continue;
+        }
+
+        // If/elif/else
+        for (size_t arm_idx = 0; arm_idx < node->nchildren; ++arm_idx) {
+            const struct node *const arm = node->children[arm_idx];
+
+            if (arm->nt == NT_Else) {
+                run_par_block(arm->children[2], ivar, i);
+                break;
+            }
+
+            if (eval_par(arm->children[1], ivar, i)) {
+                run_par_block(arm->children[3], ivar, i);
+                break;
+            }
+        }
+    }
+}
+
+// A parallel loop being run
+struct par_run {
+    struct run_state *state;
+    const struct loop_info *loop;
+    int64_t start;    // First value of i
+    int64_t count;    // Number of iterations
+};
+
+// Run the iterations of one task of a parallel loop
+static void run_par_task(void *const ctx, const size_t task)
+{
+    const struct par_run *const run = ctx;
+    const struct loop_info *const loop = run->loop;
+    const int64_t end = (int64_t) (task + 1) * PAR_CHUNK;
+
+    adopt(run->state);
+
+    for (int64_t it = (int64_t) task * PAR_CHUNK; it < end && it < run->count; ++it) {
+        run_par_block(loop->node->children[3], loop->ivar,
+            (int) (run->start + it * loop->par->step));
+    }
+}
+
+// Run a loop with independent iterations (see struct par_loop) on the
+// thread pool. This only happens when no iteration could print anything:
+// every variable it reads is defined, every array element it reads or writes
+// is in bounds, except in arrays that each iteration assigns before reading
+// them, which first grow exactly as the serial loop would have grown them.
+// Returns 0, having changed nothing visible, when the loop has to run
+// serially.
+static int run_parallel(const struct loop_info *const loop, FILE *output_file)
+{
+    const struct par_loop *const lp = loop->par;
+
+    if (state->par.threads < 2 || state->par.statements || !scalar_assignable(loop->ivar) ||
+        !reads_defined(loop->limit)) {
+        return 0;
+    }
+
+    const int64_t start = scalar_value(loop->ivar);
+    const int64_t last = (int64_t) eval_expr(loop->limit, output_file) - !loop->inclusive;
+    const int64_t count = last < start ? 0 : (last - start) / lp->step + 1;
+    const int64_t final = start + (count - 1) * lp->step;
+
+    // Small loops are not worth waking the threads for
+    if (count < PAR_MIN_ITERATIONS) {
+        return 0;
+    }
+
+    if (final + lp->step > INT32_MAX) {
+        return stats.par_fallbacks++, 0;
+    }
+
+    for (size_t idx = 0; idx < lp->nscalars; ++idx) {
+        if (!state->varstore.vars[lp->scalars[idx]].defined) {
+            return stats.par_fallbacks++, 0;
+        }
+    }
+
+    size_t created = 0;
+
+    for (size_t idx = 0; idx < lp->narrays; ++idx) {
+        const struct par_array *const entry = &lp->arrays[idx];
+
+        if (entry->grow ?
+            !writable_range(entry->slot, start + entry->kmin, final + entry->kmin) :
+            !readable_range(entry->slot, start + entry->kmin, final + entry->kmax)) {
+            return stats.par_fallbacks++, 0;
+        }
+
+        created += !state->varstore.vars[entry->slot].defined;
+    }
+
+    if (state->varstore.size + created > VARSTORE_CAPACITY) {
+        return stats.par_fallbacks++, 0;
+    }
+
+    if (!state->par.pool && !(state->par.pool = pool_create(state->par.threads))) {
+        state->par.threads = 1;
+        return stats.par_fallbacks++, 0;
+    }
+
+    // Grow the arrays whose elements the loop writes before reading them
+    for (size_t idx = 0; idx < lp->narrays; ++idx) {
+        const struct par_array *const entry = &lp->arrays[idx];
+
+        if (entry->grow && !grow_for_range(entry->slot, start + entry->kmin, final + entry->kmin)) {
+            return stats.par_fallbacks++, 0;
+        }
+    }
+
+    if (!take_steps(count)) {
+        return stats.par_fallbacks++, 0;
+    }
+
+    struct par_run run = { state, loop, start, count };
+    pool_for(state->par.pool, (count + PAR_CHUNK - 1) / PAR_CHUNK, run_par_task, &run);
+
+    set_scalar(loop->ivar, (int) (final + lp->step));
+    stats.par_runs++;
+    stats.par_iterations += count;
+    return 1;
+}
+
+// A top-level statement run by run_scheduled()
+struct stmt_run {
+    const struct node *stmt;
+    FILE *out;                 // Where it prints: the output file or a buffer
+    char *buf;                 // The buffer, once `out` is closed
+    size_t len;
+    struct run_stats stats;    // Counters of a statement run on the pool
+    struct warn_log warnings;  // Its warnings
+    struct warn_cut *cuts;     // Warnings an earlier statement printed first, left out of
+    size_t ncuts;              // the buffer
+    uint8_t done;
+};
+
+// The statements of one level that run on the pool
+struct stmt_level {
+    struct run_state *state;
+    struct stmt_run *runs;
+    const size_t *tasks;       // Index in `runs` of each task
+    struct warn_log *warnings; // Of the run, which the tasks read but do not change
+};
+
+// Run a top-level statement on the pool, keeping its counters, warnings and
+// scratch rows apart from those of the thread. A warning the run printed
+// before is not printed again; statements running at the same time may each
+// print the first warning of a site in a function they all call, and all but
+// the earliest are cut from the output when the logs are merged.
+static void run_stmt_task(void *const ctx, const size_t task)
+{
+    const struct stmt_level *const level = ctx;
+    struct stmt_run *const run = &level->runs[level->tasks[task]];
+    struct warn_log *const saved_warnings = warnings;
+    const struct run_stats saved_stats = stats;
+    const typeof(scratch) saved_scratch = scratch;
+    const typeof(frames) saved_frames = frames;
+    struct memo *const saved_memos = memos;
+    const int64_t saved_fuel = fuel;
+    const uint64_t saved_granted = granted;
+
+    adopt(level->state);
+    stats = (struct run_stats) { 0 };
+    scratch = (typeof(scratch)) { 0 };
+    frames = (typeof(frames)) { 0 };
+    memos = NULL;
+    warn_init(&run->warnings, NULL, level->warnings->all);
+    run->warnings.parent = level->warnings;
+    warnings = &run->warnings;
+    fuel_init();
+    run_statement(run->stmt, run->out);
+    stats.steps = fuel_used();
+    run->stats = stats;
+
+    // Steps left unused go back to the budget
+    if (state->gov.max_steps && fuel > 0) {
+        atomic_fetch_add(&state->gov.left, fuel);
+    }
+
+    fuel = saved_fuel;
+    granted = saved_granted;
+    free(scratch.rows);
+    frames_free();
+    memo_free();
+    stats = saved_stats;
+    scratch = saved_scratch;
+    frames = saved_frames;
+    memos = saved_memos;
+    warnings = saved_warnings;
+}
+
+// Add the counters of a statement that ran on the pool
+static void add_stats(const struct run_stats *const from)
+{
+    stats.bce_guards_passed += from->bce_guards_passed;
+    stats.bce_guards_failed += from->bce_guards_failed;
+    stats.bce_elided += from->bce_elided;
+    stats.vector_runs += from->vector_runs;
+    stats.vector_fallbacks += from->vector_fallbacks;
+    stats.vector_elements += from->vector_elements;
+    stats.bulk_elements += from->bulk_elements;
+    stats.bulk_fallbacks += from->bulk_fallbacks;
+    stats.tier_entries += from->tier_entries;
+    stats.calls += from->calls;
+    stats.memo_hits += from->memo_hits;
+    stats.steps += from->steps;
+    stats.tier1_ns += from->tier1_ns;
+}
+
+// Compile the loops of a statement before it runs alongside others, which
+// tier_count() cannot do for it
+static void precompile(const size_t stmt_idx)
+{
+    const uint32_t begin = stmt_idx ? state->program->stmts[stmt_idx - 1].loops_end : 1;
+
+    for (uint32_t id = begin; state->tier.threshold && id < state->program->stmts[stmt_idx].loops_end; ++id) {
+        if (!state->tier.loops[id].code) {
+            state->tier.loops[id].code = compile_loop(state->program->loops[id].node);
+            state->tier.loops[id].code ? stats.tier_promotions++ : stats.tier_failures++;
+        }
+    }
+}
+
+// Write out the buffered output of the statements that are done, in program
+// order, up to the first one that is not
+static void commit_output(struct stmt_run *const runs, size_t *const next, FILE *output_file)
+{
+    for (; *next < state->program->nstmts && runs[*next].done; ++*next) {
+        struct stmt_run *const run = &runs[*next];
+
+        if (run->out != output_file) {
+            size_t at = 0;
+
+            fclose(run->out);
+
+            for (size_t cut = 0; cut < run->ncuts; ++cut) {
+                fwrite(run->buf + at, 1, run->cuts[cut].offset - at, output_file);
+                at = run->cuts[cut].offset + run->cuts[cut].len;
+            }
+
+            fwrite(run->buf + at, 1, run->len - at, output_file);
+            free(run->buf);
+        }
+
+        free(run->cuts);
+    }
+}
+
+// Run the top-level statements level by level (see struct stmt_info). The
+// heavy statements of a level with several of them run on the pool, each
+// printing to a buffer. Any statement that runs while an earlier one has not
+// finished prints to a buffer too, and buffers are written out in program
+// order, so the output is the same as when running serially. Only if a
+// buffer cannot be allocated does a statement print directly.
+static void run_scheduled(const struct node *const unit, FILE *output_file)
+{
+    const size_t nstmts = state->program->nstmts;
+    struct stmt_run *const runs = calloc(nstmts, sizeof(struct stmt_run));
+    size_t *const order = malloc(nstmts * sizeof(size_t));        // By level
+    size_t *const ends = calloc(state->program->nlevels + 1, sizeof(size_t));  // Of each level in `order`
+    size_t *const tasks = malloc(nstmts * sizeof(size_t));
+    size_t next = 0;  // First statement whose output has not been written out
+
+    if (!runs || !order || !ends || !tasks) {
+        free(runs);
+        free(order);
+        free(ends);
+        free(tasks);
+
+        for (size_t stmt_idx = 1; stmt_idx < unit->nchildren - 1; ++stmt_idx) {
+            run_statement(unit->children[stmt_idx], output_file);
+        }
+
+        return;
+    }
+
+    // Sort the statements by level, keeping program order within a level
+    for (size_t stmt_idx = 0; stmt_idx < nstmts; ++stmt_idx) {
+        ends[state->program->stmts[stmt_idx].level]++;
+        runs[stmt_idx].stmt = unit->children[stmt_idx + 1];
+    }
+
+    for (uint32_t level = 1; level <= state->program->nlevels; ++level) {
+        ends[level] += ends[level - 1];
+    }
+
+    for (size_t stmt_idx = nstmts; stmt_idx-- > 0;) {
+        order[--ends[state->program->stmts[stmt_idx].level]] = stmt_idx;
+    }
+
+    // ends[level] is now where the level begins
+    for (uint32_t level = 1; level <= state->program->nlevels && !stopping(); ++level) {
+        const size_t begin = ends[level];
+        const size_t end = level < state->program->nlevels ? ends[level + 1] : nstmts;
+        size_t nheavy = 0, ntasks = 0;
+
+        for (size_t pos = begin; pos < end; ++pos) {
+            nheavy += state->program->stmts[order[pos]].heavy;
+        }
+
+        if (nheavy >= 2 && state->par.threads > 1 && !state->par.pool && !(state->par.pool = pool_create(state->par.threads))) {
+            state->par.threads = 1;
+        }
+
+        // The heavy statements, each on the pool with its own buffer
+        for (size_t pos = begin; nheavy >= 2 && state->par.threads > 1 && pos < end; ++pos) {
+            struct stmt_run *const run = &runs[order[pos]];
+
+            if (state->program->stmts[order[pos]].heavy &&
+                (run->out = open_memstream(&run->buf, &run->len))) {
+                precompile(order[pos]);
+                tasks[ntasks++] = order[pos];
+            }
+        }
+
+        if (ntasks) {
+            struct stmt_level group = { state, runs, tasks, warnings };
+
+            state->par.statements = 1;
+            pool_for(state->par.pool, ntasks, run_stmt_task, &group);
+            state->par.statements = 0;
+
+            for (size_t task = 0; task < ntasks; ++task) {
+                struct stmt_run *const run = &runs[tasks[task]];
+
+                add_stats(&run->stats);
+
+                // Without memory for the cuts, a warning may be printed again
+                run->cuts = malloc((run->warnings.nentries ?: 1) * sizeof(struct warn_cut));
+                run->ncuts = warn_merge(warnings, &run->warnings, run->cuts);
+                warn_free(&run->warnings);
+                run->done = 1;
+            }
+
+            stats.stmt_groups++;
+            stats.stmt_tasks += ntasks;
+        }
+
+        // The others, one after the other
+        for (size_t pos = begin; pos < end; ++pos) {
+            struct stmt_run *const run = &runs[order[pos]];
+
+            if (run->done || stopping()) {
+                continue;
+            }
+
+            commit_output(runs, &next, output_file);
+
+            if (order[pos] != next && !run->out) {
+                run->out = open_memstream(&run->buf, &run->len);
+            }
+
+            run->out = run->out ?: output_file;
+            run_statement(run->stmt, run->out);
+            run->done = 1;
+        }
+
+        commit_output(runs, &next, output_file);
+    }
+
+    // A run that stopped leaves the buffers of statements after the first one
+    // that did not finish, which are dropped
+    for (size_t stmt_idx = next; stmt_idx < nstmts; ++stmt_idx) {
+        if (runs[stmt_idx].out && runs[stmt_idx].out != output_file) {
+            fclose(runs[stmt_idx].out);
+            free(runs[stmt_idx].buf);
+        }
+
+        free(runs[stmt_idx].cuts);
+    }
+
+    free(runs);
+    free(order);
+    free(ends);
+    free(tasks);
+}
+
+// The array named by argument `idx` of a call
+static uint32_t array_arg(const struct node *const call, const size_t idx)
+{
+    return call_arg(call, idx)->children[0]->slot;
+}
+
+// fill(a, value, n): a[i] = value for i = 0 .. n - 1
+static void run_fill(const struct node *const call, FILE *output_file)
+{
+    const uint32_t slot = array_arg(call, 0);
+    const int value = eval_expr(call_arg(call, 1), output_file);
+    const int n = eval_expr(call_arg(call, 2), output_file);
+
+    if (n <= 0 || !spend(n)) {
+        return;
+    }
+
+    if (writable_range(slot, 0, n - 1) && grow_for_range(slot, 0, n - 1)) {
+        state->simd->fill(state->varstore.vars[slot].array.dense, value, n);
+        stats.bulk_elements += n;
+        return;
+    }
+
+    stats.bulk_fallbacks++;
+
+    for (int idx = 0; idx < n && fuel >= 0; ++idx) {
+        int fresh;
+        struct array *const array = element_for_write(slot, idx, &fresh,
+            call->children[0]->token, output_file);
+
+        if (array) {
+            store_element(slot, array, idx, value, fresh);
+        }
+    }
+}
+
+// copy(dst, src, n): dst[i] = src[i] for i = 0 .. n - 1
+static void run_copy(const struct node *const call, FILE *output_file)
+{
+    const uint32_t dst = array_arg(call, 0), src = array_arg(call, 1);
+    const int n = eval_expr(call_arg(call, 2), output_file);
+
+    if (n <= 0 || !spend(n)) {
+        return;
+    }
+
+    if (readable_range(src, 0, n - 1) && writable_range(dst, 0, n - 1)) {
+        if (dst == src) {
+            return;  // Every element is already in bounds and stays the same
+        }
+
+        if (grow_for_range(dst, 0, n - 1)) {
+            memcpy(state->varstore.vars[dst].array.dense, state->varstore.vars[src].array.dense,
+                n * sizeof(int));
+            stats.bulk_elements += n;
+            return;
+        }
+    }
+
+    stats.bulk_fallbacks++;
+
+    const struct token *const site = call->children[0]->token;
+
+    for (int idx = 0; idx < n && fuel >= 0; ++idx) {
+        int fresh;
+        struct array *const array = element_for_write(dst, idx, &fresh, site, output_file);
+
+        if (array) {
+            store_element(dst, array, idx, load_element(src, idx, site, output_file), fresh);
+        }
+    }
+}
+
+// Execute an expression statement: fill() and copy() write arrays, anything
+// else is evaluated for its warnings only
+static void run_exst(const struct node *const exst, FILE *output_file)
+{
+    const struct node *const call = exst->children[0]->children[0];
+
+    if (call->nt == NT_Call && call->aux == BUILTIN_FILL) {
+        run_fill(call, output_file);
+    } else if (call->nt == NT_Call && call->aux == BUILTIN_COPY) {
+        run_copy(call, output_file);
+    } else {
+        eval_expr(exst->children[0], output_file);
+    }
+}
+
+// sum(a, n), min(a, n), max(a, n) and find(a, value, n)
+static int eval_reduce(const struct node *const call, FILE *output_file)
+{
+    const uint32_t slot = array_arg(call, 0);
+    const int value = call->aux == BUILTIN_FIND ? eval_expr(call_arg(call, 1), output_file) : 0;
+    const int n = eval_expr(call_arg(call, call->aux == BUILTIN_FIND ? 2 : 1), output_file);
+
+    if (n <= 0 || !spend(n)) {
+        return call->aux == BUILTIN_FIND ? -1 : 0;
+    }
+
+    if (readable_range(slot, 0, n - 1)) {
+        const int *const a = state->varstore.vars[slot].array.dense;
+        size_t found;
+
+        stats.bulk_elements += n;
+
+        switch (call->aux) {
+        case BUILTIN_SUM:
+            return state->simd->sum(a, n);
+
+        case BUILTIN_MIN:
+            return state->simd->min(a, n);
+
+        case BUILTIN_MAX:
+            return state->simd->max(a, n);
+
+        default:
+            found = state->simd->find(a, value, n);
+            return found < (size_t) n ? (int) found : -1;
+        }
+    }
+
+    // Element by element, with the warnings the equivalent loop would print
+    stats.bulk_fallbacks++;
+    const struct token *const site = call->children[0]->token;
+    int result = call->aux == BUILTIN_FIND ? -1 : load_element(slot, 0, site, output_file);
+
+    for (int idx = call->aux == BUILTIN_FIND ? 0 : 1; idx < n; ++idx) {
+        const int element = load_element(slot, idx, site, output_file);
+
+        switch (call->aux) {
+        case BUILTIN_SUM:
+            result = (int) ((unsigned) result + (unsigned) element);
+            break;
+
+        case BUILTIN_MIN:
+            result = element < result ? element : result;
+            break;
+
+        case BUILTIN_MAX:
+            result = element > result ? element : result;
+            break;
+
+        default:
+            if (element == value) {
+                return idx;
+            }
+        }
+    }
+
+    return result;
+}
+
+// Make room in the stack of frames for `size` locals
+static int reserve_frames(const size_t size)
+{
+    if (size <= frames.capacity) {
+        return 1;
+    }
+
+    size_t capacity = frames.capacity ? 2 * frames.capacity : 256;
+
+    while (capacity < size) {
+        capacity *= 2;
+    }
+
+    int *const values = realloc(frames.values, capacity * sizeof(int));
+
+    if (values) {
+        frames.values = values;
+    }
+
+    uint8_t *const defined = realloc(frames.defined, capacity);
+
+    if (defined) {
+        frames.defined = defined;
+    }
+
+    if (!values || !defined) {
+        return 0;
+    }
+
+    frames.capacity = capacity;
+    return 1;
+}
+
+static size_t memo_hash(const int *const args, const uint32_t nargs)
+{
+    uint64_t hash = 14695981039346656037u;  // FNV-1a
+
+    for (uint32_t idx = 0; idx < nargs; ++idx) {
+        hash = (hash ^ (uint32_t) args[idx]) * 1099511628211u;
+    }
+
+    return hash ^ (hash >> 32);
+}
+
+// Find the entry of `args` in a memo table, or the free entry where it would go
+static size_t memo_find(const struct memo *const memo, const int *const args, const uint32_t nargs)
+{
+    size_t at = memo_hash(args, nargs) & (memo->capacity - 1);
+
+    while (memo->used[at] && memcmp(&memo->entries[at * (nargs + 2)], args, nargs * sizeof(int))) {
+        at = (at + 1) & (memo->capacity - 1);
+    }
+
+    return at;
+}
+
+// Look up the result of a pure function for some arguments, called at
+// `depth`. A result whose call would now run out of stack is not reused: the
+// call must refuse the same calls, with the same warnings, as without
+// memoizing. Sets *height for frames.peak.
+static int memo_lookup(const uint32_t index, const int *const args, const unsigned depth,
+    int *const result, unsigned *const height)
+{
+    const uint32_t nargs = state->program->functions[index].nparams;
+    const struct memo *const memo = memos ? &memos[index] : NULL;
+
+    if (!memo || !memo->nentries) {
+        return 0;
+    }
+
+    const size_t at = memo_find(memo, args, nargs);
+
+    if (!memo->used[at] || (unsigned) memo->entries[at * (nargs + 2) + nargs + 1] >
+        RUN_CALL_DEPTH - depth) {
+        return 0;
+    }
+
+    *result = memo->entries[at * (nargs + 2) + nargs];
+    *height = memo->entries[at * (nargs + 2) + nargs + 1];
+    return 1;
+}
+
+// Remember the result of a pure function for some arguments. Running out of
+// memory only means it is not remembered.
+static void memo_store(const uint32_t index, const int *const args, const int result,
+    const unsigned height)
+{
+    const uint32_t nargs = state->program->functions[index].nparams;
+
+    if (!memos && !(memos = calloc(state->program->nfunctions, sizeof(struct memo)))) {
+        return;
+    }
+
+    struct memo *const memo = &memos[index];
+
+    // Keep the table at most half full
+    if (2 * (memo->nentries + 1) > memo->capacity) {
+        const size_t capacity = memo->capacity ? 2 * memo->capacity : 64;
+        int *const entries = capacity <= 2 * MEMO_ENTRIES ?
+            malloc(capacity * (nargs + 2) * sizeof(int)) : NULL;
+        uint8_t *const used = entries ? calloc(capacity, sizeof(uint8_t)) : NULL;
+
+        if (!used) {
+            free(entries);
+            return;
+        }
+
+        const struct memo grown = { entries, used, memo->nentries, capacity };
+
+        for (size_t idx = 0; idx < memo->capacity; ++idx) {
+            if (memo->used[idx]) {
+                const int *const entry = &memo->entries[idx * (nargs + 2)];
+                const size_t at = memo_find(&grown, entry, nargs);
+
+                memcpy(&entries[at * (nargs + 2)], entry, (nargs + 2) * sizeof(int));
+                used[at] = 1;
+            }
+        }
+
+        free(memo->entries);
+        free(memo->used);
+        *memo = grown;
+    }
+
+    const size_t at = memo_find(memo, args, nargs);
+
+    memcpy(&memo->entries[at * (nargs + 2)], args, nargs * sizeof(int));
+    memo->entries[at * (nargs + 2) + nargs] = result;
+    memo->entries[at * (nargs + 2) + nargs + 1] = (int) height;
+    memo->used[at] = 1;
+    memo->nentries++;
+}
+
+static void memo_free(void)
+{
+    for (size_t idx = 0; memos && idx < state->program->nfunctions; ++idx) {
+        free(memos[idx].entries);
+        free(memos[idx].used);
+    }
+
+    free(memos);
+    memos = NULL;
+}
+
+static void frames_free(void)
+{
+    free(frames.values);
+    free(frames.defined);
+    frames = (typeof(frames)) { 0 };
+}
+
+// Call a user-defined function. The arguments are evaluated in the caller's
+// frame into the parameters of a new frame above it, then the body runs up
+// to a return statement or its end, which returns 0. A pure function called
+// again with the same arguments returns its earlier result when memoizing,
+// unless that call was refused for lack of stack and so printed a warning,
+// was cut short by a limit of the governor, or went deeper than the stack
+// left to this one.
+static int call_function(const struct node *const call, FILE *output_file)
+{
+    const uint32_t index = call->slot;
+    const struct function *const function = &state->program->functions[index];
+    const int memo = state->memoize && function->pure;
+    const size_t base = frames.top;
+    const size_t nlocals = function->nlocals;
+    unsigned height;
+    int result = 0;
+
+    if (!reserve_frames(base + nlocals + (memo ? function->nparams : 0))) {
+        fprintf(output_file, "malloc failed\n");
+        return 0;
+    }
+
+    frames.top = base + nlocals + (memo ? function->nparams : 0);
+
+    for (uint32_t param = 0; param < function->nparams; ++param) {
+        // Evaluated first: a call in the argument may move the stack
+        const int value = eval_expr(call_arg(call, param), output_file);
+        frames.values[base + param] = value;
+    }
+
+    stats.calls++;
+
+    if (!step()) {
+        // The run is stopping
+    } else if (frames.depth >= RUN_CALL_DEPTH) {
+        warn_at(warnings, output_file, call->children[0]->token, WARN_DEPTH);
+        frames.refused++;
+    } else if (memo && memo_lookup(index, &frames.values[base], frames.depth, &result, &height)) {
+        stats.memo_hits++;
+
+        if (frames.peak < frames.depth + height) {
+            frames.peak = frames.depth + height;
+        }
+    } else {
+        const size_t caller = frames.base;
+        const uint64_t refused = frames.refused;
+        const unsigned peak = frames.peak;
+
+        memset(&frames.defined[base], 1, function->nparams);
+        memset(&frames.defined[base + function->nparams], 0, nlocals - function->nparams);
+
+        if (memo) {
+            memcpy(&frames.values[base + nlocals], &frames.values[base],
+                function->nparams * sizeof(int));
+        }
+
+        frames.base = base;
+        frames.peak = ++frames.depth;
+        run_block(function->node->children[3], output_file);
+        result = frames.returning ? frames.result : 0;
+        frames.returning = 0;
+        frames.depth--;
+        frames.base = caller;
+        height = frames.peak - frames.depth;
+
+        if (frames.peak < peak) {
+            frames.peak = peak;
+        }
+
+        if (memo && frames.refused == refused && fuel >= 0) {
+            memo_store(index, &frames.values[base + nlocals], result, height);
+        }
+    }
+
+    frames.top = base;
+    return result;
+}
+
+// Evaluate a call to a built-in or user-defined function
+static int eval_call(const struct node *const call, FILE *output_file)
+{
+    switch (call->aux) {
+    case BUILTIN_SUM:
+    case BUILTIN_MIN:
+    case BUILTIN_MAX:
+    case BUILTIN_FIND:
+        return eval_reduce(call, output_file);
+
+    case BUILTIN_USER:
+        return call_function(call, output_file);
+
+    default:
+        // Unknown function, wrong arguments, or fill()/copy() inside an expression
+        warn_at(warnings, output_file, call->children[0]->token, WARN_CALL);
+        return 0;
+    }
+}
+
+// Tier 1. A loop that has run tier.threshold iterations in the AST walker is
+// compiled for a small register machine, and the running loop continues in
+// the compiled code from its next iteration (on-stack replacement). The
+// registers are varstore.scalars: the first nsymbols are the unboxed scalars
+// themselves, so no state moves between the tiers, and each compiled loop
+// appends its constants and temporaries. What the compiler does not handle
+// itself (variables used as arrays, built-in calls) goes back to the AST
+// walker one statement or expression at a time, so the output and warnings
+// are the same in both tiers.
+
+// Instructions, R[x] being register x
+enum {
+    OP_HALT,   // Leave the compiled loop
+    OP_JMP,    // Jump to c
+    OP_JZ,     // Jump to c if R[a] == 0
+    OP_JNZ,    // Jump to c if R[a] != 0
+    OP_MOV,    // R[a] = R[b]
+    OP_EQ,     // R[a] = R[b] op R[c], in the order of the operator tokens
+    OP_NE,
+    OP_LT,
+    OP_GT,
+    OP_LE,
+    OP_GE,
+    OP_AND,
+    OP_OR,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,    // Warns when dividing by zero
+    OP_MOD,
+    OP_NEG,    // R[a] = -R[b]
+    OP_NOT,    // R[a] = !R[b]
+    OP_LOAD,   // R[a] = scalar b, warning if it is undefined
+    OP_EVAL,   // R[a] = the NT_Expr `node`, evaluated by the AST walker
+    OP_AGET,   // R[a] = element R[b] of the NT_Aexp `node`
+    OP_SCHK,   // Jump to c, warning, if scalar a is undefined and cannot be created
+    OP_SSET,   // R[a] = R[b], defining scalar a
+    OP_APREP,  // Make element R[b] of the NT_Assn `node` writable, or jump to c
+    OP_APUT,   // Store R[b] into the element made writable by the last OP_APREP
+    OP_PRNT,   // Print R[b] as the NT_Prnt `node` does
+    OP_STMT,   // Run the NT_Stmt `node` in the AST walker
+    OP_ENTER,  // Entry actions of the NT_Whil `node`, saving its state in R[a];
+               // jump to c if it ran element-wise. b is the site of the loop it is
+               // nested in, which the sampler is back on after it (see sample_site).
+    OP_LEAVE,  // Restore the state OP_ENTER saved in R[a], and the site b
+    OP_STEP,   // Charge a loop iteration to the governor, leaving if the run is stopping
+    OP_PROF,   // Count a run of statement a in the profile, or if b, an iteration of loop a
+};
+
+// The loop being compiled
+static _Thread_local struct {
+    struct insn *insns;
+    size_t ninsns, allocated;
+    size_t barrier;     // Instructions before this one may be jumped over, see label()
+    int32_t temps;      // First register of this loop
+    int nomem;          // An allocation failed, the code is unusable
+    const struct node *loop;  // Innermost loop the code being compiled is in
+    const int32_t *args;  // Registers of the parameters of the function being inlined
+} comp;
+
+// Append an instruction and return its index
+static int32_t emit(const uint8_t op, const int32_t a, const int32_t b, const int32_t c,
+    const struct node *const node)
+{
+    if (comp.nomem) {
+        return 0;
+    }
+
+    if (comp.ninsns == comp.allocated) {
+        const size_t allocated = comp.allocated ? 2 * comp.allocated : 64;
+        struct insn *const tmp = realloc(comp.insns, allocated * sizeof(*tmp));
+
+        if (!tmp) {
+            comp.nomem = 1;
+            return 0;
+        }
+
+        comp.insns = tmp;
+        comp.allocated = allocated;
+    }
+
+    comp.insns[comp.ninsns] = (struct insn) { op, a, b, c, node };
+    return (int32_t) comp.ninsns++;
+}
+
+// Index of the next instruction, as a jump target
+static int32_t label(void)
+{
+    comp.barrier = comp.ninsns;
+    return (int32_t) comp.ninsns;
+}
+
+// Set the target of the jump at `at`
+static void patch(const int32_t at, const int32_t target)
+{
+    if (!comp.nomem) {
+        comp.insns[at].c = target;
+    }
+}
+
+// Allocate a register
+static int32_t new_reg(void)
+{
+    if (comp.nomem || state->tier.nregs >= INT32_MAX) {
+        comp.nomem = 1;
+        return 0;
+    }
+
+    if (state->tier.nregs == state->tier.capacity) {
+        const size_t capacity = 2 * state->tier.capacity;
+        int *const tmp = realloc(state->varstore.scalars, capacity * sizeof(int));
+
+        if (!tmp) {
+            comp.nomem = 1;
+            return 0;
+        }
+
+        state->varstore.scalars = tmp;
+        state->tier.capacity = capacity;
+    }
+
+    return (int32_t) state->tier.nregs++;
+}
+
+// A register holding a constant; nothing writes it after compilation
+static int32_t constant(const int value)
+{
+    const int32_t reg = new_reg();
+
+    if (!comp.nomem) {
+        state->varstore.scalars[reg] = value;
+    }
+
+    return reg;
+}
+
+// Store R[value] into the scalar in register `slot`. When the value is the
+// temporary just computed, the instruction computing it writes the scalar.
+static void store_scalar(const int32_t slot, const int32_t value)
+{
+    struct insn *const last = comp.ninsns > comp.barrier ? &comp.insns[comp.ninsns - 1] : NULL;
+
+    if (!comp.nomem && value >= comp.temps && last &&
+        last->op >= OP_MOV && last->op <= OP_AGET && last->a == value) {
+        last->a = slot;
+    } else if (value != slot) {
+        emit(OP_MOV, slot, value, 0, NULL);
+    }
+}
+
+// Compile an expression, returning the register holding its value
+static int32_t compile_expr(const struct node *const expr)
+{
+    const struct node *const node = expr->children[0];
+
+    switch (node->nt) {
+    case NT_Atom:
+        if (node->children[0]->token->token == token_NMBR) {
+            return constant(eval_atom(node, NULL));
+        }
+
+        if (node->flags & NF_LOCAL) {
+            return comp.args[node->slot];  // Only inlined bodies are compiled
+        }
+
+        if (!(node->flags & NF_SCALAR)) {
+            break;
+        }
+
+        // Variables never become undefined again, so a defined one is read directly
+        if (state->varstore.vars[node->slot].defined) {
+            return (int32_t) node->slot;
+        } else {
+            const int32_t result = new_reg();
+            emit(OP_LOAD, result, (int32_t) node->slot, 0, node);
+            return result;
+        }
+
+    case NT_Pexp:
+        return compile_expr(node->children[1]);
+
+    case NT_Bexp: {
+        // Both operands are evaluated, as in eval_bexp()
+        const int32_t left = compile_expr(node->children[0]);
+        const int32_t right = compile_expr(node->children[2]);
+        const int32_t result = new_reg();
+
+        emit(OP_EQ + node->children[1]->token->token - token_EQUL, result, left, right, node);
+        return result;
+    }
+
+    case NT_Uexp: {
+        const int32_t operand = compile_expr(node->children[1]);
+        const token_t op = node->children[0]->token->token;
+
+        if (op == token_PLUS) {
+            return operand;
+        }
+
+        const int32_t result = new_reg();
+        emit(op == token_MINS ? OP_NEG : OP_NOT, result, operand, 0, NULL);
+        return result;
+    }
+
+    case NT_Texp: {
+        const int32_t result = new_reg();
+        const int32_t skip = emit(OP_JZ, compile_expr(node->children[0]), 0, 0, NULL);
+        emit(OP_MOV, result, compile_expr(node->children[2]), 0, NULL);
+        const int32_t end = emit(OP_JMP, 0, 0, 0, NULL);
+        patch(skip, label());
+        emit(OP_MOV, result, compile_expr(node->children[4]), 0, NULL);
+        patch(end, label());
+        return result;
+    }
+
+    case NT_Aexp: {
+        const int32_t idx = compile_expr(node->children[2]);
+        const int32_t result = new_reg();
+
+        emit(OP_AGET, result, idx, 0, node);
+        return result;
+    }
+
+    case NT_Call: {
+        const struct function *const function =
+            node->aux == BUILTIN_USER ? &state->program->functions[node->slot] : NULL;
+        int32_t args[INLINE_PARAMS];
+
+        if (!function || !function->inline_expr) {
+            break;
+        }
+
+        // The body of a small function is compiled in place, its parameters
+        // being the registers of the arguments. It cannot run out of stack,
+        // as loops are only compiled outside of functions.
+        for (uint32_t param = 0; param < function->nparams; ++param) {
+            args[param] = compile_expr(call_arg(node, param));
+        }
+
+        comp.args = args;
+        const int32_t result = compile_expr(function->inline_expr);
+        comp.args = NULL;
+        stats.inlined++;
+        return result;
+    }
+
+    default:
+        break;
+    }
+
+    // Variables used as arrays and other calls
+    const int32_t result = new_reg();
+    emit(OP_EVAL, result, 0, 0, expr);
+    return result;
+}
+
+static void compile_block(const struct node *);
+
+// Charge the iteration of `loop` starting here to the governor, if the run
+// has limits, and count it in the profile
+static void step_insn(const struct node *const loop)
+{
+    if (state->gov.active) {
+        emit(OP_STEP, 0, 0, 0, NULL);
+    }
+
+    if (prof.data) {
+        emit(OP_PROF, (int32_t) state->program->loops[loop->loop].stmt, 1, 0, NULL);
+    }
+}
+
+// Count a run of a statement compiled here in the profile
+static void count_insn(const struct node *const stmt)
+{
+    if (prof.data) {
+        prof.data->statements[stmt->slot].how |= PROFILE_COMPILED;
+        emit(OP_PROF, (int32_t) stmt->slot, 0, 0, NULL);
+    }
+}
+
+// Compile a while loop nested in the one being compiled
+static void compile_while(const struct node *const whil)
+{
+    const struct node *const outer = comp.loop;
+    const int32_t site = (int32_t) state->program->loops[outer->loop].stmt + 1;
+    const int32_t saved = new_reg();
+    const int32_t enter = emit(OP_ENTER, saved, site, 0, whil);
+    const int32_t head = label();
+    const int32_t done = emit(OP_JZ, compile_expr(whil->children[1]), 0, 0, NULL);
+
+    comp.loop = whil;
+    step_insn(whil);
+    compile_block(whil->children[3]);
+    comp.loop = outer;
+    emit(OP_JMP, 0, 0, head, NULL);
+    patch(done, label());
+    emit(OP_LEAVE, saved, site, 0, whil);
+    patch(enter, label());
+}
+
+// Compile an if/elif/else chain
+static void compile_cond(const struct node *const ctrl)
+{
+    int32_t ends = -1;  // Jumps to the end of the chain, linked through their targets
+
+    for (size_t arm_idx = 0; arm_idx < ctrl->nchildren; ++arm_idx) {
+        const struct node *const arm = ctrl->children[arm_idx];
+
+        if (arm->nt == NT_Else) {
+            compile_block(arm->children[2]);
+            break;
+        }
+
+        const int32_t skip = emit(OP_JZ, compile_expr(arm->children[1]), 0, 0, NULL);
+        compile_block(arm->children[3]);
+
+        if (arm_idx + 1 < ctrl->nchildren) {
+            ends = emit(OP_JMP, 0, 0, ends, NULL);
+        }
+
+        patch(skip, label());
+    }
+
+    const int32_t end = label();
+
+    while (!comp.nomem && ends >= 0) {
+        const int32_t next = comp.insns[ends].c;
+        comp.insns[ends].c = end;
+        ends = next;
+    }
+}
+
+// Compile a statement
+static void compile_stmt(const struct node *const stmt)
+{
+    const struct node *const node = stmt->children[0];
+
+    switch (node->nt) {
+    case NT_Assn: {
+        const struct node *const lhs = node->children[0];
+
+        if (node->flags & NF_SCALAR) {
+            const int32_t slot = (int32_t) node->slot;
+
+            count_insn(stmt);
+
+            if (state->varstore.vars[slot].defined) {
+                store_scalar(slot, compile_expr(node->children[2]));
+            } else {
+                // The value is evaluated while the variable is still undefined
+                const int32_t skip = emit(OP_SCHK, slot, 0, 0, node);
+                emit(OP_SSET, slot, compile_expr(node->children[2]), 0, NULL);
+                patch(skip, label());
+            }
+        } else if (lhs->nchildren) {
+            count_insn(stmt);
+
+            const int32_t skip = emit(OP_APREP, 0, compile_expr(lhs->children[2]), 0, node);
+            emit(OP_APUT, 0, compile_expr(node->children[2]), 0, node);
+            patch(skip, label());
+        } else {
+            emit(OP_STMT, 0, 0, 0, stmt);
+        }
+    } break;
+
+    case NT_Prnt:
+        count_insn(stmt);
+        emit(OP_PRNT, 0, compile_expr(node->children[node->nchildren - 2]), 0, node);
+        break;
+
+    case NT_Ctrl:
+        count_insn(stmt);
+
+        switch (node->children[0]->nt) {
+        case NT_Cond:
+            compile_cond(node);
+            break;
+
+        case NT_Whil:
+            compile_while(node->children[0]);
+            break;
+
+        default: {  // Do-while loop
+            const struct node *const dowh = node->children[0];
+            const int32_t start = label();
+
+            step_insn(dowh);
+            compile_block(dowh->children[2]);
+            emit(OP_JNZ, compile_expr(dowh->children[dowh->nchildren - 2]), 0, start, NULL);
+        }
+        }
+        break;
+
+    default:
+        emit(OP_STMT, 0, 0, 0, stmt);
+    }
+}
+
+// Compile the statements of a block
+static void compile_block(const struct node *stmt)
+{
+    while (stmt->nchildren) {
+        compile_stmt(stmt++);
+    }
+}
+
+// Compile a loop whose entry actions have already run. A while loop's code
+// starts at its condition, a do-while loop's code at its body.
+static struct insn *compile_loop(const struct node *const loop)
+{
+    const size_t nregs = state->tier.nregs;
+
+    comp = (typeof(comp)) { .temps = (int32_t) nregs, .loop = loop };
+
+    if (loop->nt == NT_Whil) {
+        const int32_t done = emit(OP_JZ, compile_expr(loop->children[1]), 0, 0, NULL);
+
+        step_insn(loop);
+        compile_block(loop->children[3]);
+        emit(OP_JMP, 0, 0, 0, NULL);
+        patch(done, label());
+    } else {
+        step_insn(loop);
+        compile_block(loop->children[2]);
+        emit(OP_JNZ, compile_expr(loop->children[loop->nchildren - 2]), 0, 0, NULL);
+    }
+
+    emit(OP_HALT, 0, 0, 0, NULL);
+
+    if (comp.nomem) {
+        free(comp.insns);
+        state->tier.nregs = nregs;
+        return NULL;
+    }
+
+    return comp.insns;
+}
+
+// Count an iteration of a loop in the AST walker. Returns 1 if that made the
+// loop hot and it has just been compiled: the caller then continues it with
+// run_tier().
+static int tier_count(const struct node *const loop)
+{
+    // Compiling moves the registers, which other statements may be using.
+    // Loops in functions would need the registers of every frame.
+    if (state->par.statements || state->program->loops[loop->loop].in_function ||
+        ++state->tier.loops[loop->loop].iterations != state->tier.threshold) {
+        return 0;
+    }
+
+    if (!(state->tier.loops[loop->loop].code = compile_loop(loop))) {
+        stats.tier_failures++;
+        return 0;
+    }
+
+    stats.tier_promotions++;
+    return 1;
+}
+
+// Execute compiled code
+static void run_code(const struct insn *const code, FILE *output_file)
+{
+    struct run_state *const shared = state;  // Once: stores of bytes could change `state`
+    int *R = shared->varstore.scalars;
+    struct array *array = NULL;  // Set by OP_APREP, NULL if the store skips its checks
+    int idx = 0, fresh = 0;
+
+    for (size_t pc = 0;;) {
+        const struct insn *const insn = &code[pc++];
+
+        switch (insn->op) {
+        case OP_HALT:
+            return;
+
+        case OP_JMP:
+            pc = insn->c;
+            break;
+
+        case OP_JZ:
+            if (!R[insn->a]) {
+                pc = insn->c;
+            }
+            break;
+
+        case OP_JNZ:
+            if (R[insn->a]) {
+                pc = insn->c;
+            }
+            break;
+
+        case OP_MOV:
+            R[insn->a] = R[insn->b];
+            break;
+
+        case OP_EQ:
+            R[insn->a] = R[insn->b] == R[insn->c];
+            break;
+
+        case OP_NE:
+            R[insn->a] = R[insn->b] != R[insn->c];
+            break;
+
+        case OP_LT:
+            R[insn->a] = R[insn->b] < R[insn->c];
+            break;
+
+        case OP_GT:
+            R[insn->a] = R[insn->b] > R[insn->c];
+            break;
+
+        case OP_LE:
+            R[insn->a] = R[insn->b] <= R[insn->c];
+            break;
+
+        case OP_GE:
+            R[insn->a] = R[insn->b] >= R[insn->c];
+            break;
+
+        case OP_AND:
+            R[insn->a] = R[insn->b] && R[insn->c];
+            break;
+
+        case OP_OR:
+            R[insn->a] = R[insn->b] || R[insn->c];
+            break;
+
+        case OP_ADD:
+            R[insn->a] = R[insn->b] + R[insn->c];
+            break;
+
+        case OP_SUB:
+            R[insn->a] = R[insn->b] - R[insn->c];
+            break;
+
+        case OP_MUL:
+            R[insn->a] = R[insn->b] * R[insn->c];
+            break;
+
+        case OP_DIV:
+            if (R[insn->c]) {
+                R[insn->a] = R[insn->b] / R[insn->c];
+            } else {
+                warn_at(warnings, output_file, insn->node->children[1]->token, WARN_DIVIDE);
+                R[insn->a] = 0;
+            }
+            break;
+
+        case OP_MOD:
+            R[insn->a] = R[insn->b] % R[insn->c];
+            break;
+
+        case OP_NEG:
+            R[insn->a] = -R[insn->b];
+            break;
+
+        case OP_NOT:
+            R[insn->a] = !R[insn->b];
+            break;
+
+        case OP_LOAD:
+            if (shared->varstore.vars[insn->b].defined) {
+                R[insn->a] = R[insn->b];
+            } else {
+                warn_at(warnings, output_file, insn->node->children[0]->token, WARN_UNDEFINED);
+                R[insn->a] = 0;
+            }
+            break;
+
+        case OP_EVAL: {
+            const int value = eval_expr(insn->node, output_file);
+            R = shared->varstore.scalars;
+            R[insn->a] = value;
+
+            if (fuel < 0) {
+                return;
+            }
+        } break;
+
+        case OP_AGET: {
+            const struct node *const aexp = insn->node;
+
+            if ((aexp->flags & NF_INBOUNDS) && shared->bce_live[aexp->loop]) {
+                stats.bce_elided++;
+                R[insn->a] = shared->varstore.vars[aexp->slot].array.dense[R[insn->b]];
+            } else {
+                R[insn->a] = load_element(aexp->slot, R[insn->b], aexp->children[0]->token,
+                    output_file);
+            }
+        } break;
+
+        case OP_SCHK:
+            if (!shared->varstore.vars[insn->a].defined && shared->varstore.size >= VARSTORE_CAPACITY) {
+                warn_at(warnings, output_file, insn->node->children[0]->token, WARN_VARSTORE);
+                pc = insn->c;
+            }
+            break;
+
+        case OP_SSET:
+            R[insn->a] = R[insn->b];
+
+            if (!shared->varstore.vars[insn->a].defined) {
+                shared->varstore.vars[insn->a].defined = 1;
+                shared->varstore.size++;
+            }
+            break;
+
+        case OP_APREP: {
+            const struct node *const lhs = insn->node->children[0];
+
+            idx = R[insn->b];
+
+            if ((lhs->flags & NF_INBOUNDS) && shared->bce_live[lhs->loop]) {
+                array = NULL;
+            } else if (!(array = element_for_write(insn->node->slot, idx, &fresh,
+                lhs->children[0]->token, output_file))) {
+                if (fuel < 0) {
+                    return;
+                }
+
+                pc = insn->c;
+            }
+        } break;
+
+        case OP_APUT:
+            if (array) {
+                store_element(insn->node->slot, array, idx, R[insn->b], fresh);
+            } else {
+                shared->varstore.vars[insn->node->slot].array.dense[idx] = R[insn->b];
+                stats.bce_elided++;
+            }
+            break;
+
+        case OP_PRNT:
+            print_value(insn->node, R[insn->b], output_file);
+            break;
+
+        case OP_STMT:
+            run_statement(insn->node, output_file);
+            R = shared->varstore.scalars;
+
+            if (fuel < 0) {
+                return;
+            }
+            break;
+
+        case OP_ENTER: {
+            uint8_t was_live;
+
+            if (shared->sampling) {
+                atomic_store_explicit(&sample_site, shared->program->loops[insn->node->loop].stmt + 1,
+                    memory_order_relaxed);
+            }
+
+            const int vectorized = enter_while(insn->node, &was_live, output_file);
+
+            R = shared->varstore.scalars;
+
+            if (vectorized) {
+                pc = insn->c;
+
+                if (shared->sampling) {
+                    atomic_store_explicit(&sample_site, insn->b, memory_order_relaxed);
+                }
+            } else {
+                R[insn->a] = was_live;
+            }
+        } break;
+
+        case OP_LEAVE:
+            shared->bce_live[insn->node->loop] = (uint8_t) R[insn->a];
+
+            if (shared->sampling) {
+                atomic_store_explicit(&sample_site, insn->b, memory_order_relaxed);
+            }
+            break;
+
+        case OP_STEP:
+            if (!step()) {
+                return;
+            }
+            break;
+
+        case OP_PROF:
+            if (insn->b) {
+                prof.data->statements[insn->a].trips++;
+            } else {
+                prof.data->statements[insn->a].count++;
+            }
+            break;
+
+        default:
+            abort();  // Unknown instruction
+        }
+    }
+}
+
+// Run the compiled code of a loop, timing the outermost one
+static void run_tier(const struct node *const loop, FILE *output_file)
+{
+    const uint64_t start_ns = tier_depth++ ? 0 : now_ns();
+
+    if (prof.data) {
+        prof.data->statements[state->program->loops[loop->loop].stmt].how |= PROFILE_COMPILED;
+    }
+
+    run_code(state->tier.loops[loop->loop].code, output_file);
+
+    if (!--tier_depth) {
+        stats.tier1_ns += now_ns() - start_ns;
+    }
+}
+
+// Release the compiled loops
+static void tier_free(void)
+{
+    for (size_t loop_idx = 0; state->tier.loops && loop_idx < state->program->nloops; ++loop_idx) {
+        free(state->tier.loops[loop_idx].code);
+    }
+
+    free(state->tier.loops);
+    state->tier.loops = NULL;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Clock of the profile: the time stamp counter where there is one, as it
+// costs less to read than the time
+static uint64_t profile_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return now_ns();
+#endif
+}
@@ -1,12 +1,91 @@
 #pragma once  // Ensure this header file is only included once during compilation
 #include <stdio.h>
-// Forward declaration of the "node" structure
-// This likely represents a node in an Abstract Syntax Tree (AST)
-struct node;
+#include <stdint.h>
+// Forward declaration of the "program" structure
+// This is the parsed Abstract Syntax Tree (AST) together with the optimizer's tables (see opt.h)
+struct program;
+struct profile;
+
+// Counters collected while running a program
+struct run_stats {
+    uint64_t bce_guards_passed;  // Loop entries where the in-bounds proof held
+    uint64_t bce_guards_failed;  // Loop entries that fell back to checked accesses
+    uint64_t bce_elided;         // Array accesses that skipped their bounds check
+    uint64_t vector_runs;        // Loop entries that ran element-wise
+    uint64_t vector_fallbacks;   // Loop entries of element-wise loops that ran normally
+    uint64_t vector_elements;    // Iterations done element-wise
+    uint64_t bulk_elements;      // Elements handled by built-in functions' kernels
+    uint64_t bulk_fallbacks;     // Built-in calls that went element by element
+    uint64_t tier_promotions;    // Hot loops compiled, each moving into its code between iterations
+    uint64_t tier_failures;      // Hot loops that could not be compiled (out of memory)
+    uint64_t tier_entries;       // Later entries to compiled loops
+    uint64_t par_runs;           // Loop entries that ran on several threads
+    uint64_t par_fallbacks;      // Entries of parallel loops whose entry checks failed
+    uint64_t par_iterations;     // Iterations run on several threads
+    uint64_t par_steals;         // Times a thread took iterations from another one
+    uint64_t stmt_groups;        // Groups of top-level statements run at the same time
+    uint64_t stmt_tasks;         // Top-level statements in those groups
+    uint64_t calls;              // Calls of user-defined functions
+    uint64_t memo_hits;          // Of those, calls answered from the results of earlier ones
+    uint64_t inlined;            // Calls compiled inline into the code of hot loops
+    uint64_t steps;              // Steps charged to the governor (see run_options)
+    int stopped;                 // RUN_STOP_ reason the run was stopped for, if any
+    uint64_t tier0_ns;           // Time spent walking the AST
+    uint64_t tier1_ns;           // Time spent in compiled loops
+};
+
+// Iterations a loop runs in the AST walker before it is compiled
+#define RUN_TIER_THRESHOLD 1000
+
+// Nested calls of user-defined functions; a call made deeper warns and yields 0
+#define RUN_CALL_DEPTH 2000
+
+// How to run a program
+struct run_options {
+    uint64_t tier_threshold;  // Iterations before a loop is compiled (0: never compile)
+    unsigned threads;         // Threads for parallel loops and statements (0: one per CPU,
+                              // 1: run everything serially)
+    int memoize;              // Reuse the results of pure functions called again with
+                              // the same arguments
+    // Limits of the governor (0: no limit). A step is a loop iteration, a
+    // call of a user-defined function or an element handled by a built-in
+    // function, whichever tier runs it.
+    uint64_t max_steps;       // Steps the run may take
+    uint64_t time_limit_ms;   // Wall-clock time the run may take
+    size_t max_array_bytes;   // Memory all arrays may hold together
+    int all_warnings;         // Print every runtime warning, rather than the first of each
+                              // kind at each site followed by a summary of the others
+    struct profile *profile;  // Filled with what each statement cost (NULL: no profiling),
+                              // once profile_init() has prepared it for the program
+    int sample;               // Keep sample_site on the statement running, for the sampling
+                              // profiler (see sample.h)
+};
+
+// Why a run stopped before the end of the program
+enum {
+    RUN_STOP_NONE,    // It did not
+    RUN_STOP_STEPS,   // It ran out of steps
+    RUN_STOP_TIME,    // It ran out of time
+    RUN_STOP_MEMORY,  // Its arrays would have passed their memory limit
+};
+
+// Whether any limit of the governor is set
+static inline int run_governed(const struct run_options *const options)
+{
+    return options && (options->max_steps || options->time_limit_ms || options->max_array_bytes);
+}
 
 // Function declaration: run
-// Executes or interprets the Abstract Syntax Tree starting from the given node.
+// Executes or interprets the program, which must have been through optimize().
 // Parameters:
-//   - const struct node *: a pointer to the root of the AST to run
-// The function likely traverses and evaluates the AST to perform the program's actions.
-void run(const struct node *,FILE*);
+//   - const struct program *: the program to run
+//   - FILE *: where the program's output (and warnings) are printed
+//   - const struct run_options *: how to run it (NULL for the defaults)
+//   - struct run_stats *: filled with the run's counters (may be NULL)
+// The function traverses and evaluates the AST to perform the program's actions.
+// A run that reaches a limit of the governor stops there, with the output
+// printed so far, and prints which limit it reached. Warnings are printed
+// once per kind and site (see warn.h), and the run ends with the summary of
+// those that happened more often; those of program.warnings, reported
+// before running, are only counted.
+void run(const struct program *, FILE *, const struct run_options *, struct run_stats *);
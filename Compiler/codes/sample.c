@@ -0,0 +1,223 @@
+#include "sample.h"
+#include "parse.h"
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#if !defined(_WIN32) && __has_include(<sys/time.h>)
+#include <sys/time.h>  // setitimer
+#endif
+
+#if defined(SIGPROF) && defined(ITIMER_PROF)
+#define HAVE_SIGPROF 1
+#else
+#define HAVE_SIGPROF 0
+#endif
+
+atomic_uint_fast32_t sample_site;
+
+// The samples being taken, for the signal handler
+static struct samples *taking;
+
+#if HAVE_SIGPROF
+static struct sigaction previous;
+
+// Count a sample for the statement running. Only lock-free atomics are used,
+// which is safe in a signal handler, whichever thread the signal lands on.
+static void take_sample(int signal)
+{
+    (void) signal;
+    const uint_fast32_t site = atomic_load_explicit(&sample_site, memory_order_relaxed);
+
+    atomic_fetch_add_explicit(site ? &taking->counts[site - 1] : &taking->outside, 1,
+        memory_order_relaxed);
+}
+#endif
+
+int samples_init(struct samples *const samples, const struct program *const program,
+    const unsigned hz)
+{
+    *samples = (struct samples) {
+        .nstatements = program->nstatements,
+        .counts = calloc(program->nstatements ?: 1, sizeof(atomic_uint_fast64_t)),
+        .hz = hz ?: SAMPLE_DEFAULT_HZ,
+    };
+
+    return samples->counts ? 0 : -1;
+}
+
+int samples_start(struct samples *const samples)
+{
+#if HAVE_SIGPROF
+    struct sigaction action = { .sa_handler = take_sample, .sa_flags = SA_RESTART };
+    const long usec = samples->hz >= 1000000 ? 1 : 1000000 / samples->hz;
+    const struct timeval period = { usec / 1000000, usec % 1000000 };
+    const struct itimerval timer = { period, period };
+
+    sigemptyset(&action.sa_mask);
+    taking = samples;
+    atomic_store(&sample_site, 0);
+
+    if (sigaction(SIGPROF, &action, &previous)) {
+        return SAMPLES_TIMER;
+    }
+
+    if (setitimer(ITIMER_PROF, &timer, NULL)) {
+        sigaction(SIGPROF, &previous, NULL);
+        return SAMPLES_TIMER;
+    }
+
+    return SAMPLES_OK;
+#else
+    (void) samples;
+    return SAMPLES_UNSUPPORTED;
+#endif
+}
+
+void samples_stop(struct samples *const samples)
+{
+#if HAVE_SIGPROF
+    const struct itimerval off = { { 0, 0 }, { 0, 0 } };
+
+    setitimer(ITIMER_PROF, &off, NULL);
+    sigaction(SIGPROF, &previous, NULL);
+#endif
+    (void) samples;
+    taking = NULL;
+}
+
+// Number of statements in the subtree of `node`, itself included
+static size_t count_statements(const struct node *const node)
+{
+    size_t count = node->nchildren && node->nt == NT_Stmt;
+
+    for (size_t child_idx = 0; child_idx < node->nchildren; ++child_idx) {
+        count += count_statements(node->children[child_idx]);
+    }
+
+    return count;
+}
+
+// A line or a loop and its samples
+struct hot {
+    uint64_t samples;
+    size_t line;
+};
+
+// Most samples first, then in source order
+static int compare_hot(const void *const a, const void *const b)
+{
+    const struct hot *const x = a, *const y = b;
+
+    if (x->samples != y->samples) {
+        return x->samples < y->samples ? 1 : -1;
+    }
+
+    return (x->line > y->line) - (x->line < y->line);
+}
+
+// Print the hottest of `nhot` entries, sorting them
+static void print_hot(const struct program *const program, struct hot *const hot, size_t nhot,
+    const uint64_t total, FILE *out)
+{
+    qsort(hot, nhot, sizeof(struct hot), compare_hot);
+    fprintf(out, "%10s %7s  %5s\n", "samples", "%", "line");
+
+    for (size_t idx = 0, shown = 0; idx < nhot && shown < SAMPLE_TOP && hot[idx].samples; ++idx) {
+        if (!hot[idx].line) {
+            continue;  // A loop -D built
+        }
+
+        const uint8_t *beg = program->lines[hot[idx].line - 1];
+        const uint8_t *end = beg;
+
+        while (end < program->source + program->source_size && *end != '\n' && *end != '\r') {
+            end++;
+        }
+
+        while (beg < end && (*beg == ' ' || *beg == '\t')) {
+            beg++;
+        }
+
+        shown++;
+        fprintf(out, "%10llu %6.1f%%  %5zu  %.*s\n", (unsigned long long) hot[idx].samples,
+            100.0 * hot[idx].samples / total, hot[idx].line, (int) (end - beg), beg);
+    }
+}
+
+void samples_write(const struct samples *const samples, const struct program *const program,
+    FILE *out)
+{
+    struct hot *const lines = calloc(program->nlines ?: 1, sizeof(struct hot));
+    struct hot *const loops = calloc(program->nloops ?: 1, sizeof(struct hot));
+    const uint64_t outside = atomic_load(&samples->outside);
+    uint64_t total = outside, built = 0;
+
+    if (!lines || !loops) {
+        fprintf(stderr, "The samples could not allocate memory.\n");
+        free(lines);
+        free(loops);
+        return;
+    }
+
+    for (size_t line = 0; line < program->nlines; ++line) {
+        lines[line].line = line + 1;
+    }
+
+    for (size_t stmt = 0; stmt < samples->nstatements; ++stmt) {
+        const uint64_t count = atomic_load(&samples->counts[stmt]);
+        const uint8_t *const beg = program_statement_start(program, stmt);
+
+        total += count;
+
+        if (beg) {
+            lines[program_line_at(program, beg) - 1].samples += count;
+        } else {
+            built += count;
+        }
+    }
+
+    // Statements are numbered in pre-order, so the body of a loop follows it
+    for (size_t loop = 1; loop < program->nloops; ++loop) {
+        const uint32_t stmt = program->loops[loop].stmt;
+        const size_t end = stmt + count_statements(program->statements[stmt]);
+        const uint8_t *const beg = program_statement_start(program, stmt);
+
+        for (size_t body = stmt; beg && body < end; ++body) {
+            loops[loop - 1].samples += atomic_load(&samples->counts[body]);
+        }
+
+        loops[loop - 1].line = beg ? program_line_at(program, beg) : 0;
+    }
+
+    fprintf(out, "%llu samples, asking for %u per second of CPU time (the system may take\n"
+        "fewer)", (unsigned long long) total, samples->hz);
+
+    if (outside) {
+        fprintf(out, "; %llu outside any statement", (unsigned long long) outside);
+    }
+
+    if (built) {
+        fprintf(out, "; %llu in statements -D built", (unsigned long long) built);
+    }
+
+    if (!total) {
+        fprintf(out, ".\n");
+    } else {
+        fprintf(out, ".\n\nHot lines: samples in the statements that begin on the line (loops\n"
+            "compiled to code are sampled as a whole, on their first line)\n\n");
+        print_hot(program, lines, program->nlines, total, out);
+        fprintf(out, "\nHot loops: samples in the loop and the statements of its body (the\n"
+            "statements of a function it calls count where the function is)\n\n");
+        print_hot(program, loops, program->nloops ? program->nloops - 1 : 0, total, out);
+    }
+
+    free(lines);
+    free(loops);
+}
+
+void samples_free(struct samples *const samples)
+{
+    free(samples->counts);
+    samples->counts = NULL;
+}
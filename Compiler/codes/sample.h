@@ -0,0 +1,57 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include "opt.h"
+#include <stdio.h>
+#include <stdint.h>  // For fixed-width counters
+#include <stddef.h>  // For size_t type
+#include <stdatomic.h>
+
+// Samples taken per second of CPU time by default
+#define SAMPLE_DEFAULT_HZ 1000
+
+// The hot lines and loops reports list at most this many of each
+#define SAMPLE_TOP 20
+
+// Id + 1 of the statement the run is executing, 0 outside any statement.
+// run() keeps it up to date when run_options.sample is set; the timer's
+// signal handler reads it.
+extern atomic_uint_fast32_t sample_site;
+
+// Samples of a run, by statement
+struct samples {
+    size_t nstatements;
+    atomic_uint_fast64_t *counts;  // By statement id
+    atomic_uint_fast64_t outside;  // Taken outside any statement
+    unsigned hz;
+};
+
+// Possible return codes of samples_start()
+enum {
+    SAMPLES_OK,
+    SAMPLES_UNSUPPORTED,  // No SIGPROF timer on this system
+    SAMPLES_TIMER,        // The timer could not be set
+};
+
+// Function declaration: samples_init
+// Prepares empty samples of the statements of a program, to take `hz` times
+// per second of CPU time. Returns 0 on success, -1 if memory ran out.
+int samples_init(struct samples *, const struct program *, unsigned hz);
+
+// Function declaration: samples_start
+// Starts the SIGPROF timer: at each tick, the statement in sample_site gets a
+// sample. Only one set of samples can be taken at a time. Returns SAMPLES_OK
+// or the reason it could not start.
+int samples_start(struct samples *);
+
+// Function declaration: samples_stop
+// Stops the timer and restores the previous SIGPROF handler.
+void samples_stop(struct samples *);
+
+// Function declaration: samples_write
+// Writes the hot lines and the hot loops of the program, with their share of
+// the samples.
+void samples_write(const struct samples *, const struct program *, FILE *);
+
+// Function declaration: samples_free
+// Releases the counters of the samples.
+void samples_free(struct samples *);
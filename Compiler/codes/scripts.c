@@ -0,0 +1,391 @@
+#include "scripts.h"
+#include "interp.h"
+#include "source.h"
+#include "pool.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>  // FindFirstFile, GetFileAttributes
+#else
+#include <dirent.h>   // opendir, readdir
+#endif
+
+// What became of a script, until its group is written
+struct result {
+    char *output;         // What it printed, or why it did not run
+    size_t size;
+    const char *why;      // Its status, in words
+    int status;           // INTERP_ code, or -1 if it could not be loaded
+    uint64_t source_bytes;
+    uint64_t compile_ns;  // Loading and compiling
+    uint64_t run_ns;
+};
+
+// A group of scripts being run
+struct group {
+    const struct scripts *scripts;
+    const struct scripts_options *options;
+    size_t first;             // Index of the first script of the group
+    struct result *results;   // One per script of the group
+};
+
+static const char *const statuses[] = {
+    [INTERP_OK] = "ok",
+    [INTERP_NOMEM] = "out of memory",
+    [INTERP_LEX] = "unknown token",
+    [INTERP_PARSE] = "syntax error",
+    [INTERP_INVALID] = "rejected by the optimizer",
+    [INTERP_UNKNOWN] = "unknown -D name",
+    [INTERP_STOPPED] = "stopped by a limit",
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Compile and run script `task` of the group into its result. Runs on any
+// worker of the pool: everything it touches is its own.
+static void run_script(void *const ctx, const size_t task)
+{
+    const struct group *const group = ctx;
+    const struct scripts_options *const options = group->options;
+    const char *const path = group->scripts->paths[group->first + task];
+    struct result *const result = &group->results[task];
+    struct interp_program *program;
+    struct source source;
+
+    *result = (struct result) { .status = INTERP_NOMEM, .why = statuses[INTERP_NOMEM] };
+
+    FILE *const out = open_memstream(&result->output, &result->size);
+
+    if (!out) {
+        return;
+    }
+
+    const uint64_t start_ns = now_ns();
+    const int error = source_open(&source, path);
+
+    if (error == SOURCE_EMPTY) {
+        fprintf(out, "The file is empty\n");
+        *result = (struct result) { .status = -1, .why = "empty" };
+    } else if (error) {
+        fprintf(out, "%s\n", strerror(errno));
+        *result = (struct result) { .status = -1, .why = "unreadable" };
+    } else {
+        result->source_bytes = source.size;
+        result->status = interp_compile((const char *) source.text, source.size,
+            options->options, &program, out);
+        source_close(&source);
+    }
+
+    const uint64_t compiled_ns = now_ns();
+
+    result->compile_ns = compiled_ns - start_ns;
+
+    if (result->status == INTERP_OK) {
+        result->status = interp_run(program, options->bindings, options->nbindings, out,
+            options->run, NULL);
+        result->run_ns = now_ns() - compiled_ns;
+        interp_free(program);
+    }
+
+    if (result->status >= 0) {
+        result->why = statuses[result->status];
+    }
+
+    // The stream sets output and size when it is closed
+    fclose(out);
+}
+
+// Write the results of a group in order, and add them to the stats
+static void write_group(const struct group *const group, const size_t n, FILE *out,
+    struct scripts_stats *const stats)
+{
+    for (size_t idx = 0; idx < n; ++idx) {
+        const struct result *const result = &group->results[idx];
+        const size_t script = group->first + idx;
+
+        fprintf(out, "=== %s: exit %d (%s) ===\n", group->scripts->paths[script],
+            result->status != INTERP_OK, result->why);
+        fwrite(result->output, 1, result->size, out);
+        fprintf(out, result->size && result->output[result->size - 1] != '\n' ? "\n\n" : "\n");
+
+        if (result->status == INTERP_OK) {
+            stats->ok++;
+        } else if (result->status == INTERP_STOPPED) {
+            stats->stopped++;
+        } else if (result->status < 0) {
+            stats->unreadable++;
+        } else {
+            stats->rejected++;
+        }
+
+        stats->source_bytes += result->source_bytes;
+        stats->output_bytes += result->size;
+        stats->compile_ns += result->compile_ns;
+        stats->run_ns += result->run_ns;
+
+        if (result->compile_ns + result->run_ns > stats->slowest_ns) {
+            stats->slowest = script;
+            stats->slowest_ns = result->compile_ns + result->run_ns;
+        }
+
+        free(result->output);
+    }
+}
+
+int scripts_run(const struct scripts *const scripts, const struct scripts_options *const options,
+    FILE *out, struct scripts_stats *const stats)
+{
+    const size_t capacity = scripts->count < SCRIPTS_GROUP ? scripts->count : SCRIPTS_GROUP;
+    const unsigned workers = options->workers ? options->workers : pool_cpus();
+    struct pool *const pool = workers > 1 ? pool_create(workers) : NULL;
+    struct group group = {
+        .scripts = scripts,
+        .options = options,
+        .results = malloc((capacity ?: 1) * sizeof(struct result)),
+    };
+
+    *stats = (struct scripts_stats) { 0 };
+
+    if (!group.results) {
+        if (pool) {
+            pool_destroy(pool);
+        }
+
+        return -1;
+    }
+
+    // Without a pool, the scripts run one at a time on this thread
+    stats->workers = pool ? workers : 1;
+
+    const uint64_t start_ns = now_ns();
+
+    for (; group.first < scripts->count; group.first += capacity) {
+        const size_t left = scripts->count - group.first;
+        const size_t n = left < capacity ? left : capacity;
+
+        if (pool) {
+            pool_for(pool, n, run_script, &group);
+        } else {
+            for (size_t task = 0; task < n; ++task) {
+                run_script(&group, task);
+            }
+        }
+
+        write_group(&group, n, out, stats);
+    }
+
+    fflush(out);
+    stats->wall_ns = now_ns() - start_ns;
+
+    if (pool) {
+        pool_destroy(pool);
+    }
+
+    free(group.results);
+    return stats->ok == scripts->count && !ferror(out) ? 0 : -1;
+}
+
+// Start a list of the `count` paths laid out one after the other in text
+static int index_paths(struct scripts *const scripts, char *const text, const size_t count)
+{
+    scripts->text = text;
+    scripts->count = count;
+
+    if (!(scripts->paths = malloc((count ?: 1) * sizeof(char *)))) {
+        return SCRIPTS_NOMEM;
+    }
+
+    for (size_t idx = 0, at = 0; idx < count; ++idx) {
+        scripts->paths[idx] = text + at;
+        at += strlen(text + at) + 1;
+    }
+
+    return count ? SCRIPTS_OK : SCRIPTS_NONE;
+}
+
+// The paths of a manifest, one per line
+static int list_manifest(struct scripts *const scripts, const char *const path)
+{
+    struct source manifest;
+    const int error = source_open(&manifest, path);
+
+    if (error == SOURCE_EMPTY) {
+        return SCRIPTS_NONE;
+    } else if (error) {
+        return SCRIPTS_OPEN;
+    }
+
+    char *const text = malloc(manifest.size + 1);
+    size_t count = 0, len = 0;
+
+    if (!text) {
+        source_close(&manifest);
+        return SCRIPTS_NOMEM;
+    }
+
+    // Keep each path, trimmed, followed by its '\0'
+    for (const char *line = (const char *) manifest.text, *const end = line + manifest.size;
+        line < end;) {
+        const char *eol = memchr(line, '\n', end - line) ?: end;
+        const char *const next = eol < end ? eol + 1 : end;
+
+        while (line < eol && (*line == ' ' || *line == '\t')) {
+            line++;
+        }
+
+        while (eol > line && (eol[-1] == ' ' || eol[-1] == '\t' || eol[-1] == '\r')) {
+            eol--;
+        }
+
+        if (line < eol && *line != '#') {
+            memcpy(text + len, line, eol - line);
+            len += eol - line;
+            text[len++] = '\0';
+            count++;
+        }
+
+        line = next;
+    }
+
+    source_close(&manifest);
+    return index_paths(scripts, text, count);
+}
+
+static int compare_names(const void *const a, const void *const b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+// Add "directory/name" to the text of a directory's list
+static int add_path(char **const text, size_t *const len, size_t *const allocated,
+    const char *const directory, const char *const name)
+{
+    const size_t dirlen = strlen(directory);
+    const int slash = dirlen && (directory[dirlen - 1] == '/' || directory[dirlen - 1] == '\\');
+    const size_t size = dirlen + !slash + strlen(name) + 1;
+
+    if (size > *allocated - *len) {
+        const size_t grown = 2 * *allocated + size;
+        char *const tmp = realloc(*text, grown);
+
+        if (!tmp) {
+            return -1;
+        }
+
+        *text = tmp;
+        *allocated = grown;
+    }
+
+    *len += snprintf(*text + *len, size, "%s%s%s", directory, slash ? "" : "/", name) + 1;
+    return 0;
+}
+
+// Whether a file name ends with .txt
+static int is_script(const char *const name)
+{
+    const size_t len = strlen(name);
+
+    return len > 4 && !strcmp(name + len - 4, ".txt");
+}
+
+// The .txt files of a directory, by name. Returns -1 if `path` is no
+// directory.
+static int list_directory(struct scripts *const scripts, const char *const path)
+{
+    char *text = NULL;
+    size_t len = 0, allocated = 0, count = 0;
+    int status = SCRIPTS_OK;
+
+#ifdef _WIN32
+    char pattern[4096];
+    WIN32_FIND_DATAA found;
+    const DWORD attributes = GetFileAttributesA(path);
+
+    if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return -1;
+    }
+
+    snprintf(pattern, sizeof(pattern), "%s\\*.txt", path);
+
+    const HANDLE find = FindFirstFileA(pattern, &found);
+
+    for (int more = find != INVALID_HANDLE_VALUE; more; more = FindNextFileA(find, &found)) {
+        if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && is_script(found.cFileName)) {
+            if (add_path(&text, &len, &allocated, path, found.cFileName)) {
+                status = SCRIPTS_NOMEM;
+                break;
+            }
+
+            count++;
+        }
+    }
+
+    if (find != INVALID_HANDLE_VALUE) {
+        FindClose(find);
+    }
+#else
+    DIR *const directory = opendir(path);
+
+    if (!directory) {
+        return errno == ENOTDIR ? -1 : SCRIPTS_OPEN;
+    }
+
+    for (const struct dirent *entry; (entry = readdir(directory));) {
+        if (entry->d_name[0] != '.' && is_script(entry->d_name)) {
+            if (add_path(&text, &len, &allocated, path, entry->d_name)) {
+                status = SCRIPTS_NOMEM;
+                break;
+            }
+
+            count++;
+        }
+    }
+
+    closedir(directory);
+#endif
+
+    if (status != SCRIPTS_OK) {
+        free(text);
+        return status;
+    }
+
+    status = index_paths(scripts, text, count);
+
+    if (status == SCRIPTS_OK) {
+        qsort(scripts->paths, count, sizeof(char *), compare_names);
+    }
+
+    return status;
+}
+
+int scripts_list(struct scripts *const scripts, const char *const path)
+{
+    *scripts = (struct scripts) { 0 };
+
+    int status = list_directory(scripts, path);
+
+    if (status < 0) {
+        status = list_manifest(scripts, path);
+    }
+
+    if (status != SCRIPTS_OK) {
+        scripts_free(scripts);
+    }
+
+    return status;
+}
+
+void scripts_free(struct scripts *const scripts)
+{
+    free(scripts->paths);
+    free(scripts->text);
+    *scripts = (struct scripts) { 0 };
+}
@@ -0,0 +1,74 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include <stdio.h>
+#include <stdint.h>  // For fixed-width counters
+#include <stddef.h>  // For size_t type
+
+// Forward declarations (see run.h and spec.h)
+struct run_options;
+struct spec_binding;
+
+// Scripts compiled and run by one pool_for() of scripts_run(): their outputs
+// are held until the group is done, then written in order
+#define SCRIPTS_GROUP 1024
+
+// The scripts of a manifest (one path per line) or of a directory (its
+// .txt files, by name)
+struct scripts {
+    size_t count;
+    char **paths;
+    char *text;  // The paths point into it
+};
+
+// How to run the scripts
+struct scripts_options {
+    unsigned workers;                     // Scripts run at once (0: one per CPU)
+    unsigned options;                     // OPT_ bits for the optimizer
+    const struct spec_binding *bindings;  // -D bindings, for every script
+    size_t nbindings;
+    const struct run_options *run;        // For every run (may be NULL)
+};
+
+// What scripts_run() did
+struct scripts_stats {
+    unsigned workers;
+    size_t ok;                // Scripts that ran to the end
+    size_t unreadable;        // Scripts that could not be loaded, or are empty
+    size_t rejected;          // Scripts that did not lex, parse, optimize or bind
+    size_t stopped;           // Runs stopped by a limit of run_options
+    uint64_t source_bytes;
+    uint64_t output_bytes;
+    uint64_t wall_ns;         // From the first script to the last output written
+    uint64_t compile_ns;      // Spent in interp_compile(), by all workers together
+    uint64_t run_ns;          // Spent in interp_run(), by all workers together
+    size_t slowest;           // Index of the script that took longest to compile and run
+    uint64_t slowest_ns;
+};
+
+// Possible return codes of scripts_list()
+enum {
+    SCRIPTS_OK,     // The paths are listed
+    SCRIPTS_NOMEM,  // Memory allocation failed
+    SCRIPTS_OPEN,   // The manifest or directory could not be read; errno tells why
+    SCRIPTS_NONE,   // There is no script to run
+};
+
+// Function declaration: scripts_list
+// Lists the scripts of `path`: the .txt files of a directory, sorted by
+// name, or the non-blank lines of a manifest that do not start with '#'.
+// Release the list with scripts_free().
+int scripts_list(struct scripts *, const char *path);
+
+// Function declaration: scripts_run
+// Compiles and runs every script on a pool of workers, each run with its own
+// interpreter state (see interp.h). For each script, in the order of the
+// list, writes a "=== path: exit N (status) ===" line to `out` and then
+// what the script printed after "---*** Running ***---", or why it did not
+// run. N is the exit status `interpret <path>` would have. Returns 0 if
+// every script ran to the end, -1 otherwise.
+int scripts_run(const struct scripts *, const struct scripts_options *, FILE *out,
+    struct scripts_stats *);
+
+// Function declaration: scripts_free
+// Releases the list filled by scripts_list().
+void scripts_free(struct scripts *);
@@ -0,0 +1,611 @@
+#define _GNU_SOURCE  // For fopencookie()
+
+#include "server.h"
+#include "interp.h"
+#include "cache.h"
+#include "source.h"
+#include "spec.h"
+#include "pool.h"
+#include "run.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__GLIBC__) && __has_include(<sys/un.h>)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Accepted connections that may wait for a worker
+#define SERVER_QUEUE 256
+
+// Seconds a client has to send its request, and to take each part of the
+// reply: a client that stops reading is dropped rather than holding a worker
+#define SERVER_TIMEOUT 10
+
+// A compiled program the server keeps
+struct kept {
+    struct interp_program *program;  // NULL: the slot is free
+    uint64_t hash;                   // Of the source, from the options
+    unsigned options;
+    size_t size;
+    uint8_t *source;                 // To tell sources with the same hash apart
+    unsigned users;                  // Runs using the program
+    uint64_t used;                   // When it was last used, for eviction
+};
+
+struct server {
+    char path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+    int listener;
+    pthread_t *threads;          // The workers
+    unsigned nworkers;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;        // A connection was queued, or the server is draining
+    pthread_cond_t room;         // A connection left the queue
+    int queue[SERVER_QUEUE];     // Accepted connections, from `head`
+    size_t head, count;
+    int draining;
+    int wake[2];                 // A byte in this pipe tells the accepting thread to drain
+    const struct run_options *limits;
+    struct kept kept[SERVER_PROGRAMS];
+    uint64_t clock;              // Ticks at each use of a kept program
+    struct server_stats stats;
+};
+
+// Where SIGINT and SIGTERM write (only one server runs at a time)
+static int wake_fd = -1;
+
+// Ask the accepting thread to drain. Only write() is used, which is safe in a
+// signal handler.
+static void wake_up(int signal)
+{
+    const int saved = errno;
+
+    (void) signal;
+
+    if (write(wake_fd, "", 1) < 0) {
+        // The pipe is full: the server is waking up already
+    }
+
+    errno = saved;
+}
+
+static int read_all(const int fd, void *const data, size_t size)
+{
+    for (uint8_t *at = data; size;) {
+        const ssize_t got = recv(fd, at, size, 0);
+
+        if (got < 0 && errno == EINTR) {
+            continue;
+        } else if (got <= 0) {
+            return -1;
+        }
+
+        at += got;
+        size -= got;
+    }
+
+    return 0;
+}
+
+static int send_all(const int fd, const void *const data, size_t size)
+{
+    for (const uint8_t *at = data; size;) {
+        const ssize_t sent = send(fd, at, size, MSG_NOSIGNAL);
+
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0) {
+            return -1;
+        }
+
+        at += sent;
+        size -= sent;
+    }
+
+    return 0;
+}
+
+// A reply being streamed to a client
+struct reply {
+    int fd;
+    int failed;  // The client is gone or stopped reading: what the run prints goes nowhere
+};
+
+// fopencookie() write callback: send what the run printed as output frames
+static ssize_t send_output(void *const cookie, const char *data, size_t size)
+{
+    struct reply *const reply = cookie;
+    const size_t total = size;
+
+    while (size && !reply->failed) {
+        const size_t chunk = size < (1u << 20) ? size : 1u << 20;
+        const struct server_frame frame = { REPLY_OUTPUT, (uint32_t) chunk };
+
+        reply->failed = send_all(reply->fd, &frame, sizeof(frame)) ||
+            send_all(reply->fd, data, chunk);
+        data += chunk;
+        size -= chunk;
+    }
+
+    // Drop the connection: the client sees it end without REPLY_END
+    if (reply->failed) {
+        shutdown(reply->fd, SHUT_RDWR);
+    }
+
+    return reply->failed ? -1 : (ssize_t) total;
+}
+
+// The compiled program of a source: a kept one, or one compiled now and kept
+// if a slot is free or holds a program no run uses. *kept is set to its slot,
+// or to NULL if the program is not kept. Returns NULL if the source does not
+// compile, after printing why.
+static struct interp_program *acquire(struct server *const server, const uint8_t *const source,
+    const size_t size, const unsigned options, FILE *out, struct kept **const kept)
+{
+    const uint64_t hash = cache_hash(source, size, options);
+    struct interp_program *program = NULL;
+
+    *kept = NULL;
+    pthread_mutex_lock(&server->lock);
+
+    for (size_t idx = 0; idx < SERVER_PROGRAMS; ++idx) {
+        struct kept *const slot = &server->kept[idx];
+
+        if (slot->program && slot->hash == hash && slot->options == options &&
+            slot->size == size && !memcmp(slot->source, source, size)) {
+            slot->users++;
+            slot->used = ++server->clock;
+            server->stats.program_hits++;
+            *kept = slot;
+            program = slot->program;
+            break;
+        }
+    }
+
+    server->stats.program_misses += !program;
+    pthread_mutex_unlock(&server->lock);
+
+    if (program) {
+        return program;
+    } else if (interp_compile((const char *) source, size, options, &program, out)) {
+        return NULL;
+    }
+
+    uint8_t *const copy = malloc(size ?: 1);
+    struct kept evicted = { 0 };
+
+    if (copy) {
+        memcpy(copy, source, size);
+        pthread_mutex_lock(&server->lock);
+
+        for (size_t idx = 0; idx < SERVER_PROGRAMS; ++idx) {
+            struct kept *const slot = &server->kept[idx];
+
+            if (!slot->program) {
+                *kept = slot;
+                break;
+            } else if (!slot->users && (!*kept || slot->used < (*kept)->used)) {
+                *kept = slot;
+            }
+        }
+
+        if (*kept) {
+            evicted = **kept;
+            **kept = (struct kept) {
+                .program = program, .hash = hash, .options = options, .size = size,
+                .source = copy, .users = 1, .used = ++server->clock,
+            };
+        }
+
+        pthread_mutex_unlock(&server->lock);
+    }
+
+    if (!*kept) {
+        free(copy);
+    }
+
+    interp_free(evicted.program);
+    free(evicted.source);
+    return program;
+}
+
+// Done with a program acquire() returned
+static void release(struct server *const server, struct kept *const kept,
+    struct interp_program *const program)
+{
+    if (!kept) {
+        interp_free(program);
+        return;
+    }
+
+    pthread_mutex_lock(&server->lock);
+    kept->users--;
+    pthread_mutex_unlock(&server->lock);
+}
+
+// The request's limit, within the server's (0: none)
+static uint64_t within(const uint64_t asked, const uint64_t limit)
+{
+    return limit && (!asked || asked > limit) ? limit : asked;
+}
+
+// Run a request, printing to `out`. Returns the exit status interpret would have.
+static int run_request(struct server *const server, const struct server_request *const request,
+    const char *const bindings_text, const char *const payload, FILE *out)
+{
+    const struct run_options none = { 0 };
+    const struct run_options *const limits = server->limits ? server->limits : &none;
+    const unsigned cpus = pool_cpus();
+    const struct run_options run_options = {
+        .tier_threshold = request->tier_threshold,
+        .threads = !request->threads ? 1 : request->threads < cpus ? request->threads : cpus,
+        .memoize = !!(request->flags & REQUEST_MEMOIZE),
+        .all_warnings = !!(request->flags & REQUEST_ALL_WARNINGS),
+        .max_steps = within(request->max_steps, limits->max_steps),
+        .time_limit_ms = within(request->time_limit_ms, limits->time_limit_ms),
+        .max_array_bytes = within(request->max_array_bytes, limits->max_array_bytes),
+    };
+    size_t nbindings = 0;
+
+    for (size_t at = 0; at < request->bindings_size; at += strlen(bindings_text + at) + 1) {
+        nbindings++;
+    }
+
+    struct spec_binding *const bindings = malloc((nbindings ?: 1) * sizeof(struct spec_binding));
+
+    if (!bindings) {
+        fprintf(out, "malloc failed\n");
+        return 1;
+    }
+
+    for (size_t at = 0, idx = 0; at < request->bindings_size; at += strlen(bindings_text + at) + 1) {
+        if (spec_parse_binding(bindings_text + at, &bindings[idx++])) {
+            fprintf(out, "-D %s: expected name=value with a value from 0 to 2147483647\n",
+                bindings_text + at);
+            free(bindings);
+            return 1;
+        }
+    }
+
+    // A path is mapped, and kept only as long as it takes to find its program
+    struct source source = { .text = (const uint8_t *) payload, .size = request->payload_size };
+    struct interp_program *program = NULL;
+    struct kept *kept;
+
+    if (request->kind == REQUEST_PATH) {
+        const int error = source_open(&source, payload);
+
+        if (error == SOURCE_EMPTY) {
+            fprintf(out, "‘%s‘: The file is empty\n", payload);
+        } else if (error) {
+            fprintf(out, "%s: %s\n", payload, strerror(errno));
+        } else {
+            program = acquire(server, source.text, source.size, request->options, out, &kept);
+            source_close(&source);
+        }
+    } else if (!source.size) {
+        fprintf(out, "The source is empty\n");
+    } else {
+        program = acquire(server, source.text, source.size, request->options, out, &kept);
+    }
+
+    int status = INTERP_NOMEM;
+
+    if (program) {
+        status = interp_run(program, bindings, nbindings, out, &run_options, NULL);
+        release(server, kept, program);
+    }
+
+    free(bindings);
+    return status != INTERP_OK;
+}
+
+// Read a request from a connection and answer it
+static void serve_client(struct server *const server, const int fd)
+{
+    struct server_request request;
+    struct reply reply = { .fd = fd };
+    char *bindings_text = NULL, *payload = NULL;
+    int exit_status = -1;  // -1: no valid request
+
+    if (!read_all(fd, &request, sizeof(request)) &&
+        !memcmp(request.magic, SERVER_MAGIC, sizeof(request.magic)) &&
+        request.kind <= REQUEST_SHUTDOWN && request.bindings_size <= SERVER_MAX_BINDINGS &&
+        request.payload_size <= SERVER_MAX_SOURCE &&
+        (request.kind != REQUEST_PATH || request.payload_size) &&
+        (bindings_text = malloc(request.bindings_size + 1)) &&
+        (payload = malloc(request.payload_size + 1)) &&
+        !read_all(fd, bindings_text, request.bindings_size) &&
+        !read_all(fd, payload, request.payload_size)) {
+        bindings_text[request.bindings_size] = '\0';
+        payload[request.payload_size] = '\0';
+        exit_status = 0;
+    }
+
+    if (exit_status < 0) {
+        // Nothing to answer
+    } else if (request.kind == REQUEST_SHUTDOWN) {
+        // Drain, as on SIGTERM
+        if (write(server->wake[1], "", 1) < 0) {
+            // The pipe is full: the server is draining already
+        }
+    } else {
+        FILE *const out = fopencookie(&reply, "w", (cookie_io_functions_t) {
+            .write = send_output,
+        });
+
+        if (out) {
+            exit_status = run_request(server, &request, bindings_text, payload, out);
+            fclose(out);
+        } else {
+            exit_status = 1;
+        }
+    }
+
+    if (exit_status >= 0 && !reply.failed) {
+        const struct server_frame end = { REPLY_END, (uint32_t) exit_status };
+
+        send_all(fd, &end, sizeof(end));
+    }
+
+    pthread_mutex_lock(&server->lock);
+    server->stats.requests += exit_status >= 0;
+    server->stats.failed += exit_status > 0 || (exit_status == 0 && reply.failed);
+    server->stats.bad += exit_status < 0;
+    pthread_mutex_unlock(&server->lock);
+
+    free(bindings_text);
+    free(payload);
+    close(fd);
+}
+
+// Body of a worker: answer queued connections until the server drains and
+// none is left
+static void *work(void *const arg)
+{
+    struct server *const server = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&server->lock);
+
+        while (!server->count && !server->draining) {
+            pthread_cond_wait(&server->ready, &server->lock);
+        }
+
+        if (!server->count) {
+            pthread_mutex_unlock(&server->lock);
+            return NULL;
+        }
+
+        const int fd = server->queue[server->head];
+
+        server->head = (server->head + 1) % SERVER_QUEUE;
+        server->count--;
+        pthread_cond_signal(&server->room);
+        pthread_mutex_unlock(&server->lock);
+        serve_client(server, fd);
+    }
+}
+
+// Bind a listening socket to `path`, replacing a socket no server listens on.
+// Returns the socket, or -1.
+static int listen_at(const char *const path, int *const status)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+    *status = SERVER_SOCKET_ERROR;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    strcpy(address.sun_path, path);
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (listener < 0) {
+        return -1;
+    }
+
+    if (bind(listener, (const struct sockaddr *) &address, sizeof(address))) {
+        const int probe = errno == EADDRINUSE ? socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) : -1;
+
+        if (probe < 0) {
+            goto fail;
+        }
+
+        const int live = !connect(probe, (const struct sockaddr *) &address, sizeof(address));
+
+        close(probe);
+
+        if (live) {
+            close(listener);
+            *status = SERVER_RUNNING;
+            return -1;
+        }
+
+        // Left by a server that is gone
+        unlink(path);
+
+        if (bind(listener, (const struct sockaddr *) &address, sizeof(address))) {
+            goto fail;
+        }
+    }
+
+    if (listen(listener, SOMAXCONN)) {
+        goto fail;
+    }
+
+    *status = SERVER_OK;
+    return listener;
+
+fail:;
+    const int saved = errno;
+
+    close(listener);
+    errno = saved;
+    return -1;
+}
+
+int server_open(struct server **const opened, const char *const path,
+    const struct server_options *const options)
+{
+    struct server *const server = calloc(1, sizeof(struct server));
+    const unsigned nworkers = options->workers ? options->workers : pool_cpus();
+    int status = SERVER_NOMEM;
+
+    *opened = NULL;
+
+    if (!server || !(server->threads = calloc(nworkers, sizeof(pthread_t)))) {
+        free(server);
+        return status;
+    }
+
+    server->limits = options->limits;
+    snprintf(server->path, sizeof(server->path), "%s", path);
+
+    if (pipe2(server->wake, O_CLOEXEC | O_NONBLOCK)) {
+        free(server->threads);
+        free(server);
+        return SERVER_SOCKET_ERROR;
+    }
+
+    if ((server->listener = listen_at(path, &status)) < 0) {
+        goto fail;
+    }
+
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->ready, NULL);
+    pthread_cond_init(&server->room, NULL);
+
+    while (server->nworkers < nworkers &&
+        !pthread_create(&server->threads[server->nworkers], NULL, work, server)) {
+        server->nworkers++;
+    }
+
+    if (server->nworkers) {
+        *opened = server;
+        return SERVER_OK;
+    }
+
+    status = SERVER_NOMEM;
+    close(server->listener);
+    unlink(path);
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->ready);
+    pthread_cond_destroy(&server->room);
+
+fail:
+    close(server->wake[0]);
+    close(server->wake[1]);
+    free(server->threads);
+    free(server);
+    return status;
+}
+
+void server_run(struct server *const server, struct server_stats *const stats)
+{
+    // Drain on SIGINT and SIGTERM, as on a REQUEST_SHUTDOWN
+    struct sigaction action = { .sa_handler = wake_up, .sa_flags = SA_RESTART }, previous[2];
+
+    sigemptyset(&action.sa_mask);
+    wake_fd = server->wake[1];
+    sigaction(SIGINT, &action, &previous[0]);
+    sigaction(SIGTERM, &action, &previous[1]);
+
+    for (;;) {
+        struct pollfd fds[2] = { { .fd = server->listener, .events = POLLIN },
+            { .fd = server->wake[0], .events = POLLIN } };
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            break;
+        } else if (fds[1].revents) {
+            break;
+        } else if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+
+        const int fd = accept4(server->listener, NULL, NULL, SOCK_CLOEXEC);
+
+        if (fd < 0) {
+            continue;  // The client gave up, or there is no descriptor for it yet
+        }
+
+        const struct timeval timeout = { SERVER_TIMEOUT, 0 };
+
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        pthread_mutex_lock(&server->lock);
+
+        while (server->count == SERVER_QUEUE) {
+            pthread_cond_wait(&server->room, &server->lock);
+        }
+
+        server->queue[(server->head + server->count++) % SERVER_QUEUE] = fd;
+        pthread_cond_signal(&server->ready);
+        pthread_mutex_unlock(&server->lock);
+    }
+
+    // Drain: no more connections, but those accepted are answered
+    close(server->listener);
+    unlink(server->path);
+    pthread_mutex_lock(&server->lock);
+    server->draining = 1;
+    pthread_cond_broadcast(&server->ready);
+    pthread_mutex_unlock(&server->lock);
+
+    for (unsigned idx = 0; idx < server->nworkers; ++idx) {
+        pthread_join(server->threads[idx], NULL);
+    }
+
+    sigaction(SIGINT, &previous[0], NULL);
+    sigaction(SIGTERM, &previous[1], NULL);
+    wake_fd = -1;
+
+    *stats = server->stats;
+    stats->workers = server->nworkers;
+
+    for (size_t idx = 0; idx < SERVER_PROGRAMS; ++idx) {
+        interp_free(server->kept[idx].program);
+        free(server->kept[idx].source);
+    }
+
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->ready);
+    pthread_cond_destroy(&server->room);
+    close(server->wake[0]);
+    close(server->wake[1]);
+    free(server->threads);
+    free(server);
+}
+
+#else
+
+int server_open(struct server **const opened, const char *const path,
+    const struct server_options *const options)
+{
+    (void) path;
+    (void) options;
+    *opened = NULL;
+    return SERVER_UNSUPPORTED;
+}
+
+void server_run(struct server *const server, struct server_stats *const stats)
+{
+    (void) server;
+    *stats = (struct server_stats) { 0 };
+}
+
+#endif
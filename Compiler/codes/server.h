@@ -0,0 +1,110 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include <stdint.h>  // For fixed-width integer types
+#include <stddef.h>  // For size_t type
+
+// Forward declaration (see run.h)
+struct run_options;
+
+// Where --serve listens, and interpret-client connects, by default
+#define SERVER_SOCKET "outputs/interpret.sock"
+
+// Compiled programs the server keeps, to run the same source again without
+// lexing, parsing and optimizing it
+#define SERVER_PROGRAMS 64
+
+// Limits of a request
+#define SERVER_MAX_BINDINGS 65536      // Bytes of -D bindings
+#define SERVER_MAX_SOURCE (64u << 20)  // Bytes of source, or of a path
+
+// The protocol, between processes of the same build on the same machine.
+// A client connects, sends a request, and reads frames until REPLY_END; a
+// connection carries one request.
+#define SERVER_MAGIC "INT1"
+
+// What a request asks for
+enum {
+    REQUEST_PATH,      // Run the file at the path that follows (absolute, or from the server's directory)
+    REQUEST_SOURCE,    // Run the source that follows
+    REQUEST_SHUTDOWN,  // Finish the requests accepted so far, then stop
+};
+
+// Bits of server_request.flags
+enum {
+    REQUEST_MEMOIZE = 1,       // As --memoize
+    REQUEST_ALL_WARNINGS = 2,  // As --all-warnings
+};
+
+// A request: this header, then `bindings_size` bytes of -D bindings
+// ("name=value", each followed by '\0'), then `payload_size` bytes of path or
+// source
+struct server_request {
+    char magic[4];             // SERVER_MAGIC
+    uint32_t kind;             // REQUEST_
+    uint32_t options;          // OPT_ bits for the optimizer
+    uint32_t flags;            // REQUEST_ bits
+    uint32_t threads;          // As --threads (0: 1, as the workers keep the CPUs busy), up
+                               // to one per CPU
+    uint32_t unused;
+    uint64_t tier_threshold;   // As --tier-threshold
+    uint64_t max_steps;        // The limits of run_options (0: none, or the server's)
+    uint64_t time_limit_ms;
+    uint64_t max_array_bytes;
+    uint64_t bindings_size;
+    uint64_t payload_size;
+};
+
+// Kinds of reply frames
+enum {
+    REPLY_OUTPUT,  // `value` bytes the program printed follow
+    REPLY_END,     // The request is done: `value` is the exit status interpret would have
+};
+
+// A reply is a sequence of frames, the last one REPLY_END
+struct server_frame {
+    uint32_t kind;
+    uint32_t value;
+};
+
+// How to serve
+struct server_options {
+    unsigned workers;                  // Requests run at once (0: one per CPU)
+    const struct run_options *limits;  // Limits no request may exceed (may be NULL)
+};
+
+// What the server did
+struct server_stats {
+    unsigned workers;
+    uint64_t requests;         // Requests read, shutdowns included
+    uint64_t failed;           // Requests whose exit status was not 0, or whose client
+                               // stopped reading the reply
+    uint64_t bad;              // Connections that sent no valid request
+    uint64_t program_hits;     // Runs of a program compiled for an earlier request
+    uint64_t program_misses;   // Runs of a program compiled for them
+};
+
+// Opaque server state (defined in server.c)
+struct server;
+
+// Possible return codes of server_open()
+enum {
+    SERVER_OK,           // Listening
+    SERVER_NOMEM,        // Memory allocation failed, or no worker could be started
+    SERVER_SOCKET_ERROR, // The socket could not be set up; errno tells why
+    SERVER_RUNNING,      // Another server listens on the socket
+    SERVER_UNSUPPORTED,  // This system has no UNIX-domain sockets
+};
+
+// Function declaration: server_open
+// Listens on the UNIX-domain socket at `path`, replacing a socket no server
+// listens on, and starts the workers. Returns SERVER_OK with *server set.
+int server_open(struct server **, const char *path, const struct server_options *);
+
+// Function declaration: server_run
+// Runs the requests of clients on the workers, streaming what each run
+// prints back to its client as it is printed. Compiled programs are kept
+// (see SERVER_PROGRAMS) and the workers live as long as the server. On
+// SIGINT, SIGTERM or a REQUEST_SHUTDOWN, stops accepting connections,
+// finishes the requests already accepted, removes the socket and releases
+// the server.
+void server_run(struct server *, struct server_stats *);
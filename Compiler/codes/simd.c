@@ -0,0 +1,363 @@
+#include "simd.h"
+#include <stdatomic.h>
+
+// Scalar kernels. They also finish the tails of the vector kernels.
+// Arithmetic goes through unsigned so overflow wraps like the vector code.
+#define SCALAR_BINARY(name, expr) \
+static void scalar_##name(int *const dst, const int *const a, const int *const b, \
+    const size_t n) \
+{ \
+    for (size_t i = 0; i < n; ++i) { \
+        const int x = a[i], y = b[i]; \
+        dst[i] = (expr); \
+    } \
+}
+
+SCALAR_BINARY(add, (int) ((unsigned) x + (unsigned) y))
+SCALAR_BINARY(sub, (int) ((unsigned) x - (unsigned) y))
+SCALAR_BINARY(mul, (int) ((unsigned) x * (unsigned) y))
+SCALAR_BINARY(eq,  x == y)
+SCALAR_BINARY(ne,  x != y)
+SCALAR_BINARY(lt,  x < y)
+SCALAR_BINARY(gt,  x > y)
+SCALAR_BINARY(le,  x <= y)
+SCALAR_BINARY(ge,  x >= y)
+SCALAR_BINARY(and, x && y)
+SCALAR_BINARY(or,  x || y)
+
+static void scalar_neg(int *const dst, const int *const a, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = (int) (0u - (unsigned) a[i]);
+    }
+}
+
+static void scalar_not(int *const dst, const int *const a, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = !a[i];
+    }
+}
+
+static void scalar_select(int *const dst, const int *const cond,
+    const int *const a, const int *const b, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = cond[i] ? a[i] : b[i];
+    }
+}
+
+static void scalar_fill(int *const dst, const int value, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = value;
+    }
+}
+
+static void scalar_iota(int *const dst, const int first, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = (int) ((unsigned) first + i);
+    }
+}
+
+static int scalar_sum(const int *const a, const size_t n)
+{
+    unsigned total = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        total += (unsigned) a[i];
+    }
+
+    return (int) total;
+}
+
+static int scalar_min(const int *const a, const size_t n)
+{
+    int result = a[0];
+
+    for (size_t i = 1; i < n; ++i) {
+        result = a[i] < result ? a[i] : result;
+    }
+
+    return result;
+}
+
+static int scalar_max(const int *const a, const size_t n)
+{
+    int result = a[0];
+
+    for (size_t i = 1; i < n; ++i) {
+        result = a[i] > result ? a[i] : result;
+    }
+
+    return result;
+}
+
+static size_t scalar_find(const int *const a, const int value, const size_t n)
+{
+    size_t i = 0;
+
+    while (i < n && a[i] != value) {
+        ++i;
+    }
+
+    return i;
+}
+
+#define SIMD_TABLE(prefix, isa) { \
+    .name = isa, \
+    .binary = { \
+        [SIMD_ADD] = prefix##_add, \
+        [SIMD_SUB] = prefix##_sub, \
+        [SIMD_MUL] = prefix##_mul, \
+        [SIMD_EQ]  = prefix##_eq, \
+        [SIMD_NE]  = prefix##_ne, \
+        [SIMD_LT]  = prefix##_lt, \
+        [SIMD_GT]  = prefix##_gt, \
+        [SIMD_LE]  = prefix##_le, \
+        [SIMD_GE]  = prefix##_ge, \
+        [SIMD_AND] = prefix##_and, \
+        [SIMD_OR]  = prefix##_or, \
+    }, \
+    .neg = prefix##_neg, \
+    .not = prefix##_not, \
+    .select = prefix##_select, \
+    .fill = prefix##_fill, \
+    .iota = prefix##_iota, \
+    .sum = prefix##_sum, \
+    .min = prefix##_min, \
+    .max = prefix##_max, \
+    .find = prefix##_find, \
+}
+
+const struct simd simd_scalar = SIMD_TABLE(scalar, "scalar");
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+// Kernels for an instruction set described by the helpers P##_load, P##_add, ...
+// (T is the target attribute, V the vector type and W its width in ints)
+#define VEC_BINARY(K, P, T, V, W, name, body) \
+__attribute__((target(T))) \
+static void K##_##name(int *const dst, const int *const a, const int *const b, \
+    const size_t n) \
+{ \
+    const V one = P##_set1(1), zero = P##_set1(0); \
+    size_t i = 0; \
+    (void) one, (void) zero; \
+    for (; i + W <= n; i += W) { \
+        const V x = P##_load(a + i), y = P##_load(b + i); \
+        P##_store(dst + i, (body)); \
+    } \
+    scalar_##name(dst + i, a + i, b + i, n - i); \
+}
+
+// Minimum or maximum: lanes hold the running result of every W-th element
+#define VEC_REDUCE(K, P, T, V, W, name) \
+__attribute__((target(T))) \
+static int K##_##name(const int *const a, const size_t n) \
+{ \
+    int lanes[W + 1]; \
+    if (n < W) { \
+        return scalar_##name(a, n); \
+    } \
+    V acc = P##_load(a); \
+    size_t i = W; \
+    for (; i + W <= n; i += W) { \
+        acc = P##_##name(acc, P##_load(a + i)); \
+    } \
+    P##_store(lanes, acc); \
+    lanes[W] = i < n ? scalar_##name(a + i, n - i) : lanes[0]; \
+    return scalar_##name(lanes, W + 1); \
+}
+
+#define VEC_KERNELS(K, P, T, V, W) \
+VEC_BINARY(K, P, T, V, W, add, P##_add(x, y)) \
+VEC_BINARY(K, P, T, V, W, sub, P##_sub(x, y)) \
+VEC_BINARY(K, P, T, V, W, mul, P##_mul(x, y)) \
+VEC_BINARY(K, P, T, V, W, eq,  P##_and(P##_eq(x, y), one)) \
+VEC_BINARY(K, P, T, V, W, ne,  P##_andnot(P##_eq(x, y), one)) \
+VEC_BINARY(K, P, T, V, W, lt,  P##_and(P##_gt(y, x), one)) \
+VEC_BINARY(K, P, T, V, W, gt,  P##_and(P##_gt(x, y), one)) \
+VEC_BINARY(K, P, T, V, W, le,  P##_andnot(P##_gt(x, y), one)) \
+VEC_BINARY(K, P, T, V, W, ge,  P##_andnot(P##_gt(y, x), one)) \
+VEC_BINARY(K, P, T, V, W, and, P##_andnot(P##_or(P##_eq(x, zero), P##_eq(y, zero)), one)) \
+VEC_BINARY(K, P, T, V, W, or,  P##_andnot(P##_and(P##_eq(x, zero), P##_eq(y, zero)), one)) \
+\
+__attribute__((target(T))) \
+static void K##_neg(int *const dst, const int *const a, const size_t n) \
+{ \
+    size_t i = 0; \
+    for (; i + W <= n; i += W) { \
+        P##_store(dst + i, P##_sub(P##_set1(0), P##_load(a + i))); \
+    } \
+    scalar_neg(dst + i, a + i, n - i); \
+} \
+\
+__attribute__((target(T))) \
+static void K##_not(int *const dst, const int *const a, const size_t n) \
+{ \
+    size_t i = 0; \
+    for (; i + W <= n; i += W) { \
+        P##_store(dst + i, P##_and(P##_eq(P##_load(a + i), P##_set1(0)), P##_set1(1))); \
+    } \
+    scalar_not(dst + i, a + i, n - i); \
+} \
+\
+__attribute__((target(T))) \
+static void K##_select(int *const dst, const int *const cond, \
+    const int *const a, const int *const b, const size_t n) \
+{ \
+    size_t i = 0; \
+    for (; i + W <= n; i += W) { \
+        const V is_zero = P##_eq(P##_load(cond + i), P##_set1(0)); \
+        P##_store(dst + i, P##_or(P##_and(is_zero, P##_load(b + i)), \
+            P##_andnot(is_zero, P##_load(a + i)))); \
+    } \
+    scalar_select(dst + i, cond + i, a + i, b + i, n - i); \
+} \
+\
+__attribute__((target(T))) \
+static void K##_fill(int *const dst, const int value, const size_t n) \
+{ \
+    const V v = P##_set1(value); \
+    size_t i = 0; \
+    for (; i + W <= n; i += W) { \
+        P##_store(dst + i, v); \
+    } \
+    scalar_fill(dst + i, value, n - i); \
+} \
+\
+__attribute__((target(T))) \
+static void K##_iota(int *const dst, const int first, const size_t n) \
+{ \
+    static const int offsets[8] = { 0, 1, 2, 3, 4, 5, 6, 7 }; \
+    const V step = P##_set1(W); \
+    V v = P##_add(P##_load(offsets), P##_set1(first)); \
+    size_t i = 0; \
+    for (; i + W <= n; i += W, v = P##_add(v, step)) { \
+        P##_store(dst + i, v); \
+    } \
+    scalar_iota(dst + i, (int) ((unsigned) first + i), n - i); \
+} \
+\
+__attribute__((target(T))) \
+static int K##_sum(const int *const a, const size_t n) \
+{ \
+    int lanes[W]; \
+    V acc = P##_set1(0); \
+    size_t i = 0; \
+    for (; i + W <= n; i += W) { \
+        acc = P##_add(acc, P##_load(a + i)); \
+    } \
+    P##_store(lanes, acc); \
+    return (int) ((unsigned) scalar_sum(lanes, W) + (unsigned) scalar_sum(a + i, n - i)); \
+} \
+\
+VEC_REDUCE(K, P, T, V, W, min) \
+VEC_REDUCE(K, P, T, V, W, max) \
+\
+__attribute__((target(T))) \
+static size_t K##_find(const int *const a, const int value, const size_t n) \
+{ \
+    const V v = P##_set1(value); \
+    size_t i = 0; \
+    for (; i + W <= n; i += W) { \
+        const unsigned mask = P##_mask(P##_eq(P##_load(a + i), v)); \
+        if (mask) { \
+            return i + __builtin_ctz(mask) / sizeof(int); \
+        } \
+    } \
+    return i + scalar_find(a + i, value, n - i); \
+}
+
+// SSE2 helpers
+#define SSE2 __attribute__((target("sse2"))) static inline
+SSE2 __m128i v128_load(const int *p) { return _mm_loadu_si128((const __m128i *) p); }
+SSE2 void v128_store(int *p, __m128i v) { _mm_storeu_si128((__m128i *) p, v); }
+SSE2 __m128i v128_set1(int v) { return _mm_set1_epi32(v); }
+SSE2 __m128i v128_add(__m128i a, __m128i b) { return _mm_add_epi32(a, b); }
+SSE2 __m128i v128_sub(__m128i a, __m128i b) { return _mm_sub_epi32(a, b); }
+SSE2 __m128i v128_eq(__m128i a, __m128i b) { return _mm_cmpeq_epi32(a, b); }
+SSE2 __m128i v128_gt(__m128i a, __m128i b) { return _mm_cmpgt_epi32(a, b); }
+SSE2 __m128i v128_and(__m128i a, __m128i b) { return _mm_and_si128(a, b); }
+SSE2 __m128i v128_or(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+SSE2 __m128i v128_andnot(__m128i a, __m128i b) { return _mm_andnot_si128(a, b); }
+SSE2 unsigned v128_mask(__m128i a) { return _mm_movemask_epi8(a); }
+
+// SSE2 has no 32-bit minimum or maximum: select through a comparison
+SSE2 __m128i v128_min(__m128i a, __m128i b)
+{
+    const __m128i a_greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(a_greater, b), _mm_andnot_si128(a_greater, a));
+}
+
+SSE2 __m128i v128_max(__m128i a, __m128i b)
+{
+    const __m128i a_greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(a_greater, a), _mm_andnot_si128(a_greater, b));
+}
+
+// SSE2 has no 32-bit low multiply: multiply even and odd lanes separately
+SSE2 __m128i v128_mul(__m128i a, __m128i b)
+{
+    const __m128i even = _mm_mul_epu32(a, b);
+    const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+        _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+VEC_KERNELS(sse2, v128, "sse2", __m128i, 4)
+
+// AVX2 helpers
+#define AVX2 __attribute__((target("avx2"))) static inline
+AVX2 __m256i v256_load(const int *p) { return _mm256_loadu_si256((const __m256i *) p); }
+AVX2 void v256_store(int *p, __m256i v) { _mm256_storeu_si256((__m256i *) p, v); }
+AVX2 __m256i v256_set1(int v) { return _mm256_set1_epi32(v); }
+AVX2 __m256i v256_add(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+AVX2 __m256i v256_sub(__m256i a, __m256i b) { return _mm256_sub_epi32(a, b); }
+AVX2 __m256i v256_mul(__m256i a, __m256i b) { return _mm256_mullo_epi32(a, b); }
+AVX2 __m256i v256_eq(__m256i a, __m256i b) { return _mm256_cmpeq_epi32(a, b); }
+AVX2 __m256i v256_gt(__m256i a, __m256i b) { return _mm256_cmpgt_epi32(a, b); }
+AVX2 __m256i v256_and(__m256i a, __m256i b) { return _mm256_and_si256(a, b); }
+AVX2 __m256i v256_or(__m256i a, __m256i b) { return _mm256_or_si256(a, b); }
+AVX2 __m256i v256_andnot(__m256i a, __m256i b) { return _mm256_andnot_si256(a, b); }
+AVX2 unsigned v256_mask(__m256i a) { return _mm256_movemask_epi8(a); }
+AVX2 __m256i v256_min(__m256i a, __m256i b) { return _mm256_min_epi32(a, b); }
+AVX2 __m256i v256_max(__m256i a, __m256i b) { return _mm256_max_epi32(a, b); }
+
+VEC_KERNELS(avx2, v256, "avx2", __m256i, 8)
+
+const struct simd simd_sse2 = SIMD_TABLE(sse2, "sse2");
+const struct simd simd_avx2 = SIMD_TABLE(avx2, "avx2");
+
+const struct simd *simd_best(void)
+{
+    // Runs in several threads may look it up at once, and all find the same
+    static _Atomic(const struct simd *) best;
+    const struct simd *found = atomic_load_explicit(&best, memory_order_relaxed);
+
+    if (!found) {
+        __builtin_cpu_init();
+        found = __builtin_cpu_supports("avx2") ? &simd_avx2 :
+            __builtin_cpu_supports("sse2") ? &simd_sse2 : &simd_scalar;
+        atomic_store_explicit(&best, found, memory_order_relaxed);
+    }
+
+    return found;
+}
+
+#else
+
+const struct simd simd_sse2 = SIMD_TABLE(scalar, "scalar");
+const struct simd simd_avx2 = SIMD_TABLE(scalar, "scalar");
+
+const struct simd *simd_best(void)
+{
+    return &simd_scalar;
+}
+
+#endif
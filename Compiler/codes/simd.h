@@ -0,0 +1,65 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include <stddef.h>  // For size_t type
+
+// Element-wise operations on int arrays, in the order of the binary kernels
+// below. Every operation has the exact result of the interpreter's operator
+// (comparisons and logical operators produce 0 or 1).
+enum {
+    SIMD_ADD,    // a + b
+    SIMD_SUB,    // a - b
+    SIMD_MUL,    // a * b
+    SIMD_EQ,     // a == b
+    SIMD_NE,     // a != b
+    SIMD_LT,     // a < b
+    SIMD_GT,     // a > b
+    SIMD_LE,     // a <= b
+    SIMD_GE,     // a >= b
+    SIMD_AND,    // a && b
+    SIMD_OR,     // a || b
+    SIMD_BINARY_COUNT,
+};
+
+// A set of kernels built for one instruction set. Source and destination
+// arrays may be the same array but must not otherwise overlap.
+struct simd {
+    const char *name;
+
+    // dst[i] = a[i] op b[i]
+    void (*binary[SIMD_BINARY_COUNT])(int *dst, const int *a, const int *b, size_t n);
+
+    // dst[i] = -a[i]
+    void (*neg)(int *dst, const int *a, size_t n);
+
+    // dst[i] = !a[i]
+    void (*not)(int *dst, const int *a, size_t n);
+
+    // dst[i] = cond[i] ? a[i] : b[i]
+    void (*select)(int *dst, const int *cond, const int *a, const int *b, size_t n);
+
+    // dst[i] = value
+    void (*fill)(int *dst, int value, size_t n);
+
+    // dst[i] = first + i
+    void (*iota)(int *dst, int first, size_t n);
+
+    // a[0] + ... + a[n - 1], wrapping around on overflow
+    int (*sum)(const int *a, size_t n);
+
+    // Smallest and largest of a[0] .. a[n - 1] (n > 0)
+    int (*min)(const int *a, size_t n);
+    int (*max)(const int *a, size_t n);
+
+    // Index of the first element equal to value, or n if there is none
+    size_t (*find)(const int *a, int value, size_t n);
+};
+
+// Kernels for each instruction set (the SSE2 and AVX2 ones fall back to the
+// scalar kernels when the compiler does not target x86)
+extern const struct simd simd_scalar;
+extern const struct simd simd_sse2;
+extern const struct simd simd_avx2;
+
+// Function declaration: simd_best
+// Returns the widest kernel set the running CPU supports.
+const struct simd *simd_best(void);
@@ -0,0 +1,161 @@
+#include "source.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+
+#include <windows.h>  // Windows-specific headers
+
+int source_open(struct source *const source, const char *const path)
+{
+    LARGE_INTEGER size;
+
+    *source = (struct source) { .mapped = 1 };
+    source->file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (source->file == INVALID_HANDLE_VALUE) {
+        errno = ENOENT;
+        return SOURCE_ERROR;
+    }
+
+    // 64 bits: GetFileSize() alone stops at 4 GB
+    if (!GetFileSizeEx(source->file, &size) || (uint64_t) size.QuadPart > SIZE_MAX) {
+        CloseHandle(source->file);
+        errno = EFBIG;
+        return SOURCE_ERROR;
+    }
+
+    if (!size.QuadPart) {
+        CloseHandle(source->file);
+        return SOURCE_EMPTY;
+    }
+
+    // Sizes of 0 map the whole file
+    source->size = size.QuadPart;
+    source->mapping = CreateFileMapping(source->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    source->text = source->mapping ? MapViewOfFile(source->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+
+    if (!source->text) {
+        if (source->mapping) {
+            CloseHandle(source->mapping);
+        }
+
+        CloseHandle(source->file);
+        errno = EIO;
+        return SOURCE_ERROR;
+    }
+
+    return 0;
+}
+
+void source_close(struct source *const source)
+{
+    UnmapViewOfFile(source->text);
+    CloseHandle(source->mapping);
+    CloseHandle(source->file);
+}
+
+#else
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Read all of `fd` into a malloc'd buffer, for inputs that cannot be mapped
+static int read_all(struct source *const source, const int fd)
+{
+    size_t capacity = 64 * 1024, size = 0;
+    uint8_t *text = malloc(capacity);
+
+    while (text) {
+        const ssize_t got = read(fd, text + size, capacity - size);
+
+        if (got < 0 && errno == EINTR) {
+            continue;
+        } else if (got < 0) {
+            break;
+        } else if (!got) {
+            source->text = text;
+            source->size = size;
+            return size ? 0 : (free(text), SOURCE_EMPTY);
+        }
+
+        size += got;
+
+        if (size == capacity) {
+            uint8_t *const grown = capacity <= SIZE_MAX / 2 ? realloc(text, 2 * capacity) : NULL;
+
+            if (!grown) {
+                errno = ENOMEM;
+                break;
+            }
+
+            text = grown;
+            capacity *= 2;
+        }
+    }
+
+    free(text);
+    return SOURCE_ERROR;
+}
+
+int source_open(struct source *const source, const char *const path)
+{
+    struct stat st;
+    const int fd = open(path, O_RDONLY);
+    int status = 0;
+
+    *source = (struct source) { 0 };
+
+    if (fd < 0) {
+        return SOURCE_ERROR;
+    }
+
+    if (fstat(fd, &st)) {
+        status = SOURCE_ERROR;
+    } else if (!S_ISREG(st.st_mode)) {
+        status = read_all(source, fd);
+    } else if (!st.st_size) {
+        status = SOURCE_EMPTY;
+    } else if ((uint64_t) st.st_size > SIZE_MAX) {
+        errno = EFBIG;
+        status = SOURCE_ERROR;
+    } else {
+        // Fault the pages in up front, with read-ahead for a front-to-back pass
+#ifdef MAP_POPULATE
+        const int flags = MAP_PRIVATE | MAP_POPULATE;
+#else
+        const int flags = MAP_PRIVATE;
+#endif
+        void *const text = mmap(NULL, st.st_size, PROT_READ, flags, fd, 0);
+
+        if (text == MAP_FAILED) {
+            status = read_all(source, fd);
+        } else {
+            madvise(text, st.st_size, MADV_SEQUENTIAL);
+            source->text = text;
+            source->size = st.st_size;
+            source->mapped = 1;
+        }
+    }
+
+    // The mapping stays valid once the file is closed
+    const int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return status;
+}
+
+void source_close(struct source *const source)
+{
+    if (source->mapped) {
+        munmap((void *) source->text, source->size);
+    } else {
+        free((void *) source->text);
+    }
+}
+
+#endif
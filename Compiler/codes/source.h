@@ -0,0 +1,31 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include <stdint.h>  // For uint8_t
+#include <stddef.h>  // For size_t type
+
+// Return codes of source_open()
+enum {
+    SOURCE_EMPTY = 1,  // The file holds nothing to lex
+    SOURCE_ERROR,      // The file could not be opened, mapped or read; errno tells why
+};
+
+// The text of an input file, mapped into memory when the file allows it
+// (the lexer and tokens then point into the page cache), read into a buffer
+// otherwise (pipes, character devices)
+struct source {
+    const uint8_t *text;
+    size_t size;
+    int mapped;  // 1: text is a mapping of the file, 0: a malloc'd buffer
+#ifdef _WIN32
+    void *file, *mapping;  // HANDLEs of the mapped file
+#endif
+};
+
+// Function declaration: source_open
+// Loads the file at `path` into `source`. Returns 0 on success, or a SOURCE_
+// code, in which case there is nothing to close.
+int source_open(struct source *, const char *path);
+
+// Function declaration: source_close
+// Unmaps or frees the text of a source.
+void source_close(struct source *);
@@ -0,0 +1,1165 @@
+#include "spec.h"
+#include "lex.h"
+#include "parse.h"
+#include <limits.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Same limit as the interpreter's variable store (see run.c); in programs
+// with more variables an assignment may fail, so values are not tracked
+#define VARSTORE_CAPACITY 128
+
+// Loops are unrolled if they run at most UNROLL_TRIPS times and their copies
+// take at most UNROLL_NODES nodes
+#define UNROLL_TRIPS 16
+#define UNROLL_NODES 1024
+
+// Statements specialized before unrolling stops being tried, which bounds
+// the work spent on nested loops that turn out not to unroll
+#define UNROLL_WORK (1 << 16)
+
+// Iterate over the statements of a block: they are contiguous in memory and
+// the block ends at the first leaf (the closing brace or the end of file)
+#define foreach_stmt(stmt, first) \
+    for (const struct node *stmt = (first); stmt->nchildren; ++stmt)
+
+// What is known about a variable at some point of the program
+enum {
+    K_UNKNOWN,    // It may or may not be defined, with any value
+    K_UNDEFINED,  // It is not defined yet: reading it warns and yields 0
+    K_CONST,      // It is defined and holds `value`
+};
+
+struct known {
+    uint8_t state;
+    int value;
+};
+
+// What is known about the value of an expression
+struct value {
+    uint8_t known;  // Its value is `value`
+    uint8_t pure;   // Evaluating it cannot print a warning
+    int value;
+};
+
+// A block of arena memory
+struct spec_chunk {
+    struct spec_chunk *next;
+    size_t used, size;
+    alignas(max_align_t) unsigned char data[];
+};
+
+#define CHUNK_SIZE (64 * 1024)
+
+// Statements of a block being built
+struct list {
+    struct node *stmts;
+    size_t n, allocated;
+};
+
+// State of the specialization being built
+static _Thread_local struct {
+    const struct program *program;
+    struct spec *spec;
+    int track;      // Variable values are tracked
+    size_t nodes;   // Nodes allocated so far
+    size_t work;    // Statements specialized so far
+} pe;
+
+// Tokens of nodes that have no counterpart in the source
+static const struct token token_if = { (const uint8_t *) "if", (const uint8_t *) "if" + 2, token_COND };
+static const struct token token_else = { (const uint8_t *) "else", (const uint8_t *) "else" + 4, token_ELSE };
+static const struct token token_minus = { (const uint8_t *) "-", (const uint8_t *) "-" + 1, token_MINS };
+
+static void *arena_alloc(const size_t size)
+{
+    const size_t rounded = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    struct spec_chunk *chunk = pe.spec->arena;
+
+    if (!chunk || chunk->size - chunk->used < rounded) {
+        const size_t chunk_size = rounded > CHUNK_SIZE ? rounded : CHUNK_SIZE;
+
+        if (!(chunk = malloc(sizeof(struct spec_chunk) + chunk_size))) {
+            return NULL;
+        }
+
+        chunk->next = pe.spec->arena;
+        chunk->used = 0;
+        chunk->size = chunk_size;
+        pe.spec->arena = chunk;
+    }
+
+    void *const at = chunk->data + chunk->used;
+    chunk->used += rounded;
+    return at;
+}
+
+// A new leaf holding `token`
+static struct node *leaf(const struct token *const token)
+{
+    struct node *const node = arena_alloc(sizeof(struct node));
+
+    if (node) {
+        *node = (struct node) { .token = token };
+        pe.nodes++;
+    }
+
+    return node;
+}
+
+// A new node of type `nt` with room for its children
+static struct node *inner(const nt_t nt, const size_t nchildren)
+{
+    struct node *const node = arena_alloc(sizeof(struct node));
+    struct node **const children = arena_alloc(nchildren * sizeof(struct node *));
+
+    if (!node || !children) {
+        return NULL;
+    }
+
+    *node = (struct node) { .nchildren = nchildren, .nt = nt, .children = children };
+    pe.nodes++;
+    return node;
+}
+
+// A new Expr node above `child`
+static struct node *wrap(struct node *const child)
+{
+    struct node *const expr = child ? inner(NT_Expr, 1) : NULL;
+
+    if (expr) {
+        expr->children[0] = child;
+    }
+
+    return expr;
+}
+
+// A new Atom node for a number literal with `digits`
+static struct node *number(const unsigned digits)
+{
+    struct token *const token = arena_alloc(sizeof(struct token));
+    char *const text = arena_alloc(12);
+    struct node *const atom = inner(NT_Atom, 1);
+
+    if (!token || !text || !atom) {
+        return NULL;
+    }
+
+    const int len = snprintf(text, 12, "%u", digits);
+
+    *token = (struct token) {
+        .beg = (const uint8_t *) text,
+        .end = (const uint8_t *) text + len,
+        .token = token_NMBR,
+    };
+
+    return (atom->children[0] = leaf(token)) ? atom : NULL;
+}
+
+// A new Uexp node "-operand"
+static struct node *negate(struct node *const operand)
+{
+    struct node *const uexp = operand ? inner(NT_Uexp, 2) : NULL;
+
+    if (!uexp || !(uexp->children[0] = leaf(&token_minus))) {
+        return NULL;
+    }
+
+    uexp->children[1] = operand;
+    return uexp;
+}
+
+// A new Expr node with the value `value`; literals are never negative, so
+// negative values are negated literals (and INT_MIN is -2147483647 - 1)
+static struct node *constant(const int value)
+{
+    if (value >= 0) {
+        return wrap(number(value));
+    } else if (value > INT_MIN) {
+        return wrap(negate(wrap(number(-(unsigned) value))));
+    }
+
+    struct node *const bexp = inner(NT_Bexp, 3);
+
+    if (!bexp) {
+        return NULL;
+    }
+
+    bexp->children[0] = wrap(negate(wrap(number(INT_MAX))));
+    bexp->children[1] = leaf(&token_minus);
+    bexp->children[2] = wrap(number(1));
+    return bexp->children[0] && bexp->children[1] && bexp->children[2] ? wrap(bexp) : NULL;
+}
+
+// Value of a number literal, converted as eval_atom() does
+static int literal_value(const struct node *const atom)
+{
+    const uint8_t *const beg = atom->children[0]->token->beg;
+    const uint8_t *const end = atom->children[0]->token->end;
+    unsigned result = 0, mult = 1;
+
+    for (ptrdiff_t idx = end - beg - 1; idx >= 0; --idx, mult *= 10) {
+        result += mult * (beg[idx] - '0');
+    }
+
+    return (int) result;
+}
+
+// Apply a binary operator to known operands as apply_binary() does. Returns
+// 0 if the interpreter would crash (% by zero or INT_MIN / -1); sets *warns
+// if it would print the division warning.
+static int fold(const token_t op, const int left, const int right, int *const result,
+    int *const warns)
+{
+    *warns = 0;
+
+    switch (op) {
+    case token_PLUS:
+        return *result = (int) ((unsigned) left + (unsigned) right), 1;
+
+    case token_MINS:
+        return *result = (int) ((unsigned) left - (unsigned) right), 1;
+
+    case token_MULT:
+        return *result = (int) ((unsigned) left * (unsigned) right), 1;
+
+    case token_DIVI:
+        if (!right) {
+            return *warns = 1, *result = 0, 1;
+        }
+
+        return left == INT_MIN && right == -1 ? 0 : (*result = left / right, 1);
+
+    case token_MODU:
+        return !right || (left == INT_MIN && right == -1) ? 0 : (*result = left % right, 1);
+
+    case token_EQUL:
+        return *result = left == right, 1;
+
+    case token_NEQL:
+        return *result = left != right, 1;
+
+    case token_LTHN:
+        return *result = left < right, 1;
+
+    case token_GTHN:
+        return *result = left > right, 1;
+
+    case token_LTEQ:
+        return *result = left <= right, 1;
+
+    case token_GTEQ:
+        return *result = left >= right, 1;
+
+    case token_CONJ:
+        return *result = left && right, 1;
+
+    case token_DISJ:
+        return *result = left || right, 1;
+
+    default:
+        abort();
+    }
+}
+
+// Copy a node whose children are only leaves
+static struct node *copy_leaves(const struct node *const node)
+{
+    if (!node->nchildren) {
+        return leaf(node->token);
+    }
+
+    struct node *const copy = inner(node->nt, node->nchildren);
+
+    for (size_t child_idx = 0; copy && child_idx < node->nchildren; ++child_idx) {
+        if (!(copy->children[child_idx] = leaf(node->children[child_idx]->token))) {
+            return NULL;
+        }
+    }
+
+    return copy;
+}
+
+static struct node *spec_expr(const struct node *, const struct known *, struct value *);
+
+// Copy a node, specializing the expressions among its children (their
+// values are not needed)
+static struct node *spec_children(const struct node *const node, const struct known *const env)
+{
+    struct node *const copy = inner(node->nt, node->nchildren);
+    struct value ignored;
+
+    for (size_t child_idx = 0; copy && child_idx < node->nchildren; ++child_idx) {
+        const struct node *const child = node->children[child_idx];
+
+        copy->children[child_idx] = !child->nchildren ? leaf(child->token) :
+            child->nt == NT_Expr ? spec_expr(child, env, &ignored) : spec_children(child, env);
+
+        if (!copy->children[child_idx]) {
+            return NULL;
+        }
+    }
+
+    return copy;
+}
+
+// Specialize an expression, setting what is known about its value. Parts
+// that may warn are kept, so the warnings are printed as before.
+static struct node *spec_expr(const struct node *const expr, const struct known *const env,
+    struct value *const out)
+{
+    const struct node *const node = expr->children[0];
+    struct value left, right;
+
+    *out = (struct value) { 0 };
+
+    switch (node->nt) {
+    case NT_Atom:
+        if (node->children[0]->token->token == token_NMBR) {
+            *out = (struct value) { .known = 1, .pure = 1, .value = literal_value(node) };
+        } else if (pe.program->symbols[node->slot].is_array) {
+            break;
+        } else if (env[node->slot].state == K_CONST) {
+            pe.spec->stats.reads++;
+            *out = (struct value) { .known = 1, .pure = 1, .value = env[node->slot].value };
+            return constant(out->value);
+        } else if (env[node->slot].state == K_UNDEFINED) {
+            // The read warns and yields 0
+            *out = (struct value) { .known = 1, .pure = 0, .value = 0 };
+        }
+
+        return wrap(copy_leaves(node));
+
+    case NT_Pexp: {
+        struct node *const inside = spec_expr(node->children[1], env, out);
+
+        if (out->known && out->pure) {
+            return inside;
+        }
+
+        struct node *const pexp = inside ? inner(NT_Pexp, 3) : NULL;
+
+        if (!pexp || !(pexp->children[0] = leaf(node->children[0]->token)) ||
+            !(pexp->children[2] = leaf(node->children[2]->token))) {
+            return NULL;
+        }
+
+        pexp->children[1] = inside;
+        return wrap(pexp);
+    }
+
+    case NT_Bexp: {
+        struct node *const bexp = inner(NT_Bexp, 3);
+
+        if (!bexp || !(bexp->children[0] = spec_expr(node->children[0], env, &left)) ||
+            !(bexp->children[1] = leaf(node->children[1]->token)) ||
+            !(bexp->children[2] = spec_expr(node->children[2], env, &right))) {
+            return NULL;
+        }
+
+        int result, warns;
+
+        if (left.known && right.known &&
+            fold(node->children[1]->token->token, left.value, right.value, &result, &warns)) {
+            *out = (struct value) {
+                .known = 1,
+                .pure = left.pure && right.pure && !warns,
+                .value = result,
+            };
+
+            if (out->pure) {
+                pe.spec->stats.folds++;
+                return constant(result);
+            }
+        }
+
+        return wrap(bexp);
+    }
+
+    case NT_Uexp: {
+        struct node *const uexp = inner(NT_Uexp, 2);
+
+        if (!uexp || !(uexp->children[0] = leaf(node->children[0]->token)) ||
+            !(uexp->children[1] = spec_expr(node->children[1], env, &right))) {
+            return NULL;
+        }
+
+        if (right.known) {
+            const token_t op = node->children[0]->token->token;
+
+            *out = right;
+            out->value = op == token_MINS ? (int) -(unsigned) right.value :
+                op == token_NEGA ? !right.value : right.value;
+
+            if (out->pure) {
+                pe.spec->stats.folds++;
+                return constant(out->value);
+            }
+        }
+
+        return wrap(uexp);
+    }
+
+    case NT_Texp: {
+        struct value cond;
+        struct node *const test = spec_expr(node->children[0], env, &cond);
+
+        if (!test) {
+            return NULL;
+        }
+
+        // Only the branch taken is evaluated
+        if (cond.known && cond.pure) {
+            pe.spec->stats.folds++;
+            return spec_expr(node->children[cond.value ? 2 : 4], env, out);
+        }
+
+        struct node *const texp = inner(NT_Texp, 5);
+
+        if (!texp || !(texp->children[1] = leaf(node->children[1]->token)) ||
+            !(texp->children[2] = spec_expr(node->children[2], env, &left)) ||
+            !(texp->children[3] = leaf(node->children[3]->token)) ||
+            !(texp->children[4] = spec_expr(node->children[4], env, &right))) {
+            return NULL;
+        }
+
+        texp->children[0] = test;
+
+        if (cond.known) {
+            *out = cond.value ? left : right;
+            out->pure = 0;
+        }
+
+        return wrap(texp);
+    }
+
+    default:
+        // Array elements and calls are never known
+        break;
+    }
+
+    return wrap(spec_children(node, env));
+}
+
+// Append a statement holding `node` to a block being built
+static int add_stmt(struct list *const list, struct node *const node)
+{
+    struct node **const children = node ? arena_alloc(sizeof(struct node *)) : NULL;
+
+    if (!children) {
+        return SPEC_NOMEM;
+    }
+
+    if (list->n == list->allocated) {
+        const size_t allocated = list->allocated ? 2 * list->allocated : 16;
+        struct node *const stmts = realloc(list->stmts, allocated * sizeof(struct node));
+
+        if (!stmts) {
+            return SPEC_NOMEM;
+        }
+
+        list->stmts = stmts;
+        list->allocated = allocated;
+    }
+
+    children[0] = node;
+    list->stmts[list->n++] = (struct node) { .nchildren = 1, .nt = NT_Stmt, .children = children };
+    pe.nodes++;
+    return SPEC_OK;
+}
+
+// First statement of the block inside a Unit, Func, Cond, Elif, Else, Dowh or Whil node
+static const struct node *block_of(const struct node *const node)
+{
+    switch (node->nt) {
+    case NT_Unit:
+        return node->children[1];
+
+    case NT_Else:
+    case NT_Dowh:
+        return node->children[2];
+
+    default:
+        return node->children[3];
+    }
+}
+
+// The leaf closing the block that starts at `first`
+static const struct node *block_end(const struct node *first)
+{
+    while (first->nchildren) {
+        ++first;
+    }
+
+    return first;
+}
+
+// A new node of type `nt` whose children are `before`, then the statements
+// of `body` (stored contiguously and closed by a copy of `end`), then `after`
+static struct node *with_block(const nt_t nt, struct node **const before, const size_t nbefore,
+    const struct list *const body, const struct node *const end, struct node **const after,
+    const size_t nafter)
+{
+    struct node *const node = inner(nt, nbefore + body->n + 1 + nafter);
+    struct node *const block = arena_alloc((body->n + 1) * sizeof(struct node));
+
+    if (!node || !block) {
+        return NULL;
+    }
+
+    for (size_t stmt_idx = 0; stmt_idx < body->n; ++stmt_idx) {
+        block[stmt_idx] = body->stmts[stmt_idx];
+    }
+
+    block[body->n] = (struct node) { .token = end->token };
+    pe.nodes++;
+
+    for (size_t idx = 0; idx < nbefore; ++idx) {
+        node->children[idx] = before[idx];
+    }
+
+    for (size_t stmt_idx = 0; stmt_idx <= body->n; ++stmt_idx) {
+        node->children[nbefore + stmt_idx] = &block[stmt_idx];
+    }
+
+    for (size_t idx = 0; idx < nafter; ++idx) {
+        node->children[nbefore + body->n + 1 + idx] = after[idx];
+    }
+
+    return node;
+}
+
+// Copy a node as it is, with the statements of its blocks contiguous
+static struct node *copy_tree(const struct node *const node)
+{
+    if (!node->nchildren) {
+        return leaf(node->token);
+    }
+
+    switch (node->nt) {
+    case NT_Func:
+    case NT_Cond:
+    case NT_Elif:
+    case NT_Whil:
+    case NT_Else:
+    case NT_Dowh: {
+        const struct node *const first = block_of(node);
+        const struct node *const end = block_end(first);
+        const size_t nbefore = node->nt == NT_Else || node->nt == NT_Dowh ? 2 : 3;
+        const size_t nafter = node->nchildren - nbefore - (end - first) - 1;
+        struct node *before[3], *after[3];  // At most 3 (Dowh: WHIL, Expr, SCOL)
+        struct list body = { 0 };
+        int status = SPEC_OK;
+
+        for (size_t idx = 0; idx < nbefore; ++idx) {
+            status = status ?: (before[idx] = copy_tree(node->children[idx])) ? SPEC_OK : SPEC_NOMEM;
+        }
+
+        for (size_t idx = 0; idx < nafter; ++idx) {
+            status = status ?: (after[idx] = copy_tree(node->children[node->nchildren - nafter + idx])) ?
+                SPEC_OK : SPEC_NOMEM;
+        }
+
+        foreach_stmt(stmt, first) {
+            status = status ?: add_stmt(&body, copy_tree(stmt->children[0]));
+        }
+
+        struct node *const copy = status ? NULL :
+            with_block(node->nt, before, nbefore, &body, end, after, nafter);
+
+        free(body.stmts);
+        return copy;
+    }
+
+    default: {
+        struct node *const copy = inner(node->nt, node->nchildren);
+
+        for (size_t child_idx = 0; copy && child_idx < node->nchildren; ++child_idx) {
+            if (!(copy->children[child_idx] = copy_tree(node->children[child_idx]))) {
+                return NULL;
+            }
+        }
+
+        return copy;
+    }
+    }
+}
+
+// Combine what is known after two paths that join
+static void meet(struct known *const into, const struct known *const from)
+{
+    for (size_t slot = 0; slot < pe.program->nsymbols; ++slot) {
+        if (into[slot].state != from[slot].state ||
+            (into[slot].state == K_CONST && into[slot].value != from[slot].value)) {
+            into[slot].state = K_UNKNOWN;
+        }
+    }
+}
+
+// Forget the values of the variables a block may assign, nested blocks included
+static void forget_writes(const struct node *const first, struct known *const env)
+{
+    foreach_stmt(stmt, first) {
+        const struct node *const node = stmt->children[0];
+
+        if (node->nt == NT_Assn) {
+            env[node->slot].state = K_UNKNOWN;
+        } else if (node->nt == NT_Ctrl) {
+            for (size_t arm_idx = 0; arm_idx < node->nchildren; ++arm_idx) {
+                forget_writes(block_of(node->children[arm_idx]), env);
+            }
+        }
+    }
+}
+
+static int spec_block(const struct node *, struct known *, struct list *);
+
+// The value bound to a parameter's assignment, if it is one
+static const int *bound_value(const struct node *const assn)
+{
+    for (size_t param = 0; param < pe.spec->nbound; ++param) {
+        if (pe.spec->targets[param] == assn) {
+            return &pe.spec->values[param];
+        }
+    }
+
+    return NULL;
+}
+
+static int spec_assign(const struct node *const assn, struct known *const env,
+    struct list *const out)
+{
+    const struct node *const lhs = assn->children[0];
+    const int *const bound = bound_value(assn);
+    struct node *const copy = inner(NT_Assn, 4);
+    struct value value;
+
+    if (!copy) {
+        return SPEC_NOMEM;
+    }
+
+    if (bound) {
+        value = (struct value) { .known = 1, .pure = 1, .value = *bound };
+        copy->children[2] = constant(*bound);
+    } else {
+        copy->children[2] = spec_expr(assn->children[2], env, &value);
+    }
+
+    copy->children[0] = lhs->nchildren ? spec_children(lhs, env) : leaf(lhs->token);
+    copy->children[1] = leaf(assn->children[1]->token);
+    copy->children[3] = leaf(assn->children[3]->token);
+
+    if (!copy->children[0] || !copy->children[1] || !copy->children[2] || !copy->children[3]) {
+        return SPEC_NOMEM;
+    }
+
+    if (pe.track && !pe.program->symbols[assn->slot].is_array) {
+        env[assn->slot] = value.known ?
+            (struct known) { .state = K_CONST, .value = value.value } :
+            (struct known) { .state = K_UNKNOWN };
+    }
+
+    return add_stmt(out, copy);
+}
+
+// Specialize an if/elif/else chain: arms whose condition is known to be
+// false are dropped, and so are the arms after one known to be true
+static int spec_cond(const struct node *const ctrl, struct known *const env,
+    struct list *const out)
+{
+    const size_t nsymbols = pe.program->nsymbols ?: 1;
+    struct node **const arms = malloc(ctrl->nchildren * sizeof(struct node *));
+    struct known *const arm_env = malloc(nsymbols * sizeof(struct known));
+    struct known *const joined = malloc(nsymbols * sizeof(struct known));
+    size_t narms = 0, arm_idx = 0;
+    int status = arms && arm_env && joined ? SPEC_OK : SPEC_NOMEM;
+    int taken = 0;  // Some arm always runs
+
+    for (; !status && !taken && arm_idx < ctrl->nchildren; ++arm_idx) {
+        const struct node *const arm = ctrl->children[arm_idx];
+        struct value cond = { .known = 1, .pure = 1, .value = 1 };
+        struct node *const test = arm->nt == NT_Else ? NULL : spec_expr(arm->children[1], env, &cond);
+
+        if (arm->nt != NT_Else && !test) {
+            status = SPEC_NOMEM;
+            break;
+        }
+
+        if (cond.known && cond.pure && !cond.value) {
+            pe.spec->stats.arms++;
+            continue;
+        }
+
+        taken = cond.known && cond.pure;
+
+        if (taken && !narms) {
+            // The first arm that can run always runs: its statements replace the chain
+            status = spec_block(block_of(arm), env, out);
+            memcpy(joined, env, nsymbols * sizeof(struct known));
+            ++arm_idx;
+            break;
+        }
+
+        struct list body = { 0 };
+        struct node *before[3];
+        size_t nbefore = 0;
+        nt_t nt = arm->nt;
+
+        memcpy(arm_env, env, nsymbols * sizeof(struct known));
+        status = spec_block(block_of(arm), arm_env, &body);
+
+        if (taken) {
+            // Known to run if the arms before it do not: it becomes the else
+            nt = NT_Else;
+            before[nbefore++] = leaf(arm->nt == NT_Else ? arm->children[0]->token : &token_else);
+            before[nbefore++] = leaf(arm->children[arm->nt == NT_Else ? 1 : 2]->token);
+        } else {
+            // An elif left first becomes the if
+            nt = narms ? NT_Elif : NT_Cond;
+            before[nbefore++] = leaf(narms || arm->nt == NT_Cond ? arm->children[0]->token : &token_if);
+            before[nbefore++] = test;
+            before[nbefore++] = leaf(arm->children[2]->token);
+        }
+
+        for (size_t idx = 0; idx < nbefore; ++idx) {
+            status = status ?: before[idx] ? SPEC_OK : SPEC_NOMEM;
+        }
+
+        if (!status && !(arms[narms++] = with_block(nt, before, nbefore, &body,
+            block_end(block_of(arm)), NULL, 0))) {
+            status = SPEC_NOMEM;
+        }
+
+        free(body.stmts);
+
+        if (narms == 1) {
+            memcpy(joined, arm_env, nsymbols * sizeof(struct known));
+        } else {
+            meet(joined, arm_env);
+        }
+    }
+
+    pe.spec->stats.arms += ctrl->nchildren - arm_idx;
+
+    if (!status && narms) {
+        // Without an else, no arm may run at all
+        if (!taken) {
+            meet(joined, env);
+        }
+
+        struct node *const copy = inner(NT_Ctrl, narms);
+
+        if (copy) {
+            memcpy(copy->children, arms, narms * sizeof(struct node *));
+            memcpy(env, joined, nsymbols * sizeof(struct known));
+        }
+
+        status = add_stmt(out, copy);
+    }
+
+    free(arms);
+    free(arm_env);
+    free(joined);
+    return status;
+}
+
+// Whether a loop condition, evaluated with what is known, is known and cannot warn
+static int known_test(const struct node *const expr, const struct known *const env,
+    int *const value)
+{
+    const struct spec_stats saved = pe.spec->stats;
+    struct value cond;
+
+    if (!spec_expr(expr, env, &cond)) {
+        return -1;
+    }
+
+    // The test is not kept, so nothing of it counts
+    pe.spec->stats = saved;
+    *value = cond.value;
+    return cond.known && cond.pure;
+}
+
+// Unroll a loop into `out` if it runs a few known times. Returns 1 if it was
+// unrolled, 0 if not (leaving `out` and `env` as they were) and -1 if
+// memory ran out.
+static int unroll(const struct node *const loop, struct known *const env, struct list *const out)
+{
+    const size_t nsymbols = pe.program->nsymbols ?: 1;
+    const struct node *const test = loop->nt == NT_Whil ? loop->children[1] :
+        loop->children[loop->nchildren - 2];
+    const struct spec_stats saved = pe.spec->stats;
+    const size_t mark = out->n, nodes = pe.nodes;
+    struct known *const iter = malloc(nsymbols * sizeof(struct known));
+    size_t trips = 0;
+    int result = iter ? 0 : -1, value = 1;
+
+    if (iter) {
+        memcpy(iter, env, nsymbols * sizeof(struct known));
+    }
+
+    while (!result && pe.work < UNROLL_WORK) {
+        if (loop->nt == NT_Whil && (result = known_test(test, iter, &value)) != 1) {
+            break;
+        }
+
+        result = 0;
+
+        if (!value) {
+            result = 1;
+            break;
+        }
+
+        if (trips == UNROLL_TRIPS || pe.nodes - nodes > UNROLL_NODES) {
+            break;
+        }
+
+        if (spec_block(block_of(loop), iter, out)) {
+            result = -1;
+            break;
+        }
+
+        ++trips;
+
+        if (loop->nt == NT_Dowh && (result = known_test(test, iter, &value)) != 1) {
+            break;
+        }
+
+        result = 0;
+    }
+
+    if (result == 1) {
+        memcpy(env, iter, nsymbols * sizeof(struct known));
+        pe.spec->stats.unrolled++;
+        pe.spec->stats.iterations += trips;
+    } else {
+        out->n = mark;
+        pe.spec->stats = saved;
+        result = result < 0 ? -1 : 0;
+    }
+
+    free(iter);
+    return result;
+}
+
+// Specialize a while or do-while loop that is not unrolled: the variables
+// it assigns are unknown in the whole loop and after it
+static int spec_loop(const struct node *const loop, struct known *const env,
+    struct list *const out)
+{
+    const int unrolled = unroll(loop, env, out);
+
+    if (unrolled) {
+        return unrolled < 0 ? SPEC_NOMEM : SPEC_OK;
+    }
+
+    const size_t nsymbols = pe.program->nsymbols ?: 1;
+    const struct node *const first = block_of(loop);
+    struct known *const body_env = malloc(nsymbols * sizeof(struct known));
+    struct list body = { 0 };
+    struct value ignored;
+    struct node *node = NULL;
+
+    if (!body_env) {
+        return SPEC_NOMEM;
+    }
+
+    forget_writes(first, env);
+    memcpy(body_env, env, nsymbols * sizeof(struct known));
+    int status = spec_block(first, body_env, &body);
+
+    if (!status && loop->nt == NT_Whil) {
+        struct node *before[] = {
+            leaf(loop->children[0]->token),
+            spec_expr(loop->children[1], env, &ignored),
+            leaf(loop->children[2]->token),
+        };
+
+        node = before[0] && before[1] && before[2] ?
+            with_block(NT_Whil, before, 3, &body, block_end(first), NULL, 0) : NULL;
+    } else if (!status) {
+        const size_t nchildren = loop->nchildren;
+        struct node *before[] = {
+            leaf(loop->children[0]->token),
+            leaf(loop->children[1]->token),
+        };
+        struct node *after[] = {
+            leaf(loop->children[nchildren - 3]->token),
+            spec_expr(loop->children[nchildren - 2], env, &ignored),
+            leaf(loop->children[nchildren - 1]->token),
+        };
+
+        node = before[0] && before[1] && after[0] && after[1] && after[2] ?
+            with_block(NT_Dowh, before, 2, &body, block_end(first), after, 3) : NULL;
+    }
+
+    free(body.stmts);
+    free(body_env);
+
+    struct node *const ctrl = node ? inner(NT_Ctrl, 1) : NULL;
+
+    if (status || !ctrl) {
+        return status ?: SPEC_NOMEM;
+    }
+
+    ctrl->children[0] = node;
+    return add_stmt(out, ctrl);
+}
+
+static int spec_block(const struct node *const first, struct known *const env,
+    struct list *const out)
+{
+    int status = SPEC_OK;
+
+    foreach_stmt(stmt, first) {
+        const struct node *const node = stmt->children[0];
+
+        pe.work++;
+
+        switch (node->nt) {
+        case NT_Assn:
+            status = spec_assign(node, env, out);
+            break;
+
+        case NT_Ctrl:
+            status = node->children[0]->nt == NT_Whil || node->children[0]->nt == NT_Dowh ?
+                spec_loop(node->children[0], env, out) : spec_cond(node, env, out);
+            break;
+
+        case NT_Func:
+            // Function bodies are not specialized: they run in any context
+            status = add_stmt(out, copy_tree(node));
+            break;
+
+        default:
+            // Print and expression statements
+            status = add_stmt(out, spec_children(node, env));
+        }
+
+        if (status) {
+            break;
+        }
+    }
+
+    return status;
+}
+
+int spec_parse_binding(const char *const text, struct spec_binding *const binding)
+{
+    const char *p = text;
+
+    while (*p == '_' || (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+        (p > text && *p >= '0' && *p <= '9')) {
+        ++p;
+    }
+
+    binding->name = text;
+    binding->len = p - text;
+
+    if (!binding->len || *p++ != '=' || *p < '0' || *p > '9') {
+        return SPEC_SYNTAX;
+    }
+
+    long long value = 0;
+
+    for (; *p >= '0' && *p <= '9'; ++p) {
+        if ((value = 10 * value + (*p - '0')) > INT_MAX) {
+            return SPEC_SYNTAX;
+        }
+    }
+
+    binding->value = (int) value;
+    return *p ? SPEC_SYNTAX : SPEC_OK;
+}
+
+static void spec_free(struct spec *const spec)
+{
+    if (!spec) {
+        return;
+    }
+
+    program_free(&spec->program);
+
+    for (struct spec_chunk *chunk = spec->arena, *next; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+
+    free(spec->targets);
+    free(spec->values);
+    free(spec);
+}
+
+// Build the specialization of `spec`'s bindings
+static int specialize(const struct program *const program, struct spec *const spec)
+{
+    const size_t nsymbols = program->nsymbols ?: 1;
+    struct known *const env = malloc(nsymbols * sizeof(struct known));
+    struct list body = { 0 };
+
+    if (!env) {
+        return SPEC_NOMEM;
+    }
+
+    pe.program = program;
+    pe.spec = spec;
+    pe.track = program->nsymbols <= VARSTORE_CAPACITY;
+    pe.nodes = pe.work = 0;
+
+    for (size_t slot = 0; slot < nsymbols; ++slot) {
+        env[slot].state = pe.track ? K_UNDEFINED : K_UNKNOWN;
+    }
+
+    const struct node *const unit = &program->root;
+    const struct node *const first = block_of(unit);
+    int status = spec_block(first, env, &body);
+    struct node *before[] = { leaf(unit->children[0]->token) };
+    struct node *const root = status || !before[0] ? NULL :
+        with_block(NT_Unit, before, 1, &body, block_end(first), NULL, 0);
+
+    free(body.stmts);
+    free(env);
+
+    if (!root) {
+        return status ?: SPEC_NOMEM;
+    }
+
+    spec->program.root = *root;
+    spec->program.source = program->source;
+    spec->program.source_size = program->source_size;
+    spec->program.options = program->options;
+
+    if (optimize(&spec->program)) {
+        return SPEC_NOMEM;
+    }
+
+    // The warnings reported before running stay those of the original
+    // program, whose output the specialized one prints
+    struct warning *const warnings = malloc((program->nwarnings ?: 1) * sizeof(struct warning));
+
+    if (!warnings) {
+        return SPEC_NOMEM;
+    }
+
+    for (size_t idx = 0; idx < program->nwarnings; ++idx) {
+        warnings[idx] = program->warnings[idx];
+    }
+
+    free(spec->program.warnings);
+    spec->program.warnings = warnings;
+    spec->program.nwarnings = program->nwarnings;
+    return SPEC_OK;
+}
+
+int spec_cache_get(struct spec_cache *const cache, const struct program *const program,
+    const struct spec_binding *const bindings, const size_t nbindings, struct spec **const out,
+    size_t *const bad_binding)
+{
+    struct spec *const spec = calloc(1, sizeof(struct spec));
+
+    *out = NULL;
+
+    if (!spec || !(spec->targets = malloc((nbindings ?: 1) * sizeof(struct node *))) ||
+        !(spec->values = malloc((nbindings ?: 1) * sizeof(int)))) {
+        spec_free(spec);
+        return SPEC_NOMEM;
+    }
+
+    // The key: the bound parameters in AST order, each with its last value
+    for (size_t binding = 0; binding < nbindings; ++binding) {
+        const struct node *const target = find_parameter(program, bindings[binding].name,
+            bindings[binding].len);
+        size_t at = 0;
+
+        if (!target) {
+            *bad_binding = binding;
+            spec_free(spec);
+            return SPEC_UNKNOWN;
+        }
+
+        while (at < spec->nbound && (uintptr_t) spec->targets[at] < (uintptr_t) target) {
+            ++at;
+        }
+
+        if (at == spec->nbound || spec->targets[at] != target) {
+            memmove(&spec->targets[at + 1], &spec->targets[at],
+                (spec->nbound - at) * sizeof(struct node *));
+            memmove(&spec->values[at + 1], &spec->values[at], (spec->nbound - at) * sizeof(int));
+            spec->targets[at] = target;
+            spec->nbound++;
+        }
+
+        spec->values[at] = bindings[binding].value;
+    }
+
+    for (size_t entry = 0; entry < cache->nentries; ++entry) {
+        const struct spec *const cached = cache->entries[entry];
+
+        if (cached->nbound == spec->nbound &&
+            !memcmp(cached->targets, spec->targets, spec->nbound * sizeof(struct node *)) &&
+            !memcmp(cached->values, spec->values, spec->nbound * sizeof(int))) {
+            cache->hits++;
+            spec_free(spec);
+            *out = cache->entries[entry];
+            (*out)->users++;
+            return SPEC_OK;
+        }
+    }
+
+    spec->stats.bound = spec->nbound;
+    const int status = specialize(program, spec);
+
+    if (status) {
+        spec_free(spec);
+        return status;
+    }
+
+    cache->misses++;
+    spec->users = 1;
+
+    if (cache->nentries < SPEC_CACHE_ENTRIES) {
+        cache->entries[cache->nentries++] = spec;
+    } else {
+        // Replace the oldest entry no run uses; with none, the caller's
+        // release frees the specialization
+        for (size_t tried = 0; tried < SPEC_CACHE_ENTRIES; ++tried) {
+            const size_t entry = (cache->next + tried) % SPEC_CACHE_ENTRIES;
+
+            if (!cache->entries[entry]->users) {
+                spec_free(cache->entries[entry]);
+                cache->entries[entry] = spec;
+                cache->next = (entry + 1) % SPEC_CACHE_ENTRIES;
+                break;
+            }
+        }
+    }
+
+    *out = spec;
+    return SPEC_OK;
+}
+
+void spec_cache_release(struct spec_cache *const cache, struct spec *const spec)
+{
+    if (!spec || --spec->users) {
+        return;
+    }
+
+    for (size_t entry = 0; entry < cache->nentries; ++entry) {
+        if (cache->entries[entry] == spec) {
+            return;
+        }
+    }
+
+    spec_free(spec);
+}
+
+void spec_cache_free(struct spec_cache *const cache)
+{
+    for (size_t entry = 0; entry < cache->nentries; ++entry) {
+        spec_free(cache->entries[entry]);
+    }
+
+    *cache = (struct spec_cache) { 0 };
+}
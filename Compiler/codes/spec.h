@@ -0,0 +1,94 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include "opt.h"
+#include <stdint.h>  // For fixed-width counters
+#include <stddef.h>  // For size_t type
+
+// Specialized programs a cache keeps (replaced in turn, skipping those a run
+// uses)
+#define SPEC_CACHE_ENTRIES 8
+
+// A variable bound from the command line with -D name=value
+struct spec_binding {
+    const char *name;
+    size_t len;
+    int value;
+};
+
+// What the partial evaluator did
+struct spec_stats {
+    size_t bound;       // Parameters whose number was replaced
+    size_t reads;       // Variable reads replaced by their known value
+    size_t folds;       // Operators computed ahead of time
+    size_t arms;        // if/elif/else arms dropped as unreachable
+    size_t unrolled;    // Loops replaced by copies of their body (or dropped)
+    size_t iterations;  // Copies of loop bodies made by unrolling
+};
+
+// A program specialized on some bindings. Its AST lives in an arena owned
+// by the specialization, and is annotated by its own optimize() call.
+struct spec {
+    struct program program;
+    struct spec_stats stats;
+    size_t nbound;
+    const struct node **targets;  // The parameters' NT_Assn nodes in the original AST,
+                                  // sorted, and the values bound to them
+    int *values;
+    struct spec_chunk *arena;
+    size_t users;                 // Runs that got it from spec_cache_get() and have not
+                                  // released it
+};
+
+// Specializations of one program, by bindings. A cache is not locked:
+// threads that share one call spec_cache_get() and spec_cache_release()
+// under a lock of their own.
+struct spec_cache {
+    size_t nentries, next;
+    struct spec *entries[SPEC_CACHE_ENTRIES];
+    uint64_t hits, misses;
+};
+
+// Possible return codes of spec_parse_binding() and spec_cache_get()
+enum {
+    SPEC_OK,       // Done
+    SPEC_NOMEM,    // Memory allocation failed
+    SPEC_SYNTAX,   // Not name=value with 0 <= value <= INT_MAX
+    SPEC_UNKNOWN,  // A name has no top-level "name = number;" assignment
+};
+
+// Function declaration: spec_parse_binding
+// Parses "name=value" into a binding that points into the text.
+int spec_parse_binding(const char *, struct spec_binding *);
+
+// Function declaration: spec_cache_get
+// Returns the program specialized on the bindings, building it on the first
+// request and reusing it for the same bindings as long as the cache lives:
+// a cache only pays off when it is kept with the program across its runs,
+// and one used for a single lookup always misses. Release the
+// specialization with spec_cache_release() once its run is done. Each binding
+// replaces the number of the parameter's first top-level "name = number;"
+// (a later binding of the same name wins). The partial evaluator then
+// propagates the values known at each point, computes the operators whose
+// operands are known, drops the if/elif/else arms that cannot run and
+// unrolls the loops that run a few known times. The specialized program
+// prints exactly what the original one prints with those numbers, warnings
+// included: expressions that may warn are kept, and are only simplified
+// inside.
+// Parameters:
+//   - struct spec_cache *: the cache of this program (zero-initialized at first)
+//   - const struct program *: the program, after optimize()
+//   - const struct spec_binding *, size_t: the bindings
+//   - struct spec **: set to the specialization, kept by the cache while
+//     there is room for it
+//   - size_t *: set to the index of the unknown binding, if any
+int spec_cache_get(struct spec_cache *, const struct program *, const struct spec_binding *,
+    size_t nbindings, struct spec **, size_t *bad_binding);
+
+// Function declaration: spec_cache_release
+// Ends a use of a specialization spec_cache_get() returned: a cache frees
+// one it had no room to keep once no run uses it.
+void spec_cache_release(struct spec_cache *, struct spec *);
+
+// Function declaration: spec_cache_free
+// Releases every specialization of the cache, once no run uses any.
+void spec_cache_free(struct spec_cache *);
@@ -0,0 +1,391 @@
+#include "stats.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if __has_include(<sys/resource.h>)
+#include <sys/resource.h>
+#endif
+
+#if __has_include(<linux/perf_event.h>)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define HAVE_PERF_EVENTS 1
+#else
+#define HAVE_PERF_EVENTS 0
+#endif
+
+// Allocations are counted by standing in for malloc(), calloc() and realloc()
+// in front of glibc's own, which every caller (the C library included) then
+// goes through. Sanitizers replace them too, so they keep theirs.
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define COUNT_ALLOCS 0
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#define COUNT_ALLOCS 0
+#endif
+#endif
+
+#ifndef COUNT_ALLOCS
+#ifdef __GLIBC__
+#define COUNT_ALLOCS 1
+#else
+#define COUNT_ALLOCS 0
+#endif
+#endif
+
+// Set by stats_start(); until then allocations cost one untaken branch more
+static int counting;
+static atomic_uint_fast64_t allocs, alloc_bytes;
+
+#if COUNT_ALLOCS
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+static inline void count(const size_t bytes)
+{
+    if (__builtin_expect(counting, 0)) {
+        atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&alloc_bytes, bytes, memory_order_relaxed);
+    }
+}
+
+void *malloc(const size_t size)
+{
+    count(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(const size_t nmemb, const size_t size)
+{
+    count(nmemb * size);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *const ptr, const size_t size)
+{
+    count(size);
+    return __libc_realloc(ptr, size);
+}
+
+#endif
+
+static uint64_t clock_ns(const clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Peak resident set size of the process so far, in bytes
+static uint64_t peak_rss(void)
+{
+#if __has_include(<sys/resource.h>)
+    struct rusage usage;
+
+    // Linux counts ru_maxrss in kilobytes
+    return getrusage(RUSAGE_SELF, &usage) ? 0 : (uint64_t) usage.ru_maxrss * 1024;
+#else
+    return 0;
+#endif
+}
+
+// Open the hardware counters of a run as one group, so that they count over
+// the same time, led by the first one that opens. Counters the machine lacks
+// stay closed.
+static void open_counters(struct stats *const stats, const int hw_counters)
+{
+    int leader = -1;
+
+    for (int counter = 0; counter < COUNTERS; ++counter) {
+        stats->counter_fds[counter] = -1;
+    }
+
+#if HAVE_PERF_EVENTS
+    static const uint64_t configs[COUNTERS] = {
+        [COUNTER_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+        [COUNTER_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+        [COUNTER_BRANCHES] = PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
+        [COUNTER_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES,
+        [COUNTER_CACHE_REFERENCES] = PERF_COUNT_HW_CACHE_REFERENCES,
+        [COUNTER_CACHE_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+    };
+
+    for (int counter = 0; hw_counters && counter < COUNTERS; ++counter) {
+        // User space only, which needs no privileges at perf_event_paranoid 2;
+        // inherited by the threads of the pool
+        struct perf_event_attr attr = {
+            .size = sizeof(attr),
+            .type = PERF_TYPE_HARDWARE,
+            .config = configs[counter],
+            .read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING,
+            .exclude_kernel = 1,
+            .exclude_hv = 1,
+            .inherit = 1,
+        };
+        const int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+
+        if (fd >= 0) {
+            stats->counter_fds[counter] = fd;
+            leader = leader < 0 ? fd : leader;
+        } else if (!stats->counters_error) {
+            stats->counters_error = errno;
+        }
+    }
+#else
+    stats->counters_error = hw_counters ? ENOSYS : 0;
+#endif
+
+    stats->hw_counters = leader >= 0;
+    stats->counters_error = stats->hw_counters ? 0 : stats->counters_error;
+}
+
+const char *stats_counters_error(const struct stats *const stats)
+{
+    switch (stats->counters_error) {
+    case EACCES:
+    case EPERM:
+        return "no access to perf events, see /proc/sys/kernel/perf_event_paranoid";
+    case ENOENT:
+    case ENODEV:
+    case EOPNOTSUPP:
+        return "the processor has none that can be read here";
+    case ENOSYS:
+        return "perf events are not supported";
+    default:
+        return strerror(stats->counters_error);
+    }
+}
+
+// Current value of a hardware counter, scaled up for the time it did not
+// run while the counters were multiplexed
+static uint64_t read_counter(const int fd)
+{
+#if HAVE_PERF_EVENTS
+    uint64_t values[3];  // Value, time enabled, time running
+
+    if (fd < 0 || read(fd, values, sizeof(values)) != sizeof(values) || !values[2]) {
+        return 0;
+    }
+
+    return values[2] < values[1] ? (uint64_t) ((double) values[0] * values[1] / values[2]) : values[0];
+#else
+    (void) fd;
+    return 0;
+#endif
+}
+
+// Current values of the counters
+static struct phase_stats now(const struct stats *const stats)
+{
+    struct phase_stats at = {
+        .wall_ns = clock_ns(CLOCK_MONOTONIC),
+        .cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID),
+        .allocs = atomic_load_explicit(&allocs, memory_order_relaxed),
+        .alloc_bytes = atomic_load_explicit(&alloc_bytes, memory_order_relaxed),
+    };
+
+    for (int counter = 0; counter < COUNTERS; ++counter) {
+        at.counters[counter] = read_counter(stats->counter_fds[counter]);
+    }
+
+    return at;
+}
+
+// Add to `into` what happened since `from`
+static void add_since(const struct stats *const stats, struct phase_stats *const into,
+    const struct phase_stats *const from)
+{
+    const struct phase_stats to = now(stats);
+
+    into->wall_ns += to.wall_ns - from->wall_ns;
+    into->cpu_ns += to.cpu_ns - from->cpu_ns;
+    into->allocs += to.allocs - from->allocs;
+    into->alloc_bytes += to.alloc_bytes - from->alloc_bytes;
+    into->peak_rss = peak_rss();
+    into->ran = 1;
+
+    // Scaling can make a reading smaller than the one before it
+    for (int counter = 0; counter < COUNTERS; ++counter) {
+        if (to.counters[counter] > from->counters[counter]) {
+            into->counters[counter] += to.counters[counter] - from->counters[counter];
+        }
+    }
+}
+
+void stats_start(struct stats *const stats, const int hw_counters)
+{
+    if (!stats) {
+        return;
+    }
+
+    *stats = (struct stats) { 0 };
+    open_counters(stats, hw_counters);
+    counting = 1;
+    stats->began = now(stats);
+}
+
+void stats_begin(struct stats *const stats, const int phase)
+{
+    if (stats) {
+        stats->phase = phase;
+        stats->phase_began = now(stats);
+    }
+}
+
+void stats_end(struct stats *const stats)
+{
+    if (stats) {
+        add_since(stats, &stats->phases[stats->phase], &stats->phase_began);
+    }
+}
+
+size_t stats_count_nodes(const struct node node)
+{
+    size_t count = 1;
+
+    for (uint32_t idx = 0; idx < node.nchildren; ++idx) {
+        count += stats_count_nodes(*node.children[idx]);
+    }
+
+    return count;
+}
+
+// Print a string as a JSON string literal
+static void print_string(const char *text, FILE *out)
+{
+    fputc('"', out);
+
+    for (; *text; ++text) {
+        const unsigned char c = *text;
+
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+
+    fputc('"', out);
+}
+
+// Print a ratio of two counters, or null if either is missing
+static void print_ratio(const char *const name, const struct stats *const stats,
+    const struct phase_stats *const phase, const int of, const int per, FILE *out)
+{
+    if (stats->counter_fds[of] < 0 || stats->counter_fds[per] < 0 || !phase->counters[per]) {
+        fprintf(out, ", \"%s\": null", name);
+    } else {
+        fprintf(out, ", \"%s\": %.4f", name, (double) phase->counters[of] / phase->counters[per]);
+    }
+}
+
+static void print_phase(const struct stats *const stats, const struct phase_stats *const phase,
+    FILE *out)
+{
+    static const char *const names[COUNTERS] = {
+        [COUNTER_CYCLES] = "cycles",
+        [COUNTER_INSTRUCTIONS] = "instructions",
+        [COUNTER_BRANCHES] = "branches",
+        [COUNTER_BRANCH_MISSES] = "branch_misses",
+        [COUNTER_CACHE_REFERENCES] = "cache_references",
+        [COUNTER_CACHE_MISSES] = "cache_misses",
+    };
+
+    if (!phase->ran) {
+        fprintf(out, "null");
+        return;
+    }
+
+    fprintf(out, "{\"wall_ns\": %llu, \"cpu_ns\": %llu, ",
+        (unsigned long long) phase->wall_ns, (unsigned long long) phase->cpu_ns);
+
+    if (COUNT_ALLOCS) {
+        fprintf(out, "\"allocs\": %llu, \"alloc_bytes\": %llu, ",
+            (unsigned long long) phase->allocs, (unsigned long long) phase->alloc_bytes);
+    } else {
+        fprintf(out, "\"allocs\": null, \"alloc_bytes\": null, ");
+    }
+
+    fprintf(out, "\"peak_rss_bytes\": %llu", (unsigned long long) phase->peak_rss);
+
+    if (stats->hw_counters) {
+        for (int counter = 0; counter < COUNTERS; ++counter) {
+            if (stats->counter_fds[counter] < 0) {
+                fprintf(out, ", \"%s\": null", names[counter]);
+            } else {
+                fprintf(out, ", \"%s\": %llu", names[counter],
+                    (unsigned long long) phase->counters[counter]);
+            }
+        }
+
+        print_ratio("ipc", stats, phase, COUNTER_INSTRUCTIONS, COUNTER_CYCLES, out);
+        print_ratio("branch_miss_rate", stats, phase, COUNTER_BRANCH_MISSES, COUNTER_BRANCHES, out);
+        print_ratio("cache_miss_rate", stats, phase, COUNTER_CACHE_MISSES, COUNTER_CACHE_REFERENCES,
+            out);
+    }
+
+    fputc('}', out);
+}
+
+int stats_write(struct stats *const stats, const char *const input_path, FILE *out)
+{
+    static const char *const names[PHASES] = {
+        [PHASE_LOAD] = "load",
+        [PHASE_LEX] = "lex",
+        [PHASE_PARSE] = "parse",
+        [PHASE_OPTIMIZE] = "optimize",
+        [PHASE_RUN] = "run",
+        [PHASE_COLLAPSE] = "collapse",
+    };
+
+    stats->total = (struct phase_stats) { 0 };
+    add_since(stats, &stats->total, &stats->began);
+    counting = 0;
+
+#if HAVE_PERF_EVENTS
+    for (int counter = 0; counter < COUNTERS; ++counter) {
+        if (stats->counter_fds[counter] >= 0) {
+            close(stats->counter_fds[counter]);
+        }
+    }
+#endif
+
+    fprintf(out, "{\n  \"input\": ");
+    print_string(input_path, out);
+    fprintf(out, ",\n  \"input_bytes\": %zu,\n  \"tokens\": %zu,\n  \"nodes\": %zu,\n"
+        "  \"variables\": %zu,\n  \"array_bytes\": %zu,\n",
+        stats->input_bytes, stats->tokens, stats->nodes, stats->variables, stats->array_bytes);
+
+    if (stats->cache) {
+        fprintf(out, "  \"cache\": \"%s\",\n", stats->cache);
+    }
+
+    if (stats->hw_counters) {
+        fprintf(out, "  \"hw_counters\": true,\n");
+    } else if (stats->counters_error) {
+        fprintf(out, "  \"hw_counters\": false,\n  \"hw_counters_error\": ");
+        print_string(stats_counters_error(stats), out);
+        fprintf(out, ",\n");
+    }
+
+    fprintf(out, "  \"phases\": {\n");
+
+    for (int phase = 0; phase < PHASES; ++phase) {
+        fprintf(out, "    \"%s\": ", names[phase]);
+        print_phase(stats, &stats->phases[phase], out);
+        fprintf(out, phase + 1 < PHASES ? ",\n" : "\n");
+    }
+
+    fprintf(out, "  },\n  \"total\": ");
+    print_phase(stats, &stats->total, out);
+    fprintf(out, "\n}\n");
+    return ferror(out);
+}
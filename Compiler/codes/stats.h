@@ -0,0 +1,89 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include "parse.h"
+#include <stdio.h>
+#include <stdint.h>  // For fixed-width counters
+#include <stddef.h>  // For size_t type
+
+// Phases of the interpreter, in the order they run
+enum {
+    PHASE_LOAD,      // Mapping or reading the input file
+    PHASE_LEX,       // lex() and the token listing (with --cache, also the lookup, and all
+                     // a hit costs before optimize())
+    PHASE_PARSE,     // parse() and its trace, and storing them with --cache
+    PHASE_OPTIMIZE,  // optimize(), and the -D specialization
+    PHASE_RUN,       // run(), or the batch runner, or the C emitter
+    PHASE_COLLAPSE,  // collapse_tree()
+    PHASES
+};
+
+// Hardware counters of --hw-counters, opened as one perf_event_open group
+enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_BRANCHES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_CACHE_REFERENCES,
+    COUNTER_CACHE_MISSES,
+    COUNTERS
+};
+
+// What a phase cost
+struct phase_stats {
+    uint64_t wall_ns;      // Elapsed time
+    uint64_t cpu_ns;       // CPU time of all threads of the process
+    uint64_t allocs;       // Calls of malloc(), calloc() and realloc()
+    uint64_t alloc_bytes;  // Bytes those calls asked for
+    uint64_t peak_rss;     // Most memory the process had resident by the end of the phase
+    uint64_t counters[COUNTERS];  // In user space, scaled if the counters were multiplexed
+    int ran;               // The phase ran (a failed parse skips the later ones)
+};
+
+// The cost of each phase of a run, and the size of what they worked on.
+// Filled by the caller between stats_start() and stats_write().
+struct stats {
+    struct phase_stats phases[PHASES];
+    struct phase_stats total;        // From stats_start() to stats_write()
+    struct phase_stats began;        // Counters at stats_start()
+    struct phase_stats phase_began;  // Counters when the current phase began
+    int phase;                       // The current phase
+    int hw_counters;                 // Some hardware counters are open
+    int counter_fds[COUNTERS];       // -1 for a counter that could not be opened
+    int counters_error;              // errno of the first counter, if none could be opened
+    size_t input_bytes;
+    size_t tokens;
+    size_t nodes;          // Of the syntax tree (see stats_count_nodes())
+    size_t variables;      // Distinct variable names
+    size_t array_bytes;    // Most bytes all arrays held together
+    const char *cache;     // What --cache found: "hit", "miss", "stale" or "corrupt" (NULL: no cache)
+};
+
+// Function declaration: stats_start
+// Starts collecting statistics into `stats`, which may be NULL for none:
+// every stats_ function then returns at once, so the phases cost nothing more.
+// With `hw_counters`, the hardware counters are read around each phase too,
+// where the system allows it (Linux, with access to perf events); otherwise
+// only timings are collected. Threads started later are counted once they end.
+void stats_start(struct stats *, int hw_counters);
+
+// Function declaration: stats_begin
+// Marks the start of a phase.
+void stats_begin(struct stats *, int phase);
+
+// Function declaration: stats_end
+// Marks the end of the phase begun last and adds what it cost.
+void stats_end(struct stats *);
+
+// Function declaration: stats_counters_error
+// Returns why no hardware counter could be opened.
+const char *stats_counters_error(const struct stats *);
+
+// Function declaration: stats_count_nodes
+// Returns the number of nodes of a syntax tree, leaves included.
+size_t stats_count_nodes(struct node);
+
+// Function declaration: stats_write
+// Ends the total and writes the statistics as one JSON object, then closes
+// the hardware counters. Allocation counters are null where they cannot be
+// collected (C libraries other than glibc, sanitizers). Returns 0 on success.
+int stats_write(struct stats *, const char *input_path, FILE *);
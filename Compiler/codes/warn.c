@@ -0,0 +1,223 @@
+#include "warn.h"
+#include "lex.h"
+#include <stdlib.h>
+#include <string.h>
+
+const char *const warn_messages[WARN_KINDS] = {
+    [WARN_UNDEFINED] = "warn: access to undefined variable",
+    [WARN_NO_ARRAY]  = "warn: access to undefined array",
+    [WARN_NEGATIVE]  = "warn: negative array offset",
+    [WARN_BOUNDS]    = "warn: out of bounds array access",
+    [WARN_VARSTORE]  = "warn: varstore exhausted, assignment has no effect",
+    [WARN_REALLOC]   = "WARN: a previous reallocation has failed, assignment has no effect",
+    [WARN_DIVIDE]    = "warn: prevented attempt to divide by zero",
+    [WARN_CALL]      = "warn: invalid call, it has no effect",
+    [WARN_DEPTH]     = "warn: call stack exhausted, the call yields 0",
+};
+
+// First slot to probe for a site and kind, in a table of `capacity` entries
+// (a power of two)
+static size_t home(const struct token *const site, const int kind, const size_t capacity)
+{
+    const uint64_t hash = ((uint64_t) (uintptr_t) site * WARN_KINDS + kind) * 0x9e3779b97f4a7c15u;
+    return (size_t) (hash >> 32) & (capacity - 1);
+}
+
+// The entry of a site and kind, or NULL if the log has none
+static struct warn_entry *find(const struct warn_log *const log, const struct token *const site,
+    const int kind)
+{
+    for (size_t at = log->capacity ? home(site, kind, log->capacity) : 0; log->capacity;
+        at = (at + 1) & (log->capacity - 1)) {
+        struct warn_entry *const entry = &log->entries[at];
+
+        if (!entry->site) {
+            break;
+        } else if (entry->site == site && entry->kind == kind) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+// Double the table of a log. Returns 0 if memory ran out.
+static int grow(struct warn_log *const log)
+{
+    const size_t capacity = log->capacity ? 2 * log->capacity : 64;
+    struct warn_entry *const entries = calloc(capacity, sizeof(struct warn_entry));
+
+    if (!entries) {
+        return 0;
+    }
+
+    for (size_t idx = 0; idx < log->capacity; ++idx) {
+        const struct warn_entry *const entry = &log->entries[idx];
+        size_t at = home(entry->site, entry->kind, capacity);
+
+        while (entry->site && entries[at].site) {
+            at = (at + 1) & (capacity - 1);
+        }
+
+        if (entry->site) {
+            entries[at] = *entry;
+        }
+    }
+
+    free(log->entries);
+    log->entries = entries;
+    log->capacity = capacity;
+    return 1;
+}
+
+// The entry of a site and kind, added if the log has none. Returns NULL if
+// memory ran out.
+static struct warn_entry *entry_of(struct warn_log *const log, const struct token *const site,
+    const int kind)
+{
+    struct warn_entry *const found = find(log, site, kind);
+
+    if (found) {
+        return found;
+    }
+
+    if (2 * (log->nentries + 1) > log->capacity && !grow(log)) {
+        return NULL;
+    }
+
+    size_t at = home(site, kind, log->capacity);
+
+    while (log->entries[at].site) {
+        at = (at + 1) & (log->capacity - 1);
+    }
+
+    log->nentries++;
+    log->entries[at] = (struct warn_entry) { .site = site, .kind = kind };
+    return &log->entries[at];
+}
+
+void warn_init(struct warn_log *const log, const struct program *const program, const int all)
+{
+    *log = (struct warn_log) { .all = all };
+
+    // Without memory for them, they are printed as they happen
+    for (size_t idx = 0; program && idx < program->nwarnings; ++idx) {
+        struct warn_entry *const entry = entry_of(log, program->warnings[idx].site,
+            program->warnings[idx].kind);
+
+        if (entry) {
+            entry->quiet = 1;
+        }
+    }
+}
+
+void warn_at(struct warn_log *const log, FILE *output_file, const struct token *const site,
+    const int kind)
+{
+    struct warn_entry *const entry = log->all ? NULL : entry_of(log, site, kind);
+
+    if (!entry) {
+        fprintf(output_file, "%s\n", warn_messages[kind]);
+        return;
+    }
+
+    if (!entry->count++ && !entry->quiet) {
+        const struct warn_entry *const known = log->parent ? find(log->parent, site, kind) : NULL;
+
+        if (!known || (!known->quiet && !known->shown)) {
+            entry->offset = log->parent ? ftell(output_file) : 0;
+            fprintf(output_file, "%s\n", warn_messages[kind]);
+            entry->shown++;
+        }
+    }
+}
+
+// Order cuts by offset
+static int compare_cuts(const void *const a, const void *const b)
+{
+    const struct warn_cut *const x = a, *const y = b;
+
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+size_t warn_merge(struct warn_log *const log, const struct warn_log *const from,
+    struct warn_cut *const cuts)
+{
+    size_t ncuts = 0;
+
+    for (size_t idx = 0; idx < from->capacity; ++idx) {
+        const struct warn_entry *const entry = &from->entries[idx];
+        struct warn_entry *const into = entry->site ? entry_of(log, entry->site, entry->kind) : NULL;
+
+        if (!into) {
+            continue;
+        }
+
+        if (cuts && into->shown && entry->shown && entry->offset >= 0) {
+            cuts[ncuts++] = (struct warn_cut) {
+                entry->offset, strlen(warn_messages[entry->kind]) + 1
+            };
+            into->shown--;
+        }
+
+        into->count += entry->count;
+        into->shown += entry->shown;
+        into->quiet |= entry->quiet;
+    }
+
+    if (ncuts > 1) {
+        qsort(cuts, ncuts, sizeof(struct warn_cut), compare_cuts);
+    }
+
+    return ncuts;
+}
+
+// Order entries by site, then kind
+static int compare_entries(const void *const a, const void *const b)
+{
+    const struct warn_entry *const x = a, *const y = b;
+
+    if (x->site != y->site) {
+        return x->site < y->site ? -1 : 1;
+    }
+
+    return (x->kind > y->kind) - (x->kind < y->kind);
+}
+
+void warn_summary(const struct warn_log *const log, const struct program *const program,
+    FILE *output_file)
+{
+    struct warn_entry *const hidden = malloc((log->nentries ?: 1) * sizeof(struct warn_entry));
+    size_t nhidden = 0;
+
+    if (!hidden) {
+        fprintf(output_file, "malloc failed\n");
+        return;
+    }
+
+    for (size_t idx = 0; idx < log->capacity; ++idx) {
+        if (log->entries[idx].count > log->entries[idx].shown) {
+            hidden[nhidden++] = log->entries[idx];
+        }
+    }
+
+    if (nhidden > 1) {
+        qsort(hidden, nhidden, sizeof(struct warn_entry), compare_entries);
+    }
+
+    for (size_t idx = 0; idx < nhidden; ++idx) {
+        fprintf(output_file, "%s (line %zu): %llu time%s, %llu not shown\n",
+            warn_messages[hidden[idx].kind], program_line(program, hidden[idx].site),
+            (unsigned long long) hidden[idx].count, hidden[idx].count == 1 ? "" : "s",
+            (unsigned long long) (hidden[idx].count - hidden[idx].shown));
+    }
+
+    free(hidden);
+}
+
+void warn_free(struct warn_log *const log)
+{
+    free(log->entries);
+    log->entries = NULL;
+    log->nentries = log->capacity = 0;
+}
@@ -0,0 +1,66 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include "opt.h"
+#include <stdio.h>
+#include <stdint.h>  // For fixed-width counters
+#include <stddef.h>  // For size_t type
+
+// The line each kind of warning prints
+extern const char *const warn_messages[WARN_KINDS];
+
+// One kind of warning at one site
+struct warn_entry {
+    const struct token *site;  // NULL for a free entry
+    uint8_t kind;              // WARN_
+    uint8_t quiet;             // Reported before running (program.warnings): never printed
+    uint64_t count;            // Times it happened
+    uint64_t shown;            // Times it was printed
+    long offset;               // In a statement's log, where the printed one starts in the
+                               // statement's output
+};
+
+// A line to leave out of a statement's output (see warn_merge())
+struct warn_cut {
+    long offset;
+    size_t len;
+};
+
+// The warnings of a run, by site. Only the first of each kind at each site is
+// printed, unless `all` is set; the others are counted for warn_summary().
+struct warn_log {
+    int all;                        // Print every warning, as the interpreter used to
+    const struct warn_log *parent;  // Log of the run, for the log of a statement that runs
+                                    // alongside others: warnings it already holds are not
+                                    // printed again (it must not change meanwhile)
+    struct warn_entry *entries;     // Open-addressing hash table
+    size_t nentries, capacity;
+};
+
+// Function declaration: warn_init
+// Starts a log for a run of the program (NULL for none), in which the
+// warnings of program.warnings are quiet.
+void warn_init(struct warn_log *, const struct program *, int all);
+
+// Function declaration: warn_at
+// Counts a warning of `kind` at `site` (a token of the program) and prints it
+// to the output file if it is the first, or if every warning is printed. A
+// warning that cannot be counted for lack of memory is printed.
+void warn_at(struct warn_log *, FILE *, const struct token *site, int kind);
+
+// Function declaration: warn_merge
+// Adds the counts of a statement's log to the log of the run. Statements
+// merged in program order may have printed the same warning: the lines to
+// cut from the later one's output, so that only the first is printed, are
+// stored into `cuts` (room for nentries of the statement's log, or NULL to
+// keep them) by offset, and their number returned.
+size_t warn_merge(struct warn_log *, const struct warn_log *, struct warn_cut *cuts);
+
+// Function declaration: warn_summary
+// Prints to the output file, in source order, how often the warnings that
+// were not all printed happened, e.g.
+// "warn: out of bounds array access (line 3): 1000 times, 999 not shown".
+void warn_summary(const struct warn_log *, const struct program *, FILE *);
+
+// Function declaration: warn_free
+// Releases the table of a log.
+void warn_free(struct warn_log *);
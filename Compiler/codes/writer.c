@@ -0,0 +1,300 @@
+#define _GNU_SOURCE  // For fopencookie()
+
+#include "writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__GLIBC__)
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// One of the two output buffers
+struct buffer {
+    char *data;              // Buffered bytes
+    size_t len;              // Number of bytes filled by the interpreter
+    atomic_size_t done;      // Number of bytes already claimed for writing
+};
+
+struct writer {
+    FILE *sink;              // Output file owned by the writer thread
+    FILE *stream;            // Stream handed to the interpreter
+    int fd;                  // File descriptor behind `sink`
+    size_t capacity;         // Size of each buffer
+
+    struct buffer buffers[2];
+    size_t fill;             // Buffer currently filled by the interpreter
+    size_t drain;            // Buffer the writer thread drains next
+
+    sem_t filled;            // Number of buffers waiting to be drained
+    sem_t drained;           // Number of free buffers besides the filled one
+    atomic_int inflight;     // Set while the writer thread is inside write()
+    atomic_int closing;      // Set once the interpreter has handed over the last buffer
+
+    pthread_t thread;
+    struct writer_stats stats;
+};
+
+// The writer flushed from the SIGABRT handler (only one can be open at a time)
+static struct writer *_Atomic abort_writer;
+static struct sigaction previous_abort_action;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Write the whole range to the descriptor, retrying on short writes
+static void write_all(const int fd, const char *data, size_t len)
+{
+    while (len) {
+        const ssize_t written = write(fd, data, len);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return;  // Nothing sensible left to do with the output
+        }
+
+        data += written;
+        len -= written;
+    }
+}
+
+// Write out whatever part of a buffer has not been claimed yet.
+// The range is claimed with a single exchange so that the writer thread and
+// the abort handler never write the same bytes twice.
+static void drain_buffer(struct writer *const w, struct buffer *const b)
+{
+    const size_t from = atomic_exchange(&b->done, b->len);
+
+    if (from < b->len) {
+        write_all(w->fd, b->data + from, b->len - from);
+    }
+}
+
+// Body of the writer thread: drain buffers in the order they were handed over
+static void *writer_main(void *const arg)
+{
+    struct writer *const w = arg;
+
+    for (;;) {
+        while (sem_wait(&w->filled) && errno == EINTR) {
+        }
+
+        struct buffer *const b = &w->buffers[w->drain];
+
+        if (!b->len && atomic_load(&w->closing)) {
+            break;  // Woken up by writer_close() with nothing left to write
+        }
+
+        atomic_store(&w->inflight, 1);
+        drain_buffer(w, b);
+        atomic_store(&w->inflight, 0);
+
+        b->len = 0;
+        atomic_store(&b->done, 0);
+        w->drain ^= 1;
+        sem_post(&w->drained);
+    }
+
+    return NULL;
+}
+
+// Pass the filled buffer to the writer thread and take the other one.
+// Blocks only if the writer thread has not finished draining it yet.
+static void handoff(struct writer *const w)
+{
+    w->stats.handoffs++;
+    sem_post(&w->filled);
+
+    if (sem_trywait(&w->drained)) {
+        const uint64_t start = now_ns();
+
+        while (sem_wait(&w->drained) && errno == EINTR) {
+        }
+
+        w->stats.stalls++;
+        w->stats.stall_ns += now_ns() - start;
+    }
+
+    w->fill ^= 1;
+}
+
+// fopencookie() write callback: copy into the fill buffer, hand it over when full
+static ssize_t writer_write(void *const cookie, const char *data, size_t size)
+{
+    struct writer *const w = cookie;
+    const size_t total = size;
+
+    while (size) {
+        struct buffer *const b = &w->buffers[w->fill];
+        const size_t room = w->capacity - b->len;
+        const size_t chunk = size < room ? size : room;
+
+        memcpy(b->data + b->len, data, chunk);
+        b->len += chunk;
+        data += chunk;
+        size -= chunk;
+
+        if (b->len == w->capacity) {
+            handoff(w);
+        }
+    }
+
+    w->stats.bytes += total;
+    return total;
+}
+
+// SIGABRT handler: write out everything still buffered, in order, then die
+static void writer_on_abort(const int sig)
+{
+    struct writer *const w = atomic_exchange(&abort_writer, NULL);
+
+    if (w) {
+        // Let the writer thread finish the write() it is in the middle of
+        for (int spins = 0; atomic_load(&w->inflight) && spins < 1000; ++spins) {
+            nanosleep(&(struct timespec) { .tv_nsec = 1000000 }, NULL);
+        }
+
+        // The buffer being drained precedes the one being filled
+        drain_buffer(w, &w->buffers[w->drain]);
+
+        if (w->drain != w->fill) {
+            drain_buffer(w, &w->buffers[w->fill]);
+        }
+    }
+
+    sigaction(sig, &previous_abort_action, NULL);
+    raise(sig);
+}
+
+struct writer *writer_open(FILE *const sink, const size_t buffer_size)
+{
+    const int fd = fileno(sink);
+
+    if (fd < 0 || !buffer_size || atomic_load(&abort_writer)) {
+        return NULL;
+    }
+
+    struct writer *const w = calloc(1, sizeof(*w));
+
+    if (!w) {
+        return NULL;
+    }
+
+    w->sink = sink;
+    w->fd = fd;
+    w->capacity = buffer_size;
+    w->buffers[0].data = malloc(buffer_size);
+    w->buffers[1].data = malloc(buffer_size);
+
+    if (!w->buffers[0].data || !w->buffers[1].data) {
+        goto fail_buffers;
+    }
+
+    if (sem_init(&w->filled, 0, 0) || sem_init(&w->drained, 0, 1)) {
+        goto fail_buffers;
+    }
+
+    w->stream = fopencookie(w, "w", (cookie_io_functions_t) {
+        .write = writer_write,
+    });
+
+    if (!w->stream) {
+        goto fail_sems;
+    }
+
+    // Every printf lands in our buffers directly, so an abort loses nothing
+    setvbuf(w->stream, NULL, _IONBF, 0);
+    fflush(sink);
+
+    if (pthread_create(&w->thread, NULL, writer_main, w)) {
+        fclose(w->stream);
+        goto fail_sems;
+    }
+
+    atomic_store(&abort_writer, w);
+
+    struct sigaction action = { .sa_handler = writer_on_abort };
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGABRT, &action, &previous_abort_action);
+    return w;
+
+fail_sems:
+    sem_destroy(&w->filled);
+    sem_destroy(&w->drained);
+fail_buffers:
+    free(w->buffers[0].data);
+    free(w->buffers[1].data);
+    free(w);
+    return NULL;
+}
+
+FILE *writer_stream(const struct writer *const w)
+{
+    return w->stream;
+}
+
+void writer_close(struct writer *const w, struct writer_stats *const stats)
+{
+    fflush(w->stream);
+
+    // Hand over the partially filled buffer, if any
+    if (w->buffers[w->fill].len) {
+        handoff(w);
+    }
+
+    // Wake the writer thread once more with an empty buffer so it exits
+    atomic_store(&w->closing, 1);
+    sem_post(&w->filled);
+    pthread_join(w->thread, NULL);
+
+    atomic_store(&abort_writer, NULL);
+    sigaction(SIGABRT, &previous_abort_action, NULL);
+
+    fclose(w->stream);
+    sem_destroy(&w->filled);
+    sem_destroy(&w->drained);
+
+    if (stats) {
+        *stats = w->stats;
+    }
+
+    free(w->buffers[0].data);
+    free(w->buffers[1].data);
+    free(w);
+}
+
+#else
+
+// Without fopencookie() the interpreter keeps writing synchronously
+struct writer *writer_open(FILE *const sink, const size_t buffer_size)
+{
+    (void) sink, (void) buffer_size;
+    return NULL;
+}
+
+FILE *writer_stream(const struct writer *const w)
+{
+    (void) w;
+    abort();
+}
+
+void writer_close(struct writer *const w, struct writer_stats *const stats)
+{
+    (void) w, (void) stats;
+    abort();
+}
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once  // Ensure this header file is only included once during compilation
+
+#include <stdio.h>
+#include <stdint.h>  // For fixed-width counters
+#include <stddef.h>  // For size_t type
+
+// Default size of each of the two output buffers
+#define WRITER_DEFAULT_BUFFER (64 * 1024)
+
+// Counters collected while a writer thread owned the output file
+struct writer_stats {
+    uint64_t bytes;     // Total bytes written through the writer
+    uint64_t handoffs;  // Buffers handed from the interpreter to the writer thread
+    uint64_t stalls;    // Handoffs that had to wait for the other buffer to drain
+    uint64_t stall_ns;  // Time the interpreter spent blocked on those stalls
+};
+
+// Opaque writer state (defined in writer.c)
+struct writer;
+
+// Function declaration: writer_open
+// Starts a writer thread that takes ownership of the output file `sink`.
+// The interpreter fills one buffer of `buffer_size` bytes while the thread
+// drains the other one. Pending output is also written out if the process
+// aborts. Returns NULL if the writer could not be started, in which case
+// the caller should keep writing to `sink` directly.
+struct writer *writer_open(FILE *sink, size_t buffer_size);
+
+// Function declaration: writer_stream
+// Returns the stream the interpreter should print to while the writer is open.
+FILE *writer_stream(const struct writer *);
+
+// Function declaration: writer_close
+// Flushes all buffered output, stops the writer thread and hands the output
+// file back to the caller. Fills `stats` if it is not NULL.
+void writer_close(struct writer *, struct writer_stats *stats);